@@ -0,0 +1,106 @@
+#include "bench.hpp"
+
+#include <chrono>
+
+#include "surf.hpp"
+
+// Compact cold-storage encoding (SuRF::serializeCompact): size against
+// serialize() and encode/decode speed, for random int and random text
+// keys with each suffix type. Decode throughput is given both in
+// compact bytes read and in serialize() bytes produced.
+//
+// Usage: compact_bench [num_keys]
+
+static const int kNumRuns = 5; // best of
+
+static std::string randomTextKey(std::mt19937_64& gen) {
+    std::string key(8 + gen() % 17, 'a');
+    for (size_t i = 0; i < key.size(); i++)
+	key[i] = static_cast<char>('a' + gen() % 26);
+    return key;
+}
+
+struct Config {
+    const char* name;
+    surf::SuffixType suffix_type;
+    surf::level_t hash_suffix_len;
+    surf::level_t real_suffix_len;
+};
+
+static double elapsedMs(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void runConfig(const std::string& key_type, const std::vector<std::string>& keys, const Config& config) {
+    surf::SuRF* filter = new surf::SuRF(keys, surf::kIncludeDense, surf::kSparseDenseRatio, config.suffix_type,
+					config.hash_suffix_len, config.real_suffix_len);
+    uint64_t raw_size = filter->serializedSize();
+    char* raw = filter->serialize();
+
+    double encode_ms = 0;
+    double decode_ms = 0;
+    uint64_t size = 0;
+    char* data = nullptr;
+    bool same = true;
+    for (int run = 0; run < kNumRuns; run++) {
+	delete[] data;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	data = filter->serializeCompact(size);
+	double ms = elapsedMs(start);
+	encode_ms = (run == 0 || ms < encode_ms) ? ms : encode_ms;
+
+	start = std::chrono::steady_clock::now();
+	surf::SuRF* decoded = surf::SuRF::deSerializeCompact(data, size);
+	ms = elapsedMs(start);
+	decode_ms = (run == 0 || ms < decode_ms) ? ms : decode_ms;
+	if (decoded == nullptr || decoded->serializedSize() != raw_size) {
+	    same = false;
+	} else {
+	    char* decoded_raw = decoded->serialize();
+	    same = same && (memcmp(raw, decoded_raw, raw_size) == 0);
+	    delete[] decoded_raw;
+	}
+	if (decoded != nullptr) {
+	    decoded->destroy();
+	    delete decoded;
+	}
+    }
+
+    std::cout << key_type << ", " << config.name << ": " << raw_size << " -> " << size << " bytes, ratio "
+	      << (double)raw_size / size << ", encode " << encode_ms << " ms, decode " << decode_ms << " ms ("
+	      << size / decode_ms / 1000 << " MB/s in, " << raw_size / decode_ms / 1000 << " MB/s out, "
+	      << keys.size() / decode_ms / 1000 << " Mkeys/s)";
+    if (same)
+	std::cout << "  " << bench::kGreen << "(same bytes)" << bench::kNoColor;
+    else
+	std::cout << "  " << bench::kRed << "(bytes differ)" << bench::kNoColor;
+    std::cout << std::endl;
+
+    delete[] data;
+    delete[] raw;
+    filter->destroy();
+    delete filter;
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t num_keys = (argc > 1) ? strtoull(argv[1], nullptr, 10) : 2000000;
+
+    std::mt19937_64 gen(2018);
+    std::vector<std::string> int_keys;
+    std::vector<std::string> text_keys;
+    for (uint64_t i = 0; i < num_keys; i++) {
+	int_keys.push_back(bench::uint64ToString(gen()));
+	text_keys.push_back(randomTextKey(gen));
+    }
+    surf::sortUniqueKeys(int_keys, std::thread::hardware_concurrency());
+    surf::sortUniqueKeys(text_keys, std::thread::hardware_concurrency());
+
+    const Config configs[] = {{"no suffix", surf::kNone, 0, 0},
+			      {"8-bit hash suffix", surf::kHash, 8, 0},
+			      {"8-bit real suffix", surf::kReal, 0, 8}};
+    for (const Config& config : configs)
+	runConfig("random int", int_keys, config);
+    for (const Config& config : configs)
+	runConfig("random text", text_keys, config);
+    return 0;
+}
@@ -9,6 +9,12 @@ namespace bench {
 class Filter {
 public:
     virtual bool lookup(const std::string& key) = 0;
+    // Filters without a batched path answer one key at a time
+    virtual void lookupBatch(const std::vector<std::string>& keys, std::vector<bool>& results) {
+	results.resize(keys.size());
+	for (int i = 0; i < (int)keys.size(); i++)
+	    results[i] = lookup(keys[i]);
+    }
     virtual bool lookupRange(const std::string& left_key, const std::string& right_key) = 0;
     virtual bool approxCount(const std::string& left_key, const std::string& right_key) = 0;
     virtual uint64_t getMemoryUsage() = 0;
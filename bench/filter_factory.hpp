@@ -9,17 +9,39 @@ namespace bench {
 
 class FilterFactory {
 public:
+    // Suffix configuration of the SuRF variants; false for other filters
+    static bool getSuRFConfig(const std::string& filter_type,
+			      const uint32_t suffix_len,
+			      surf::SuffixType& suffix_type,
+			      uint32_t& hash_suffix_len,
+			      uint32_t& real_suffix_len) {
+	hash_suffix_len = 0;
+	real_suffix_len = 0;
+	if (filter_type.compare(std::string("SuRF")) == 0) {
+	    suffix_type = surf::kNone;
+	} else if (filter_type.compare(std::string("SuRFHash")) == 0) {
+	    suffix_type = surf::kHash;
+	    hash_suffix_len = suffix_len;
+	} else if (filter_type.compare(std::string("SuRFReal")) == 0) {
+	    suffix_type = surf::kReal;
+	    real_suffix_len = suffix_len;
+	} else if (filter_type.compare(std::string("SuRFMixed")) == 0) {
+	    suffix_type = surf::kMixed;
+	    hash_suffix_len = suffix_len;
+	    real_suffix_len = suffix_len;
+	} else {
+	    return false;
+	}
+	return true;
+    }
+
     static Filter* createFilter(const std::string& filter_type,
 				const uint32_t suffix_len,
 				const std::vector<std::string>& keys) {
-	if (filter_type.compare(std::string("SuRF")) == 0)
-	    return new FilterSuRF(keys, surf::kNone, 0, 0);
-	else if (filter_type.compare(std::string("SuRFHash")) == 0)
-	    return new FilterSuRF(keys, surf::kHash, suffix_len, 0);
-	else if (filter_type.compare(std::string("SuRFReal")) == 0)
-	    return new FilterSuRF(keys, surf::kReal, 0, suffix_len);
-        else if (filter_type.compare(std::string("SuRFMixed")) == 0)
-	    return new FilterSuRF(keys, surf::kMixed, suffix_len, suffix_len);
+	surf::SuffixType suffix_type;
+	uint32_t hash_suffix_len, real_suffix_len;
+	if (getSuRFConfig(filter_type, suffix_len, suffix_type, hash_suffix_len, real_suffix_len))
+	    return new FilterSuRF(keys, suffix_type, hash_suffix_len, real_suffix_len);
 	else if (filter_type.compare(std::string("Bloom")) == 0)
 	    return new FilterBloom(keys);
 	else
@@ -28,13 +28,17 @@ public:
 	return filter_->lookupKey(key);
     }
 
+    void lookupBatch(const std::vector<std::string>& keys, std::vector<bool>& results) {
+	filter_->lookupKeys(keys, results);
+    }
+
     bool lookupRange(const std::string& left_key, const std::string& right_key) {
-	//return filter_->lookupRange(left_key, false, right_key, false);
-	return filter_->lookupRange(left_key, true, right_key, true);
+	//return filter_->lookupRange(left_key, false, right_key, false, queryContext());
+	return filter_->lookupRange(left_key, true, right_key, true, queryContext());
     }
 
     bool approxCount(const std::string& left_key, const std::string& right_key) {
-	return filter_->approxCount(left_key, right_key);
+	return filter_->approxCount(left_key, right_key, queryContext());
     }
 
     uint64_t getMemoryUsage() {
@@ -42,6 +46,12 @@ public:
     }
 
 private:
+    // one context per thread, so that workload_multi_thread can share the filter
+    static surf::SuRF::QueryContext& queryContext() {
+	thread_local surf::SuRF::QueryContext context;
+	return context;
+    }
+
     surf::SuRF* filter_;
 };
 
@@ -0,0 +1,131 @@
+#include "bench.hpp"
+
+#include "cpu_features.hpp"
+#include "surfpopcount.h"
+
+// Microbenchmark for the bit-manipulation kernels in surfpopcount.h.
+// Every kernel variant supported by this cpu runs over the same inputs;
+// the report is nanoseconds per call and the gain over the baseline
+// variant (the first one listed for each kernel).
+
+static const uint64_t kNumWords = 1 << 16; // 512KB of bits, fits in L2
+static const uint64_t kNumRounds = 200;
+
+static uint64_t sink = 0; // keeps results alive
+
+struct Result {
+    std::string name;
+    double ns_per_op;
+};
+
+void printResults(const std::string& kernel, const std::vector<Result>& results) {
+    std::cout << kernel << std::endl;
+    for (const Result& result : results) {
+	std::cout << "  " << result.name << ": " << result.ns_per_op << " ns/op";
+	if (&result != &results[0]) {
+	    double gain = results[0].ns_per_op / result.ns_per_op;
+	    std::cout << "  " << (gain > 1.0 ? bench::kGreen : bench::kRed)
+		      << "(" << gain << "x)" << bench::kNoColor;
+	}
+	std::cout << std::endl;
+    }
+}
+
+template <typename Popcount>
+Result benchPopcount(const std::string& name, const std::vector<uint64_t>& words, Popcount popcount_fn) {
+    double start_time = bench::getNow();
+    uint64_t sum = 0;
+    for (uint64_t round = 0; round < kNumRounds; round++)
+	for (uint64_t i = 0; i < words.size(); i++)
+	    sum += popcount_fn(words[i] ^ (sum & 1)); // serialize calls; keeps the loop from being vectorized
+    double end_time = bench::getNow();
+    sink += sum;
+    return Result{name, (end_time - start_time) * 1e9 / (kNumRounds * words.size())};
+}
+
+template <typename Select>
+Result benchSelect64(const std::string& name, const std::vector<uint64_t>& words,
+		     const std::vector<int>& ranks, Select select_fn) {
+    double start_time = bench::getNow();
+    uint64_t sum = 0;
+    for (uint64_t round = 0; round < kNumRounds; round++)
+	for (uint64_t i = 0; i < words.size(); i++)
+	    sum += select_fn(words[i], ranks[i]);
+    double end_time = bench::getNow();
+    sink += sum;
+    return Result{name, (end_time - start_time) * 1e9 / (kNumRounds * words.size())};
+}
+
+template <typename PopcountLinear>
+Result benchPopcountLinear(const std::string& name, std::vector<uint64_t>& words,
+			   const uint64_t nbits, PopcountLinear popcount_linear_fn) {
+    uint64_t words_per_op = (nbits + 63) / 64;
+    uint64_t num_ops = words.size() / words_per_op - 1;
+    double start_time = bench::getNow();
+    uint64_t sum = 0;
+    for (uint64_t round = 0; round < kNumRounds; round++)
+	for (uint64_t i = 0; i < num_ops; i++)
+	    sum += popcount_linear_fn(words.data(), i * words_per_op, nbits);
+    double end_time = bench::getNow();
+    sink += sum;
+    return Result{name, (end_time - start_time) * 1e9 / (kNumRounds * num_ops)};
+}
+
+int main() {
+    const surf::CpuFeatures& features = surf::getCpuFeatures();
+    std::cout << "cpu: popcnt=" << features.popcnt << " bmi2=" << features.bmi2
+	      << " fast_pdep=" << features.fast_pdep
+	      << " avx512vpopcntdq=" << features.avx512vpopcntdq << std::endl;
+
+    std::mt19937_64 gen(2018);
+    std::vector<uint64_t> words(kNumWords);
+    std::vector<int> ranks(kNumWords);
+    for (uint64_t i = 0; i < kNumWords; i++) {
+	uint64_t word = gen();
+	if (word == 0) word = 1;
+	words[i] = word;
+	ranks[i] = static_cast<int>(gen() % surf::popcount_sw(word)) + 1;
+    }
+
+    std::vector<Result> results;
+    results.push_back(benchPopcount("software (builtin)", words,
+				    [](uint64_t x) { return surf::popcount_sw(x); }));
+    if (features.popcnt)
+	results.push_back(benchPopcount("popcnt", words,
+					[](uint64_t x) { return surf::popcount_hw(x); }));
+    results.push_back(benchPopcount("dispatched popcount()", words,
+				    [](uint64_t x) { return surf::popcount(x); }));
+    printResults("popcount", results);
+
+    results.clear();
+    results.push_back(benchSelect64("popcount search", words, ranks,
+				    [](uint64_t x, int k) { return surf::select64_popcount_search(x, k); }));
+    results.push_back(benchSelect64("broadword", words, ranks,
+				    [](uint64_t x, int k) { return surf::select64_broadword_msb(x, k); }));
+    if (features.bmi2)
+	results.push_back(benchSelect64("pdep", words, ranks,
+					[](uint64_t x, int k) { return surf::select64_pdep_msb(x, k); }));
+    results.push_back(benchSelect64("dispatched select64()", words, ranks,
+				    [](uint64_t x, int k) { return surf::select64(x, k); }));
+    printResults("select64", results);
+
+    const uint64_t lengths[] = {512, 4096};
+    for (uint64_t nbits : lengths) {
+	results.clear();
+	results.push_back(benchPopcountLinear("scalar", words, nbits,
+					      [](const uint64_t* bits, uint64_t x, uint64_t n) {
+						  return surf::popcountLinear_scalar(bits, x, n); }));
+#ifdef SURF_X86
+	if (features.avx512vpopcntdq)
+	    results.push_back(benchPopcountLinear("avx512 vpopcntdq", words, nbits,
+						  [](const uint64_t* bits, uint64_t x, uint64_t n) {
+						      return surf::popcountLinear_avx512(bits, x, n); }));
+#endif
+	results.push_back(benchPopcountLinear("dispatched popcountLinear()", words, nbits,
+					      [](uint64_t* bits, uint64_t x, uint64_t n) {
+						  return surf::popcountLinear(bits, x, n); }));
+	printResults("popcountLinear, " + std::to_string(nbits) + " bits", results);
+    }
+
+    return (sink == 0) ? 1 : 0;
+}
@@ -1,11 +1,23 @@
 #!bin/bash
 
+echo 'popcount/select kernels'
+../build/bench/kernel_bench
+
+echo 'SuRF, tiered loading, random int, point queries'
+../build/bench/tiered_bench
+
+echo 'SuRF, compact encoding, random int and text keys'
+../build/bench/compact_bench
+
 echo 'Bloom Filter, random int, point queries'
 ../build/bench/workload Bloom 1 mixed 50 0 randint point zipfian
 
 echo 'SuRF, random int, point queries'
 ../build/bench/workload SuRF 1 mixed 50 0 randint point zipfian
 
+echo 'SuRF, random int, batched point queries'
+../build/bench/workload SuRF 1 mixed 50 0 randint point-batch zipfian
+
 echo 'SuRFHash, 4-bit suffixes, random int, point queries'
 ../build/bench/workload SuRFHash 4 mixed 50 0 randint point zipfian
 
@@ -0,0 +1,130 @@
+#include "bench.hpp"
+
+#include <chrono>
+
+#include "surf.hpp"
+
+// Tiered loading (SuRF::openTiered): point lookup latency and resident
+// memory for a range of resident louds-sparse levels and page cache
+// sizes, against the fully loaded filter. Latencies are reported for
+// all lookups and separately for those that had to read a page.
+//
+// Usage: tiered_bench [num_keys] [num_queries]
+
+static const char* kPath = "tiered_bench.surf";
+
+// Lower-case keys of kMinKeyLen to kMaxKeyLen letters: a deep trie
+// whose louds-sparse part dominates
+static const uint64_t kMinKeyLen = 8;
+static const uint64_t kMaxKeyLen = 24;
+
+static std::string randomKey(std::mt19937_64& gen) {
+    std::string key(kMinKeyLen + gen() % (kMaxKeyLen - kMinKeyLen + 1), 'a');
+    for (size_t i = 0; i < key.size(); i++)
+	key[i] = static_cast<char>('a' + gen() % 26);
+    return key;
+}
+
+struct Config {
+    surf::level_t resident_levels;
+    uint64_t cache_pages;
+};
+
+static double percentile(std::vector<double>& latencies, const double p) {
+    if (latencies.empty())
+	return 0;
+    size_t idx = static_cast<size_t>(p * (latencies.size() - 1));
+    std::nth_element(latencies.begin(), latencies.begin() + idx, latencies.end());
+    return latencies[idx];
+}
+
+static void printLatencies(const std::string& name, std::vector<double>& latencies) {
+    std::cout << "  " << name << ": " << latencies.size() << " lookups";
+    if (!latencies.empty()) {
+	double p50 = percentile(latencies, 0.5);
+	double p99 = percentile(latencies, 0.99);
+	std::cout << ", p50 " << p50 << " ns, p99 " << p99 << " ns";
+    }
+    std::cout << std::endl;
+}
+
+static uint64_t runLookups(surf::SuRF* filter, const std::vector<std::string>& queries) {
+    const surf::PageCache* cache = filter->getPageCache();
+    std::vector<double> all;
+    std::vector<double> faulting;
+    std::vector<double> resident;
+    uint64_t num_positives = 0;
+    for (size_t i = 0; i < queries.size(); i++) {
+	uint64_t faults = (cache != nullptr) ? cache->getNumFaults() : 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (filter->lookupKey(queries[i]))
+	    num_positives++;
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	all.push_back(ns);
+	if (cache != nullptr && cache->getNumFaults() != faults)
+	    faulting.push_back(ns);
+	else
+	    resident.push_back(ns);
+    }
+    printLatencies("all", all);
+    if (cache != nullptr) {
+	printLatencies("no fault", resident);
+	printLatencies("fault", faulting);
+    }
+    return num_positives;
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t num_keys = (argc > 1) ? strtoull(argv[1], nullptr, 10) : 2000000;
+    uint64_t num_queries = (argc > 2) ? strtoull(argv[2], nullptr, 10) : 1000000;
+
+    std::mt19937_64 gen(2018);
+    std::vector<std::string> keys;
+    for (uint64_t i = 0; i < num_keys; i++)
+	keys.push_back(randomKey(gen));
+    surf::sortUniqueKeys(keys, std::thread::hardware_concurrency());
+    // half present keys, half random probes, in random order
+    std::vector<std::string> queries;
+    for (uint64_t i = 0; i < num_queries; i++)
+	queries.push_back((i % 2 == 0) ? keys[gen() % keys.size()] : randomKey(gen));
+
+    surf::SuRF* filter = new surf::SuRF(keys, surf::kReal, 0, 8);
+    char* data = filter->serializeFormatted();
+    std::ofstream out(kPath, std::ios::binary | std::ios::trunc);
+    out.write(data, filter->formattedSize());
+    out.close();
+    delete[] data;
+    std::cout << "filter: " << keys.size() << " keys, " << filter->formattedSize() << " bytes on disk, height "
+	      << filter->getHeight() << ", sparse from level " << filter->getSparseStartLevel() << std::endl;
+
+    std::cout << "fully loaded: " << filter->getMemoryUsage() << " bytes" << std::endl;
+    uint64_t expected_positives = runLookups(filter, queries);
+
+    const Config configs[] = {{0, 256}, {2, 256}, {2, 4096}, {4, 256}, {4, 4096}, {1000, 256}};
+    for (const Config& config : configs) {
+	surf::SuRF* tiered = surf::SuRF::openTiered(kPath, config.resident_levels, config.cache_pages);
+	if (tiered == nullptr) {
+	    std::cout << "openTiered failed" << std::endl;
+	    return 1;
+	}
+	const surf::PageCache* cache = tiered->getPageCache();
+	std::cout << "tiered, " << config.resident_levels << " resident sparse levels, " << config.cache_pages
+		  << " cache pages: " << cache->getNumPinnedPages() * cache->getPageSize() << " bytes pinned, up to "
+		  << cache->getCapacity() * cache->getPageSize() << " bytes cached" << std::endl;
+	uint64_t num_positives = runLookups(tiered, queries);
+	std::cout << "  " << cache->getNumPageReads() << " page reads, " << cache->getNumEvictions() << " evictions, "
+		  << cache->getResidentBytes() << " bytes resident";
+	if (num_positives == expected_positives)
+	    std::cout << "  " << bench::kGreen << "(same answers)" << bench::kNoColor;
+	else
+	    std::cout << "  " << bench::kRed << "(answers differ)" << bench::kNoColor;
+	std::cout << std::endl;
+	tiered->destroy();
+	delete tiered;
+    }
+
+    filter->destroy();
+    delete filter;
+    remove(kPath);
+    return 0;
+}
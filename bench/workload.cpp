@@ -1,5 +1,40 @@
 #include "bench.hpp"
 #include "filter_factory.hpp"
+#include "surf_int.hpp"
+
+// randint workloads on SuRF run through the fixed-width integer
+// front-end (surf::SuRFInt); keys are converted before timing starts
+static void executeIntQueries(const surf::SuRFInt<uint64_t>& filter, const std::string& query_type,
+			      const std::vector<uint64_t>& txn_keys,
+			      const std::vector<uint64_t>& left_keys, const std::vector<uint64_t>& right_keys,
+			      int64_t& positives, uint64_t& count) {
+    surf::SuRF::QueryContext context;
+    if (query_type.compare(std::string("point")) == 0) {
+	for (int i = 0; i < (int)txn_keys.size(); i++)
+	    positives += (int)filter.lookup(txn_keys[i]);
+    } else if (query_type.compare(std::string("point-batch")) == 0) {
+	std::vector<bool> results;
+	filter.lookupKeys(txn_keys, results);
+	for (int i = 0; i < (int)results.size(); i++)
+	    positives += (int)results[i];
+    } else if (query_type.compare(std::string("range")) == 0) {
+	for (int i = 0; i < (int)txn_keys.size(); i++)
+	    positives += (int)filter.lookupRange(txn_keys[i], true, txn_keys[i] + bench::kIntRangeSize, true, context);
+    } else if (query_type.compare(std::string("mix")) == 0) {
+	for (int i = 0; i < (int)txn_keys.size(); i++) {
+	    if (i % 2 == 0)
+		positives += (int)filter.lookup(txn_keys[i]);
+	    else
+		positives += (int)filter.lookupRange(txn_keys[i], true, txn_keys[i] + bench::kIntRangeSize, true, context);
+	}
+    } else if (query_type.compare(std::string("count-long")) == 0) {
+	for (int i = 0; i < (int)left_keys.size(); i++)
+	    count += filter.approxCount(left_keys[i], right_keys[i], context);
+    } else if (query_type.compare(std::string("count-short")) == 0) {
+	for (int i = 0; i < (int)txn_keys.size(); i++)
+	    count += filter.approxCount(txn_keys[i], txn_keys[i] + bench::kIntRangeSize, context);
+    }
+}
 
 int main(int argc, char *argv[]) {
     if (argc != 9) {
@@ -10,7 +45,7 @@ int main(int argc, char *argv[]) {
 	std::cout << "4. percentage of keys inserted: 0 < num <= 100\n";
 	std::cout << "5. byte position (conting from last, only for alterByte): num\n";
 	std::cout << "6. key type: randint, email\n";
-	std::cout << "7. query type: point, range, mix, count-long, count-short\n";
+	std::cout << "7. query type: point, point-batch, range, mix, count-long, count-short\n";
 	std::cout << "8. distribution: uniform, zipfian, latest\n";
 	return -1;
     }
@@ -59,6 +94,7 @@ int main(int argc, char *argv[]) {
     }
 
     if (query_type.compare(std::string("point")) != 0
+	&& query_type.compare(std::string("point-batch")) != 0
 	&& query_type.compare(std::string("range")) != 0
 	&& query_type.compare(std::string("mix")) != 0
 	&& query_type.compare(std::string("count-long")) != 0
@@ -113,20 +149,50 @@ int main(int argc, char *argv[]) {
     	}
     }
     
+    surf::SuffixType suffix_type;
+    uint32_t hash_suffix_len, real_suffix_len;
+    bool use_int_filter = (key_type.compare(std::string("randint")) == 0)
+	&& bench::FilterFactory::getSuRFConfig(filter_type, suffix_len, suffix_type, hash_suffix_len, real_suffix_len);
+    std::vector<uint64_t> insert_ints, txn_ints, left_ints, right_ints;
+    if (use_int_filter) {
+	for (int i = 0; i < (int)insert_keys.size(); i++)
+	    insert_ints.push_back(bench::stringToUint64(insert_keys[i]));
+	for (int i = 0; i < (int)txn_keys.size(); i++)
+	    txn_ints.push_back(bench::stringToUint64(txn_keys[i]));
+	for (int i = 0; i < (int)left_keys.size(); i++) {
+	    left_ints.push_back(bench::stringToUint64(left_keys[i]));
+	    right_ints.push_back(bench::stringToUint64(right_keys[i]));
+	}
+    }
+
     // create filter ==============================================
     double time1 = bench::getNow();
-    bench::Filter* filter = bench::FilterFactory::createFilter(filter_type, suffix_len, insert_keys);
+    bench::Filter* filter = nullptr;
+    surf::SuRFInt<uint64_t>* int_filter = nullptr;
+    if (use_int_filter)
+	int_filter = new surf::SuRFInt<uint64_t>(insert_ints, surf::kIncludeDense, surf::kSparseDenseRatio,
+						 suffix_type, hash_suffix_len, real_suffix_len);
+    else
+	filter = bench::FilterFactory::createFilter(filter_type, suffix_len, insert_keys);
     double time2 = bench::getNow();
     std::cout << "Build time = " << (time2 - time1) << std::endl;
 
     // execute transactions =======================================
     int64_t positives = 0;
     uint64_t count = 0;
+    std::vector<bool> batch_results;
+    batch_results.reserve(txn_keys.size());
     double start_time = bench::getNow();
 
-    if (query_type.compare(std::string("point")) == 0) {
+    if (use_int_filter) {
+	executeIntQueries(*int_filter, query_type, txn_ints, left_ints, right_ints, positives, count);
+    } else if (query_type.compare(std::string("point")) == 0) {
 	for (int i = 0; i < (int)txn_keys.size(); i++)
 	    positives += (int)filter->lookup(txn_keys[i]);
+    } else if (query_type.compare(std::string("point-batch")) == 0) {
+	filter->lookupBatch(txn_keys, batch_results);
+	for (int i = 0; i < (int)batch_results.size(); i++)
+	    positives += (int)batch_results[i];
     } else if (query_type.compare(std::string("range")) == 0) {
 	for (int i = 0; i < (int)txn_keys.size(); i++)
 	    if (key_type.compare(std::string("email")) == 0) {
@@ -173,7 +239,8 @@ int main(int argc, char *argv[]) {
 
     int64_t true_positives = 0;
     std::map<std::string, bool>::iterator ht_iter;
-    if (query_type.compare(std::string("point")) == 0) {
+    if (query_type.compare(std::string("point")) == 0
+	|| query_type.compare(std::string("point-batch")) == 0) {
 	for (int i = 0; i < (int)txn_keys.size(); i++) {
 	    ht_iter = ht.find(txn_keys[i]);
 	    true_positives += (ht_iter != ht.end());
@@ -231,7 +298,8 @@ int main(int argc, char *argv[]) {
 	fp_rate = false_positives / (true_negatives + false_positives + 0.0);
     std::cout << bench::kGreen << "False Positive Rate = " << bench::kNoColor << fp_rate << "\n";
 
-    std::cout << bench::kGreen << "Memory = " << bench::kNoColor << filter->getMemoryUsage() << "\n\n";
+    uint64_t memory = use_int_filter ? int_filter->getMemoryUsage() : filter->getMemoryUsage();
+    std::cout << bench::kGreen << "Memory = " << bench::kNoColor << memory << "\n\n";
 
     return 0;
 }
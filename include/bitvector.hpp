@@ -6,17 +6,18 @@
 #include <vector>
 
 #include "config.hpp"
+#include "page_cache.hpp"
 
 namespace surf {
 
 class Bitvector {
 public:
-    Bitvector() : num_bits_(0), bits_(nullptr) {}
+    Bitvector() : num_bits_(0), bits_(nullptr), is_borrowed_(false), page_cache_(nullptr) {}
 
     Bitvector(const std::vector<std::vector<word_t> >& bitvector_per_level, 
 	      const std::vector<position_t>& num_bits_per_level, 
 	      const level_t start_level = 0, 
-	      level_t end_level = 0/* non-inclusive */) {
+	      level_t end_level = 0/* non-inclusive */) : is_borrowed_(false), page_cache_(nullptr) {
 	if (end_level == 0)
 		end_level = static_cast<level_t>(bitvector_per_level.size());
 	num_bits_ = totalNumBits(num_bits_per_level, start_level, end_level);
@@ -25,6 +26,12 @@ public:
 	concatenateBitvectors(bitvector_per_level, num_bits_per_level, start_level, end_level);
     }
 
+    // num_bits 0's, to be filled in place with setBit
+    explicit Bitvector(const position_t num_bits) : num_bits_(num_bits), is_borrowed_(false), page_cache_(nullptr) {
+	bits_ = new word_t[numWords()];
+	memset(bits_, 0, bitsSize());
+    }
+
     ~Bitvector() {}
 
     position_t numBits() const {
@@ -48,11 +55,32 @@ public:
 	return (sizeof(Bitvector) + bitsSize());
     }
 
+    // The reads take kPaged = true only in a paged filter (see
+    // setPageCache): only then do they touch the page cache, so the
+    // default instantiation is free of it
+    template <bool kPaged = false>
     bool readBit(const position_t pos) const;
+    void setBit(const position_t pos);
+
+    inline void prefetchBits(const position_t pos) const { __builtin_prefetch(bits_ + (pos / kWordSize)); }
+
+    // true if the arrays point into a caller-owned buffer (zero-copy
+    // deSerialize); destroy() then frees nothing
+    bool isBorrowed() const {
+	return is_borrowed_;
+    }
 
+    template <bool kPaged = false>
     position_t distanceToNextSetBit(const position_t pos) const;
+    template <bool kPaged = false>
     position_t distanceToPrevSetBit(const position_t pos) const;
 
+    // Paged reads (kPaged = true) of bits_ then go through page_cache
+    // (see SuRF::openTiered); bits_ must point into its region
+    void setPageCache(PageCache* page_cache) {
+	page_cache_ = page_cache;
+    }
+
 private:
     position_t totalNumBits(const std::vector<position_t>& num_bits_per_level, 
 			    const level_t start_level, 
@@ -63,17 +91,34 @@ private:
 			       const level_t start_level, 
 			       const level_t end_level/* non-inclusive */);
 protected:
+    // Makes words[0, num_words) readable in a paged read
+    template <bool kPaged>
+    void touchWords(const word_t* words, const position_t num_words) const {
+	if (kPaged && page_cache_ != nullptr)
+	    page_cache_->touch(words, num_words * sizeof(word_t));
+    }
+
     position_t num_bits_;
     word_t* bits_;
+    bool is_borrowed_;
+    PageCache* page_cache_;
 };
 
+template <bool kPaged>
 inline bool Bitvector::readBit (const position_t pos) const {
     assert(pos <= num_bits_);
     position_t word_id = pos / kWordSize;
     position_t offset = pos & (kWordSize - 1);
+    touchWords<kPaged>(bits_ + word_id, 1);
     return bits_[word_id] & (kMsbMask >> offset);
 }
 
+inline void Bitvector::setBit (const position_t pos) {
+    assert(pos < num_bits_);
+    bits_[pos / kWordSize] |= (kMsbMask >> (pos & (kWordSize - 1)));
+}
+
+template <bool kPaged>
 inline position_t Bitvector::distanceToNextSetBit (const position_t pos) const {
     assert(pos < num_bits_);
     position_t distance = 1;
@@ -82,6 +127,7 @@ inline position_t Bitvector::distanceToNextSetBit (const position_t pos) const {
     position_t offset = (pos + 1) % kWordSize;
 
     //first word left-over bits
+    touchWords<kPaged>(bits_ + word_id, 1);
     word_t test_bits = bits_[word_id] << offset;
     if (test_bits > 0) {
 	return (distance + __builtin_clzll(test_bits));
@@ -93,6 +139,7 @@ inline position_t Bitvector::distanceToNextSetBit (const position_t pos) const {
 
     while (word_id < numWords() - 1) {
 	word_id++;
+	touchWords<kPaged>(bits_ + word_id, 1);
 	test_bits = bits_[word_id];
 	if (test_bits > 0)
 	    return (distance + __builtin_clzll(test_bits));
@@ -101,6 +148,7 @@ inline position_t Bitvector::distanceToNextSetBit (const position_t pos) const {
     return distance;
 }
 
+template <bool kPaged>
 inline position_t Bitvector::distanceToPrevSetBit (const position_t pos) const {
     assert(pos <= num_bits_);
     if (pos == 0) return 0;
@@ -110,6 +158,7 @@ inline position_t Bitvector::distanceToPrevSetBit (const position_t pos) const {
     position_t offset = (pos - 1) % kWordSize;
 
     //first word left-over bits
+    touchWords<kPaged>(bits_ + word_id, 1);
     word_t test_bits = bits_[word_id] >> (kWordSize - 1 - offset);
     if (test_bits > 0) {
 	return (distance + __builtin_ctzll(test_bits));
@@ -121,6 +170,7 @@ inline position_t Bitvector::distanceToPrevSetBit (const position_t pos) const {
 
     while (word_id > 0) {
 	word_id--;
+	touchWords<kPaged>(bits_ + word_id, 1);
 	test_bits = bits_[word_id];
 	if (test_bits > 0)
 	    return (distance + __builtin_ctzll(test_bits));
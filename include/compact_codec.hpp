@@ -0,0 +1,407 @@
+#ifndef COMPACTCODEC_H_
+#define COMPACTCODEC_H_
+
+#include <string.h>
+
+#include <vector>
+
+#include "config.hpp"
+
+namespace surf
+{
+
+// Compact cold-storage encoding of a filter (SuRF::serializeCompact).
+//
+//   CompactHeader | louds-dense | louds-sparse
+//
+// Only what cannot be recomputed is stored: no rank/select LUTs and no
+// alignment padding. Integers are varints and level cuts are bit-packed.
+// The trie items (labels, child indicator bits, node boundaries and
+// prefix key bits) go through an adaptive binary range coder with small
+// context models (TrieItemModel); suffixes are kept raw, since hash
+// suffixes do not compress. Loading decodes back to the normal
+// in-memory layout and rebuilds the LUTs, so a decoded filter is
+// indistinguishable from the one that was encoded.
+//
+// All fixed-width fields are in host byte order, like the serialize()
+// image.
+
+static const char kCompactMagic[8] = {'S', 'u', 'R', 'F', 'c', 'm', 'p', '\0'};
+// Bump on any change to the encoding or to the context models
+static const uint32_t kCompactVersion = 1;
+
+struct CompactHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t body_crc; // CRC32C of the body_size bytes after the header
+    uint64_t body_size;
+};
+
+static_assert(sizeof(CompactHeader) % 8 == 0, "CompactHeader must keep the body 8-byte aligned");
+
+// Longest key a compact image holds: a trie has a level per key byte
+// plus the terminator level, and decoding allocates by the height, so a
+// corrupt height must be bounded before it reaches the allocator
+static const level_t kCompactMaxKeyLen = 1 << 16;
+
+// Appends varints, raw bytes and bit-packed arrays to a growing buffer
+class CompactWriter
+{
+public:
+    inline std::vector<char> & buffer() { return buffer_; }
+
+    inline void putVarint(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            buffer_.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        buffer_.push_back(static_cast<char>(value));
+    }
+
+    inline void putBytes(const void * src, const uint64_t len)
+    {
+        const char * bytes = static_cast<const char *>(src);
+        buffer_.insert(buffer_.end(), bytes, bytes + len);
+    }
+
+    // The width of the largest value, then every value in that many bits
+    inline void putPacked(const position_t * values, const uint64_t num_values)
+    {
+        position_t max_value = 0;
+        for (uint64_t i = 0; i < num_values; i++)
+            max_value |= values[i];
+        unsigned width = (max_value == 0) ? 0 : (32 - __builtin_clz(max_value));
+        buffer_.push_back(static_cast<char>(width));
+        uint64_t acc = 0;
+        unsigned acc_bits = 0;
+        for (uint64_t i = 0; i < num_values; i++)
+        {
+            acc |= (static_cast<uint64_t>(values[i]) << acc_bits);
+            acc_bits += width;
+            for (; acc_bits >= 8; acc_bits -= 8, acc >>= 8)
+                buffer_.push_back(static_cast<char>(acc & 0xFF));
+        }
+        if (acc_bits > 0)
+            buffer_.push_back(static_cast<char>(acc & 0xFF));
+    }
+
+private:
+    std::vector<char> buffer_;
+};
+
+// Reads back what CompactWriter wrote. Reading past the end or a value
+// out of range marks the reader failed; later reads then return zeros,
+// so that a truncated or corrupt input still decodes to a (wrong but
+// well-formed) structure that the caller checks failed() for and frees.
+class CompactReader
+{
+public:
+    CompactReader(const char * src, const uint64_t size)
+        : cur_(src)
+        , end_(src + size)
+        , failed_(false)
+    {
+    }
+
+    inline bool failed() const { return failed_; }
+    inline bool atEnd() const { return cur_ == end_; }
+    inline uint64_t remaining() const { return static_cast<uint64_t>(end_ - cur_); }
+    inline void fail() { failed_ = true; }
+
+    inline uint64_t getVarint()
+    {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64 && cur_ < end_; shift += 7)
+        {
+            uint8_t byte = static_cast<uint8_t>(*cur_++);
+            value |= (static_cast<uint64_t>(byte & 0x7F) << shift);
+            if ((byte & 0x80) == 0)
+                return failed_ ? 0 : value;
+        }
+        failed_ = true;
+        return 0;
+    }
+
+    // A varint that must not exceed max_value
+    inline uint64_t getVarint(const uint64_t max_value)
+    {
+        uint64_t value = getVarint();
+        if (value <= max_value)
+            return value;
+        failed_ = true;
+        return 0;
+    }
+
+    // Returns a pointer to the next len bytes, or nullptr
+    inline const char * getBytes(const uint64_t len)
+    {
+        if (failed_ || len > remaining())
+        {
+            failed_ = true;
+            return nullptr;
+        }
+        const char * bytes = cur_;
+        cur_ += len;
+        return bytes;
+    }
+
+    inline void getPacked(position_t * values, const uint64_t num_values)
+    {
+        memset(values, 0, num_values * sizeof(position_t));
+        const char * width_byte = getBytes(1);
+        if (width_byte == nullptr)
+            return;
+        unsigned width = static_cast<uint8_t>(*width_byte);
+        if (width > 32 || (num_values * width + 7) / 8 > remaining())
+        {
+            failed_ = true;
+            return;
+        }
+        uint64_t mask = (1ULL << width) - 1;
+        uint64_t acc = 0;
+        unsigned acc_bits = 0;
+        for (uint64_t i = 0; i < num_values; i++)
+        {
+            for (; acc_bits < width; acc_bits += 8)
+                acc |= (static_cast<uint64_t>(static_cast<uint8_t>(*cur_++)) << acc_bits);
+            values[i] = static_cast<position_t>(acc & mask);
+            acc >>= width;
+            acc_bits -= width;
+        }
+    }
+
+private:
+    const char * cur_;
+    const char * end_;
+    bool failed_;
+};
+
+// Binary adaptive range coder (the LZMA construction): every bit is
+// coded with an 11-bit probability that moves 1/32 of the way towards
+// each bit it sees.
+static const unsigned kRangeProbBits = 11;
+static const uint16_t kRangeProbInit = 1 << (kRangeProbBits - 1);
+static const unsigned kRangeMoveBits = 5;
+static const uint32_t kRangeTop = 1 << 24;
+
+class RangeEncoder
+{
+public:
+    explicit RangeEncoder(std::vector<char> & out)
+        : out_(out)
+        , low_(0)
+        , range_(0xFFFFFFFF)
+        , cache_(0)
+        , cache_size_(1)
+    {
+    }
+
+    inline void encodeBit(uint16_t & prob, const unsigned bit)
+    {
+        uint32_t bound = (range_ >> kRangeProbBits) * prob;
+        if (bit == 0)
+        {
+            range_ = bound;
+            prob = static_cast<uint16_t>(prob + (((1 << kRangeProbBits) - prob) >> kRangeMoveBits));
+        }
+        else
+        {
+            low_ += bound;
+            range_ -= bound;
+            prob = static_cast<uint16_t>(prob - (prob >> kRangeMoveBits));
+        }
+        while (range_ < kRangeTop)
+        {
+            range_ <<= 8;
+            shiftLow();
+        }
+    }
+
+    // MSB first down a binary tree of 255 probabilities (probs[1..255])
+    inline void encodeByte(uint16_t * probs, const uint8_t byte)
+    {
+        unsigned node = 1;
+        for (int i = 7; i >= 0; i--)
+        {
+            unsigned bit = (byte >> i) & 1;
+            encodeBit(probs[node], bit);
+            node = (node << 1) | bit;
+        }
+    }
+
+    inline void flush()
+    {
+        for (int i = 0; i < 5; i++)
+            shiftLow();
+    }
+
+private:
+    inline void shiftLow()
+    {
+        if (static_cast<uint32_t>(low_) < 0xFF000000 || (low_ >> 32) != 0)
+        {
+            uint8_t carry = static_cast<uint8_t>(low_ >> 32);
+            uint8_t byte = cache_;
+            do
+            {
+                out_.push_back(static_cast<char>(static_cast<uint8_t>(byte + carry)));
+                byte = 0xFF;
+            } while (--cache_size_ != 0);
+            cache_ = static_cast<uint8_t>(low_ >> 24);
+        }
+        cache_size_++;
+        low_ = (low_ & 0x00FFFFFF) << 8;
+    }
+
+    std::vector<char> & out_;
+    uint64_t low_;
+    uint32_t range_;
+    uint8_t cache_;
+    uint64_t cache_size_;
+};
+
+class RangeDecoder
+{
+public:
+    // Reading past size bytes yields zeros and sets overrun()
+    RangeDecoder(const char * src, const uint64_t size)
+        : cur_(src)
+        , end_(src + size)
+        , size_(size)
+        , code_(0)
+        , range_(0xFFFFFFFF)
+        , overrun_(false)
+    {
+        for (int i = 0; i < 5; i++)
+            code_ = (code_ << 8) | nextByte();
+    }
+
+    inline bool overrun() const { return overrun_; }
+
+    // An upper bound on the bits a stream of size bytes decodes before
+    // overrun(): a probability saturates 31/2048 short of certainty, so
+    // a bit costs at least 1/46 of a stream bit
+    inline uint64_t maxBits() const { return (size_ + 1) * 8 * 64; }
+
+    inline unsigned decodeBit(uint16_t & prob)
+    {
+        uint32_t bound = (range_ >> kRangeProbBits) * prob;
+        unsigned bit;
+        if (code_ < bound)
+        {
+            range_ = bound;
+            prob = static_cast<uint16_t>(prob + (((1 << kRangeProbBits) - prob) >> kRangeMoveBits));
+            bit = 0;
+        }
+        else
+        {
+            code_ -= bound;
+            range_ -= bound;
+            prob = static_cast<uint16_t>(prob - (prob >> kRangeMoveBits));
+            bit = 1;
+        }
+        while (range_ < kRangeTop)
+        {
+            range_ <<= 8;
+            code_ = (code_ << 8) | nextByte();
+        }
+        return bit;
+    }
+
+    inline uint8_t decodeByte(uint16_t * probs)
+    {
+        unsigned node = 1;
+        for (int i = 0; i < 8; i++)
+            node = (node << 1) | decodeBit(probs[node]);
+        return static_cast<uint8_t>(node);
+    }
+
+private:
+    inline uint32_t nextByte()
+    {
+        if (cur_ < end_)
+            return static_cast<uint8_t>(*cur_++);
+        overrun_ = true;
+        return 0;
+    }
+
+    const char * cur_;
+    const char * end_;
+    uint64_t size_;
+    uint32_t code_;
+    uint32_t range_;
+    bool overrun_;
+};
+
+// Adaptive context models for the items of one trie encoding (see
+// LoudsDense/LoudsSparse::serializeCompact). Every item is a label with
+// its child indicator bit; the node boundaries are coded as bits too.
+// - a label is coded in the context of the previous label of its node
+//   (labels are sorted within a node, so it bounds the next one), or of
+//   kNodeStart for the first label of a node
+// - boundary, child and prefix key bits are coded in the context of the
+//   level (deep levels are mostly leaves) and of the previous bit
+class TrieItemModel
+{
+public:
+    static const unsigned kNodeStart = 256;
+    static const level_t kLevelContexts = 16; // deeper levels share the last one
+
+    TrieItemModel()
+        : labels_((kNodeStart + 1) * 256, kRangeProbInit)
+        , boundaries_(kLevelContexts * 2, kRangeProbInit)
+        , children_(kLevelContexts * 4, kRangeProbInit)
+        , prefix_keys_(kLevelContexts * 2, kRangeProbInit)
+    {
+    }
+
+    // level is counted from the first level of the encoding
+    static level_t levelContext(const level_t level) { return (level < kLevelContexts) ? level : (kLevelContexts - 1); }
+
+    // prev_label: the previous label of the node, or kNodeStart
+    inline uint16_t * labelProbs(const unsigned prev_label) { return &labels_[prev_label * 256]; }
+
+    inline uint16_t & boundaryProb(const level_t level, const bool prev_bit)
+    {
+        return boundaries_[levelContext(level) * 2 + (prev_bit ? 1 : 0)];
+    }
+
+    inline uint16_t & childProb(const level_t level, const label_t label, const bool prev_bit)
+    {
+        return children_[levelContext(level) * 4 + ((label == kTerminator) ? 2 : 0) + (prev_bit ? 1 : 0)];
+    }
+
+    inline uint16_t & prefixKeyProb(const level_t level, const bool prev_bit)
+    {
+        return prefix_keys_[levelContext(level) * 2 + (prev_bit ? 1 : 0)];
+    }
+
+private:
+    std::vector<uint16_t> labels_;
+    std::vector<uint16_t> boundaries_;
+    std::vector<uint16_t> children_;
+    std::vector<uint16_t> prefix_keys_;
+};
+
+// A range-coded stream, prefixed with its length
+inline void putRangeCoded(CompactWriter & writer, const std::vector<char> & stream)
+{
+    writer.putVarint(stream.size());
+    writer.putBytes(stream.data(), stream.size());
+}
+
+// Returns a decoder over the stream putRangeCoded wrote (an empty one if
+// reader fails)
+inline RangeDecoder getRangeCoded(CompactReader & reader)
+{
+    uint64_t len = reader.getVarint(reader.remaining());
+    const char * stream = reader.getBytes(len);
+    return RangeDecoder(stream, (stream == nullptr) ? 0 : len);
+}
+
+} // namespace surf
+
+#endif // COMPACTCODEC_H_
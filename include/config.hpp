@@ -4,6 +4,9 @@
 #include <cstdint>
 #include <cstring>
 #include <string>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 namespace surf
 {
@@ -29,6 +32,57 @@ static const int kHashShift = 7;
 
 static const int kCouldBePositive = 2018; // used in suffix comparison
 
+// Number of point lookups kept in flight by SuRF::lookupKeys
+static const unsigned kLookupBatchSize = 16;
+
+// Trie levels an iterator stores inline; taller tries spill to the heap
+static const level_t kIterInlineLevels = 64;
+
+// GrowingSuRF re-encodes its frozen part once the unencoded tail holds
+// at least kGrowingMinTailKeys keys and 1/kGrowingTailRatio of the
+// frozen keys
+static const size_t kGrowingMinTailKeys = 1024;
+static const size_t kGrowingTailRatio = 8;
+
+// DynamicSuRF flushes its insert buffer into a new run at
+// kDynamicBufferKeys keys, and merges two adjacent runs when the older
+// one is less than kDynamicRunGrowth times the size of the newer one
+static const size_t kDynamicBufferKeys = 4096;
+static const uint64_t kDynamicRunGrowth = 2;
+
+// sortUniqueKeys (key_sort.hpp) hands ranges of at most kRadixSortCutoff
+// keys to std::sort, and gives each thread at least kParallelSortMinKeys
+// keys
+static const size_t kRadixSortCutoff = 32;
+static const size_t kParallelSortMinKeys = 16384;
+
+// SuRF::needsRebuild() turns true once this fraction of the keys has
+// been erased
+static const double kEraseRebuildRatio = 0.25;
+
+// SuRF::openTiered reads the lazily loaded louds-sparse levels in pages
+// of kTieredPageSize bytes (rounded up to the OS page size) and keeps at
+// most kTieredCachePages of them in memory
+static const uint64_t kTieredPageSize = 4096;
+static const uint64_t kTieredCachePages = 256;
+
+// Progress of a point lookup that is advanced one trie level at a time
+// (batched lookups, see SuRF::lookupKeys)
+enum LookupStatus
+{
+    kLookupInProgress = 0,
+    kLookupFound = 1,
+    kLookupNotFound = 2,
+    kLookupToSparse = 3 // louds-dense part done; continue in louds-sparse
+};
+
+// Where BitvectorRank keeps its rank directory
+enum RankLayout
+{
+    kRankLut = 0, // separate look-up table with one count per basic block
+    kRankInterleaved = 1 // counts stored in the same cache line as the bits
+};
+
 enum SuffixType
 {
     kNone = 0,
@@ -52,6 +106,83 @@ inline void sizeAlign(uint64_t & size)
     size = (size + 7) & ~(static_cast<uint64_t>(7));
 }
 
+// Non-owning view of a probe key (bytes + length). The query paths take
+// keys as KeyView so that keys living in network buffers or mmap'd pages
+// can be probed without first being copied into a std::string.
+// The viewed bytes must outlive the call they are passed to.
+class KeyView
+{
+public:
+    KeyView()
+        : data_(nullptr)
+        , length_(0)
+    {
+    }
+
+    KeyView(const char * data, const size_t length)
+        : data_(data)
+        , length_(length)
+    {
+    }
+
+    // NUL-terminated key
+    KeyView(const char * data)
+        : data_(data)
+        , length_(strlen(data))
+    {
+    }
+
+    KeyView(const std::string & key)
+        : data_(key.data())
+        , length_(key.length())
+    {
+    }
+
+#if __cplusplus >= 201703L
+    KeyView(const std::string_view key)
+        : data_(key.data())
+        , length_(key.length())
+    {
+    }
+#endif
+
+    inline const char * data() const { return data_; }
+    inline size_t length() const { return length_; }
+    inline size_t size() const { return length_; }
+    inline char operator[](const size_t pos) const { return data_[pos]; }
+
+    inline std::string toString() const { return std::string(data_, length_); }
+
+private:
+    const char * data_;
+    size_t length_;
+};
+
+// Compares iter_key[0, iter_len) against the first iter_len bytes of key
+// (or all of key if it is shorter) as unsigned bytes: returns -1, 0 or 1.
+// Same result as std::string(iter_key).compare(key.substr(0, iter_len)),
+// without building either string.
+inline int compareKeyBytes(const label_t * iter_key, const size_t iter_len, const char * key, const size_t key_len)
+{
+    size_t len = (iter_len < key_len) ? iter_len : key_len;
+    int compare = memcmp(iter_key, key, len);
+    if (compare != 0)
+        return (compare < 0) ? -1 : 1;
+    return (iter_len > len) ? 1 : 0;
+}
+
+// Compares two whole keys as unsigned bytes: returns -1, 0 or 1
+inline int compareKeys(const KeyView & a, const KeyView & b)
+{
+    size_t len = (a.length() < b.length()) ? a.length() : b.length();
+    int compare = memcmp(a.data(), b.data(), len);
+    if (compare != 0)
+        return (compare < 0) ? -1 : 1;
+    if (a.length() == b.length())
+        return 0;
+    return (a.length() < b.length()) ? -1 : 1;
+}
+
 inline std::string uint64ToString(const uint64_t word)
 {
     uint64_t endian_swapped_word = __builtin_bswap64(word);
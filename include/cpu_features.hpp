@@ -0,0 +1,63 @@
+#ifndef CPUFEATURES_H_
+#define CPUFEATURES_H_
+
+namespace surf
+{
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SURF_X86 1
+#endif
+
+// Instruction set extensions available at run time.
+// Kernels compiled with per-function target attributes are selected
+// from these flags once, so that a binary built for the baseline ISA
+// still uses the wider instructions on machines that have them.
+struct CpuFeatures
+{
+    bool sse2;
+    bool sse42;
+    bool avx2;
+    bool avx512bw;
+    bool popcnt;
+    bool bmi2;
+    // pdep/pext run in microcode on AMD family 17h (Zen 1/2) and are
+    // slower there than the broadword fallbacks
+    bool fast_pdep;
+    bool avx512vpopcntdq;
+};
+
+inline CpuFeatures detectCpuFeatures()
+{
+    CpuFeatures features;
+#ifdef SURF_X86
+    __builtin_cpu_init();
+    features.sse2 = __builtin_cpu_supports("sse2");
+    features.sse42 = __builtin_cpu_supports("sse4.2");
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.avx512bw = __builtin_cpu_supports("avx512bw");
+    features.popcnt = __builtin_cpu_supports("popcnt");
+    features.bmi2 = __builtin_cpu_supports("bmi2");
+    features.fast_pdep = features.bmi2 && !__builtin_cpu_is("amdfam17h");
+    features.avx512vpopcntdq = __builtin_cpu_supports("avx512vpopcntdq");
+#else
+    features.sse2 = false;
+    features.sse42 = false;
+    features.avx2 = false;
+    features.avx512bw = false;
+    features.popcnt = false;
+    features.bmi2 = false;
+    features.fast_pdep = false;
+    features.avx512vpopcntdq = false;
+#endif
+    return features;
+}
+
+inline const CpuFeatures & getCpuFeatures()
+{
+    static const CpuFeatures features = detectCpuFeatures();
+    return features;
+}
+
+} // namespace surf
+
+#endif // CPUFEATURES_H_
@@ -0,0 +1,102 @@
+#ifndef CRC32C_H_
+#define CRC32C_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cpu_features.hpp"
+
+#ifdef SURF_X86
+#include <immintrin.h>
+#endif
+
+namespace surf
+{
+
+// CRC32C (Castagnoli polynomial, reflected), the checksum of the
+// serialized filter format (see surf_format.hpp). The SSE4.2 crc32
+// instruction computes it 8 bytes at a time; it is picked at run time
+// like the popcount kernels (see surfpopcount.h).
+#if defined(__SSE4_2__)
+static const bool kUseHwCrc32c = true;
+#elif defined(SURF_X86)
+static const bool kUseHwCrc32c = getCpuFeatures().sse42;
+#else
+static const bool kUseHwCrc32c = false;
+#endif
+
+static const uint32_t kCrc32cPoly = 0x82F63B78; // reflected 0x1EDC6F41
+
+struct Crc32cTable
+{
+    uint32_t entries[256];
+
+    Crc32cTable()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc >> 1) ^ ((crc & 1) ? kCrc32cPoly : 0);
+            entries[i] = crc;
+        }
+    }
+};
+
+// Byte-at-a-time table lookup. crc is the running (inverted) state.
+inline uint32_t crc32cUpdateSw(uint32_t crc, const uint8_t * data, uint64_t len)
+{
+    static const Crc32cTable table;
+    for (uint64_t i = 0; i < len; i++)
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef SURF_X86
+// Only valid when getCpuFeatures().sse42.
+__attribute__((target("sse4.2"))) inline uint32_t crc32cUpdateHw(uint32_t crc, const uint8_t * data, uint64_t len)
+{
+    for (; len > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0; len--)
+        crc = _mm_crc32_u8(crc, *data++);
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for (; len >= 8; len -= 8, data += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+    for (; len >= 4; len -= 4, data += 4)
+    {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for (; len > 0; len--)
+        crc = _mm_crc32_u8(crc, *data++);
+    return crc;
+}
+#endif
+
+// Extends crc, the CRC32C of some bytes (0 for none), by data[0, len)
+inline uint32_t crc32cExtend(uint32_t crc, const void * data, uint64_t len)
+{
+    const uint8_t * bytes = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+#ifdef SURF_X86
+    if (kUseHwCrc32c)
+        return ~crc32cUpdateHw(crc, bytes, len);
+#endif
+    return ~crc32cUpdateSw(crc, bytes, len);
+}
+
+inline uint32_t crc32c(const void * data, uint64_t len)
+{
+    return crc32cExtend(0, data, len);
+}
+
+} // namespace surf
+
+#endif // CRC32C_H_
@@ -0,0 +1,340 @@
+#ifndef DYNAMICSURF_H_
+#define DYNAMICSURF_H_
+
+#include <cassert>
+
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+#include "surf.hpp"
+
+namespace surf
+{
+
+// Range filter over a key set that grows by unsorted inserts, organized
+// as a log-structured set of immutable SuRF runs.
+//
+// Inserts go into a small ordered buffer (O(log n) per insert; each key
+// is copied into the buffer on insert and once more at the flush). A
+// full buffer is built into a new run, which is appended after the
+// older runs. Run sizes are kept geometric: whenever a run holds less
+// than run_growth times the keys of the next (newer) run, the two are
+// merged with SuRF::merge. There are then O(log(n / buffer_capacity))
+// runs, and every key takes part in O(log(n / buffer_capacity))
+// merges. Queries probe the buffer and every run.
+//
+// Merges run on one background thread while inserts and queries go on.
+// Merged runs are conservative unions (see SuRF::merge): no false
+// negatives, but they keep real suffixes only, so the configured hash
+// suffix applies to the newest runs.
+//
+// Calls on one DynamicSuRF must not run concurrently; only the
+// background merge is synchronized internally.
+class DynamicSuRF
+{
+public:
+    DynamicSuRF(
+        const bool include_dense,
+        const uint32_t sparse_dense_ratio,
+        const SuffixType suffix_type,
+        const level_t hash_suffix_len,
+        const level_t real_suffix_len,
+        const size_t buffer_capacity = kDynamicBufferKeys,
+        const uint64_t run_growth = kDynamicRunGrowth,
+        const bool background_merges = true)
+        : include_dense_(include_dense)
+        , sparse_dense_ratio_(sparse_dense_ratio)
+        , suffix_type_(suffix_type)
+        , hash_suffix_len_(hash_suffix_len)
+        , real_suffix_len_(real_suffix_len)
+        , buffer_capacity_(buffer_capacity)
+        , run_growth_(run_growth)
+        , background_merges_(background_merges)
+        , is_merging_(false)
+    {
+    }
+
+    ~DynamicSuRF()
+    {
+        waitForMerges();
+        for (size_t i = 0; i < runs_.size(); i++)
+            releaseRun(runs_[i]);
+    }
+
+    DynamicSuRF(const DynamicSuRF &) = delete;
+    DynamicSuRF & operator=(const DynamicSuRF &) = delete;
+
+    // Keys can arrive in any order; duplicates are allowed
+    inline void insert(const std::string & key);
+
+    // Builds the buffered keys into a new run now
+    inline void flush();
+
+    // Blocks until no merge is in flight and the runs are geometric again
+    inline void waitForMerges();
+
+    inline bool lookupKey(const KeyView & key) const;
+    // The range queries use each run's own QueryContext (see
+    // SuRF::lookupRange) and must not run concurrently.
+    inline bool lookupRange(const KeyView & left_key, const bool left_inclusive, const KeyView & right_key, const bool right_inclusive);
+    // Sum over the buffer and the runs. A key inserted into several runs
+    // is counted once per run; keys that share a stored prefix in a
+    // merged run are counted once.
+    inline uint64_t approxCount(const KeyView & left_key, const KeyView & right_key);
+
+    inline size_t getNumRuns() const;
+    inline size_t getBufferSize() const { return buffer_.size(); }
+    // Keys inserted into runs so far (duplicates across runs included)
+    // plus the buffered keys
+    inline uint64_t getNumKeys() const;
+    inline uint64_t getMemoryUsage() const;
+
+private:
+    struct Run
+    {
+        SuRF * filter;
+        uint64_t num_keys;
+    };
+
+    // Unsigned byte order, the trie order. It also compares a stored key
+    // with a KeyView, so that probes are looked up without a copy.
+    struct Less
+    {
+        typedef void is_transparent;
+        inline bool operator()(const KeyView & a, const KeyView & b) const { return compareKeys(a, b) < 0; }
+    };
+    typedef std::set<std::string, Less> Buffer;
+
+    // First buffered key >= key (> key if !inclusive)
+    inline Buffer::const_iterator bufferLowerBound(const KeyView & key, const bool inclusive) const;
+    // Newest adjacent pair (i, i + 1) that breaks the size ratio, or
+    // runs_.size() if there is none. REQUIRED: mutex_ is held.
+    inline size_t findMergeablePair() const;
+    inline void scheduleMerges();
+    inline void mergeLoop();
+    static inline void releaseRun(const Run & run);
+
+    bool include_dense_;
+    uint32_t sparse_dense_ratio_;
+    SuffixType suffix_type_;
+    level_t hash_suffix_len_;
+    level_t real_suffix_len_;
+    size_t buffer_capacity_;
+    uint64_t run_growth_;
+    bool background_merges_;
+
+    Buffer buffer_;
+#if __cplusplus <= 201103L
+    // C++11 sets have no heterogeneous lookup: bufferLowerBound copies
+    // the probe here, which reuses its capacity across calls
+    mutable std::string probe_key_;
+#endif
+
+    // runs_ (oldest first) is shared with the merge thread. It only
+    // changes under mutex_: the caller appends new runs, the merge thread
+    // swaps a merged pair for its result. The runs themselves are
+    // immutable, so the merge thread reads its inputs without the lock.
+    mutable std::mutex mutex_;
+    std::vector<Run> runs_;
+    bool is_merging_; // guarded by mutex_
+    std::thread merge_thread_;
+};
+
+inline void DynamicSuRF::insert(const std::string & key)
+{
+    if (!buffer_.insert(key).second)
+        return;
+    if (buffer_.size() >= buffer_capacity_)
+        flush();
+}
+
+inline void DynamicSuRF::flush()
+{
+    if (buffer_.empty())
+        return;
+    std::vector<std::string> keys(buffer_.begin(), buffer_.end());
+    buffer_.clear();
+    Run run;
+    run.filter = new SuRF(keys, include_dense_, sparse_dense_ratio_, suffix_type_, hash_suffix_len_, real_suffix_len_);
+    run.num_keys = keys.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        runs_.push_back(run);
+    }
+    scheduleMerges();
+}
+
+inline void DynamicSuRF::scheduleMerges()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (is_merging_ || findMergeablePair() == runs_.size())
+            return;
+        is_merging_ = true;
+    }
+    if (merge_thread_.joinable())
+        merge_thread_.join(); // finished: is_merging_ was false
+    if (background_merges_)
+        merge_thread_ = std::thread(&DynamicSuRF::mergeLoop, this);
+    else
+        mergeLoop();
+}
+
+inline void DynamicSuRF::waitForMerges()
+{
+    // the merge thread only exits once it finds nothing to merge; a
+    // later flush starts a new one
+    if (merge_thread_.joinable())
+        merge_thread_.join();
+}
+
+inline size_t DynamicSuRF::findMergeablePair() const
+{
+    for (size_t i = runs_.size(); i >= 2; i--)
+    {
+        if (runs_[i - 2].num_keys < run_growth_ * runs_[i - 1].num_keys)
+            return i - 2;
+    }
+    return runs_.size();
+}
+
+inline void DynamicSuRF::mergeLoop()
+{
+    while (true)
+    {
+        Run older;
+        Run newer;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_t i = findMergeablePair();
+            if (i == runs_.size())
+            {
+                is_merging_ = false;
+                return;
+            }
+            older = runs_[i];
+            newer = runs_[i + 1];
+        }
+
+        std::vector<const SuRF *> inputs;
+        inputs.push_back(older.filter);
+        inputs.push_back(newer.filter);
+        Run merged;
+        merged.filter = SuRF::merge(inputs, include_dense_, sparse_dense_ratio_);
+        merged.num_keys = older.num_keys + newer.num_keys;
+
+        {
+            // only appends happened meanwhile, so the pair is still adjacent
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_t i = 0;
+            while (runs_[i].filter != older.filter)
+                i++;
+            assert(runs_[i + 1].filter == newer.filter);
+            runs_[i] = merged;
+            runs_.erase(runs_.begin() + i + 1);
+        }
+        releaseRun(older);
+        releaseRun(newer);
+    }
+}
+
+inline void DynamicSuRF::releaseRun(const Run & run)
+{
+    run.filter->destroy();
+    delete run.filter;
+}
+
+inline DynamicSuRF::Buffer::const_iterator DynamicSuRF::bufferLowerBound(const KeyView & key, const bool inclusive) const
+{
+    if (buffer_.empty())
+        return buffer_.end();
+#if __cplusplus > 201103L
+    return inclusive ? buffer_.lower_bound(key) : buffer_.upper_bound(key);
+#else
+    probe_key_.assign(key.data(), key.length());
+    return inclusive ? buffer_.lower_bound(probe_key_) : buffer_.upper_bound(probe_key_);
+#endif
+}
+
+inline bool DynamicSuRF::lookupKey(const KeyView & key) const
+{
+    Buffer::const_iterator it = bufferLowerBound(key, true);
+    if (it != buffer_.end() && compareKeys(*it, key) == 0)
+        return true;
+    std::lock_guard<std::mutex> lock(mutex_);
+    // newest runs first: recent keys are the likeliest probes
+    for (size_t i = runs_.size(); i > 0; i--)
+    {
+        if (runs_[i - 1].filter->lookupKey(key))
+            return true;
+    }
+    return false;
+}
+
+inline bool
+DynamicSuRF::lookupRange(const KeyView & left_key, const bool left_inclusive, const KeyView & right_key, const bool right_inclusive)
+{
+    Buffer::const_iterator it = bufferLowerBound(left_key, left_inclusive);
+    if (it != buffer_.end())
+    {
+        int compare = compareKeys(*it, right_key);
+        if (right_inclusive ? (compare <= 0) : (compare < 0))
+            return true;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = runs_.size(); i > 0; i--)
+    {
+        if (runs_[i - 1].filter->lookupRange(left_key, left_inclusive, right_key, right_inclusive))
+            return true;
+    }
+    return false;
+}
+
+inline uint64_t DynamicSuRF::approxCount(const KeyView & left_key, const KeyView & right_key)
+{
+    uint64_t count = 0;
+    if (compareKeys(left_key, right_key) < 0)
+        count = static_cast<uint64_t>(std::distance(bufferLowerBound(left_key, true), bufferLowerBound(right_key, true)));
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < runs_.size(); i++)
+        count += runs_[i].filter->approxCount(left_key, right_key);
+    return count;
+}
+
+inline size_t DynamicSuRF::getNumRuns() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return runs_.size();
+}
+
+inline uint64_t DynamicSuRF::getNumKeys() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t num_keys = buffer_.size();
+    for (size_t i = 0; i < runs_.size(); i++)
+        num_keys += runs_[i].num_keys;
+    return num_keys;
+}
+
+inline uint64_t DynamicSuRF::getMemoryUsage() const
+{
+    // a tree node holds the string, three links and a color
+    uint64_t size = sizeof(DynamicSuRF) + buffer_.size() * (sizeof(std::string) + 4 * sizeof(void *));
+    for (Buffer::const_iterator it = buffer_.begin(); it != buffer_.end(); ++it)
+        size += it->capacity();
+    std::lock_guard<std::mutex> lock(mutex_);
+    size += runs_.capacity() * sizeof(Run);
+    for (size_t i = 0; i < runs_.size(); i++)
+        size += runs_[i].filter->getMemoryUsage();
+    return size;
+}
+
+} // namespace surf
+
+#endif // DYNAMICSURF_H_
@@ -0,0 +1,448 @@
+#ifndef GROWINGSURF_H_
+#define GROWINGSURF_H_
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "surf.hpp"
+#include "surf_builder.hpp"
+
+namespace surf
+{
+
+// A filter that answers queries while sorted keys are still arriving.
+// The keys inserted so far are split into a frozen part, encoded as an
+// ordinary SuRF, and a tail of the most recent keys kept verbatim in a
+// sorted vector. Every tail key is greater than every frozen key, so a
+// query goes to the frozen part, to the tail, or to the frozen part and
+// then the tail (ranges and iteration). Tail answers are exact.
+//
+// All keys also go into an incremental SuRFBuilder. Once the tail holds
+// at least min_tail_keys keys and 1/tail_ratio of the frozen keys, the
+// frozen part is re-encoded from a finalized copy of that builder and
+// the tail is emptied. The tail stays within a constant fraction of the
+// filter, so a tail search costs about as much as a trie walk, and each
+// key is re-encoded O(tail_ratio) times over the whole ingestion.
+//
+// insert() invalidates iterators. Queries must not run concurrently with
+// insert().
+class GrowingSuRF
+{
+public:
+    class Iter
+    {
+    public:
+        Iter()
+            : filter_(nullptr)
+            , in_tail_(true)
+            , tail_pos_(0)
+        {
+        }
+
+        inline bool isValid() const;
+        // Tail keys are stored in full and are never false positives
+        inline bool getFpFlag() const;
+        inline int compare(const KeyView & key) const;
+        // Frozen keys come back as their stored prefix (as SuRF::Iter::getKey)
+        inline std::string getKey() const;
+
+        // Returns true if the status of the iterator after the operation is valid
+        inline bool operator++(int);
+        inline bool operator--(int);
+
+    private:
+        inline void setToTail(const size_t tail_pos);
+
+        const GrowingSuRF * filter_;
+        SuRF::Iter frozen_iter_; // used while !in_tail_
+        bool in_tail_;
+        size_t tail_pos_;
+
+        friend class GrowingSuRF;
+    };
+
+    // Caller-owned scratch state for the const range queries (see
+    // SuRF::QueryContext). It follows the filter across re-encodes.
+    class QueryContext
+    {
+    public:
+        QueryContext()
+            : filter_(nullptr)
+            , generation_(0)
+        {
+        }
+
+    private:
+        const GrowingSuRF * filter_;
+        uint64_t generation_;
+        SuRF::QueryContext context_;
+
+        friend class GrowingSuRF;
+    };
+
+public:
+    // tail_ratio 0 is taken as 1 (re-encode once the tail is as large as
+    // the frozen part)
+    GrowingSuRF(
+        const bool include_dense,
+        const uint32_t sparse_dense_ratio,
+        const SuffixType suffix_type,
+        const level_t hash_suffix_len,
+        const level_t real_suffix_len,
+        const size_t min_tail_keys = kGrowingMinTailKeys,
+        const size_t tail_ratio = kGrowingTailRatio)
+        : builder_(include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len)
+        , frozen_(nullptr)
+        , num_frozen_keys_(0)
+        , generation_(0)
+        , min_tail_keys_(min_tail_keys)
+        , tail_ratio_((tail_ratio > 0) ? tail_ratio : 1)
+        , has_last_key_(false)
+        , is_finalized_(false)
+    {
+    }
+
+    ~GrowingSuRF() { releaseFrozen(frozen_); }
+
+    GrowingSuRF(const GrowingSuRF &) = delete;
+    GrowingSuRF & operator=(const GrowingSuRF &) = delete;
+
+    // REQUIRED: key must be inserted in sorted order relative to previously inserted keys
+    // Returns true if insertion was successful, false if key violates sort
+    // order or the filter is finalized. Duplicates are accepted and ignored.
+    // The insert() that fills the tail re-encodes the frozen part before
+    // it returns: it copies the builder and encodes every key so far, in
+    // time and transient memory linear in the filter size. That insert()
+    // is a latency spike; calling freeze() at a quiet moment takes the
+    // re-encode off the insert path.
+    inline bool insert(const std::string & key);
+
+    // Re-encodes the tail into the frozen part now
+    inline void freeze();
+
+    // Ends the ingestion: every key is encoded into the frozen part, which
+    // is then the same filter as a SuRF built from all keys at once
+    inline void finalize();
+
+    inline bool lookupKey(const KeyView & key) const;
+    inline Iter moveToKeyGreaterThan(const KeyView & key, const bool inclusive) const;
+    inline Iter moveToFirst() const;
+    inline Iter moveToLast() const;
+
+    // The range queries without a QueryContext share one context owned by
+    // the filter and must not run concurrently on the same filter.
+    inline bool
+    lookupRange(const KeyView & left_key, const bool left_inclusive, const KeyView & right_key, const bool right_inclusive);
+    inline bool lookupRange(
+        const KeyView & left_key,
+        const bool left_inclusive,
+        const KeyView & right_key,
+        const bool right_inclusive,
+        QueryContext & context) const;
+    // Frozen part: accurate except at the boundaries (see SuRF::approxCount);
+    // tail: exact
+    inline uint64_t approxCount(const KeyView & left_key, const KeyView & right_key);
+    inline uint64_t approxCount(const KeyView & left_key, const KeyView & right_key, QueryContext & context) const;
+
+    inline uint64_t getNumKeys() const { return num_frozen_keys_ + tail_.size(); }
+    inline uint64_t getNumFrozenKeys() const { return num_frozen_keys_; }
+    inline uint64_t getTailSize() const { return tail_.size(); }
+    inline bool isFinalized() const { return is_finalized_; }
+    // nullptr until the first re-encode
+    inline const SuRF * getFrozenSuRF() const { return frozen_; }
+    // Frozen filter + tail keys + builder vectors
+    inline uint64_t getMemoryUsage() const;
+
+private:
+    inline size_t tailLimit() const { return std::max(min_tail_keys_, static_cast<size_t>(num_frozen_keys_ / tail_ratio_)); }
+    // Index of the first tail key >= key (> key if !inclusive)
+    inline size_t tailLowerBound(const KeyView & key, const bool inclusive) const;
+    // true if key cannot be in the frozen part
+    inline bool isPastFrozen(const KeyView & key) const { return !tail_.empty() && compareKeys(tail_[0], key) <= 0; }
+    inline SuRF::QueryContext & bind(QueryContext & context) const;
+    inline void setFrozen(SuRF * frozen);
+    static inline void releaseFrozen(SuRF * frozen);
+
+    SuRFBuilder builder_; // every inserted key
+    SuRF * frozen_;
+    uint64_t num_frozen_keys_;
+    uint64_t generation_; // bumped on every re-encode
+    std::vector<std::string> tail_;
+    size_t min_tail_keys_;
+    size_t tail_ratio_;
+    std::string last_key_;
+    bool has_last_key_;
+    bool is_finalized_;
+    QueryContext context_; // used by the range queries that take no context
+};
+
+inline bool GrowingSuRF::insert(const std::string & key)
+{
+    if (is_finalized_ || !builder_.insert(key))
+        return false;
+    if (has_last_key_ && key == last_key_)
+        return true;
+    last_key_.assign(key);
+    has_last_key_ = true;
+    tail_.push_back(key);
+    if (tail_.size() >= tailLimit())
+        freeze();
+    return true;
+}
+
+inline void GrowingSuRF::freeze()
+{
+    if (is_finalized_ || tail_.empty())
+        return;
+    // the builder keeps accepting keys, so the copy is finalized instead
+    SuRFBuilder snapshot(builder_);
+    snapshot.finalize();
+    setFrozen(new SuRF(snapshot));
+}
+
+inline void GrowingSuRF::finalize()
+{
+    if (is_finalized_)
+        return;
+    builder_.finalize();
+    is_finalized_ = true;
+    if (!tail_.empty())
+        setFrozen(new SuRF(builder_));
+}
+
+inline void GrowingSuRF::setFrozen(SuRF * frozen)
+{
+    // the new filter is built before the old one is freed, so the two
+    // never share an address
+    releaseFrozen(frozen_);
+    frozen_ = frozen;
+    num_frozen_keys_ += tail_.size();
+    tail_.clear();
+    generation_++;
+}
+
+inline void GrowingSuRF::releaseFrozen(SuRF * frozen)
+{
+    if (frozen == nullptr)
+        return;
+    frozen->destroy();
+    delete frozen;
+}
+
+inline size_t GrowingSuRF::tailLowerBound(const KeyView & key, const bool inclusive) const
+{
+    std::vector<std::string>::const_iterator it;
+    if (inclusive)
+        it = std::lower_bound(
+            tail_.begin(), tail_.end(), key, [](const std::string & a, const KeyView & b) { return compareKeys(a, b) < 0; });
+    else
+        it = std::upper_bound(
+            tail_.begin(), tail_.end(), key, [](const KeyView & a, const std::string & b) { return compareKeys(b, a) > 0; });
+    return static_cast<size_t>(it - tail_.begin());
+}
+
+inline SuRF::QueryContext & GrowingSuRF::bind(QueryContext & context) const
+{
+    // a context bound to an older frozen part must not be reused: the new
+    // part may be taller than its iterators
+    if (context.filter_ != this || context.generation_ != generation_)
+    {
+        context.filter_ = this;
+        context.generation_ = generation_;
+        context.context_ = SuRF::QueryContext();
+    }
+    return context.context_;
+}
+
+inline bool GrowingSuRF::lookupKey(const KeyView & key) const
+{
+    if (isPastFrozen(key))
+    {
+        size_t pos = tailLowerBound(key, true);
+        return (pos < tail_.size()) && (compareKeys(tail_[pos], key) == 0);
+    }
+    return (frozen_ != nullptr) && frozen_->lookupKey(key);
+}
+
+inline GrowingSuRF::Iter GrowingSuRF::moveToKeyGreaterThan(const KeyView & key, const bool inclusive) const
+{
+    Iter iter;
+    iter.filter_ = this;
+    if (frozen_ != nullptr && !isPastFrozen(key))
+    {
+        iter.frozen_iter_ = frozen_->moveToKeyGreaterThan(key, inclusive);
+        if (iter.frozen_iter_.isValid())
+        {
+            iter.in_tail_ = false;
+            return iter;
+        }
+    }
+    iter.setToTail(tailLowerBound(key, inclusive));
+    return iter;
+}
+
+inline GrowingSuRF::Iter GrowingSuRF::moveToFirst() const
+{
+    Iter iter;
+    iter.filter_ = this;
+    if (frozen_ != nullptr)
+    {
+        iter.frozen_iter_ = frozen_->moveToFirst();
+        iter.in_tail_ = false;
+    }
+    else
+    {
+        iter.setToTail(0);
+    }
+    return iter;
+}
+
+inline GrowingSuRF::Iter GrowingSuRF::moveToLast() const
+{
+    Iter iter;
+    iter.filter_ = this;
+    if (!tail_.empty() || frozen_ == nullptr)
+    {
+        iter.setToTail(tail_.empty() ? 0 : tail_.size() - 1);
+    }
+    else
+    {
+        iter.frozen_iter_ = frozen_->moveToLast();
+        iter.in_tail_ = false;
+    }
+    return iter;
+}
+
+inline bool GrowingSuRF::lookupRange(
+    const KeyView & left_key, const bool left_inclusive, const KeyView & right_key, const bool right_inclusive)
+{
+    return lookupRange(left_key, left_inclusive, right_key, right_inclusive, context_);
+}
+
+inline bool GrowingSuRF::lookupRange(
+    const KeyView & left_key,
+    const bool left_inclusive,
+    const KeyView & right_key,
+    const bool right_inclusive,
+    QueryContext & context) const
+{
+    SuRF::QueryContext & frozen_context = bind(context);
+    if (frozen_ != nullptr && !isPastFrozen(left_key)
+        && frozen_->lookupRange(left_key, left_inclusive, right_key, right_inclusive, frozen_context))
+        return true;
+    size_t pos = tailLowerBound(left_key, left_inclusive);
+    if (pos >= tail_.size())
+        return false;
+    int compare = compareKeys(tail_[pos], right_key);
+    return right_inclusive ? (compare <= 0) : (compare < 0);
+}
+
+inline uint64_t GrowingSuRF::approxCount(const KeyView & left_key, const KeyView & right_key)
+{
+    return approxCount(left_key, right_key, context_);
+}
+
+inline uint64_t GrowingSuRF::approxCount(const KeyView & left_key, const KeyView & right_key, QueryContext & context) const
+{
+    SuRF::QueryContext & frozen_context = bind(context);
+    uint64_t count = 0;
+    if (frozen_ != nullptr && !isPastFrozen(left_key))
+        count = frozen_->approxCount(left_key, right_key, frozen_context);
+    size_t left_pos = tailLowerBound(left_key, true);
+    size_t right_pos = tailLowerBound(right_key, true);
+    if (right_pos > left_pos)
+        count += right_pos - left_pos;
+    return count;
+}
+
+inline uint64_t GrowingSuRF::getMemoryUsage() const
+{
+    uint64_t size = sizeof(GrowingSuRF) + builder_.getMemoryStats().transientBytes();
+    if (frozen_ != nullptr)
+        size += frozen_->getMemoryUsage();
+    size += tail_.capacity() * sizeof(std::string);
+    for (size_t i = 0; i < tail_.size(); i++)
+        size += tail_[i].capacity();
+    return size;
+}
+
+//============================================================================
+
+inline void GrowingSuRF::Iter::setToTail(const size_t tail_pos)
+{
+    in_tail_ = true;
+    tail_pos_ = tail_pos;
+}
+
+inline bool GrowingSuRF::Iter::isValid() const
+{
+    if (filter_ == nullptr)
+        return false;
+    if (in_tail_)
+        return tail_pos_ < filter_->tail_.size();
+    return frozen_iter_.isValid();
+}
+
+inline bool GrowingSuRF::Iter::getFpFlag() const
+{
+    return !in_tail_ && frozen_iter_.getFpFlag();
+}
+
+inline int GrowingSuRF::Iter::compare(const KeyView & key) const
+{
+    assert(isValid());
+    if (in_tail_)
+        return compareKeys(filter_->tail_[tail_pos_], key);
+    return frozen_iter_.compare(key);
+}
+
+inline std::string GrowingSuRF::Iter::getKey() const
+{
+    if (!isValid())
+        return std::string();
+    if (in_tail_)
+        return filter_->tail_[tail_pos_];
+    return frozen_iter_.getKey();
+}
+
+inline bool GrowingSuRF::Iter::operator++(int)
+{
+    if (!isValid())
+        return false;
+    if (in_tail_)
+    {
+        tail_pos_++;
+        return isValid();
+    }
+    if (frozen_iter_++)
+        return true;
+    setToTail(0);
+    return isValid();
+}
+
+inline bool GrowingSuRF::Iter::operator--(int)
+{
+    if (!isValid())
+        return false;
+    if (!in_tail_)
+        return frozen_iter_--;
+    if (tail_pos_ > 0)
+    {
+        tail_pos_--;
+        return true;
+    }
+    if (filter_->frozen_ == nullptr)
+    {
+        setToTail(filter_->tail_.size()); // invalid
+        return false;
+    }
+    frozen_iter_ = filter_->frozen_->moveToLast();
+    in_tail_ = false;
+    return frozen_iter_.isValid();
+}
+
+} // namespace surf
+
+#endif // GROWINGSURF_H_
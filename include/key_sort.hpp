@@ -0,0 +1,256 @@
+#ifndef KEYSORT_H_
+#define KEYSORT_H_
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+
+namespace surf
+{
+
+// Sort-and-dedup front-end for unsorted key input (see
+// SuRFBuilder::buildUnsorted).
+//
+// Keys are sorted by MSD radix sort, one byte per pass. Radix digit 0
+// holds the keys that end before the current byte, so that they sort
+// before their extensions; digit 1 + b holds the keys whose byte is b.
+// Ranges of at most kRadixSortCutoff keys fall back to std::sort, and a
+// byte all keys of a range share costs one counting pass and no moves.
+//
+// With several threads, the first byte at which the keys differ is
+// counted and scattered in parallel (each thread takes a slice of the
+// keys), and the resulting buckets are then sorted and deduplicated
+// independently, largest first, by whichever thread is free.
+
+static const unsigned kRadixDigits = kFanout + 1;
+
+// Radix digits of an unsigned integer key: its bytes, most significant
+// first (the order of its big-endian encoding, see SuRFInt)
+template <typename KeyT>
+struct RadixKey
+{
+    static const level_t kMaxDepth = sizeof(KeyT);
+
+    static inline unsigned digit(const KeyT key, const level_t depth)
+    {
+        return static_cast<unsigned>((key >> (8 * (sizeof(KeyT) - 1 - depth))) & 0xFF) + 1;
+    }
+};
+
+template <>
+struct RadixKey<std::string>
+{
+    static const level_t kMaxDepth = 0xFFFFFFFF;
+
+    static inline unsigned digit(const std::string & key, const level_t depth)
+    {
+        return (depth < key.length()) ? (static_cast<label_t>(key[depth]) + 1) : 0;
+    }
+};
+
+// Sorts keys[begin, end), which share their first depth bytes, in place
+// (American flag sort)
+template <typename KeyT>
+inline void radixSort(std::vector<KeyT> & keys, const size_t begin, const size_t end, level_t depth)
+{
+    while (depth < RadixKey<KeyT>::kMaxDepth)
+    {
+        if (end - begin <= kRadixSortCutoff)
+        {
+            std::sort(keys.begin() + begin, keys.begin() + end);
+            return;
+        }
+
+        size_t counts[kRadixDigits] = {0};
+        for (size_t i = begin; i < end; i++)
+            counts[RadixKey<KeyT>::digit(keys[i], depth)]++;
+
+        unsigned first_digit = RadixKey<KeyT>::digit(keys[begin], depth);
+        if (counts[first_digit] == end - begin)
+        {
+            // a shared byte: nothing to move
+            if (first_digit == 0)
+                return; // all keys end here, so they are equal
+            depth++;
+            continue;
+        }
+
+        size_t bucket_end[kRadixDigits];
+        size_t next[kRadixDigits];
+        size_t pos = begin;
+        for (unsigned d = 0; d < kRadixDigits; d++)
+        {
+            next[d] = pos;
+            pos += counts[d];
+            bucket_end[d] = pos;
+        }
+        for (unsigned d = 0; d < kRadixDigits; d++)
+        {
+            while (next[d] < bucket_end[d])
+            {
+                unsigned key_digit = RadixKey<KeyT>::digit(keys[next[d]], depth);
+                if (key_digit == d)
+                    next[d]++;
+                else
+                    std::swap(keys[next[d]], keys[next[key_digit]++]);
+            }
+        }
+
+        // digit 0: keys that end at depth, all equal
+        for (unsigned d = 1; d < kRadixDigits; d++)
+        {
+            if (counts[d] > 1)
+                radixSort(keys, bucket_end[d] - counts[d], bucket_end[d], depth + 1);
+        }
+        return;
+    }
+}
+
+// Sorts keys (bytewise, as unsigned bytes) and removes duplicates using
+// up to num_threads threads
+template <typename KeyT>
+inline void sortUniqueKeys(std::vector<KeyT> & keys, const unsigned num_threads)
+{
+    size_t num_keys = keys.size();
+    unsigned num_workers = num_threads;
+    if (num_keys / kParallelSortMinKeys < num_workers)
+        num_workers = static_cast<unsigned>(num_keys / kParallelSortMinKeys);
+    if (num_workers <= 1)
+    {
+        radixSort(keys, 0, num_keys, 0);
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        return;
+    }
+
+    std::vector<size_t> slice_bounds;
+    for (unsigned t = 0; t <= num_workers; t++)
+        slice_bounds.push_back(num_keys * t / num_workers);
+    std::vector<std::thread> threads;
+
+    // first byte at which the keys differ: the smallest common prefix
+    // length of keys[0] and any other key
+    std::vector<level_t> slice_depth(num_workers, 0);
+    for (unsigned t = 0; t < num_workers; t++)
+    {
+        threads.push_back(std::thread([&keys, &slice_bounds, &slice_depth, t]() {
+            level_t depth = RadixKey<KeyT>::kMaxDepth;
+            for (size_t i = slice_bounds[t]; i < slice_bounds[t + 1]; i++)
+            {
+                level_t len = 0;
+                while (len < depth && RadixKey<KeyT>::digit(keys[i], len) == RadixKey<KeyT>::digit(keys[0], len)
+                       && RadixKey<KeyT>::digit(keys[0], len) != 0)
+                    len++;
+                depth = len;
+            }
+            slice_depth[t] = depth;
+        }));
+    }
+    for (unsigned t = 0; t < num_workers; t++)
+        threads[t].join();
+    threads.clear();
+    level_t depth = *std::min_element(slice_depth.begin(), slice_depth.end());
+    if (depth >= RadixKey<KeyT>::kMaxDepth)
+    {
+        // every key equals keys[0]
+        keys.resize(1);
+        return;
+    }
+
+    // count the digits at depth per slice, then scatter each slice to
+    // its share of every bucket
+    std::vector<size_t> counts(num_workers * kRadixDigits, 0);
+    for (unsigned t = 0; t < num_workers; t++)
+    {
+        threads.push_back(std::thread([&keys, &slice_bounds, &counts, depth, t]() {
+            size_t * slice_counts = &counts[t * kRadixDigits];
+            for (size_t i = slice_bounds[t]; i < slice_bounds[t + 1]; i++)
+                slice_counts[RadixKey<KeyT>::digit(keys[i], depth)]++;
+        }));
+    }
+    for (unsigned t = 0; t < num_workers; t++)
+        threads[t].join();
+    threads.clear();
+
+    std::vector<size_t> offsets(num_workers * kRadixDigits);
+    std::vector<size_t> bucket_begin(kRadixDigits + 1);
+    size_t pos = 0;
+    for (unsigned d = 0; d < kRadixDigits; d++)
+    {
+        bucket_begin[d] = pos;
+        for (unsigned t = 0; t < num_workers; t++)
+        {
+            offsets[t * kRadixDigits + d] = pos;
+            pos += counts[t * kRadixDigits + d];
+        }
+    }
+    bucket_begin[kRadixDigits] = pos;
+
+    std::vector<KeyT> scattered(num_keys);
+    for (unsigned t = 0; t < num_workers; t++)
+    {
+        threads.push_back(std::thread([&keys, &scattered, &slice_bounds, &offsets, depth, t]() {
+            size_t * slice_offsets = &offsets[t * kRadixDigits];
+            for (size_t i = slice_bounds[t]; i < slice_bounds[t + 1]; i++)
+                scattered[slice_offsets[RadixKey<KeyT>::digit(keys[i], depth)]++] = std::move(keys[i]);
+        }));
+    }
+    for (unsigned t = 0; t < num_workers; t++)
+        threads[t].join();
+    threads.clear();
+    keys.swap(scattered);
+    std::vector<KeyT>().swap(scattered);
+
+    // sort and dedup the buckets, largest first
+    std::vector<unsigned> buckets;
+    for (unsigned d = 0; d < kRadixDigits; d++)
+    {
+        if (bucket_begin[d + 1] > bucket_begin[d])
+            buckets.push_back(d);
+    }
+    std::sort(buckets.begin(), buckets.end(), [&bucket_begin](const unsigned a, const unsigned b) {
+        return (bucket_begin[a + 1] - bucket_begin[a]) > (bucket_begin[b + 1] - bucket_begin[b]);
+    });
+    std::vector<size_t> unique_end(kRadixDigits);
+    std::atomic<size_t> next_bucket(0);
+    for (unsigned t = 0; t < num_workers; t++)
+    {
+        threads.push_back(std::thread([&keys, &buckets, &bucket_begin, &unique_end, &next_bucket, depth]() {
+            size_t i;
+            while ((i = next_bucket.fetch_add(1)) < buckets.size())
+            {
+                unsigned d = buckets[i];
+                typename std::vector<KeyT>::iterator begin = keys.begin() + bucket_begin[d];
+                typename std::vector<KeyT>::iterator end = keys.begin() + bucket_begin[d + 1];
+                if (d == 0)
+                {
+                    unique_end[d] = bucket_begin[d] + 1; // keys that end at depth are equal
+                    continue;
+                }
+                radixSort(keys, bucket_begin[d], bucket_begin[d + 1], depth + 1);
+                unique_end[d] = static_cast<size_t>(std::unique(begin, end) - keys.begin());
+            }
+        }));
+    }
+    for (unsigned t = 0; t < num_workers; t++)
+        threads[t].join();
+
+    // close the gaps left by the duplicates
+    size_t num_unique = 0;
+    for (unsigned d = 0; d < kRadixDigits; d++)
+    {
+        if (bucket_begin[d + 1] == bucket_begin[d])
+            continue;
+        if (num_unique != bucket_begin[d])
+            std::move(keys.begin() + bucket_begin[d], keys.begin() + unique_end[d], keys.begin() + num_unique);
+        num_unique += unique_end[d] - bucket_begin[d];
+    }
+    keys.resize(num_unique);
+}
+
+} // namespace surf
+
+#endif // KEYSORT_H_
@@ -0,0 +1,287 @@
+#ifndef LABELSEARCH_H_
+#define LABELSEARCH_H_
+
+#include "config.hpp"
+#include "cpu_features.hpp"
+
+#ifdef SURF_X86
+#include <immintrin.h>
+#endif
+
+namespace surf
+{
+
+// Bytes of zeroed slack kept after the last label of a LabelVector.
+// The vector kernels below always load full registers; the padding
+// makes a load that starts inside a node but runs past its end safe.
+static const position_t kLabelSearchPadding = 64;
+
+// Searches the node labels[0, len) (sorted, leading terminator already
+// skipped) and, on success, stores the offset of the match in idx.
+// On failure idx is left untouched.
+// Equality kernels find target; greater-than kernels find the first label > target.
+typedef bool (*LabelSearchKernel)(const label_t * labels, const label_t target, const position_t len, position_t & idx);
+
+enum LabelSearchIsa
+{
+    kLabelSearchScalar = 0,
+    kLabelSearchSse2 = 1,
+    kLabelSearchAvx2 = 2,
+    kLabelSearchAvx512bw = 3
+};
+
+struct LabelSearchKernels
+{
+    LabelSearchIsa isa;
+    LabelSearchKernel search;
+    LabelSearchKernel search_greater_than;
+};
+
+//------------------------------------------------------------------
+// Scalar fallback (binary search)
+//------------------------------------------------------------------
+inline bool labelSearchScalar(const label_t * labels, const label_t target, const position_t len, position_t & idx)
+{
+    position_t l = 0;
+    position_t r = len;
+    while (l < r)
+    {
+        position_t m = (l + r) >> 1;
+        if (target < labels[m])
+            r = m;
+        else if (target == labels[m])
+        {
+            idx = m;
+            return true;
+        }
+        else
+            l = m + 1;
+    }
+    return false;
+}
+
+inline bool labelSearchGreaterThanScalar(const label_t * labels, const label_t target, const position_t len, position_t & idx)
+{
+    position_t l = 0;
+    position_t r = len;
+    while (l < r)
+    {
+        position_t m = (l + r) >> 1;
+        if (target < labels[m])
+            r = m;
+        else
+            l = m + 1;
+    }
+    if (l < len)
+    {
+        idx = l;
+        return true;
+    }
+    return false;
+}
+
+#ifdef SURF_X86
+//------------------------------------------------------------------
+// SSE2: 16 labels per compare
+//------------------------------------------------------------------
+// Keeps the low (len - i) bits of a per-chunk match mask
+inline uint64_t labelSearchTailMask(const position_t remaining, const position_t width)
+{
+    return (remaining >= width) ? kOneMask : ((1ULL << remaining) - 1);
+}
+
+__attribute__((target("sse2"))) inline bool
+labelSearchSse2(const label_t * labels, const label_t target, const position_t len, position_t & idx)
+{
+    const __m128i t = _mm_set1_epi8(static_cast<char>(target));
+    for (position_t i = 0; i < len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(labels + i));
+        uint64_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, t)));
+        mask &= labelSearchTailMask(len - i, 16);
+        if (mask)
+        {
+            idx = i + __builtin_ctzll(mask);
+            return true;
+        }
+    }
+    return false;
+}
+
+// SSE2 has no unsigned byte compare; v > target iff max(v, target + 1) == v
+__attribute__((target("sse2"))) inline bool
+labelSearchGreaterThanSse2(const label_t * labels, const label_t target, const position_t len, position_t & idx)
+{
+    if (target == kTerminator)
+        return false;
+    const __m128i t = _mm_set1_epi8(static_cast<char>(target + 1));
+    for (position_t i = 0; i < len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(labels + i));
+        uint64_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, t), v)));
+        mask &= labelSearchTailMask(len - i, 16);
+        if (mask)
+        {
+            idx = i + __builtin_ctzll(mask);
+            return true;
+        }
+    }
+    return false;
+}
+
+//------------------------------------------------------------------
+// AVX2: 32 labels per compare
+//------------------------------------------------------------------
+__attribute__((target("avx2"))) inline bool
+labelSearchAvx2(const label_t * labels, const label_t target, const position_t len, position_t & idx)
+{
+    const __m256i t = _mm256_set1_epi8(static_cast<char>(target));
+    for (position_t i = 0; i < len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(labels + i));
+        uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, t)));
+        mask &= labelSearchTailMask(len - i, 32);
+        if (mask)
+        {
+            idx = i + __builtin_ctzll(mask);
+            return true;
+        }
+    }
+    return false;
+}
+
+__attribute__((target("avx2"))) inline bool
+labelSearchGreaterThanAvx2(const label_t * labels, const label_t target, const position_t len, position_t & idx)
+{
+    if (target == kTerminator)
+        return false;
+    const __m256i t = _mm256_set1_epi8(static_cast<char>(target + 1));
+    for (position_t i = 0; i < len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(labels + i));
+        uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(v, t), v)));
+        mask &= labelSearchTailMask(len - i, 32);
+        if (mask)
+        {
+            idx = i + __builtin_ctzll(mask);
+            return true;
+        }
+    }
+    return false;
+}
+
+//------------------------------------------------------------------
+// AVX-512BW: 64 labels per compare, native unsigned compare masks
+//------------------------------------------------------------------
+__attribute__((target("avx512bw"))) inline bool
+labelSearchAvx512bw(const label_t * labels, const label_t target, const position_t len, position_t & idx)
+{
+    const __m512i t = _mm512_set1_epi8(static_cast<char>(target));
+    for (position_t i = 0; i < len; i += 64)
+    {
+        __m512i v = _mm512_loadu_si512(reinterpret_cast<const void *>(labels + i));
+        uint64_t mask = _mm512_cmpeq_epi8_mask(v, t);
+        mask &= labelSearchTailMask(len - i, 64);
+        if (mask)
+        {
+            idx = i + __builtin_ctzll(mask);
+            return true;
+        }
+    }
+    return false;
+}
+
+__attribute__((target("avx512bw"))) inline bool
+labelSearchGreaterThanAvx512bw(const label_t * labels, const label_t target, const position_t len, position_t & idx)
+{
+    const __m512i t = _mm512_set1_epi8(static_cast<char>(target));
+    for (position_t i = 0; i < len; i += 64)
+    {
+        __m512i v = _mm512_loadu_si512(reinterpret_cast<const void *>(labels + i));
+        uint64_t mask = _mm512_cmpgt_epu8_mask(v, t);
+        mask &= labelSearchTailMask(len - i, 64);
+        if (mask)
+        {
+            idx = i + __builtin_ctzll(mask);
+            return true;
+        }
+    }
+    return false;
+}
+#endif // SURF_X86
+
+//------------------------------------------------------------------
+// Dispatch
+//------------------------------------------------------------------
+inline bool labelSearchIsaSupported(const LabelSearchIsa isa)
+{
+    const CpuFeatures & features = getCpuFeatures();
+    switch (isa)
+    {
+        case kLabelSearchScalar:
+            return true;
+        case kLabelSearchSse2:
+            return features.sse2;
+        case kLabelSearchAvx2:
+            return features.avx2;
+        case kLabelSearchAvx512bw:
+            return features.avx512bw;
+    }
+    return false;
+}
+
+// Returns the kernels for isa; the caller must check labelSearchIsaSupported first
+inline LabelSearchKernels labelSearchKernels(const LabelSearchIsa isa)
+{
+    LabelSearchKernels kernels;
+    kernels.isa = kLabelSearchScalar;
+    kernels.search = labelSearchScalar;
+    kernels.search_greater_than = labelSearchGreaterThanScalar;
+#ifdef SURF_X86
+    switch (isa)
+    {
+        case kLabelSearchScalar:
+            break;
+        case kLabelSearchSse2:
+            kernels.isa = isa;
+            kernels.search = labelSearchSse2;
+            kernels.search_greater_than = labelSearchGreaterThanSse2;
+            break;
+        case kLabelSearchAvx2:
+            kernels.isa = isa;
+            kernels.search = labelSearchAvx2;
+            kernels.search_greater_than = labelSearchGreaterThanAvx2;
+            break;
+        case kLabelSearchAvx512bw:
+            kernels.isa = isa;
+            kernels.search = labelSearchAvx512bw;
+            kernels.search_greater_than = labelSearchGreaterThanAvx512bw;
+            break;
+    }
+#else
+    (void)isa;
+#endif
+    return kernels;
+}
+
+inline LabelSearchKernels selectLabelSearchKernels()
+{
+    if (labelSearchIsaSupported(kLabelSearchAvx512bw))
+        return labelSearchKernels(kLabelSearchAvx512bw);
+    if (labelSearchIsaSupported(kLabelSearchAvx2))
+        return labelSearchKernels(kLabelSearchAvx2);
+    if (labelSearchIsaSupported(kLabelSearchSse2))
+        return labelSearchKernels(kLabelSearchSse2);
+    return labelSearchKernels(kLabelSearchScalar);
+}
+
+// Widest kernels supported by this cpu; chosen once on first use
+inline const LabelSearchKernels & getLabelSearchKernels()
+{
+    static const LabelSearchKernels kernels = selectLabelSearchKernels();
+    return kernels;
+}
+
+} // namespace surf
+
+#endif // LABELSEARCH_H_
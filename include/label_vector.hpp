@@ -1,9 +1,13 @@
 #ifndef LABELVECTOR_H_
 #define LABELVECTOR_H_
 
+#include <cassert>
+
 #include <vector>
 
 #include "config.hpp"
+#include "label_search.hpp"
+#include "page_cache.hpp"
 
 namespace surf
 {
@@ -14,6 +18,8 @@ public:
     LabelVector()
         : num_bytes_(0)
         , labels_(nullptr)
+        , is_borrowed_(false)
+        , page_cache_(nullptr)
     {
     }
 
@@ -21,6 +27,8 @@ public:
         const std::vector<std::vector<label_t>> & labels_per_level,
         const level_t start_level = 0,
         level_t end_level = 0 /* non-inclusive */)
+        : is_borrowed_(false)
+        , page_cache_(nullptr)
     {
         if (end_level == 0)
             end_level = static_cast<level_t>(labels_per_level.size());
@@ -29,11 +37,8 @@ public:
         for (level_t level = start_level; level < end_level; level++)
             num_bytes_ += labels_per_level[level].size();
 
-        //labels_ = new label_t[num_bytes_];
-        position_t alloc_bytes = num_bytes_ * (num_bytes_ / kWordSize + 1);
-        labels_ = new label_t[alloc_bytes];
-        for (position_t i = 0; i < alloc_bytes; i++)
-            labels_[i] = 0;
+        labels_ = new label_t[allocSize()];
+        memset(labels_, 0, allocSize());
 
         position_t pos = 0;
         for (level_t level = start_level; level < end_level; level++)
@@ -46,6 +51,16 @@ public:
         }
     }
 
+    // num_labels zero labels, to be filled in with write
+    explicit LabelVector(const position_t num_labels)
+        : is_borrowed_(false)
+        , page_cache_(nullptr)
+    {
+        num_bytes_ = num_labels + 1;
+        labels_ = new label_t[allocSize()];
+        memset(labels_, 0, allocSize());
+    }
+
     ~LabelVector() { }
 
     inline position_t getNumBytes() const { return num_bytes_; }
@@ -57,13 +72,42 @@ public:
         return size;
     }
 
-    inline position_t size() const { return (sizeof(LabelVector) + num_bytes_); }
+    inline position_t size() const { return (sizeof(LabelVector) + allocSize()); }
 
-    inline label_t read(const position_t pos) const { return labels_[pos]; }
+    // size() of a LabelVector holding num_labels labels
+    static position_t sizeFor(const position_t num_labels) { return (sizeof(LabelVector) + num_labels + 1 + kLabelSearchPadding); }
 
-    inline label_t operator[](const position_t pos) const { return labels_[pos]; }
+    // The reads take kPaged = true only in a paged filter (see
+    // setPageCache): only then do they touch the page cache
+    template <bool kPaged = false>
+    inline label_t read(const position_t pos) const
+    {
+        touch<kPaged>(pos, 1);
+        return labels_[pos];
+    }
 
+    inline label_t operator[](const position_t pos) const { return read(pos); }
+
+    // Pins the first num_resident_labels labels in page_cache, whose
+    // region labels_ points into; the other labels are paged in by the
+    // paged reads that need them
+    inline void setPageCache(PageCache * page_cache, const position_t num_resident_labels)
+    {
+        page_cache->pin(labels_, num_resident_labels);
+        page_cache_ = page_cache;
+    }
+
+    inline void write(const position_t pos, const label_t label)
+    {
+        assert(pos < num_bytes_);
+        labels_[pos] = label;
+    }
+
+    inline void prefetch(const position_t pos) const { __builtin_prefetch(labels_ + pos); }
+
+    template <bool kPaged = false>
     inline bool search(const label_t target, position_t & pos, const position_t search_len) const;
+    template <bool kPaged = false>
     inline bool searchGreaterThan(const label_t target, position_t & pos, const position_t search_len) const;
 
     inline bool binarySearch(const label_t target, position_t & pos, const position_t search_len) const;
@@ -71,6 +115,7 @@ public:
     inline bool linearSearch(const label_t target, position_t & pos, const position_t search_len) const;
 
     inline bool binarySearchGreaterThan(const label_t target, position_t & pos, const position_t search_len) const;
+    inline bool simdSearchGreaterThan(const label_t target, position_t & pos, const position_t search_len) const;
     inline bool linearSearchGreaterThan(const label_t target, position_t & pos, const position_t search_len) const;
 
     inline void serialize(char *& dst) const
@@ -82,31 +127,76 @@ public:
         align(dst);
     }
 
-    static LabelVector * deSerialize(char *& src)
+    // zero_copy: point into src instead of copying (see SuRF::deSerialize).
+    // The search padding is then the bytes that follow in src: the
+    // serialized louds-sparse sections after the labels are longer than
+    // kLabelSearchPadding.
+    static LabelVector * deSerialize(char *& src, const bool zero_copy = false)
     {
         LabelVector * lv = new LabelVector();
         memcpy(&(lv->num_bytes_), src, sizeof(lv->num_bytes_));
         src += sizeof(lv->num_bytes_);
 
-        lv->labels_ = new label_t[lv->num_bytes_];
-        memcpy(lv->labels_, src, lv->num_bytes_);
+        if (zero_copy)
+        {
+            lv->is_borrowed_ = true;
+            lv->labels_ = reinterpret_cast<label_t *>(src);
+        }
+        else
+        {
+            lv->labels_ = new label_t[lv->allocSize()];
+            memcpy(lv->labels_, src, lv->num_bytes_);
+            memset(lv->labels_ + lv->num_bytes_, 0, kLabelSearchPadding);
+        }
         src += lv->num_bytes_;
-
-        //lv->labels_ = const_cast<label_t*>(reinterpret_cast<const label_t*>(src));
-        //src += lv->num_bytes_;
         align(src);
         return lv;
     }
 
-    inline void destroy() { delete[] labels_; }
+    // Bytes the serialize() image at src takes, from its header, or 0 if
+    // the image does not fit in size bytes. Nothing past src + size is
+    // read.
+    static uint64_t imageSize(const char * src, const uint64_t size)
+    {
+        position_t num_bytes = 0;
+        if (size < sizeof(num_bytes))
+            return 0;
+        memcpy(&num_bytes, src, sizeof(num_bytes));
+        uint64_t image_size = sizeof(num_bytes) + static_cast<uint64_t>(num_bytes);
+        sizeAlign(image_size);
+        return (image_size <= size) ? image_size : 0;
+    }
+
+    inline void destroy()
+    {
+        if (!is_borrowed_)
+            delete[] labels_;
+    }
 
 private:
+    // labels are followed by kLabelSearchPadding zero bytes so that the
+    // vector search kernels may load past the end of the last node
+    inline position_t allocSize() const { return num_bytes_ + kLabelSearchPadding; }
+
+    // Makes labels_[pos, pos + len) readable in a paged read
+    template <bool kPaged>
+    inline void touch(const position_t pos, const position_t len) const
+    {
+        if (kPaged && page_cache_ != nullptr)
+            page_cache_->touch(labels_ + pos, len);
+    }
+
     position_t num_bytes_;
     label_t * labels_;
+    bool is_borrowed_; // labels_ points into a caller-owned buffer
+    PageCache * page_cache_; // see setPageCache
 };
 
+template <bool kPaged>
 inline bool LabelVector::search(const label_t target, position_t & pos, position_t search_len) const
 {
+    // the vector kernels may read the padding after the node
+    touch<kPaged>(pos, search_len + kLabelSearchPadding);
     //skip terminator label
     if ((search_len > 1) && (labels_[pos] == kTerminator))
     {
@@ -116,14 +206,15 @@ inline bool LabelVector::search(const label_t target, position_t & pos, position
 
     if (search_len < 3)
         return linearSearch(target, pos, search_len);
-    if (search_len < 12)
-        return binarySearch(target, pos, search_len);
     else
         return simdSearch(target, pos, search_len);
 }
 
+template <bool kPaged>
 inline bool LabelVector::searchGreaterThan(const label_t target, position_t & pos, position_t search_len) const
 {
+    // the vector kernels may read the padding after the node
+    touch<kPaged>(pos, search_len + kLabelSearchPadding);
     //skip terminator label
     if ((search_len > 1) && (labels_[pos] == kTerminator))
     {
@@ -134,7 +225,7 @@ inline bool LabelVector::searchGreaterThan(const label_t target, position_t & po
     if (search_len < 3)
         return linearSearchGreaterThan(target, pos, search_len);
     else
-        return binarySearchGreaterThan(target, pos, search_len);
+        return simdSearchGreaterThan(target, pos, search_len);
 }
 
 inline bool LabelVector::binarySearch(const label_t target, position_t & pos, const position_t search_len) const
@@ -161,55 +252,15 @@ inline bool LabelVector::binarySearch(const label_t target, position_t & pos, co
     return false;
 }
 
+// Uses the widest compare-and-movemask kernel the cpu supports
+// (binary search if there is none); see label_search.hpp
 inline bool LabelVector::simdSearch(const label_t target, position_t & pos, const position_t search_len) const
 {
-    // Architecture-agnostic implementation that processes data in chunks
-    // This mimics SIMD behavior by processing multiple bytes at once
-
-    position_t num_labels_searched = 0;
-    position_t num_labels_left = search_len;
-
-    if (num_labels_left == 0)
-    {
-        return false; // No labels to search
-    }
-
-
-    // Process in chunks of 16 bytes (similar to SIMD 128-bit registers)
-    while (num_labels_left >= 16)
-    {
-        label_t * start_ptr = labels_ + pos + num_labels_searched;
-
-        // Check 16 bytes at once using unrolled loop for better performance
-        for (int i = 0; i < 16; i++)
-        {
-            if (start_ptr[i] == target)
-            {
-                pos += (num_labels_searched + i);
-                return true;
-            }
-        }
-
-        num_labels_searched += 16;
-        num_labels_left -= 16;
-    }
-
-    // Handle remaining bytes (less than 16)
-    if (num_labels_left > 0)
-    {
-        label_t * start_ptr = labels_ + pos + num_labels_searched;
-
-        for (position_t i = 0; i < num_labels_left; i++)
-        {
-            if (start_ptr[i] == target)
-            {
-                pos += (num_labels_searched + i);
-                return true;
-            }
-        }
-    }
-
-    return false;
+    position_t idx;
+    if (!getLabelSearchKernels().search(labels_ + pos, target, search_len, idx))
+        return false;
+    pos += idx;
+    return true;
 }
 
 inline bool LabelVector::linearSearch(const label_t target, position_t & pos, const position_t search_len) const
@@ -259,6 +310,15 @@ inline bool LabelVector::binarySearchGreaterThan(const label_t target, position_
     return false;
 }
 
+inline bool LabelVector::simdSearchGreaterThan(const label_t target, position_t & pos, const position_t search_len) const
+{
+    position_t idx;
+    if (!getLabelSearchKernels().search_greater_than(labels_ + pos, target, search_len, idx))
+        return false;
+    pos += idx;
+    return true;
+}
+
 inline bool LabelVector::linearSearchGreaterThan(const label_t target, position_t & pos, const position_t search_len) const
 {
     for (position_t i = 0; i < search_len; i++)
@@ -0,0 +1,137 @@
+#ifndef LEVELBUFFER_H_
+#define LEVELBUFFER_H_
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "config.hpp"
+
+namespace surf
+{
+
+// Per-level storage for the trie iterators (one entry per trie level).
+// The first kInlineLevels entries live inside the object, so building,
+// copying and resetting an iterator over a trie of at most that height
+// never touches the heap. Taller tries fall back to a heap array; an
+// iterator that is reset and reused keeps it.
+// T must be trivially copyable.
+template <typename T, level_t kInlineLevels>
+class LevelBuffer
+{
+public:
+    LevelBuffer()
+        : size_(0)
+        , capacity_(kInlineLevels)
+        , data_(inline_data_)
+    {
+    }
+
+    explicit LevelBuffer(const level_t size)
+        : size_(0)
+        , capacity_(kInlineLevels)
+        , data_(inline_data_)
+    {
+        resize(size);
+    }
+
+    LevelBuffer(const LevelBuffer & other)
+        : size_(0)
+        , capacity_(kInlineLevels)
+        , data_(inline_data_)
+    {
+        assign(other);
+    }
+
+    LevelBuffer & operator=(const LevelBuffer & other)
+    {
+        if (this != &other)
+            assign(other);
+        return *this;
+    }
+
+    LevelBuffer(LevelBuffer && other)
+        : size_(0)
+        , capacity_(kInlineLevels)
+        , data_(inline_data_)
+    {
+        take(other);
+    }
+
+    LevelBuffer & operator=(LevelBuffer && other)
+    {
+        if (this != &other)
+            take(other);
+        return *this;
+    }
+
+    ~LevelBuffer() { release(); }
+
+    // New entries are zeroed; existing ones are kept
+    inline void resize(const level_t size)
+    {
+        if (size > capacity_)
+        {
+            T * data = new T[size];
+            memcpy(data, data_, size_ * sizeof(T));
+            release();
+            data_ = data;
+            capacity_ = size;
+        }
+        if (size > size_)
+            memset(data_ + size_, 0, (size - size_) * sizeof(T));
+        size_ = size;
+    }
+
+    inline void fill(const T & value) { std::fill(data_, data_ + size_, value); }
+
+    inline level_t size() const { return size_; }
+    inline bool isInline() const { return data_ == inline_data_; }
+
+    inline T * data() { return data_; }
+    inline const T * data() const { return data_; }
+
+    inline T & operator[](const level_t level) { return data_[level]; }
+    inline const T & operator[](const level_t level) const { return data_[level]; }
+
+private:
+    inline void release()
+    {
+        if (data_ != inline_data_)
+            delete[] data_;
+        data_ = inline_data_;
+        capacity_ = kInlineLevels;
+    }
+
+    inline void assign(const LevelBuffer & other)
+    {
+        size_ = 0;
+        resize(other.size_);
+        memcpy(data_, other.data_, size_ * sizeof(T));
+    }
+
+    inline void take(LevelBuffer & other)
+    {
+        if (other.isInline())
+        {
+            assign(other);
+            return;
+        }
+        release();
+        size_ = other.size_;
+        capacity_ = other.capacity_;
+        data_ = other.data_;
+        other.size_ = 0;
+        other.capacity_ = kInlineLevels;
+        other.data_ = other.inline_data_;
+    }
+
+    level_t size_;
+    level_t capacity_;
+    T * data_; // inline_data_ or a heap array of capacity_ entries
+    T inline_data_[kInlineLevels];
+};
+
+} // namespace surf
+
+#endif // LEVELBUFFER_H_
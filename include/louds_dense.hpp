@@ -1,9 +1,13 @@
 #ifndef LOUDSDENSE_H_
 #define LOUDSDENSE_H_
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
+#include "compact_codec.hpp"
 #include "config.hpp"
+#include "level_buffer.hpp"
 #include "rank.hpp"
 #include "suffix.hpp"
 #include "surf_builder.hpp"
@@ -11,6 +15,8 @@
 namespace surf
 {
 
+class SuRFDirectBuilder;
+
 class LoudsDense
 {
 public:
@@ -19,6 +25,13 @@ public:
     public:
         Iter()
             : is_valid_(false)
+            , is_search_complete_(false)
+            , is_move_left_complete_(false)
+            , is_move_right_complete_(false)
+            , trie_(nullptr)
+            , send_out_node_num_(0)
+            , key_len_(0)
+            , is_at_prefix_key_(false)
         {
         }
         Iter(LoudsDense * trie)
@@ -29,27 +42,33 @@ public:
             , trie_(trie)
             , send_out_node_num_(0)
             , key_len_(0)
+            , key_(trie->getHeight())
+            , pos_in_trie_(trie->getHeight())
             , is_at_prefix_key_(false)
         {
-            for (level_t level = 0; level < trie_->getHeight(); level++)
-            {
-                key_.push_back(0);
-                pos_in_trie_.push_back(0);
-            }
         }
 
         inline void clear();
+        // Returns the iterator to its freshly constructed state without
+        // releasing its level buffers
+        inline void reset();
         inline bool isValid() const { return is_valid_; }
         inline bool isSearchComplete() const { return is_search_complete_; }
         inline bool isMoveLeftComplete() const { return is_move_left_complete_; }
         inline bool isMoveRightComplete() const { return is_move_right_complete_; }
         inline bool isComplete() const { return (is_search_complete_ && (is_move_left_complete_ && is_move_right_complete_)); }
+        inline bool isAtPrefixKey() const { return is_at_prefix_key_; }
 
-        inline int compare(const std::string & key) const;
+        inline int compare(const KeyView & key) const;
         inline std::string getKey() const;
+        // Appends the key bytes getKey() would return to key
+        inline void appendKey(std::string & key) const;
         inline int getSuffix(word_t * suffix) const;
         inline std::string getKeyWithSuffix(unsigned * bitlen) const;
         inline position_t getSendOutNodeNum() const { return send_out_node_num_; }
+        // Leaf index of the key the iter points to. REQUIRED: the iter is
+        // valid and its search is complete.
+        inline position_t getLeafIndex() const { return trie_->getSuffixPos(pos_in_trie_[key_len_ - 1], is_at_prefix_key_); }
 
         inline void setToFirstLabelInRoot();
         inline void setToLastLabelInRoot();
@@ -79,32 +98,64 @@ public:
         position_t send_out_node_num_;
         level_t key_len_; // Does NOT include suffix
 
-        std::vector<label_t> key_;
-        std::vector<position_t> pos_in_trie_;
+        LevelBuffer<label_t, kIterInlineLevels> key_;
+        LevelBuffer<position_t, kIterInlineLevels> pos_in_trie_;
         bool is_at_prefix_key_;
 
         friend class LoudsDense;
     };
 
 public:
-    LoudsDense() { }
+    LoudsDense() : level_cuts_borrowed_(false) { }
     LoudsDense(const SuRFBuilder * builder);
 
     ~LoudsDense() { }
 
     // Returns whether key exists in the trie so far
     // out_node_num == 0 means search terminates in louds-dense.
-    inline bool lookupKey(const std::string & key, position_t & out_node_num) const;
+    inline bool lookupKey(const KeyView & key, position_t & out_node_num) const;
+    // Same as above; out_leaf is set to the leaf index (= suffix position)
+    // the search ends at, or to kMaxPos if it continues in louds-sparse or
+    // reaches no leaf
+    inline bool lookupKey(const KeyView & key, position_t & out_node_num, position_t & out_leaf) const;
+    // Batched point query: advances a lookup of key by one level.
+    // Returns kLookupToSparse (with node_num set to the sparse start node)
+    // when the search continues in LoudsSparse.
+    inline LookupStatus lookupKeyStep(const KeyView & key, level_t & level, position_t & node_num) const;
+    // lookupKey for a trie built only from kKeyLen-byte keys (see SuRFInt):
+    // no key is a prefix of another, so the key-length and prefix-key
+    // checks are compiled out
+    template <level_t kKeyLen>
+    inline bool lookupFixedLengthKey(const char * key, position_t & out_node_num) const;
+    // Prefetches the cache lines read by the next lookupKeyStep call
+    inline void prefetchLookupStep(const KeyView & key, const level_t level, const position_t node_num) const;
     // return value indicates potential false positive
-    inline bool moveToKeyGreaterThan(const std::string & key, const bool inclusive, LoudsDense::Iter & iter) const;
+    inline bool moveToKeyGreaterThan(const KeyView & key, const bool inclusive, LoudsDense::Iter & iter) const;
     inline uint64_t approxCount(
         const LoudsDense::Iter * iter_left,
         const LoudsDense::Iter * iter_right,
         position_t & out_node_num_left,
         position_t & out_node_num_right) const;
+    // Same as above; left_pos_list and right_pos_list are caller-owned scratch space
+    inline uint64_t approxCount(
+        const LoudsDense::Iter * iter_left,
+        const LoudsDense::Iter * iter_right,
+        position_t & out_node_num_left,
+        position_t & out_node_num_right,
+        std::vector<position_t> & left_pos_list,
+        std::vector<position_t> & right_pos_list,
+        const std::vector<word_t> * tombstones = nullptr) const;
 
     inline uint64_t getHeight() const { return height_; }
+    // Number of keys that end in louds-dense; leaf indexes run from 0 to
+    // getNumLeaves() - 1 in key order
+    inline position_t getNumLeaves() const;
     inline uint64_t serializedSize() const;
+    // Sizes of the parts serialize() writes, in order: the header (height
+    // and level cuts), the label, child indicator and prefix key bitmaps
+    // (each with its rank LUT) and the suffixes. They add up to
+    // serializedSize().
+    inline void getSerializedPartSizes(std::vector<uint64_t> & sizes) const;
     inline uint64_t getMemoryUsage() const;
 
     inline void serialize(char *& dst) const
@@ -121,25 +172,70 @@ public:
         align(dst);
     }
 
-    static LoudsDense * deSerialize(char *& src)
+    // zero_copy: point into src instead of copying (see SuRF::deSerialize)
+    static LoudsDense * deSerialize(char *& src, const bool zero_copy = false)
     {
         LoudsDense * louds_dense = new LoudsDense();
         memcpy(&(louds_dense->height_), src, sizeof(louds_dense->height_));
         src += sizeof(louds_dense->height_);
-        louds_dense->level_cuts_ = new position_t[louds_dense->height_];
-        memcpy(louds_dense->level_cuts_, src, sizeof(position_t) * (louds_dense->height_));
+        if (zero_copy)
+        {
+            louds_dense->level_cuts_ = reinterpret_cast<position_t *>(src);
+            louds_dense->level_cuts_borrowed_ = true;
+        }
+        else
+        {
+            louds_dense->level_cuts_ = new position_t[louds_dense->height_];
+            memcpy(louds_dense->level_cuts_, src, sizeof(position_t) * (louds_dense->height_));
+        }
         src += (sizeof(position_t) * (louds_dense->height_));
         align(src);
-        louds_dense->label_bitmaps_ = BitvectorRank::deSerialize(src);
-        louds_dense->child_indicator_bitmaps_ = BitvectorRank::deSerialize(src);
-        louds_dense->prefixkey_indicator_bits_ = BitvectorRank::deSerialize(src);
-        louds_dense->suffixes_ = BitvectorSuffix::deSerialize(src);
+        louds_dense->label_bitmaps_ = BitvectorRank::deSerialize(src, zero_copy);
+        louds_dense->child_indicator_bitmaps_ = BitvectorRank::deSerialize(src, zero_copy);
+        louds_dense->prefixkey_indicator_bits_ = BitvectorRank::deSerialize(src, zero_copy);
+        louds_dense->suffixes_ = BitvectorSuffix::deSerialize(src, zero_copy);
         align(src);
         return louds_dense;
     }
 
+    // Bytes the serialize() image at src takes, from the headers of its
+    // parts, or 0 if a header is invalid or the image does not fit in
+    // size bytes. Nothing past src + size is read.
+    static uint64_t imageSize(const char * src, const uint64_t size)
+    {
+        level_t height = 0;
+        if (size < sizeof(height))
+            return 0;
+        memcpy(&height, src, sizeof(height));
+        uint64_t offset = sizeof(height) + static_cast<uint64_t>(height) * sizeof(position_t);
+        sizeAlign(offset);
+        typedef uint64_t (*ImageSizeFn)(const char *, const uint64_t);
+        const ImageSizeFn parts[]
+            = {BitvectorRank::imageSize, BitvectorRank::imageSize, BitvectorRank::imageSize, BitvectorSuffix::imageSize};
+        for (ImageSizeFn part : parts)
+        {
+            uint64_t part_size = (offset <= size) ? part(src + offset, size - offset) : 0;
+            if (part_size == 0)
+                return 0;
+            offset += part_size;
+        }
+        return offset;
+    }
+
+    // Compact encoding (see compact_codec.hpp): the height, the level
+    // cuts bit-packed, the node count and the suffixes, then per node
+    // its prefix key bit and its labels with their child indicator bits,
+    // range-coded. Only the set bits of the bitmaps are visited, so a
+    // node costs about as much as its louds-sparse encoding would. The
+    // rank LUTs are rebuilt on load.
+    inline void serializeCompact(CompactWriter & writer) const;
+    // Marks reader failed if the encoding is inconsistent
+    static inline LoudsDense * deSerializeCompact(CompactReader & reader);
+
     inline void destroy()
     {
+        if (!level_cuts_borrowed_)
+            delete[] level_cuts_;
         label_bitmaps_->destroy();
         child_indicator_bitmaps_->destroy();
         prefixkey_indicator_bits_->destroy();
@@ -149,17 +245,24 @@ public:
 private:
     inline position_t getChildNodeNum(const position_t pos) const;
     inline position_t getSuffixPos(const position_t pos, const bool is_prefix_key) const;
+    // Number of leaves (keys) that sort before position pos
+    inline position_t leavesBefore(const position_t pos) const;
     inline position_t getNextPos(const position_t pos) const;
     inline position_t getPrevPos(const position_t pos, bool * is_out_of_bound) const;
-    inline bool compareSuffixGreaterThan(const position_t pos, const std::string & key, const level_t level, LoudsDense::Iter & iter) const;
+    inline bool compareSuffixGreaterThan(const position_t pos, const KeyView & key, const level_t level, LoudsDense::Iter & iter) const;
     inline void extendPosList(std::vector<position_t> & pos_list, position_t & out_node_num) const;
 
 private:
+    friend class SuRFDirectBuilder;
+
     static const position_t kNodeFanout = 256;
     static const position_t kRankBasicBlockSize = 512;
+    // rank layout of the label and child indicator bitmaps, which every lookup step ranks
+    static const RankLayout kBitmapRankLayout = kRankInterleaved;
 
     level_t height_;
     position_t * level_cuts_; // position of the last bit at each level
+    bool level_cuts_borrowed_; // points into a zero-copy image; not ours to free
 
     BitvectorRank * label_bitmaps_;
     BitvectorRank * child_indicator_bitmaps_;
@@ -169,6 +272,7 @@ private:
 
 
 inline LoudsDense::LoudsDense(const SuRFBuilder * builder)
+    : level_cuts_borrowed_(false)
 {
     height_ = builder->getSparseStartLevel();
     std::vector<position_t> num_bits_per_level;
@@ -183,9 +287,10 @@ inline LoudsDense::LoudsDense(const SuRFBuilder * builder)
         level_cuts_[level] = bit_count - 1;
     }
 
-    label_bitmaps_ = new BitvectorRank(kRankBasicBlockSize, builder->getBitmapLabels(), num_bits_per_level, 0, height_);
-    child_indicator_bitmaps_
-        = new BitvectorRank(kRankBasicBlockSize, builder->getBitmapChildIndicatorBits(), num_bits_per_level, 0, height_);
+    label_bitmaps_
+        = new BitvectorRank(kRankBasicBlockSize, builder->getBitmapLabels(), num_bits_per_level, 0, height_, kBitmapRankLayout);
+    child_indicator_bitmaps_ = new BitvectorRank(
+        kRankBasicBlockSize, builder->getBitmapChildIndicatorBits(), num_bits_per_level, 0, height_, kBitmapRankLayout);
     prefixkey_indicator_bits_
         = new BitvectorRank(kRankBasicBlockSize, builder->getPrefixkeyIndicatorBits(), builder->getNodeCounts(), 0, height_);
 
@@ -206,8 +311,15 @@ inline LoudsDense::LoudsDense(const SuRFBuilder * builder)
     }
 }
 
-inline bool LoudsDense::lookupKey(const std::string & key, position_t & out_node_num) const
+inline bool LoudsDense::lookupKey(const KeyView & key, position_t & out_node_num) const
 {
+    position_t leaf = kMaxPos;
+    return lookupKey(key, out_node_num, leaf);
+}
+
+inline bool LoudsDense::lookupKey(const KeyView & key, position_t & out_node_num, position_t & out_leaf) const
+{
+    out_leaf = kMaxPos;
     position_t node_num = 0;
     position_t pos = 0;
     for (level_t level = 0; level < height_; level++)
@@ -215,20 +327,44 @@ inline bool LoudsDense::lookupKey(const std::string & key, position_t & out_node
         pos = (node_num * kNodeFanout);
         if (level >= key.length())
         { //if run out of searchKey bytes
-            if (prefixkey_indicator_bits_->readBit(node_num)) //if the prefix is also a key
-                return suffixes_->checkEquality(getSuffixPos(pos, true), key, level + 1);
-            else
+            if (!prefixkey_indicator_bits_->readBit(node_num)) //if the prefix is not a key
                 return false;
+            out_leaf = getSuffixPos(pos, true);
+            return suffixes_->checkEquality(out_leaf, key, level + 1);
         }
         pos += static_cast<label_t>(key[level]);
 
         //child_indicator_bitmaps_->prefetch(pos);
 
+        if (!label_bitmaps_->readBit(pos)) //if key byte does not exist
+            return false;
+
+        if (!child_indicator_bitmaps_->readBit(pos))
+        { //if trie branch terminates
+            out_leaf = getSuffixPos(pos, false);
+            return suffixes_->checkEquality(out_leaf, key, level + 1);
+        }
+
+        node_num = getChildNodeNum(pos);
+    }
+    //search will continue in LoudsSparse
+    out_node_num = node_num;
+    return true;
+}
+
+template <level_t kKeyLen>
+inline bool LoudsDense::lookupFixedLengthKey(const char * key, position_t & out_node_num) const
+{
+    assert(height_ <= kKeyLen);
+    position_t node_num = 0;
+    for (level_t level = 0; level < height_; level++)
+    {
+        position_t pos = (node_num * kNodeFanout) + static_cast<label_t>(key[level]);
         if (!label_bitmaps_->readBit(pos)) //if key byte does not exist
             return false;
 
         if (!child_indicator_bitmaps_->readBit(pos)) //if trie branch terminates
-            return suffixes_->checkEquality(getSuffixPos(pos, false), key, level + 1);
+            return suffixes_->checkEquality(getSuffixPos(pos, false), KeyView(key, kKeyLen), level + 1);
 
         node_num = getChildNodeNum(pos);
     }
@@ -237,7 +373,44 @@ inline bool LoudsDense::lookupKey(const std::string & key, position_t & out_node
     return true;
 }
 
-inline bool LoudsDense::moveToKeyGreaterThan(const std::string & key, const bool inclusive, LoudsDense::Iter & iter) const
+inline LookupStatus LoudsDense::lookupKeyStep(const KeyView & key, level_t & level, position_t & node_num) const
+{
+    position_t pos = (node_num * kNodeFanout);
+    if (level >= key.length())
+    { //if run out of searchKey bytes
+        if (prefixkey_indicator_bits_->readBit(node_num) //if the prefix is also a key
+            && suffixes_->checkEquality(getSuffixPos(pos, true), key, level + 1))
+            return kLookupFound;
+        return kLookupNotFound;
+    }
+    pos += static_cast<label_t>(key[level]);
+
+    if (!label_bitmaps_->readBit(pos)) //if key byte does not exist
+        return kLookupNotFound;
+
+    if (!child_indicator_bitmaps_->readBit(pos)) //if trie branch terminates
+        return suffixes_->checkEquality(getSuffixPos(pos, false), key, level + 1) ? kLookupFound : kLookupNotFound;
+
+    node_num = getChildNodeNum(pos);
+    level++;
+    if (level >= height_)
+        return kLookupToSparse;
+    return kLookupInProgress;
+}
+
+inline void LoudsDense::prefetchLookupStep(const KeyView & key, const level_t level, const position_t node_num) const
+{
+    if (level >= key.length())
+    {
+        prefixkey_indicator_bits_->prefetchBits(node_num);
+        return;
+    }
+    position_t pos = (node_num * kNodeFanout) + static_cast<label_t>(key[level]);
+    label_bitmaps_->prefetchBits(pos);
+    child_indicator_bitmaps_->prefetch(pos);
+}
+
+inline bool LoudsDense::moveToKeyGreaterThan(const KeyView & key, const bool inclusive, LoudsDense::Iter & iter) const
 {
     (void)inclusive;
     position_t node_num = 0;
@@ -319,6 +492,20 @@ inline uint64_t LoudsDense::approxCount(
     position_t & out_node_num_right) const
 {
     std::vector<position_t> left_pos_list, right_pos_list;
+    return approxCount(iter_left, iter_right, out_node_num_left, out_node_num_right, left_pos_list, right_pos_list);
+}
+
+inline uint64_t LoudsDense::approxCount(
+    const LoudsDense::Iter * iter_left,
+    const LoudsDense::Iter * iter_right,
+    position_t & out_node_num_left,
+    position_t & out_node_num_right,
+    std::vector<position_t> & left_pos_list,
+    std::vector<position_t> & right_pos_list,
+    const std::vector<word_t> * tombstones) const
+{
+    left_pos_list.clear();
+    right_pos_list.clear();
     for (level_t i = 0; i < iter_left->key_len_; i++)
     {
         left_pos_list.push_back(iter_left->pos_in_trie_[i]);
@@ -377,6 +564,22 @@ inline uint64_t LoudsDense::approxCount(
                 num_leafs++;
             if (iter_left->is_search_complete_ && (i == ori_left_len - 1))
                 num_leafs--;
+            if (tombstones != nullptr)
+            {
+                // the same leaves by leaf index, with the same prefix-key
+                // and left-key corrections
+                position_t first_leaf = leavesBefore(left_pos);
+                position_t end_leaf = leavesBefore(right_pos);
+                if (i >= ori_left_len && has_prefix_key_left)
+                    first_leaf--;
+                if (i >= ori_right_len && has_prefix_key_right)
+                    end_leaf--;
+                if (iter_left->is_search_complete_ && (i == ori_left_len - 1))
+                    first_leaf++;
+                if (first_leaf < end_leaf)
+                    num_leafs -= std::min(num_leafs, static_cast<position_t>(popcountRange(
+                        tombstones->data(), tombstones->size() * kWordSize, first_leaf, end_leaf)));
+            }
             count += num_leafs;
         }
     }
@@ -394,6 +597,142 @@ inline uint64_t LoudsDense::serializedSize() const
     return size;
 }
 
+inline void LoudsDense::getSerializedPartSizes(std::vector<uint64_t> & sizes) const
+{
+    uint64_t header_size = sizeof(height_) + (sizeof(position_t) * height_);
+    sizeAlign(header_size);
+    sizes.push_back(header_size);
+    sizes.push_back(label_bitmaps_->serializedSize());
+    sizes.push_back(child_indicator_bitmaps_->serializedSize());
+    sizes.push_back(prefixkey_indicator_bits_->serializedSize());
+    sizes.push_back(suffixes_->serializedSize());
+}
+
+inline void LoudsDense::serializeCompact(CompactWriter & writer) const
+{
+    writer.putVarint(height_);
+    writer.putPacked(level_cuts_, height_);
+    position_t num_nodes = prefixkey_indicator_bits_->numBits();
+    writer.putVarint(num_nodes);
+    suffixes_->serializeCompact(writer);
+
+    std::vector<char> stream;
+    RangeEncoder encoder(stream);
+    TrieItemModel model;
+    level_t level = 0;
+    bool prev_prefix_key = false;
+    bool prev_child = false;
+    for (position_t node_num = 0; node_num < num_nodes; node_num++)
+    {
+        position_t node_pos = node_num * kNodeFanout;
+        while (level + 1 < height_ && node_pos > level_cuts_[level])
+            level++;
+        bool prefix_key = prefixkey_indicator_bits_->readBit(node_num);
+        encoder.encodeBit(model.prefixKeyProb(level, prev_prefix_key), prefix_key);
+        prev_prefix_key = prefix_key;
+        // one "another label" bit before each label and a 0 after the last
+        unsigned prev_label = TrieItemModel::kNodeStart;
+        for (position_t label = 0; label < kNodeFanout; label++)
+        {
+            if (!label_bitmaps_->readBit(node_pos + label))
+            {
+                assert(!child_indicator_bitmaps_->readBit(node_pos + label));
+                continue;
+            }
+            encoder.encodeBit(model.boundaryProb(level, prev_label != TrieItemModel::kNodeStart), 1);
+            encoder.encodeByte(model.labelProbs(prev_label), static_cast<label_t>(label));
+            bool child = child_indicator_bitmaps_->readBit(node_pos + label);
+            encoder.encodeBit(model.childProb(level, static_cast<label_t>(label), prev_child), child);
+            prev_child = child;
+            prev_label = label;
+        }
+        encoder.encodeBit(model.boundaryProb(level, prev_label != TrieItemModel::kNodeStart), 0);
+    }
+    encoder.flush();
+    putRangeCoded(writer, stream);
+}
+
+inline LoudsDense * LoudsDense::deSerializeCompact(CompactReader & reader)
+{
+    LoudsDense * louds_dense = new LoudsDense();
+    louds_dense->height_ = static_cast<level_t>(reader.getVarint(kCompactMaxKeyLen + 1));
+    // every level ends at a larger cut, so the cuts take at least a bit
+    // per level
+    if (louds_dense->height_ > reader.remaining() * 8)
+    {
+        reader.fail();
+        louds_dense->height_ = 0;
+    }
+    level_t height = louds_dense->height_;
+    louds_dense->level_cuts_ = new position_t[height];
+    reader.getPacked(louds_dense->level_cuts_, height);
+    position_t num_nodes = static_cast<position_t>(reader.getVarint(kMaxPos / kNodeFanout));
+    // the cuts are non-decreasing and the last level ends at the last
+    // bitmap bit
+    if (num_nodes > 0 && (height == 0 || louds_dense->level_cuts_[height - 1] != num_nodes * kNodeFanout - 1))
+        reader.fail();
+    for (level_t level = 1; level < height; level++)
+    {
+        if (louds_dense->level_cuts_[level] < louds_dense->level_cuts_[level - 1])
+            reader.fail();
+    }
+    louds_dense->suffixes_ = BitvectorSuffix::deSerializeCompact(reader);
+    RangeDecoder decoder = getRangeCoded(reader);
+    // a node is at least its prefix key bit and its last boundary bit
+    if (num_nodes > decoder.maxBits() / 2)
+        reader.fail();
+    if (reader.failed())
+        num_nodes = 0;
+
+    BitvectorRank * label_bitmaps = new BitvectorRank(kRankBasicBlockSize, num_nodes * kNodeFanout, kBitmapRankLayout);
+    BitvectorRank * child_indicator_bitmaps = new BitvectorRank(kRankBasicBlockSize, num_nodes * kNodeFanout, kBitmapRankLayout);
+    BitvectorRank * prefixkey_indicator_bits = new BitvectorRank(kRankBasicBlockSize, num_nodes, kRankLut);
+    TrieItemModel model;
+    level_t level = 0;
+    bool prev_prefix_key = false;
+    bool prev_child = false;
+    for (position_t node_num = 0; node_num < num_nodes && !decoder.overrun(); node_num++)
+    {
+        position_t node_pos = node_num * kNodeFanout;
+        while (level + 1 < height && node_pos > louds_dense->level_cuts_[level])
+            level++;
+        bool prefix_key = decoder.decodeBit(model.prefixKeyProb(level, prev_prefix_key));
+        if (prefix_key)
+            prefixkey_indicator_bits->setBit(node_num);
+        prev_prefix_key = prefix_key;
+        unsigned prev_label = TrieItemModel::kNodeStart;
+        while (decoder.decodeBit(model.boundaryProb(level, prev_label != TrieItemModel::kNodeStart)))
+        {
+            label_t label = decoder.decodeByte(model.labelProbs(prev_label));
+            // labels are strictly increasing within a node
+            if (prev_label != TrieItemModel::kNodeStart && label <= prev_label)
+            {
+                reader.fail();
+                break;
+            }
+            bool child = decoder.decodeBit(model.childProb(level, label, prev_child));
+            label_bitmaps->setBit(node_pos + label);
+            if (child)
+                child_indicator_bitmaps->setBit(node_pos + label);
+            prev_child = child;
+            prev_label = label;
+            if (decoder.overrun())
+                break;
+        }
+        if (reader.failed())
+            break;
+    }
+    if (decoder.overrun())
+        reader.fail();
+    label_bitmaps->initRankIndex();
+    child_indicator_bitmaps->initRankIndex();
+    prefixkey_indicator_bits->initRankIndex();
+    louds_dense->label_bitmaps_ = label_bitmaps;
+    louds_dense->child_indicator_bitmaps_ = child_indicator_bitmaps;
+    louds_dense->prefixkey_indicator_bits_ = prefixkey_indicator_bits;
+    return louds_dense;
+}
+
 inline uint64_t LoudsDense::getMemoryUsage() const
 {
     return (
@@ -401,6 +740,24 @@ inline uint64_t LoudsDense::getMemoryUsage() const
         + suffixes_->size());
 }
 
+inline position_t LoudsDense::getNumLeaves() const
+{
+    position_t num_bits = label_bitmaps_->numBits();
+    if (num_bits == 0)
+        return 0;
+    return label_bitmaps_->rank(num_bits - 1) - child_indicator_bitmaps_->rank(num_bits - 1)
+        + prefixkey_indicator_bits_->rank(prefixkey_indicator_bits_->numBits() - 1);
+}
+
+inline position_t LoudsDense::leavesBefore(const position_t pos) const
+{
+    // leaf labels before pos, plus the prefix keys of nodes up to and
+    // including pos's own (a prefix key sorts before its node's labels)
+    position_t num_labels = label_bitmaps_->rank(pos) - (label_bitmaps_->readBit(pos) ? 1 : 0);
+    position_t num_children = child_indicator_bitmaps_->rank(pos) - (child_indicator_bitmaps_->readBit(pos) ? 1 : 0);
+    return num_labels - num_children + prefixkey_indicator_bits_->rank(pos / kNodeFanout);
+}
+
 inline position_t LoudsDense::getChildNodeNum(const position_t pos) const
 {
     return child_indicator_bitmaps_->rank(pos);
@@ -434,7 +791,7 @@ inline position_t LoudsDense::getPrevPos(const position_t pos, bool * is_out_of_
 }
 
 inline bool
-LoudsDense::compareSuffixGreaterThan(const position_t pos, const std::string & key, const level_t level, LoudsDense::Iter & iter) const
+LoudsDense::compareSuffixGreaterThan(const position_t pos, const KeyView & key, const level_t level, LoudsDense::Iter & iter) const
 {
     position_t suffix_pos = getSuffixPos(pos, false);
     int compare = suffixes_->compare(suffix_pos, key, level);
@@ -457,13 +814,26 @@ inline void LoudsDense::Iter::clear()
     is_at_prefix_key_ = false;
 }
 
-inline int LoudsDense::Iter::compare(const std::string & key) const
+inline void LoudsDense::Iter::reset()
+{
+    clear();
+    is_search_complete_ = false;
+    is_move_left_complete_ = false;
+    is_move_right_complete_ = false;
+    send_out_node_num_ = 0;
+    key_.fill(0);
+    pos_in_trie_.fill(0);
+}
+
+// Compares the key bytes in place (no temporary strings)
+inline int LoudsDense::Iter::compare(const KeyView & key) const
 {
     if (is_at_prefix_key_ && (key_len_ - 1) < key.length())
         return -1;
-    std::string iter_key = getKey();
-    std::string key_dense = key.substr(0, iter_key.length());
-    int compare = iter_key.compare(key_dense);
+    level_t len = 0;
+    if (is_valid_)
+        len = is_at_prefix_key_ ? (key_len_ - 1) : key_len_;
+    int compare = compareKeyBytes(key_.data(), len, key.data(), key.length());
     if (compare != 0)
         return compare;
     if (isComplete())
@@ -475,17 +845,20 @@ inline int LoudsDense::Iter::compare(const std::string & key) const
 }
 
 inline std::string LoudsDense::Iter::getKey() const
+{
+    std::string key;
+    appendKey(key);
+    return key;
+}
+
+inline void LoudsDense::Iter::appendKey(std::string & key) const
 {
     if (!is_valid_)
-    {
-        return std::string();
-    }
+        return;
     level_t len = key_len_;
     if (is_at_prefix_key_)
-    {
         len--;
-    }
-    return std::string(reinterpret_cast<const char *>(key_.data()), static_cast<size_t>(len));
+    key.append(reinterpret_cast<const char *>(key_.data()), static_cast<size_t>(len));
 }
 
 inline int LoudsDense::Iter::getSuffix(word_t * suffix) const
@@ -1,9 +1,13 @@
 #ifndef LOUDSSPARSE_H_
 #define LOUDSSPARSE_H_
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
+#include "compact_codec.hpp"
 #include "config.hpp"
+#include "level_buffer.hpp"
 #include "label_vector.hpp"
 #include "rank.hpp"
 #include "select.hpp"
@@ -13,6 +17,8 @@
 namespace surf
 {
 
+class SuRFDirectBuilder;
+
 class LoudsSparse
 {
 public:
@@ -21,6 +27,11 @@ public:
     public:
         Iter()
             : is_valid_(false)
+            , trie_(nullptr)
+            , start_level_(0)
+            , start_node_num_(0)
+            , key_len_(0)
+            , is_at_terminator_(false)
         {
         }
         Iter(LoudsSparse * trie)
@@ -31,19 +42,30 @@ public:
             , is_at_terminator_(false)
         {
             start_level_ = trie_->getStartLevel();
-            for (level_t level = start_level_; level < trie_->getHeight(); level++)
-            {
-                key_.push_back(0);
-                pos_in_trie_.push_back(0);
-            }
+            level_t num_levels = (trie_->getHeight() > start_level_) ? (trie_->getHeight() - start_level_) : 0;
+            key_.resize(num_levels);
+            pos_in_trie_.resize(num_levels);
         }
 
         inline void clear();
+        // Returns the iterator to its freshly constructed state without
+        // releasing its level buffers
+        inline void reset();
         inline bool isValid() const { return is_valid_; }
-        inline int compare(const std::string & key) const;
+        inline bool isAtTerminator() const { return is_at_terminator_; }
+        inline int compare(const KeyView & key) const;
         inline std::string getKey() const;
+        // Appends the key bytes getKey() would return to key
+        inline void appendKey(std::string & key) const;
         inline int getSuffix(word_t * suffix) const;
         inline std::string getKeyWithSuffix(unsigned * bitlen) const;
+        // Leaf index of the key the iter points to. REQUIRED: the iter is valid.
+        inline position_t getLeafIndex() const
+        {
+            if (trie_->is_paged_)
+                return trie_->getSuffixPos<true>(pos_in_trie_[key_len_ - 1]);
+            return trie_->getSuffixPos<false>(pos_in_trie_[key_len_ - 1]);
+        }
 
         inline position_t getStartNodeNum() const { return start_node_num_; }
         inline void setStartNodeNum(position_t node_num) { start_node_num_ = node_num; }
@@ -56,8 +78,29 @@ public:
         inline void operator--(int);
 
     private:
+        // The kPaged versions of the moves above (see LoudsSparse::is_paged_)
+        template <bool kPaged>
+        inline int compare(const KeyView & key) const;
+        template <bool kPaged>
+        inline void setToFirstLabelInRoot();
+        template <bool kPaged>
+        inline void setToLastLabelInRoot();
+        template <bool kPaged>
+        inline void moveToLeftMostKey();
+        template <bool kPaged>
+        inline void moveToRightMostKey();
+        template <bool kPaged>
+        inline void next();
+        template <bool kPaged>
+        inline void prev();
+        // Real suffix of the key the iter points to
+        template <bool kPaged>
+        inline word_t readRealSuffix() const;
+
+        template <bool kPaged>
         inline void append(const position_t pos);
         inline void append(const label_t label, const position_t pos);
+        template <bool kPaged>
         inline void set(const level_t level, const position_t pos);
 
     private:
@@ -67,32 +110,75 @@ public:
         position_t start_node_num_; // Passed in by the dense iterator; default = 0
         level_t key_len_; // Start counting from start_level_; does NOT include suffix
 
-        std::vector<label_t> key_;
-        std::vector<position_t> pos_in_trie_;
+        LevelBuffer<label_t, kIterInlineLevels> key_;
+        LevelBuffer<position_t, kIterInlineLevels> pos_in_trie_;
         bool is_at_terminator_;
 
         friend class LoudsSparse;
     };
 
 public:
-    LoudsSparse() { }
+    LoudsSparse()
+        : level_cuts_borrowed_(false)
+        , is_paged_(false)
+    {
+    }
     LoudsSparse(const SuRFBuilder * builder);
 
     ~LoudsSparse() { }
 
     // point query: trie walk starts at node "in_node_num" instead of root
     // in_node_num is provided by louds-dense's lookupKey function
-    inline bool lookupKey(const std::string & key, const position_t in_node_num) const;
+    inline bool lookupKey(const KeyView & key, const position_t in_node_num) const;
+    // Same as above; out_leaf is set to the leaf index (= suffix position)
+    // the search ends at, or to kMaxPos if it reaches no leaf
+    inline bool lookupKey(const KeyView & key, const position_t in_node_num, position_t & out_leaf) const;
+    // Batched point query: advances a lookup of key by one step.
+    // A step either locates the first label of node_num (pos == kMaxPos
+    // on entry) or searches that node for key[level].
+    inline LookupStatus lookupKeyStep(const KeyView & key, level_t & level, position_t & node_num, position_t & pos) const;
+    // lookupKey for a trie built only from kKeyLen-byte keys (see SuRFInt);
+    // such a trie has no terminator labels
+    template <level_t kKeyLen>
+    inline bool lookupFixedLengthKey(const char * key, const position_t in_node_num) const;
+    // Prefetches the cache lines read by the next lookupKeyStep call
+    inline void prefetchLookupStep(const position_t node_num, const position_t pos) const;
     // return value indicates potential false positive
-    inline bool moveToKeyGreaterThan(const std::string & key, const bool inclusive, LoudsSparse::Iter & iter) const;
+    inline bool moveToKeyGreaterThan(const KeyView & key, const bool inclusive, LoudsSparse::Iter & iter) const;
     inline uint64_t approxCount(
         const LoudsSparse::Iter * iter_left,
         const LoudsSparse::Iter * iter_right,
         const position_t in_node_num_left,
         const position_t in_node_num_right) const;
+    // Same as above; left_pos_list and right_pos_list are caller-owned scratch space
+    inline uint64_t approxCount(
+        const LoudsSparse::Iter * iter_left,
+        const LoudsSparse::Iter * iter_right,
+        const position_t in_node_num_left,
+        const position_t in_node_num_right,
+        std::vector<position_t> & left_pos_list,
+        std::vector<position_t> & right_pos_list,
+        const std::vector<word_t> * tombstones = nullptr) const;
     inline level_t getHeight() const { return height_; }
+    // Number of keys that end in louds-sparse; leaf indexes run from 0 to
+    // getNumLeaves() - 1 in key order
+    inline position_t getNumLeaves() const;
     inline level_t getStartLevel() const { return start_level_; }
+    inline SuffixType getSuffixType() const { return suffixes_->getType(); }
+    inline level_t getHashSuffixLen() const { return suffixes_->getHashSuffixLen(); }
+    inline level_t getRealSuffixLen() const { return suffixes_->getRealSuffixLen(); }
     inline uint64_t serializedSize() const;
+    // Sizes of the parts serialize() writes, in order: the header (height,
+    // start level, dense node/child counts and level cuts), the labels,
+    // the child indicator bits (with their rank LUT), the louds bits (with
+    // their select samples) and the suffixes. They add up to
+    // serializedSize().
+    inline void getSerializedPartSizes(std::vector<uint64_t> & sizes) const;
+    // Keeps the labels, bits and suffixes of the first num_resident_levels
+    // levels (and the rank/select LUTs) in page_cache, and pages in the
+    // deeper ones on demand (see SuRF::openTiered).
+    // REQUIRED: loaded by a zero-copy deSerialize from page_cache's region
+    inline void setPageCache(PageCache * page_cache, const level_t num_resident_levels);
     inline uint64_t getMemoryUsage() const;
 
     inline void serialize(char *& dst) const
@@ -115,7 +201,8 @@ public:
         align(dst);
     }
 
-    static LoudsSparse * deSerialize(char *& src)
+    // zero_copy: point into src instead of copying (see SuRF::deSerialize)
+    static LoudsSparse * deSerialize(char *& src, const bool zero_copy = false)
     {
         LoudsSparse * louds_sparse = new LoudsSparse();
         memcpy(&(louds_sparse->height_), src, sizeof(louds_sparse->height_));
@@ -126,21 +213,62 @@ public:
         src += sizeof(louds_sparse->node_count_dense_);
         memcpy(&(louds_sparse->child_count_dense_), src, sizeof(louds_sparse->child_count_dense_));
         src += sizeof(louds_sparse->child_count_dense_);
-        louds_sparse->level_cuts_ = new position_t[louds_sparse->height_];
-        memcpy(louds_sparse->level_cuts_, src, sizeof(position_t) * (louds_sparse->height_));
+        if (zero_copy)
+        {
+            louds_sparse->level_cuts_ = reinterpret_cast<position_t *>(src);
+            louds_sparse->level_cuts_borrowed_ = true;
+        }
+        else
+        {
+            louds_sparse->level_cuts_ = new position_t[louds_sparse->height_];
+            memcpy(louds_sparse->level_cuts_, src, sizeof(position_t) * (louds_sparse->height_));
+        }
         src += (sizeof(position_t) * (louds_sparse->height_));
         align(src);
-        louds_sparse->labels_ = LabelVector::deSerialize(src);
-        louds_sparse->child_indicator_bits_ = BitvectorRank::deSerialize(src);
-        louds_sparse->louds_bits_ = BitvectorSelect::deSerialize(src);
-        louds_sparse->suffixes_ = BitvectorSuffix::deSerialize(src);
+        louds_sparse->labels_ = LabelVector::deSerialize(src, zero_copy);
+        louds_sparse->child_indicator_bits_ = BitvectorRank::deSerialize(src, zero_copy);
+        louds_sparse->louds_bits_ = BitvectorSelect::deSerialize(src, zero_copy);
+        louds_sparse->suffixes_ = BitvectorSuffix::deSerialize(src, zero_copy);
         align(src);
         return louds_sparse;
     }
 
+    // Bytes the serialize() image at src takes, from the headers of its
+    // parts, or 0 if a header is invalid or the image does not fit in
+    // size bytes. Nothing past src + size is read.
+    static uint64_t imageSize(const char * src, const uint64_t size)
+    {
+        level_t height = 0;
+        if (size < sizeof(height))
+            return 0;
+        memcpy(&height, src, sizeof(height));
+        uint64_t offset = sizeof(height) + sizeof(level_t) + 2 * sizeof(position_t) + static_cast<uint64_t>(height) * sizeof(position_t);
+        sizeAlign(offset);
+        typedef uint64_t (*ImageSizeFn)(const char *, const uint64_t);
+        const ImageSizeFn parts[]
+            = {LabelVector::imageSize, BitvectorRank::imageSize, BitvectorSelect::imageSize, BitvectorSuffix::imageSize};
+        for (ImageSizeFn part : parts)
+        {
+            uint64_t part_size = (offset <= size) ? part(src + offset, size - offset) : 0;
+            if (part_size == 0)
+                return 0;
+            offset += part_size;
+        }
+        return offset;
+    }
+
+    // Compact encoding (see compact_codec.hpp): the header as varints,
+    // the level cuts bit-packed, the suffixes, then the louds bit, label
+    // and child indicator bit of every position, range-coded. The rank
+    // and select LUTs are rebuilt on load.
+    inline void serializeCompact(CompactWriter & writer) const;
+    // Marks reader failed if the encoding is inconsistent
+    static inline LoudsSparse * deSerializeCompact(CompactReader & reader);
+
     inline void destroy()
     {
-        delete[] level_cuts_;
+        if (!level_cuts_borrowed_)
+            delete[] level_cuts_;
         labels_->destroy();
         child_indicator_bits_->destroy();
         louds_bits_->destroy();
@@ -148,20 +276,49 @@ public:
     }
 
 private:
+    // The public queries above dispatch on is_paged_ once, to these
+    template <bool kPaged>
+    inline bool lookupKey(const KeyView & key, const position_t in_node_num, position_t & out_leaf) const;
+    template <bool kPaged>
+    inline LookupStatus lookupKeyStep(const KeyView & key, level_t & level, position_t & node_num, position_t & pos) const;
+    template <level_t kKeyLen, bool kPaged>
+    inline bool lookupFixedLengthKey(const char * key, const position_t in_node_num) const;
+    template <bool kPaged>
+    inline bool moveToKeyGreaterThan(const KeyView & key, const bool inclusive, LoudsSparse::Iter & iter) const;
+    template <bool kPaged>
+    inline uint64_t approxCount(
+        const LoudsSparse::Iter * iter_left,
+        const LoudsSparse::Iter * iter_right,
+        const position_t in_node_num_left,
+        const position_t in_node_num_right,
+        std::vector<position_t> & left_pos_list,
+        std::vector<position_t> & right_pos_list,
+        const std::vector<word_t> * tombstones) const;
+
+    template <bool kPaged>
     inline position_t getChildNodeNum(const position_t pos) const;
+    template <bool kPaged>
     inline position_t getFirstLabelPos(const position_t node_num) const;
+    template <bool kPaged>
     inline position_t getLastLabelPos(const position_t node_num) const;
+    template <bool kPaged>
     inline position_t getSuffixPos(const position_t pos) const;
+    template <bool kPaged>
     inline position_t nodeSize(const position_t pos) const;
+    template <bool kPaged>
     inline bool isEndofNode(const position_t pos) const;
 
+    template <bool kPaged>
     inline void moveToLeftInNextSubtrie(position_t pos, const position_t node_size, const label_t label, LoudsSparse::Iter & iter) const;
     // return value indicates potential false positive
+    template <bool kPaged>
     inline bool
-    compareSuffixGreaterThan(const position_t pos, const std::string & key, const level_t level, LoudsSparse::Iter & iter) const;
+    compareSuffixGreaterThan(const position_t pos, const KeyView & key, const level_t level, LoudsSparse::Iter & iter) const;
 
+    template <bool kPaged>
     inline position_t appendToPosList(
         std::vector<position_t> & pos_list, const position_t node_num, const level_t level, const bool isLeft, bool & done) const;
+    template <bool kPaged>
     inline void extendPosList(
         std::vector<position_t> & left_pos_list,
         std::vector<position_t> & right_pos_list,
@@ -169,8 +326,15 @@ private:
         const position_t right_in_node_num) const;
 
 private:
+    friend class SuRFDirectBuilder;
+
     static const position_t kRankBasicBlockSize = 512;
-    static const position_t kSelectSampleInterval = 64;
+    // select index: one sample per kSelectSampleInterval 1's in louds_bits_,
+    // sub-sampled every kSelectSubSampleInterval 1's
+    static const position_t kSelectSampleInterval = 256;
+    static const position_t kSelectSubSampleInterval = 32;
+    // rank layout of child_indicator_bits_, ranked on every move to a child node
+    static const RankLayout kChildRankLayout = kRankInterleaved;
 
     level_t height_; // trie height
     level_t start_level_; // louds-sparse encoding starts at this level
@@ -179,6 +343,11 @@ private:
     // number of children(1's in child indicator bitmap) in louds-dense encoding
     position_t child_count_dense_;
     position_t * level_cuts_; // position of the last bit at each level
+    bool level_cuts_borrowed_; // points into a zero-copy image; not ours to free
+    // Set by setPageCache: the queries then take the kPaged = true reads,
+    // which touch the page cache. Every other filter runs the kPaged =
+    // false instantiations, which compile to plain reads.
+    bool is_paged_;
 
     LabelVector * labels_;
     BitvectorRank * child_indicator_bits_;
@@ -188,6 +357,8 @@ private:
 
 
 inline LoudsSparse::LoudsSparse(const SuRFBuilder * builder)
+    : level_cuts_borrowed_(false)
+    , is_paged_(false)
 {
     height_ = static_cast<level_t>(builder->getLabels().size());
     start_level_ = builder->getSparseStartLevel();
@@ -219,9 +390,10 @@ inline LoudsSparse::LoudsSparse(const SuRFBuilder * builder)
         level_cuts_[level] = bit_count - 1;
     }
 
-    child_indicator_bits_
-        = new BitvectorRank(kRankBasicBlockSize, builder->getChildIndicatorBits(), num_items_per_level, start_level_, height_);
-    louds_bits_ = new BitvectorSelect(kSelectSampleInterval, builder->getLoudsBits(), num_items_per_level, start_level_, height_);
+    child_indicator_bits_ = new BitvectorRank(
+        kRankBasicBlockSize, builder->getChildIndicatorBits(), num_items_per_level, start_level_, height_, kChildRankLayout);
+    louds_bits_ = new BitvectorSelect(
+        kSelectSampleInterval, builder->getLoudsBits(), num_items_per_level, start_level_, height_, kSelectSubSampleInterval);
 
     if (builder->getSuffixType() == kNone)
     {
@@ -247,70 +419,179 @@ inline LoudsSparse::LoudsSparse(const SuRFBuilder * builder)
     }
 }
 
-inline bool LoudsSparse::lookupKey(const std::string & key, const position_t in_node_num) const
+inline bool LoudsSparse::lookupKey(const KeyView & key, const position_t in_node_num) const
+{
+    position_t leaf = kMaxPos;
+    return lookupKey(key, in_node_num, leaf);
+}
+
+inline bool LoudsSparse::lookupKey(const KeyView & key, const position_t in_node_num, position_t & out_leaf) const
+{
+    if (is_paged_)
+        return lookupKey<true>(key, in_node_num, out_leaf);
+    return lookupKey<false>(key, in_node_num, out_leaf);
+}
+
+template <bool kPaged>
+inline bool LoudsSparse::lookupKey(const KeyView & key, const position_t in_node_num, position_t & out_leaf) const
 {
+    out_leaf = kMaxPos;
     position_t node_num = in_node_num;
-    position_t pos = getFirstLabelPos(node_num);
+    position_t pos = getFirstLabelPos<kPaged>(node_num);
     level_t level = 0;
     for (level = start_level_; level < key.length(); level++)
     {
         //child_indicator_bits_->prefetch(pos);
-        if (!labels_->search(static_cast<label_t>(key[level]), pos, nodeSize(pos)))
+        if (!labels_->search<kPaged>(static_cast<label_t>(key[level]), pos, nodeSize<kPaged>(pos)))
+            return false;
+
+        // if trie branch terminates
+        if (!child_indicator_bits_->readBit<kPaged>(pos))
+        {
+            out_leaf = getSuffixPos<kPaged>(pos);
+            return suffixes_->checkEquality<kPaged>(out_leaf, key, level + 1);
+        }
+
+        // move to child
+        node_num = getChildNodeNum<kPaged>(pos);
+        pos = getFirstLabelPos<kPaged>(node_num);
+    }
+    if ((labels_->read<kPaged>(pos) == kTerminator) && (!child_indicator_bits_->readBit<kPaged>(pos)))
+    {
+        out_leaf = getSuffixPos<kPaged>(pos);
+        return suffixes_->checkEquality<kPaged>(out_leaf, key, level + 1);
+    }
+    return false;
+}
+
+template <level_t kKeyLen>
+inline bool LoudsSparse::lookupFixedLengthKey(const char * key, const position_t in_node_num) const
+{
+    if (is_paged_)
+        return lookupFixedLengthKey<kKeyLen, true>(key, in_node_num);
+    return lookupFixedLengthKey<kKeyLen, false>(key, in_node_num);
+}
+
+template <level_t kKeyLen, bool kPaged>
+inline bool LoudsSparse::lookupFixedLengthKey(const char * key, const position_t in_node_num) const
+{
+    position_t pos = getFirstLabelPos<kPaged>(in_node_num);
+    for (level_t level = start_level_; level < kKeyLen; level++)
+    {
+        if (!labels_->search<kPaged>(static_cast<label_t>(key[level]), pos, nodeSize<kPaged>(pos)))
             return false;
 
         // if trie branch terminates
-        if (!child_indicator_bits_->readBit(pos))
-            return suffixes_->checkEquality(getSuffixPos(pos), key, level + 1);
+        if (!child_indicator_bits_->readBit<kPaged>(pos))
+            return suffixes_->checkEquality<kPaged>(getSuffixPos<kPaged>(pos), KeyView(key, kKeyLen), level + 1);
 
         // move to child
-        node_num = getChildNodeNum(pos);
-        pos = getFirstLabelPos(node_num);
+        pos = getFirstLabelPos<kPaged>(getChildNodeNum<kPaged>(pos));
     }
-    if ((labels_->read(pos) == kTerminator) && (!child_indicator_bits_->readBit(pos)))
-        return suffixes_->checkEquality(getSuffixPos(pos), key, level + 1);
+    // every branch of a fixed-length trie ends by level kKeyLen - 1
     return false;
 }
 
-inline bool LoudsSparse::moveToKeyGreaterThan(const std::string & key, const bool inclusive, LoudsSparse::Iter & iter) const
+inline LookupStatus
+LoudsSparse::lookupKeyStep(const KeyView & key, level_t & level, position_t & node_num, position_t & pos) const
+{
+    if (is_paged_)
+        return lookupKeyStep<true>(key, level, node_num, pos);
+    return lookupKeyStep<false>(key, level, node_num, pos);
+}
+
+template <bool kPaged>
+inline LookupStatus
+LoudsSparse::lookupKeyStep(const KeyView & key, level_t & level, position_t & node_num, position_t & pos) const
+{
+    if (pos == kMaxPos)
+    {
+        pos = getFirstLabelPos<kPaged>(node_num);
+        return kLookupInProgress;
+    }
+
+    if (level < key.length())
+    {
+        if (!labels_->search<kPaged>(static_cast<label_t>(key[level]), pos, nodeSize<kPaged>(pos)))
+            return kLookupNotFound;
+
+        // if trie branch terminates
+        if (!child_indicator_bits_->readBit<kPaged>(pos))
+            return suffixes_->checkEquality<kPaged>(getSuffixPos<kPaged>(pos), key, level + 1) ? kLookupFound : kLookupNotFound;
+
+        // move to child
+        node_num = getChildNodeNum<kPaged>(pos);
+        pos = kMaxPos;
+        level++;
+        return kLookupInProgress;
+    }
+
+    if ((labels_->read<kPaged>(pos) == kTerminator) && (!child_indicator_bits_->readBit<kPaged>(pos))
+        && suffixes_->checkEquality<kPaged>(getSuffixPos<kPaged>(pos), key, level + 1))
+        return kLookupFound;
+    return kLookupNotFound;
+}
+
+inline void LoudsSparse::prefetchLookupStep(const position_t node_num, const position_t pos) const
+{
+    if (pos == kMaxPos)
+    {
+        louds_bits_->prefetchSelect(node_num + 1 - node_count_dense_);
+        return;
+    }
+    labels_->prefetch(pos);
+    louds_bits_->prefetchBits(pos);
+    child_indicator_bits_->prefetch(pos);
+}
+
+inline bool LoudsSparse::moveToKeyGreaterThan(const KeyView & key, const bool inclusive, LoudsSparse::Iter & iter) const
+{
+    if (is_paged_)
+        return moveToKeyGreaterThan<true>(key, inclusive, iter);
+    return moveToKeyGreaterThan<false>(key, inclusive, iter);
+}
+
+template <bool kPaged>
+inline bool LoudsSparse::moveToKeyGreaterThan(const KeyView & key, const bool inclusive, LoudsSparse::Iter & iter) const
 {
     position_t node_num = iter.getStartNodeNum();
-    position_t pos = getFirstLabelPos(node_num);
+    position_t pos = getFirstLabelPos<kPaged>(node_num);
 
     level_t level;
     for (level = start_level_; level < key.length(); level++)
     {
-        position_t node_size = nodeSize(pos);
+        position_t node_size = nodeSize<kPaged>(pos);
         // if no exact match
-        if (!labels_->search(static_cast<label_t>(key[level]), pos, node_size))
+        if (!labels_->search<kPaged>(static_cast<label_t>(key[level]), pos, node_size))
         {
-            moveToLeftInNextSubtrie(pos, node_size, key[level], iter);
+            moveToLeftInNextSubtrie<kPaged>(pos, node_size, key[level], iter);
             return false;
         }
 
         iter.append(key[level], pos);
 
         // if trie branch terminates
-        if (!child_indicator_bits_->readBit(pos))
-            return compareSuffixGreaterThan(pos, key, level + 1, iter);
+        if (!child_indicator_bits_->readBit<kPaged>(pos))
+            return compareSuffixGreaterThan<kPaged>(pos, key, level + 1, iter);
 
         // move to child
-        node_num = getChildNodeNum(pos);
-        pos = getFirstLabelPos(node_num);
+        node_num = getChildNodeNum<kPaged>(pos);
+        pos = getFirstLabelPos<kPaged>(node_num);
     }
 
-    if ((labels_->read(pos) == kTerminator) && (!child_indicator_bits_->readBit(pos)) && !isEndofNode(pos))
+    if ((labels_->read<kPaged>(pos) == kTerminator) && (!child_indicator_bits_->readBit<kPaged>(pos)) && !isEndofNode<kPaged>(pos))
     {
         iter.append(kTerminator, pos);
         iter.is_at_terminator_ = true;
         if (!inclusive)
-            iter++;
+            iter.next<kPaged>();
         iter.is_valid_ = true;
         return false;
     }
 
     if (key.length() <= level)
     {
-        iter.moveToLeftMostKey();
+        iter.moveToLeftMostKey<kPaged>();
         return false;
     }
 
@@ -318,10 +599,11 @@ inline bool LoudsSparse::moveToKeyGreaterThan(const std::string & key, const boo
     return true;
 }
 
+template <bool kPaged>
 inline position_t LoudsSparse::appendToPosList(
     std::vector<position_t> & pos_list, const position_t node_num, const level_t level, const bool isLeft, bool & done) const
 {
-    position_t pos = getFirstLabelPos(node_num);
+    position_t pos = getFirstLabelPos<kPaged>(node_num);
     if (pos > level_cuts_[start_level_ + level])
     {
         pos = kMaxPos;
@@ -340,6 +622,7 @@ inline position_t LoudsSparse::appendToPosList(
     return pos;
 }
 
+template <bool kPaged>
 inline void LoudsSparse::extendPosList(
     std::vector<position_t> & left_pos_list,
     std::vector<position_t> & right_pos_list,
@@ -354,9 +637,9 @@ inline void LoudsSparse::extendPosList(
     if (start_depth == 0)
     {
         if (left_pos_list.size() == 0)
-            left_pos = appendToPosList(left_pos_list, left_in_node_num, 0, true, left_done);
+            left_pos = appendToPosList<kPaged>(left_pos_list, left_in_node_num, 0, true, left_done);
         if (right_pos_list.size() == 0)
-            right_pos = appendToPosList(right_pos_list, right_in_node_num, 0, false, right_done);
+            right_pos = appendToPosList<kPaged>(right_pos_list, right_in_node_num, 0, false, right_done);
         start_depth++;
     }
 
@@ -368,17 +651,17 @@ inline void LoudsSparse::extendPosList(
             break;
         if (!left_done && static_cast<level_t>(left_pos_list.size()) <= i)
         {
-            left_node_num = getChildNodeNum(left_pos);
-            if (!child_indicator_bits_->readBit(left_pos))
+            left_node_num = getChildNodeNum<kPaged>(left_pos);
+            if (!child_indicator_bits_->readBit<kPaged>(left_pos))
                 left_node_num++;
-            left_pos = appendToPosList(left_pos_list, left_node_num, i, true, left_done);
+            left_pos = appendToPosList<kPaged>(left_pos_list, left_node_num, i, true, left_done);
         }
         if (!right_done && static_cast<level_t>(right_pos_list.size()) <= i)
         {
-            right_node_num = getChildNodeNum(right_pos);
-            if (!child_indicator_bits_->readBit(right_pos))
+            right_node_num = getChildNodeNum<kPaged>(right_pos);
+            if (!child_indicator_bits_->readBit<kPaged>(right_pos))
                 right_node_num++;
-            right_pos = appendToPosList(right_pos_list, right_node_num, i, false, right_done);
+            right_pos = appendToPosList<kPaged>(right_pos_list, right_node_num, i, false, right_done);
         }
     }
 }
@@ -388,10 +671,39 @@ uint64_t LoudsSparse::approxCount(
     const LoudsSparse::Iter * iter_right,
     const position_t in_node_num_left,
     const position_t in_node_num_right) const
+{
+    std::vector<position_t> left_pos_list, right_pos_list;
+    return approxCount(iter_left, iter_right, in_node_num_left, in_node_num_right, left_pos_list, right_pos_list);
+}
+
+uint64_t LoudsSparse::approxCount(
+    const LoudsSparse::Iter * iter_left,
+    const LoudsSparse::Iter * iter_right,
+    const position_t in_node_num_left,
+    const position_t in_node_num_right,
+    std::vector<position_t> & left_pos_list,
+    std::vector<position_t> & right_pos_list,
+    const std::vector<word_t> * tombstones) const
+{
+    if (is_paged_)
+        return approxCount<true>(iter_left, iter_right, in_node_num_left, in_node_num_right, left_pos_list, right_pos_list, tombstones);
+    return approxCount<false>(iter_left, iter_right, in_node_num_left, in_node_num_right, left_pos_list, right_pos_list, tombstones);
+}
+
+template <bool kPaged>
+uint64_t LoudsSparse::approxCount(
+    const LoudsSparse::Iter * iter_left,
+    const LoudsSparse::Iter * iter_right,
+    const position_t in_node_num_left,
+    const position_t in_node_num_right,
+    std::vector<position_t> & left_pos_list,
+    std::vector<position_t> & right_pos_list,
+    const std::vector<word_t> * tombstones) const
 {
     if (in_node_num_left == kMaxPos)
         return 0;
-    std::vector<position_t> left_pos_list, right_pos_list;
+    left_pos_list.clear();
+    right_pos_list.clear();
     for (level_t i = 0; i < iter_left->key_len_; i++)
         left_pos_list.push_back(iter_left->pos_in_trie_[i]);
     level_t ori_left_len = static_cast<level_t>(left_pos_list.size());
@@ -405,7 +717,7 @@ uint64_t LoudsSparse::approxCount(
         for (level_t i = 0; i < iter_right->key_len_; i++)
             right_pos_list.push_back(iter_right->pos_in_trie_[i]);
     }
-    extendPosList(left_pos_list, right_pos_list, in_node_num_left, in_node_num_right);
+    extendPosList<kPaged>(left_pos_list, right_pos_list, in_node_num_left, in_node_num_right);
 
     uint64_t count = 0;
     level_t search_depth = static_cast<level_t>(left_pos_list.size());
@@ -422,15 +734,27 @@ uint64_t LoudsSparse::approxCount(
         //assert(left_pos <= right_pos);
         if (left_pos < right_pos)
         {
-            position_t rank_left = child_indicator_bits_->rank(left_pos);
-            position_t rank_right = child_indicator_bits_->rank(right_pos);
+            position_t rank_left = child_indicator_bits_->rank<kPaged>(left_pos);
+            position_t rank_right = child_indicator_bits_->rank<kPaged>(right_pos);
             position_t num_leafs = (right_pos - left_pos) - (rank_right - rank_left);
-            if (child_indicator_bits_->readBit(right_pos))
+            if (child_indicator_bits_->readBit<kPaged>(right_pos))
                 num_leafs++;
-            if (child_indicator_bits_->readBit(left_pos))
+            if (child_indicator_bits_->readBit<kPaged>(left_pos))
                 num_leafs--;
             if (i == ori_left_len - 1)
                 num_leafs--;
+            if (tombstones != nullptr)
+            {
+                // the same leaves by leaf index: a leaf's index is the
+                // number of leaf labels before it
+                position_t first_leaf = (left_pos - rank_left) + (child_indicator_bits_->readBit<kPaged>(left_pos) ? 1 : 0);
+                position_t end_leaf = (right_pos - rank_right) + (child_indicator_bits_->readBit<kPaged>(right_pos) ? 1 : 0);
+                if (i == ori_left_len - 1)
+                    first_leaf++;
+                if (first_leaf < end_leaf)
+                    num_leafs -= std::min(num_leafs, static_cast<position_t>(popcountRange(
+                        tombstones->data(), tombstones->size() * kWordSize, first_leaf, end_leaf)));
+            }
             count += num_leafs;
         }
     }
@@ -449,69 +773,225 @@ uint64_t LoudsSparse::serializedSize() const
     return size;
 }
 
+inline void LoudsSparse::getSerializedPartSizes(std::vector<uint64_t> & sizes) const
+{
+    uint64_t header_size
+        = sizeof(height_) + sizeof(start_level_) + sizeof(node_count_dense_) + sizeof(child_count_dense_) + (sizeof(position_t) * height_);
+    sizeAlign(header_size);
+    sizes.push_back(header_size);
+    sizes.push_back(labels_->serializedSize());
+    sizes.push_back(child_indicator_bits_->serializedSize());
+    sizes.push_back(louds_bits_->serializedSize());
+    sizes.push_back(suffixes_->serializedSize());
+}
+
+inline void LoudsSparse::serializeCompact(CompactWriter & writer) const
+{
+    writer.putVarint(height_);
+    writer.putVarint(start_level_);
+    writer.putVarint(node_count_dense_);
+    writer.putVarint(child_count_dense_);
+    writer.putPacked(level_cuts_, height_);
+    position_t num_items = louds_bits_->numBits();
+    writer.putVarint(num_items);
+    suffixes_->serializeCompact(writer);
+
+    std::vector<char> stream;
+    RangeEncoder encoder(stream);
+    TrieItemModel model;
+    level_t level = start_level_;
+    bool prev_louds = false;
+    bool prev_child = false;
+    label_t prev_label = 0;
+    for (position_t pos = 0; pos < num_items; pos++)
+    {
+        while (level + 1 < height_ && pos > level_cuts_[level])
+            level++;
+        bool louds = louds_bits_->readBit(pos);
+        encoder.encodeBit(model.boundaryProb(level - start_level_, prev_louds), louds);
+        label_t label = labels_->read(pos);
+        encoder.encodeByte(model.labelProbs(louds ? static_cast<unsigned>(TrieItemModel::kNodeStart) : prev_label), label);
+        bool child = child_indicator_bits_->readBit(pos);
+        encoder.encodeBit(model.childProb(level - start_level_, label, prev_child), child);
+        prev_louds = louds;
+        prev_label = label;
+        prev_child = child;
+    }
+    encoder.flush();
+    putRangeCoded(writer, stream);
+}
+
+inline LoudsSparse * LoudsSparse::deSerializeCompact(CompactReader & reader)
+{
+    LoudsSparse * louds_sparse = new LoudsSparse();
+    louds_sparse->height_ = static_cast<level_t>(reader.getVarint(kCompactMaxKeyLen + 1));
+    louds_sparse->start_level_ = static_cast<level_t>(reader.getVarint(louds_sparse->height_));
+    louds_sparse->node_count_dense_ = static_cast<position_t>(reader.getVarint(kMaxPos));
+    louds_sparse->child_count_dense_ = static_cast<position_t>(reader.getVarint(kMaxPos));
+    // every sparse level ends at a larger cut, so the cuts take at least
+    // a bit per level
+    if (louds_sparse->height_ - louds_sparse->start_level_ > reader.remaining() * 8)
+    {
+        reader.fail();
+        louds_sparse->height_ = 0;
+        louds_sparse->start_level_ = 0;
+    }
+    level_t height = louds_sparse->height_;
+    level_t start_level = louds_sparse->start_level_;
+    louds_sparse->level_cuts_ = new position_t[height];
+    reader.getPacked(louds_sparse->level_cuts_, height);
+    position_t num_items = static_cast<position_t>(reader.getVarint(kMaxPos - 1));
+    // the cuts are non-decreasing and the last level ends at the last
+    // position
+    if (num_items > 0 && (height == start_level || louds_sparse->level_cuts_[height - 1] != num_items - 1))
+        reader.fail();
+    for (level_t level = start_level + 1; level < height; level++)
+    {
+        if (louds_sparse->level_cuts_[level] < louds_sparse->level_cuts_[level - 1])
+            reader.fail();
+    }
+    louds_sparse->suffixes_ = BitvectorSuffix::deSerializeCompact(reader);
+    RangeDecoder decoder = getRangeCoded(reader);
+    // an item is ten coded bits, which the stream must be able to hold
+    if (num_items > decoder.maxBits() / 10)
+        reader.fail();
+    if (reader.failed())
+        num_items = 0;
+
+    LabelVector * labels = new LabelVector(num_items);
+    BitvectorRank * child_indicator_bits = new BitvectorRank(kRankBasicBlockSize, num_items, kChildRankLayout);
+    BitvectorSelect * louds_bits = new BitvectorSelect(kSelectSampleInterval, num_items, kSelectSubSampleInterval);
+    TrieItemModel model;
+    level_t level = start_level;
+    bool prev_louds = false;
+    bool prev_child = false;
+    label_t prev_label = 0;
+    for (position_t pos = 0; pos < num_items && !decoder.overrun(); pos++)
+    {
+        while (level + 1 < height && pos > louds_sparse->level_cuts_[level])
+            level++;
+        bool louds = decoder.decodeBit(model.boundaryProb(level - start_level, prev_louds));
+        label_t label = decoder.decodeByte(model.labelProbs(louds ? static_cast<unsigned>(TrieItemModel::kNodeStart) : prev_label));
+        bool child = decoder.decodeBit(model.childProb(level - start_level, label, prev_child));
+        if (louds)
+            louds_bits->setBit(pos);
+        labels->write(pos, label);
+        if (child)
+            child_indicator_bits->setBit(pos);
+        prev_louds = louds;
+        prev_label = label;
+        prev_child = child;
+    }
+    if (decoder.overrun())
+        reader.fail();
+    child_indicator_bits->initRankIndex();
+    louds_bits->initSelectIndex();
+    louds_sparse->labels_ = labels;
+    louds_sparse->child_indicator_bits_ = child_indicator_bits;
+    louds_sparse->louds_bits_ = louds_bits;
+    return louds_sparse;
+}
+
+inline void LoudsSparse::setPageCache(PageCache * page_cache, const level_t num_resident_levels)
+{
+    position_t num_resident = 0;
+    if (num_resident_levels > 0 && height_ > start_level_)
+    {
+        level_t last_level = height_ - 1;
+        if (num_resident_levels < height_ - start_level_)
+            last_level = start_level_ + num_resident_levels - 1;
+        num_resident = level_cuts_[last_level] + 1;
+    }
+    labels_->setPageCache(page_cache, num_resident);
+    child_indicator_bits_->setPageCache(page_cache, num_resident);
+    louds_bits_->setPageCache(page_cache, num_resident);
+    // leaves before num_resident (the rank reads pinned words only)
+    position_t num_resident_leaves = (num_resident > 0) ? (num_resident - child_indicator_bits_->rank(num_resident - 1)) : 0;
+    suffixes_->setPageCache(page_cache, num_resident_leaves);
+    is_paged_ = true;
+}
+
 inline uint64_t LoudsSparse::getMemoryUsage() const
 {
     return (sizeof(this) + labels_->size() + child_indicator_bits_->size() + louds_bits_->size() + suffixes_->size());
 }
 
+inline position_t LoudsSparse::getNumLeaves() const
+{
+    position_t num_bits = louds_bits_->numBits();
+    if (num_bits == 0)
+        return 0;
+    if (is_paged_)
+        return num_bits - child_indicator_bits_->rank<true>(num_bits - 1);
+    return num_bits - child_indicator_bits_->rank<false>(num_bits - 1);
+}
+
+template <bool kPaged>
 inline position_t LoudsSparse::getChildNodeNum(const position_t pos) const
 {
-    return (child_indicator_bits_->rank(pos) + child_count_dense_);
+    return (child_indicator_bits_->rank<kPaged>(pos) + child_count_dense_);
 }
 
+template <bool kPaged>
 inline position_t LoudsSparse::getFirstLabelPos(const position_t node_num) const
 {
-    return louds_bits_->select(node_num + 1 - node_count_dense_);
+    return louds_bits_->select<kPaged>(node_num + 1 - node_count_dense_);
 }
 
+template <bool kPaged>
 inline position_t LoudsSparse::getLastLabelPos(const position_t node_num) const
 {
     position_t next_rank = node_num + 2 - node_count_dense_;
     if (next_rank > louds_bits_->numOnes())
         return (louds_bits_->numBits() - 1);
-    return (louds_bits_->select(next_rank) - 1);
+    return (louds_bits_->select<kPaged>(next_rank) - 1);
 }
 
+template <bool kPaged>
 inline position_t LoudsSparse::getSuffixPos(const position_t pos) const
 {
-    return (pos - child_indicator_bits_->rank(pos));
+    return (pos - child_indicator_bits_->rank<kPaged>(pos));
 }
 
+template <bool kPaged>
 inline position_t LoudsSparse::nodeSize(const position_t pos) const
 {
-    assert(louds_bits_->readBit(pos));
-    return louds_bits_->distanceToNextSetBit(pos);
+    assert(louds_bits_->readBit<kPaged>(pos));
+    return louds_bits_->distanceToNextSetBit<kPaged>(pos);
 }
 
+template <bool kPaged>
 inline bool LoudsSparse::isEndofNode(const position_t pos) const
 {
-    return ((pos == louds_bits_->numBits() - 1) || louds_bits_->readBit(pos + 1));
+    return ((pos == louds_bits_->numBits() - 1) || louds_bits_->readBit<kPaged>(pos + 1));
 }
 
+template <bool kPaged>
 inline void
 LoudsSparse::moveToLeftInNextSubtrie(position_t pos, const position_t node_size, const label_t label, LoudsSparse::Iter & iter) const
 {
     // if no label is greater than key[level] in this node
-    if (!labels_->searchGreaterThan(label, pos, node_size))
+    if (!labels_->searchGreaterThan<kPaged>(label, pos, node_size))
     {
-        iter.append(pos + node_size - 1);
-        return iter++;
+        iter.append<kPaged>(pos + node_size - 1);
+        return iter.next<kPaged>();
     }
     else
     {
-        iter.append(pos);
-        return iter.moveToLeftMostKey();
+        iter.append<kPaged>(pos);
+        return iter.moveToLeftMostKey<kPaged>();
     }
 }
 
+template <bool kPaged>
 inline bool
-LoudsSparse::compareSuffixGreaterThan(const position_t pos, const std::string & key, const level_t level, LoudsSparse::Iter & iter) const
+LoudsSparse::compareSuffixGreaterThan(const position_t pos, const KeyView & key, const level_t level, LoudsSparse::Iter & iter) const
 {
-    position_t suffix_pos = getSuffixPos(pos);
-    int compare = suffixes_->compare(suffix_pos, key, level);
+    position_t suffix_pos = getSuffixPos<kPaged>(pos);
+    int compare = suffixes_->compare<kPaged>(suffix_pos, key, level);
     if ((compare != kCouldBePositive) && (compare < 0))
     {
-        iter++;
+        iter.next<kPaged>();
         return false;
     }
     iter.is_valid_ = true;
@@ -527,36 +1007,62 @@ inline void LoudsSparse::Iter::clear()
     is_at_terminator_ = false;
 }
 
-inline int LoudsSparse::Iter::compare(const std::string & key) const
+inline void LoudsSparse::Iter::reset()
+{
+    clear();
+    start_node_num_ = 0;
+    key_.fill(0);
+    pos_in_trie_.fill(0);
+}
+
+// Compares the key bytes in place; the part of key below start_level_
+// is compared by the dense iterator
+inline int LoudsSparse::Iter::compare(const KeyView & key) const
+{
+    if (trie_->is_paged_)
+        return compare<true>(key);
+    return compare<false>(key);
+}
+
+template <bool kPaged>
+inline int LoudsSparse::Iter::compare(const KeyView & key) const
 {
-    if (is_at_terminator_ && (key_len_ - 1) < (key.length() - start_level_))
+    level_t key_sparse_len = (key.length() > start_level_) ? static_cast<level_t>(key.length() - start_level_) : 0;
+    if (is_at_terminator_ && (key_len_ - 1) < key_sparse_len)
         return -1;
-    std::string iter_key = getKey();
-    std::string key_sparse = key.substr(start_level_);
-    std::string key_sparse_same_length = key_sparse.substr(0, iter_key.length());
-    int compare = iter_key.compare(key_sparse_same_length);
+    level_t len = 0;
+    if (is_valid_)
+        len = is_at_terminator_ ? (key_len_ - 1) : key_len_;
+    const char * key_sparse = key.data() + (key.length() - key_sparse_len);
+    int compare = compareKeyBytes(key_.data(), len, key_sparse, key_sparse_len);
     if (compare != 0)
         return compare;
-    position_t suffix_pos = trie_->getSuffixPos(pos_in_trie_[key_len_ - 1]);
-    return trie_->suffixes_->compare(suffix_pos, key_sparse, key_len_);
+    position_t suffix_pos = trie_->getSuffixPos<kPaged>(pos_in_trie_[key_len_ - 1]);
+    return trie_->suffixes_->compare<kPaged>(suffix_pos, key, start_level_ + key_len_);
 }
 
 inline std::string LoudsSparse::Iter::getKey() const
+{
+    std::string key;
+    appendKey(key);
+    return key;
+}
+
+inline void LoudsSparse::Iter::appendKey(std::string & key) const
 {
     if (!is_valid_)
-        return std::string();
+        return;
     level_t len = key_len_;
     if (is_at_terminator_)
         len--;
-    return std::string(reinterpret_cast<const char *>(key_.data()), static_cast<size_t>(len));
+    key.append(reinterpret_cast<const char *>(key_.data()), static_cast<size_t>(len));
 }
 
 inline int LoudsSparse::Iter::getSuffix(word_t * suffix) const
 {
     if ((trie_->suffixes_->getType() == kReal) || (trie_->suffixes_->getType() == kMixed))
     {
-        position_t suffix_pos = trie_->getSuffixPos(pos_in_trie_[key_len_ - 1]);
-        *suffix = trie_->suffixes_->readReal(suffix_pos);
+        *suffix = trie_->is_paged_ ? readRealSuffix<true>() : readRealSuffix<false>();
         return trie_->suffixes_->getRealSuffixLen();
     }
     *suffix = 0;
@@ -568,8 +1074,7 @@ inline std::string LoudsSparse::Iter::getKeyWithSuffix(unsigned * bitlen) const
     std::string iter_key = getKey();
     if ((trie_->suffixes_->getType() == kReal) || (trie_->suffixes_->getType() == kMixed))
     {
-        position_t suffix_pos = trie_->getSuffixPos(pos_in_trie_[key_len_ - 1]);
-        word_t suffix = trie_->suffixes_->readReal(suffix_pos);
+        word_t suffix = trie_->is_paged_ ? readRealSuffix<true>() : readRealSuffix<false>();
         if (suffix > 0)
         {
             level_t suffix_len = trie_->suffixes_->getRealSuffixLen();
@@ -589,10 +1094,18 @@ inline std::string LoudsSparse::Iter::getKeyWithSuffix(unsigned * bitlen) const
     return iter_key;
 }
 
+template <bool kPaged>
+inline word_t LoudsSparse::Iter::readRealSuffix() const
+{
+    position_t suffix_pos = trie_->getSuffixPos<kPaged>(pos_in_trie_[key_len_ - 1]);
+    return trie_->suffixes_->readReal<kPaged>(suffix_pos);
+}
+
+template <bool kPaged>
 inline void LoudsSparse::Iter::append(const position_t pos)
 {
     assert(key_len_ < key_.size());
-    key_[key_len_] = trie_->labels_->read(pos);
+    key_[key_len_] = trie_->labels_->read<kPaged>(pos);
     pos_in_trie_[key_len_] = pos;
     key_len_++;
 }
@@ -605,43 +1118,68 @@ inline void LoudsSparse::Iter::append(const label_t label, const position_t pos)
     key_len_++;
 }
 
+template <bool kPaged>
 inline void LoudsSparse::Iter::set(const level_t level, const position_t pos)
 {
     assert(level < key_.size());
-    key_[level] = trie_->labels_->read(pos);
+    key_[level] = trie_->labels_->read<kPaged>(pos);
     pos_in_trie_[level] = pos;
 }
 
+inline void LoudsSparse::Iter::setToFirstLabelInRoot()
+{
+    if (trie_->is_paged_)
+        return setToFirstLabelInRoot<true>();
+    return setToFirstLabelInRoot<false>();
+}
+
+template <bool kPaged>
 inline void LoudsSparse::Iter::setToFirstLabelInRoot()
 {
     assert(start_level_ == 0);
     pos_in_trie_[0] = 0;
-    key_[0] = trie_->labels_->read(0);
+    key_[0] = trie_->labels_->read<kPaged>(0);
 }
 
+inline void LoudsSparse::Iter::setToLastLabelInRoot()
+{
+    if (trie_->is_paged_)
+        return setToLastLabelInRoot<true>();
+    return setToLastLabelInRoot<false>();
+}
+
+template <bool kPaged>
 inline void LoudsSparse::Iter::setToLastLabelInRoot()
 {
     assert(start_level_ == 0);
-    pos_in_trie_[0] = trie_->getLastLabelPos(0);
-    key_[0] = trie_->labels_->read(pos_in_trie_[0]);
+    pos_in_trie_[0] = trie_->getLastLabelPos<kPaged>(0);
+    key_[0] = trie_->labels_->read<kPaged>(pos_in_trie_[0]);
+}
+
+inline void LoudsSparse::Iter::moveToLeftMostKey()
+{
+    if (trie_->is_paged_)
+        return moveToLeftMostKey<true>();
+    return moveToLeftMostKey<false>();
 }
 
+template <bool kPaged>
 inline void LoudsSparse::Iter::moveToLeftMostKey()
 {
     if (key_len_ == 0)
     {
-        position_t pos = trie_->getFirstLabelPos(start_node_num_);
-        label_t label = trie_->labels_->read(pos);
+        position_t pos = trie_->getFirstLabelPos<kPaged>(start_node_num_);
+        label_t label = trie_->labels_->read<kPaged>(pos);
         append(label, pos);
     }
 
     level_t level = key_len_ - 1;
     position_t pos = pos_in_trie_[level];
-    label_t label = trie_->labels_->read(pos);
+    label_t label = trie_->labels_->read<kPaged>(pos);
 
-    if (!trie_->child_indicator_bits_->readBit(pos))
+    if (!trie_->child_indicator_bits_->readBit<kPaged>(pos))
     {
-        if ((label == kTerminator) && !trie_->isEndofNode(pos))
+        if ((label == kTerminator) && !trie_->isEndofNode<kPaged>(pos))
             is_at_terminator_ = true;
         is_valid_ = true;
         return;
@@ -649,14 +1187,14 @@ inline void LoudsSparse::Iter::moveToLeftMostKey()
 
     while (level < trie_->getHeight())
     {
-        position_t node_num = trie_->getChildNodeNum(pos);
-        pos = trie_->getFirstLabelPos(node_num);
-        label = trie_->labels_->read(pos);
+        position_t node_num = trie_->getChildNodeNum<kPaged>(pos);
+        pos = trie_->getFirstLabelPos<kPaged>(node_num);
+        label = trie_->labels_->read<kPaged>(pos);
         // if trie branch terminates
-        if (!trie_->child_indicator_bits_->readBit(pos))
+        if (!trie_->child_indicator_bits_->readBit<kPaged>(pos))
         {
             append(label, pos);
-            if ((label == kTerminator) && !trie_->isEndofNode(pos))
+            if ((label == kTerminator) && !trie_->isEndofNode<kPaged>(pos))
                 is_at_terminator_ = true;
             is_valid_ = true;
             return;
@@ -667,23 +1205,31 @@ inline void LoudsSparse::Iter::moveToLeftMostKey()
     assert(false); // shouldn't reach here
 }
 
+inline void LoudsSparse::Iter::moveToRightMostKey()
+{
+    if (trie_->is_paged_)
+        return moveToRightMostKey<true>();
+    return moveToRightMostKey<false>();
+}
+
+template <bool kPaged>
 inline void LoudsSparse::Iter::moveToRightMostKey()
 {
     if (key_len_ == 0)
     {
-        position_t pos = trie_->getFirstLabelPos(start_node_num_);
-        pos = trie_->getLastLabelPos(start_node_num_);
-        label_t label = trie_->labels_->read(pos);
+        position_t pos = trie_->getFirstLabelPos<kPaged>(start_node_num_);
+        pos = trie_->getLastLabelPos<kPaged>(start_node_num_);
+        label_t label = trie_->labels_->read<kPaged>(pos);
         append(label, pos);
     }
 
     level_t level = key_len_ - 1;
     position_t pos = pos_in_trie_[level];
-    label_t label = trie_->labels_->read(pos);
+    label_t label = trie_->labels_->read<kPaged>(pos);
 
-    if (!trie_->child_indicator_bits_->readBit(pos))
+    if (!trie_->child_indicator_bits_->readBit<kPaged>(pos))
     {
-        if ((label == kTerminator) && !trie_->isEndofNode(pos))
+        if ((label == kTerminator) && !trie_->isEndofNode<kPaged>(pos))
             is_at_terminator_ = true;
         is_valid_ = true;
         return;
@@ -691,14 +1237,14 @@ inline void LoudsSparse::Iter::moveToRightMostKey()
 
     while (level < trie_->getHeight())
     {
-        position_t node_num = trie_->getChildNodeNum(pos);
-        pos = trie_->getLastLabelPos(node_num);
-        label = trie_->labels_->read(pos);
+        position_t node_num = trie_->getChildNodeNum<kPaged>(pos);
+        pos = trie_->getLastLabelPos<kPaged>(node_num);
+        label = trie_->labels_->read<kPaged>(pos);
         // if trie branch terminates
-        if (!trie_->child_indicator_bits_->readBit(pos))
+        if (!trie_->child_indicator_bits_->readBit<kPaged>(pos))
         {
             append(label, pos);
-            if ((label == kTerminator) && !trie_->isEndofNode(pos))
+            if ((label == kTerminator) && !trie_->isEndofNode<kPaged>(pos))
                 is_at_terminator_ = true;
             is_valid_ = true;
             return;
@@ -710,12 +1256,20 @@ inline void LoudsSparse::Iter::moveToRightMostKey()
 }
 
 inline void LoudsSparse::Iter::operator++(int)
+{
+    if (trie_->is_paged_)
+        return next<true>();
+    return next<false>();
+}
+
+template <bool kPaged>
+inline void LoudsSparse::Iter::next()
 {
     assert(key_len_ > 0);
     is_at_terminator_ = false;
     position_t pos = pos_in_trie_[key_len_ - 1];
     pos++;
-    while (pos >= trie_->louds_bits_->numBits() || trie_->louds_bits_->readBit(pos))
+    while (pos >= trie_->louds_bits_->numBits() || trie_->louds_bits_->readBit<kPaged>(pos))
     {
         key_len_--;
         if (key_len_ == 0)
@@ -726,11 +1280,19 @@ inline void LoudsSparse::Iter::operator++(int)
         pos = pos_in_trie_[key_len_ - 1];
         pos++;
     }
-    set(key_len_ - 1, pos);
-    return moveToLeftMostKey();
+    set<kPaged>(key_len_ - 1, pos);
+    return moveToLeftMostKey<kPaged>();
 }
 
 inline void LoudsSparse::Iter::operator--(int)
+{
+    if (trie_->is_paged_)
+        return prev<true>();
+    return prev<false>();
+}
+
+template <bool kPaged>
+inline void LoudsSparse::Iter::prev()
 {
     assert(key_len_ > 0);
     is_at_terminator_ = false;
@@ -740,7 +1302,7 @@ inline void LoudsSparse::Iter::operator--(int)
         is_valid_ = false;
         return;
     }
-    while (trie_->louds_bits_->readBit(pos))
+    while (trie_->louds_bits_->readBit<kPaged>(pos))
     {
         key_len_--;
         if (key_len_ == 0)
@@ -751,8 +1313,8 @@ inline void LoudsSparse::Iter::operator--(int)
         pos = pos_in_trie_[key_len_ - 1];
     }
     pos--;
-    set(key_len_ - 1, pos);
-    return moveToRightMostKey();
+    set<kPaged>(key_len_ - 1, pos);
+    return moveToRightMostKey<kPaged>();
 }
 
 } // namespace surf
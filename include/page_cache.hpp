@@ -0,0 +1,264 @@
+#ifndef PAGECACHE_H_
+#define PAGECACHE_H_
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cassert>
+
+#include <vector>
+
+#include "config.hpp"
+
+namespace surf
+{
+
+// Fixed-size page cache that serves a byte range of a file as one
+// contiguous memory region (see SuRF::openTiered).
+//
+// The region is reserved up front with no access rights. Pinned ranges
+// are read in once and stay. Every other page is read from the file by
+// the first touch() that covers it and kept in one of capacity slots;
+// when the slots are full, a page is evicted in CLOCK order: its memory
+// goes back to the OS and its access rights are revoked, so that a read
+// that skips touch() faults instead of returning wrong data.
+//
+// Readers call touch() on the bytes they are about to read. The pages
+// of one touch() are never evicted by that touch(). touch() changes the
+// cache: one region must not be read from several threads at once.
+//
+// A page that cannot be read from the file (an I/O error, or the file
+// was truncated) is filled with zeros instead, and the cache is marked
+// failed() for good: it stops paging, and every page not in memory
+// then reads as zeros. The data read through it is wrong, but readable,
+// and nothing is reported to the reader: the owner checks failed() and
+// decides what a failure means for it.
+class PageCache
+{
+public:
+    // Takes over fd. Returns nullptr if the region cannot be reserved.
+    // page_size is rounded up to a multiple of the OS page size.
+    static inline PageCache *
+    create(const int fd, const uint64_t file_offset, const uint64_t size, const uint64_t page_size, const uint64_t capacity);
+
+    ~PageCache()
+    {
+        munmap(region_, num_pages_ << page_shift_);
+        close(fd_);
+    }
+
+    PageCache(const PageCache &) = delete;
+    PageCache & operator=(const PageCache &) = delete;
+
+    inline char * getRegion() const { return region_; }
+    inline uint64_t getPageSize() const { return 1ULL << page_shift_; }
+    inline uint64_t getCapacity() const { return slots_.size(); }
+
+    // Reads in the pages that overlap [ptr, ptr + len) for good.
+    // REQUIRED: no page has been cached yet (call before the first touch)
+    inline void pin(const void * ptr, const uint64_t len);
+
+    // Makes [ptr, ptr + len) readable; bytes past the region end are
+    // ignored
+    inline void touch(const void * ptr, const uint64_t len)
+    {
+        if (error_ != 0)
+            return;
+        uint64_t begin = static_cast<uint64_t>(static_cast<const char *>(ptr) - region_);
+        uint64_t first = begin >> page_shift_;
+        uint64_t last = (begin + ((len > 0) ? (len - 1) : 0)) >> page_shift_;
+        if (last >= num_pages_)
+            last = num_pages_ - 1;
+        for (uint64_t page = first; page <= last; page++)
+        {
+            if (states_[page] == kPageAbsent)
+            {
+                fault(first, last);
+                return;
+            }
+            referenced_[page] = 1;
+        }
+    }
+
+    // True once a page could not be read (see above); getError() is the
+    // errno of the first failure (EIO if the file ended early)
+    inline bool failed() const { return error_ != 0; }
+    inline int getError() const { return error_; }
+
+    // touch() calls that had to read from the file
+    inline uint64_t getNumFaults() const { return num_faults_; }
+    inline uint64_t getNumPageReads() const { return num_page_reads_; }
+    inline uint64_t getNumEvictions() const { return num_evictions_; }
+    inline uint64_t getNumPinnedPages() const { return num_pinned_; }
+    inline uint64_t getNumCachedPages() const { return num_cached_; }
+    // Memory the region holds right now
+    inline uint64_t getResidentBytes() const { return (num_pinned_ + num_cached_) << page_shift_; }
+
+private:
+    enum PageState
+    {
+        kPageAbsent = 0,
+        kPagePinned = 1,
+        kPageCached = 2
+    };
+
+    PageCache() { }
+
+    // Reads the absent pages of [first, last], evicting pages outside
+    // that range when the slots are full
+    inline void fault(const uint64_t first, const uint64_t last);
+    inline uint64_t takeSlot(const uint64_t first, const uint64_t last);
+    inline void readPage(const uint64_t page);
+    // Makes the whole region readable after a failed read: the absent
+    // pages read as zeros from then on
+    inline void openRegion();
+
+    int fd_;
+    uint64_t file_offset_;
+    uint64_t size_;
+    unsigned page_shift_;
+    uint64_t num_pages_;
+    char * region_;
+
+    std::vector<uint8_t> states_; // PageState per page
+    std::vector<uint8_t> referenced_; // CLOCK reference bit per page
+    std::vector<uint64_t> slots_; // page held by each slot
+    uint64_t clock_hand_ = 0;
+
+    uint64_t num_pinned_ = 0;
+    uint64_t num_cached_ = 0;
+    uint64_t num_faults_ = 0;
+    uint64_t num_page_reads_ = 0;
+    uint64_t num_evictions_ = 0;
+    int error_ = 0;
+};
+
+// A touch() spans at most a label node with its search padding or a
+// short bit scan: a handful of slots always leaves one to evict
+static const uint64_t kMinCachePages = 8;
+
+inline PageCache *
+PageCache::create(const int fd, const uint64_t file_offset, const uint64_t size, const uint64_t page_size, const uint64_t capacity)
+{
+    uint64_t os_page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    unsigned page_shift = 0;
+    while ((1ULL << page_shift) < page_size || (1ULL << page_shift) < os_page_size)
+        page_shift++;
+    uint64_t num_pages = (size + (1ULL << page_shift) - 1) >> page_shift;
+    if (num_pages == 0)
+        num_pages = 1;
+    void * region = mmap(nullptr, num_pages << page_shift, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED)
+        return nullptr;
+
+    PageCache * cache = new PageCache();
+    cache->fd_ = fd;
+    cache->file_offset_ = file_offset;
+    cache->size_ = size;
+    cache->page_shift_ = page_shift;
+    cache->num_pages_ = num_pages;
+    cache->region_ = static_cast<char *>(region);
+    cache->states_.assign(num_pages, kPageAbsent);
+    cache->referenced_.assign(num_pages, 0);
+    cache->slots_.assign((capacity < kMinCachePages) ? kMinCachePages : capacity, 0);
+    return cache;
+}
+
+inline void PageCache::pin(const void * ptr, const uint64_t len)
+{
+    assert(num_cached_ == 0);
+    if (len == 0)
+        return;
+    uint64_t begin = static_cast<uint64_t>(static_cast<const char *>(ptr) - region_);
+    uint64_t last = (begin + len - 1) >> page_shift_;
+    if (last >= num_pages_)
+        last = num_pages_ - 1;
+    for (uint64_t page = begin >> page_shift_; page <= last; page++)
+    {
+        if (states_[page] != kPageAbsent)
+            continue;
+        readPage(page);
+        states_[page] = kPagePinned;
+        num_pinned_++;
+        if (error_ != 0)
+            return openRegion();
+    }
+}
+
+inline void PageCache::fault(const uint64_t first, const uint64_t last)
+{
+    num_faults_++;
+    for (uint64_t page = first; page <= last; page++)
+    {
+        if (states_[page] != kPageAbsent)
+            continue;
+        uint64_t slot = takeSlot(first, last);
+        readPage(page);
+        slots_[slot] = page;
+        states_[page] = kPageCached;
+        referenced_[page] = 1;
+        // zeroed data may ask for more pages than the slots hold
+        if (error_ != 0)
+            return openRegion();
+    }
+}
+
+inline uint64_t PageCache::takeSlot(const uint64_t first, const uint64_t last)
+{
+    if (num_cached_ < slots_.size())
+        return num_cached_++;
+    while (true)
+    {
+        uint64_t slot = clock_hand_;
+        clock_hand_ = (clock_hand_ + 1 == slots_.size()) ? 0 : (clock_hand_ + 1);
+        uint64_t page = slots_[slot];
+        if (page >= first && page <= last)
+            continue;
+        if (referenced_[page])
+        {
+            referenced_[page] = 0;
+            continue;
+        }
+        char * addr = region_ + (page << page_shift_);
+        madvise(addr, 1ULL << page_shift_, MADV_DONTNEED);
+        mprotect(addr, 1ULL << page_shift_, PROT_NONE);
+        states_[page] = kPageAbsent;
+        num_evictions_++;
+        return slot;
+    }
+}
+
+inline void PageCache::readPage(const uint64_t page)
+{
+    uint64_t offset = page << page_shift_;
+    uint64_t len = ((size_ - offset) < (1ULL << page_shift_)) ? (size_ - offset) : (1ULL << page_shift_);
+    char * addr = region_ + offset;
+    mprotect(addr, 1ULL << page_shift_, PROT_READ | PROT_WRITE);
+    uint64_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = pread(fd_, addr + done, len - done, static_cast<off_t>(file_offset_ + offset + done));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            if (error_ == 0)
+                error_ = (n < 0) ? errno : EIO;
+            memset(addr + done, 0, len - done);
+            break;
+        }
+        done += static_cast<uint64_t>(n);
+    }
+    num_page_reads_++;
+}
+
+inline void PageCache::openRegion()
+{
+    mprotect(region_, num_pages_ << page_shift_, PROT_READ | PROT_WRITE);
+}
+
+} // namespace surf
+
+#endif // PAGECACHE_H_
@@ -4,7 +4,9 @@
 #include "bitvector.hpp"
 
 #include <cassert>
+#include <cstdlib>
 
+#include <new>
 #include <vector>
 
 #include "surfpopcount.h"
@@ -12,11 +14,31 @@
 namespace surf
 {
 
+// Two rank directory layouts are supported:
+//
+// kRankLut: the plain bit array plus rank_lut_, one cumulative count per
+// basic block. A rank reads the table and popcounts up to a basic block
+// of bits, touching two cache lines.
+//
+// kRankInterleaved (rank9/Poppy style): bits_ is an array of 64-byte
+// blocks, each holding
+//   word 0:    number of 1's before the block
+//   word 1:    6 x 9-bit counts of 1's before each data word in the block
+//   words 2-7: 384 bits of the bitvector
+// A rank reads one cache line and does a single popcount.
+// basic_block_size is ignored in this layout.
+//
+// The serialize() image is num_bits_, basic_block_size_, the bits and
+// the rank LUT (kRankLut only). The layout is kept in the top bit of the
+// serialized basic_block_size_ (kInterleavedFlag), so a kRankLut image
+// is the same as before the interleaved layout existed, and such older
+// images still load.
 class BitvectorRank : public Bitvector
 {
 public:
     BitvectorRank()
         : basic_block_size_(0)
+        , layout_(kRankLut)
         , rank_lut_(nullptr)
     {
     }
@@ -26,50 +48,153 @@ public:
         const std::vector<std::vector<word_t>> & bitvector_per_level,
         const std::vector<position_t> & num_bits_per_level,
         const level_t start_level = 0,
-        const level_t end_level = 0 /* non-inclusive */)
+        const level_t end_level = 0 /* non-inclusive */,
+        const RankLayout layout = kRankLut)
         : Bitvector(bitvector_per_level, num_bits_per_level, start_level, end_level)
     {
         basic_block_size_ = basic_block_size;
-        initRankLut();
+        layout_ = layout;
+        rank_lut_ = nullptr;
+        if (layout_ == kRankInterleaved)
+            initInterleavedBlocks();
+        else
+            initRankLut();
+    }
+
+    // num_bits 0's, already in the final layout; fill them in with setBit,
+    // then call initRankIndex before the first rank
+    BitvectorRank(const position_t basic_block_size, const position_t num_bits, const RankLayout layout)
+    {
+        basic_block_size_ = basic_block_size;
+        layout_ = layout;
+        rank_lut_ = nullptr;
+        num_bits_ = num_bits;
+        bits_ = allocBits();
+        memset(bits_, 0, bitsSize());
     }
 
     ~BitvectorRank() { }
 
+    inline void initRankIndex()
+    {
+        if (layout_ == kRankInterleaved)
+            initBlockHeaders();
+        else
+            initRankLut();
+    }
+
     // Counts the number of 1's in the bitvector up to position pos.
     // pos is zero-based; count is one-based.
     // E.g., for bitvector: 100101000, rank(3) = 2
+    template <bool kPaged = false>
     inline position_t rank(position_t pos) const
     {
         assert(pos <= num_bits_);
+        if (layout_ == kRankInterleaved)
+        {
+            position_t block_id = pos / kBlockBits;
+            position_t offset = pos - block_id * kBlockBits;
+            position_t word_in_block = offset / kWordSize;
+            const word_t * block = bits_ + block_id * kBlockWords;
+            touchWords<kPaged>(block, kBlockWords);
+            return static_cast<position_t>(
+                block[0] + ((block[1] >> (kSubCountWidth * word_in_block)) & kSubCountMask)
+                + popcount(block[kBlockHeaderWords + word_in_block] >> (kWordSize - 1 - (offset & (kWordSize - 1)))));
+        }
         position_t word_per_basic_block = basic_block_size_ / kWordSize;
         position_t block_id = pos / basic_block_size_;
         position_t offset = pos & (basic_block_size_ - 1);
+        touchWords<kPaged>(bits_ + block_id * word_per_basic_block, offset / kWordSize + 1);
         return (rank_lut_[block_id] + static_cast<position_t>(popcountLinear(bits_, block_id * word_per_basic_block, offset + 1)));
     }
 
-    inline position_t rankLutSize() const { return ((num_bits_ / basic_block_size_ + 1) * sizeof(position_t)); }
+    // readBit, setBit and distanceToNext/PrevSetBit hide the Bitvector
+    // versions, which assume the plain layout, and are not virtual: call
+    // them on a BitvectorRank, never through a Bitvector & or pointer.
+    template <bool kPaged = false>
+    inline bool readBit(const position_t pos) const
+    {
+        assert(pos <= num_bits_);
+        const word_t * word = bits_ + wordIndex(pos / kWordSize);
+        touchWords<kPaged>(word, 1);
+        return *word & (kMsbMask >> (pos & (kWordSize - 1)));
+    }
+
+    inline void setBit(const position_t pos)
+    {
+        assert(pos < num_bits_);
+        bits_[wordIndex(pos / kWordSize)] |= (kMsbMask >> (pos & (kWordSize - 1)));
+    }
+
+    template <bool kPaged = false>
+    inline position_t distanceToNextSetBit(const position_t pos) const;
+    template <bool kPaged = false>
+    inline position_t distanceToPrevSetBit(const position_t pos) const;
+
+    inline RankLayout layout() const { return layout_; }
+
+    // Pins the words (blocks) holding the first num_resident_bits bits and
+    // the rank LUT in page_cache, whose region bits_ points into; the other
+    // words are paged in by the paged reads that need them
+    inline void setPageCache(PageCache * page_cache, const position_t num_resident_bits)
+    {
+        position_t num_words = (num_resident_bits + kWordSize - 1) / kWordSize;
+        if (layout_ == kRankInterleaved)
+            num_words = (num_words + kBlockDataWords - 1) / kBlockDataWords * kBlockWords; // whole blocks
+        page_cache->pin(bits_, num_words * sizeof(word_t));
+        page_cache->pin(rank_lut_, rankLutSize());
+        Bitvector::setPageCache(page_cache);
+    }
+
+    // in bytes; includes the block headers in the interleaved layout
+    inline position_t bitsSize() const
+    {
+        if (layout_ == kRankInterleaved)
+            return (numBlocks() * kBlockWords * (kWordSize / 8));
+        return Bitvector::bitsSize();
+    }
+
+    inline position_t rankLutSize() const
+    {
+        if (layout_ == kRankInterleaved)
+            return 0;
+        return ((num_bits_ / basic_block_size_ + 1) * sizeof(position_t));
+    }
 
     inline position_t serializedSize() const
     {
-        position_t size = sizeof(num_bits_) + sizeof(basic_block_size_) + bitsSize() + rankLutSize();
+        position_t size = kHeaderSize + bitsSize() + rankLutSize();
         sizeAlign(size);
         return size;
     }
 
     inline position_t size() const { return (sizeof(BitvectorRank) + bitsSize() + rankLutSize()); }
 
+    // size() of a BitvectorRank over num_bits bits
+    static position_t sizeFor(const position_t num_bits, const position_t basic_block_size, const RankLayout layout)
+    {
+        if (layout == kRankInterleaved)
+            return (sizeof(BitvectorRank) + (num_bits / kBlockBits + 1) * kBlockWords * (kWordSize / 8));
+        position_t num_words = (num_bits + kWordSize - 1) / kWordSize;
+        return (sizeof(BitvectorRank) + num_words * (kWordSize / 8) + (num_bits / basic_block_size + 1) * sizeof(position_t));
+    }
+
+    inline void prefetchBits(const position_t pos) const { __builtin_prefetch(bits_ + wordIndex(pos / kWordSize)); }
+
     inline void prefetch(position_t pos) const
     {
-        __builtin_prefetch(bits_ + (pos / kWordSize));
-        __builtin_prefetch(rank_lut_ + (pos / basic_block_size_));
+        __builtin_prefetch(bits_ + wordIndex(pos / kWordSize));
+        if (layout_ != kRankInterleaved)
+            __builtin_prefetch(rank_lut_ + (pos / basic_block_size_));
     }
 
     inline void serialize(char *& dst) const
     {
         memcpy(dst, &num_bits_, sizeof(num_bits_));
         dst += sizeof(num_bits_);
-        memcpy(dst, &basic_block_size_, sizeof(basic_block_size_));
-        dst += sizeof(basic_block_size_);
+        position_t block_size_and_layout = basic_block_size_ | ((layout_ == kRankInterleaved) ? kInterleavedFlag : 0);
+        memcpy(dst, &block_size_and_layout, sizeof(block_size_and_layout));
+        dst += sizeof(block_size_and_layout);
         memcpy(dst, bits_, bitsSize());
         dst += bitsSize();
         memcpy(dst, rank_lut_, rankLutSize());
@@ -77,37 +202,146 @@ public:
         align(dst);
     }
 
-    static BitvectorRank * deSerialize(char *& src)
+    // zero_copy: point into src instead of copying (see SuRF::deSerialize)
+    static BitvectorRank * deSerialize(char *& src, const bool zero_copy = false)
     {
         BitvectorRank * bv_rank = new BitvectorRank();
-        memcpy(&(bv_rank->num_bits_), src, sizeof(bv_rank->num_bits_));
-        src += sizeof(bv_rank->num_bits_);
-        memcpy(&(bv_rank->basic_block_size_), src, sizeof(bv_rank->basic_block_size_));
-        src += sizeof(bv_rank->basic_block_size_);
+        src += bv_rank->readHeader(src);
 
-        bv_rank->bits_ = new word_t[bv_rank->numWords()];
+        if (zero_copy)
+        {
+            bv_rank->is_borrowed_ = true;
+            bv_rank->bits_ = reinterpret_cast<word_t *>(src);
+            src += bv_rank->bitsSize();
+            if (bv_rank->layout_ != kRankInterleaved)
+            {
+                bv_rank->rank_lut_ = reinterpret_cast<position_t *>(src);
+                src += bv_rank->rankLutSize();
+            }
+            align(src);
+            return bv_rank;
+        }
+
+        bv_rank->bits_ = bv_rank->allocBits();
         memcpy(bv_rank->bits_, src, bv_rank->bitsSize());
         src += bv_rank->bitsSize();
-        bv_rank->rank_lut_ = new position_t[bv_rank->rankLutSize() / sizeof(position_t)];
-        memcpy(bv_rank->rank_lut_, src, bv_rank->rankLutSize());
-        src += bv_rank->rankLutSize();
-
-        //bv_rank->bits_ = const_cast<word_t*>(reinterpret_cast<const word_t*>(src));
-        //src += bv_rank->bitsSize();
-        //bv_rank->rank_lut_ = const_cast<position_t*>(reinterpret_cast<const position_t*>(src));
-        //src += bv_rank->rankLutSize();
-
+        if (bv_rank->layout_ != kRankInterleaved)
+        {
+            bv_rank->rank_lut_ = new position_t[bv_rank->rankLutSize() / sizeof(position_t)];
+            memcpy(bv_rank->rank_lut_, src, bv_rank->rankLutSize());
+            src += bv_rank->rankLutSize();
+        }
         align(src);
         return bv_rank;
     }
 
+    // Bytes the serialize() image at src takes, from its header, or 0 if
+    // the header is invalid or the image does not fit in size bytes.
+    // Nothing past src + size is read.
+    static uint64_t imageSize(const char * src, const uint64_t size)
+    {
+        BitvectorRank bv_rank;
+        if (size < kHeaderSize)
+            return 0;
+        bv_rank.readHeader(src);
+        if (bv_rank.basic_block_size_ == 0)
+            return 0;
+        uint64_t image_size = kHeaderSize + bv_rank.bitsSize();
+        if (bv_rank.layout_ != kRankInterleaved)
+            image_size += (static_cast<uint64_t>(bv_rank.num_bits_) / bv_rank.basic_block_size_ + 1) * sizeof(position_t);
+        sizeAlign(image_size);
+        return (image_size <= size) ? image_size : 0;
+    }
+
     void destroy()
     {
-        delete[] bits_;
+        if (is_borrowed_)
+            return;
+        if (layout_ == kRankInterleaved)
+            free(bits_);
+        else
+            delete[] bits_;
         delete[] rank_lut_;
     }
 
 private:
+    static const position_t kBlockWords = 8; // one cache line
+    static const position_t kBlockHeaderWords = 2;
+    static const position_t kBlockDataWords = kBlockWords - kBlockHeaderWords;
+    static const position_t kBlockBits = kBlockDataWords * kWordSize;
+    static const unsigned kSubCountWidth = 9;
+    static const word_t kSubCountMask = (1 << kSubCountWidth) - 1;
+    // serialized num_bits_ and basic_block_size_, with the layout flag
+    static const position_t kHeaderSize = sizeof(position_t) + sizeof(position_t);
+    // set in the serialized basic_block_size_ of a kRankInterleaved image
+    static const position_t kInterleavedFlag = static_cast<position_t>(1) << (sizeof(position_t) * 8 - 1);
+
+    // Reads the serialized header at src; returns its size
+    inline position_t readHeader(const char * src)
+    {
+        position_t block_size_and_layout;
+        memcpy(&num_bits_, src, sizeof(num_bits_));
+        memcpy(&block_size_and_layout, src + sizeof(num_bits_), sizeof(block_size_and_layout));
+        layout_ = (block_size_and_layout & kInterleavedFlag) ? kRankInterleaved : kRankLut;
+        basic_block_size_ = block_size_and_layout & ~kInterleavedFlag;
+        return kHeaderSize;
+    }
+
+    // one extra block so that rank(num_bits_) never reads past the end
+    inline position_t numBlocks() const { return (num_bits_ / kBlockBits + 1); }
+
+    // Index into bits_ of the word_id-th 64-bit word of the bitvector
+    inline position_t wordIndex(const position_t word_id) const
+    {
+        if (layout_ == kRankInterleaved)
+            return ((word_id / kBlockDataWords) * kBlockWords + kBlockHeaderWords + word_id % kBlockDataWords);
+        return word_id;
+    }
+
+    // Interleaved blocks are aligned to cache lines and released with
+    // free(). Throws std::bad_alloc on failure, like new.
+    inline word_t * allocBits() const
+    {
+        if (layout_ != kRankInterleaved)
+            return new word_t[numWords()];
+        void * blocks = nullptr;
+        if (posix_memalign(&blocks, kBlockWords * sizeof(word_t), bitsSize()) != 0)
+            throw std::bad_alloc();
+        return static_cast<word_t *>(blocks);
+    }
+
+    inline void initInterleavedBlocks()
+    {
+        word_t * blocks = allocBits();
+        memset(blocks, 0, bitsSize());
+        position_t num_words = numWords();
+        for (position_t word_id = 0; word_id < num_words; word_id++)
+            blocks[wordIndex(word_id)] = bits_[word_id];
+        delete[] bits_;
+        bits_ = blocks;
+        initBlockHeaders();
+    }
+
+    // Fills in the two header words of every block from its data words
+    inline void initBlockHeaders()
+    {
+        word_t cumu_rank = 0;
+        for (position_t i = 0; i < numBlocks(); i++)
+        {
+            word_t * block = bits_ + i * kBlockWords;
+            word_t block_rank = 0;
+            word_t sub_counts = 0;
+            for (position_t j = 0; j < kBlockDataWords; j++)
+            {
+                sub_counts |= (block_rank << (kSubCountWidth * j));
+                block_rank += popcount(block[kBlockHeaderWords + j]);
+            }
+            block[0] = cumu_rank;
+            block[1] = sub_counts;
+            cumu_rank += block_rank;
+        }
+    }
+
     inline void initRankLut()
     {
         position_t word_per_basic_block = basic_block_size_ / kWordSize;
@@ -124,9 +358,85 @@ private:
     }
 
     position_t basic_block_size_;
-    position_t * rank_lut_; //rank look-up table
+    RankLayout layout_;
+    position_t * rank_lut_; //rank look-up table (kRankLut only)
 };
 
+template <bool kPaged>
+inline position_t BitvectorRank::distanceToNextSetBit(const position_t pos) const
+{
+    assert(pos < num_bits_);
+    if (layout_ != kRankInterleaved)
+        return Bitvector::distanceToNextSetBit<kPaged>(pos);
+    position_t distance = 1;
+    position_t num_words = numWords();
+
+    position_t word_id = (pos + 1) / kWordSize;
+    position_t offset = (pos + 1) % kWordSize;
+
+    //first word left-over bits
+    touchWords<kPaged>(bits_ + wordIndex(word_id), 1);
+    word_t test_bits = bits_[wordIndex(word_id)] << offset;
+    if (test_bits > 0)
+    {
+        return (distance + __builtin_clzll(test_bits));
+    }
+    else
+    {
+        if (word_id == num_words - 1)
+            return (num_bits_ - pos);
+        distance += (kWordSize - offset);
+    }
+
+    while (word_id < num_words - 1)
+    {
+        word_id++;
+        touchWords<kPaged>(bits_ + wordIndex(word_id), 1);
+        test_bits = bits_[wordIndex(word_id)];
+        if (test_bits > 0)
+            return (distance + __builtin_clzll(test_bits));
+        distance += kWordSize;
+    }
+    return distance;
+}
+
+template <bool kPaged>
+inline position_t BitvectorRank::distanceToPrevSetBit(const position_t pos) const
+{
+    assert(pos <= num_bits_);
+    if (layout_ != kRankInterleaved)
+        return Bitvector::distanceToPrevSetBit<kPaged>(pos);
+    if (pos == 0)
+        return 0;
+    position_t distance = 1;
+
+    position_t word_id = (pos - 1) / kWordSize;
+    position_t offset = (pos - 1) % kWordSize;
+
+    //first word left-over bits
+    touchWords<kPaged>(bits_ + wordIndex(word_id), 1);
+    word_t test_bits = bits_[wordIndex(word_id)] >> (kWordSize - 1 - offset);
+    if (test_bits > 0)
+    {
+        return (distance + __builtin_ctzll(test_bits));
+    }
+    else
+    {
+        distance += (offset + 1);
+    }
+
+    while (word_id > 0)
+    {
+        word_id--;
+        touchWords<kPaged>(bits_ + wordIndex(word_id), 1);
+        test_bits = bits_[wordIndex(word_id)];
+        if (test_bits > 0)
+            return (distance + __builtin_ctzll(test_bits));
+        distance += kWordSize;
+    }
+    return distance;
+}
+
 } // namespace surf
 
 #endif // RANK_H_
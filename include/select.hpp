@@ -5,6 +5,7 @@
 
 #include <cassert>
 
+#include <algorithm>
 #include <vector>
 
 #include "config.hpp"
@@ -13,13 +14,32 @@
 namespace surf
 {
 
+// Two-level select index (darray style).
+//
+// The 1's are grouped into blocks of sample_interval_ 1's. For each block,
+// select_lut_ stores the position of its first 1 and a directory entry:
+// - dense blocks (span < 2^16 bits and every sub-block fits in
+//   kMaxScanWords words) keep one 16-bit offset per sub_sample_interval_
+//   1's in sub_samples_; select finishes with a scan of at most
+//   kMaxScanWords words and a broadword select64.
+// - other blocks store the position of every 1 in explicit_positions_.
+// Either way select does a constant number of memory accesses.
+// Both intervals must be powers of two; a larger sample_interval_
+// or sub_sample_interval_ uses less memory at the cost of longer scans.
 class BitvectorSelect : public Bitvector
 {
 public:
     BitvectorSelect()
         : sample_interval_(0)
+        , sub_sample_interval_(0)
         , num_ones_(0)
+        , num_sub_samples_(0)
+        , num_explicit_(0)
+        , sample_shift_(0)
+        , sub_sample_shift_(0)
         , select_lut_(nullptr)
+        , sub_samples_(nullptr)
+        , explicit_positions_(nullptr)
     {
     }
 
@@ -28,30 +48,62 @@ public:
         const std::vector<std::vector<word_t>> & bitvector_per_level,
         const std::vector<position_t> & num_bits_per_level,
         const level_t start_level = 0,
-        const level_t end_level = 0 /* non-inclusive */)
+        const level_t end_level = 0 /* non-inclusive */,
+        const position_t sub_sample_interval = kDefaultSubSampleInterval)
         : Bitvector(bitvector_per_level, num_bits_per_level, start_level, end_level)
     {
         sample_interval_ = sample_interval;
+        sub_sample_interval_ = (sub_sample_interval < sample_interval) ? sub_sample_interval : sample_interval;
+        initShifts();
         initSelectLut();
     }
 
+    // num_bits 0's, to be filled in with setBit; call initSelectIndex
+    // before the first select
+    BitvectorSelect(
+        const position_t sample_interval, const position_t num_bits, const position_t sub_sample_interval = kDefaultSubSampleInterval)
+        : Bitvector(num_bits)
+        , num_ones_(0)
+        , num_sub_samples_(0)
+        , num_explicit_(0)
+        , select_lut_(nullptr)
+        , sub_samples_(nullptr)
+        , explicit_positions_(nullptr)
+    {
+        sample_interval_ = sample_interval;
+        sub_sample_interval_ = (sub_sample_interval < sample_interval) ? sub_sample_interval : sample_interval;
+        initShifts();
+    }
+
     ~BitvectorSelect() { }
 
+    inline void initSelectIndex() { initSelectLut(); }
+
     // Returns the position of the rank-th 1 bit.
     // position is zero-based; rank is one-based.
     // E.g., for bitvector: 100101000, select(3) = 5
+    // select(numOnes() + 1) returns numBits().
+    template <bool kPaged = false>
     inline position_t select(position_t rank) const
     {
         assert(rank > 0);
         assert(rank <= num_ones_ + 1);
-        position_t lut_idx = rank / sample_interval_;
-        position_t rank_left = rank % sample_interval_;
-        // The first slot in select_lut_ stores the position of the first 1 bit.
-        // Slot i > 0 stores the position of (i * sample_interval_)-th 1 bit
-        if (lut_idx == 0)
-            rank_left--;
+        if (rank > num_ones_)
+            return num_bits_;
+
+        position_t rank0 = rank - 1;
+        position_t block_id = rank0 >> sample_shift_;
+        position_t rank_in_block = rank0 & (sample_interval_ - 1);
+        position_t pos = select_lut_[block_id * 2];
+        position_t dir = select_lut_[block_id * 2 + 1];
+        if (dir & kExplicitBlock)
+            return explicit_positions_[(dir & ~kExplicitBlock) + rank_in_block];
 
-        position_t pos = select_lut_[lut_idx];
+        position_t sub_id = rank_in_block >> sub_sample_shift_;
+        position_t rank_left = rank_in_block & (sub_sample_interval_ - 1);
+        // the first sub-sample of a block is the block sample itself
+        if (sub_id > 0)
+            pos += sub_samples_[dir + sub_id - 1];
 
         if (rank_left == 0)
             return pos;
@@ -67,114 +119,303 @@ public:
         {
             offset++;
         }
+        // a dense block: the scan stays within kMaxScanWords words
+        touchWords<kPaged>(bits_ + word_id, (numWords() - word_id > kMaxScanWords) ? (kMaxScanWords + 1) : (numWords() - word_id));
         word_t word = bits_[word_id] << offset >> offset; //zero-out most significant bits
         position_t ones_count_in_word = popcount(word);
         while (ones_count_in_word < rank_left)
         {
+            // the words of a failed page cache read as zeros (see PageCache)
+            if (kPaged && word_id + 1 >= numWords())
+                return num_bits_ - 1;
             word_id++;
             word = bits_[word_id];
             rank_left -= ones_count_in_word;
             ones_count_in_word = popcount(word);
         }
-        return (word_id * kWordSize + select64_popcount_search(word, rank_left));
+        return (word_id * kWordSize + select64(word, rank_left));
     }
 
-    inline position_t selectLutSize() const { return ((num_ones_ / sample_interval_ + 1) * sizeof(position_t)); }
+    inline position_t numBlocks() const { return ((num_ones_ + sample_interval_ - 1) / sample_interval_); }
+
+    inline position_t selectLutSize() const { return (numBlocks() * 2 * sizeof(position_t)); }
+
+    inline position_t subSamplesSize() const { return (num_sub_samples_ * sizeof(uint16_t)); }
+
+    inline position_t explicitPositionsSize() const { return (num_explicit_ * sizeof(position_t)); }
+
+    // in bytes; all select index structures
+    inline position_t selectIndexSize() const { return (selectLutSize() + subSamplesSize() + explicitPositionsSize()); }
 
     inline position_t serializedSize() const
     {
-        position_t size = sizeof(num_bits_) + sizeof(sample_interval_) + sizeof(num_ones_) + bitsSize() + selectLutSize();
+        position_t size = sizeof(num_bits_) + sizeof(sample_interval_) + sizeof(sub_sample_interval_) + sizeof(num_ones_)
+            + sizeof(num_sub_samples_) + sizeof(num_explicit_) + bitsSize() + selectIndexSize();
         sizeAlign(size);
         return size;
     }
 
-    inline position_t size() const { return (sizeof(BitvectorSelect) + bitsSize() + selectLutSize()); }
+    inline position_t size() const { return (sizeof(BitvectorSelect) + bitsSize() + selectIndexSize()); }
+
+    // size() of a BitvectorSelect over num_bits bits with num_ones 1's,
+    // assuming every block gets sub-samples (blocks that store explicit
+    // positions instead are larger)
+    static position_t sizeFor(
+        const position_t num_bits,
+        const position_t num_ones,
+        const position_t sample_interval,
+        const position_t sub_sample_interval = kDefaultSubSampleInterval)
+    {
+        position_t sub_interval = (sub_sample_interval < sample_interval) ? sub_sample_interval : sample_interval;
+        position_t num_words = (num_bits + kWordSize - 1) / kWordSize;
+        position_t num_blocks = (num_ones + sample_interval - 1) / sample_interval;
+        return (sizeof(BitvectorSelect) + num_words * (kWordSize / 8) + num_blocks * 2 * sizeof(position_t)
+                + num_blocks * (sample_interval / sub_interval - 1) * sizeof(uint16_t));
+    }
 
     inline position_t numOnes() const { return num_ones_; }
 
+    // Pins the words holding the first num_resident_bits bits and the
+    // select index in page_cache, whose region bits_ points into; the
+    // other words are paged in by the paged reads that need them
+    inline void setPageCache(PageCache * page_cache, const position_t num_resident_bits)
+    {
+        page_cache->pin(bits_, (num_resident_bits + kWordSize - 1) / kWordSize * sizeof(word_t));
+        page_cache->pin(select_lut_, selectLutSize());
+        page_cache->pin(explicit_positions_, explicitPositionsSize());
+        page_cache->pin(sub_samples_, subSamplesSize());
+        Bitvector::setPageCache(page_cache);
+    }
+
+    // Prefetches the select look-up table entry used by select(rank)
+    inline void prefetchSelect(position_t rank) const
+    {
+        if (rank == 0 || rank > num_ones_)
+            return;
+        __builtin_prefetch(select_lut_ + (((rank - 1) >> sample_shift_) * 2));
+    }
+
     inline void serialize(char *& dst) const
     {
         memcpy(dst, &num_bits_, sizeof(num_bits_));
         dst += sizeof(num_bits_);
         memcpy(dst, &sample_interval_, sizeof(sample_interval_));
         dst += sizeof(sample_interval_);
+        memcpy(dst, &sub_sample_interval_, sizeof(sub_sample_interval_));
+        dst += sizeof(sub_sample_interval_);
         memcpy(dst, &num_ones_, sizeof(num_ones_));
         dst += sizeof(num_ones_);
+        memcpy(dst, &num_sub_samples_, sizeof(num_sub_samples_));
+        dst += sizeof(num_sub_samples_);
+        memcpy(dst, &num_explicit_, sizeof(num_explicit_));
+        dst += sizeof(num_explicit_);
         memcpy(dst, bits_, bitsSize());
         dst += bitsSize();
         memcpy(dst, select_lut_, selectLutSize());
         dst += selectLutSize();
+        memcpy(dst, explicit_positions_, explicitPositionsSize());
+        dst += explicitPositionsSize();
+        memcpy(dst, sub_samples_, subSamplesSize());
+        dst += subSamplesSize();
         align(dst);
     }
 
-    static BitvectorSelect * deSerialize(char *& src)
+    // zero_copy: point into src instead of copying (see SuRF::deSerialize)
+    static BitvectorSelect * deSerialize(char *& src, const bool zero_copy = false)
     {
         BitvectorSelect * bv_select = new BitvectorSelect();
-        memcpy(&(bv_select->num_bits_), src, sizeof(bv_select->num_bits_));
-        src += sizeof(bv_select->num_bits_);
-        memcpy(&(bv_select->sample_interval_), src, sizeof(bv_select->sample_interval_));
-        src += sizeof(bv_select->sample_interval_);
-        memcpy(&(bv_select->num_ones_), src, sizeof(bv_select->num_ones_));
-        src += sizeof(bv_select->num_ones_);
+        src += bv_select->readHeader(src);
+        bv_select->initShifts();
+
+        if (zero_copy)
+        {
+            bv_select->is_borrowed_ = true;
+            bv_select->bits_ = reinterpret_cast<word_t *>(src);
+            src += bv_select->bitsSize();
+            bv_select->select_lut_ = reinterpret_cast<position_t *>(src);
+            src += bv_select->selectLutSize();
+            bv_select->explicit_positions_ = reinterpret_cast<position_t *>(src);
+            src += bv_select->explicitPositionsSize();
+            bv_select->sub_samples_ = reinterpret_cast<uint16_t *>(src);
+            src += bv_select->subSamplesSize();
+            align(src);
+            return bv_select;
+        }
 
         bv_select->bits_ = new word_t[bv_select->numWords()];
         memcpy(bv_select->bits_, src, bv_select->bitsSize());
         src += bv_select->bitsSize();
-        bv_select->select_lut_ = new position_t[bv_select->selectLutSize() / sizeof(position_t)];
+        bv_select->select_lut_ = new position_t[bv_select->numBlocks() * 2];
         memcpy(bv_select->select_lut_, src, bv_select->selectLutSize());
         src += bv_select->selectLutSize();
+        bv_select->explicit_positions_ = new position_t[bv_select->num_explicit_];
+        memcpy(bv_select->explicit_positions_, src, bv_select->explicitPositionsSize());
+        src += bv_select->explicitPositionsSize();
+        bv_select->sub_samples_ = new uint16_t[bv_select->num_sub_samples_];
+        memcpy(bv_select->sub_samples_, src, bv_select->subSamplesSize());
+        src += bv_select->subSamplesSize();
 
-        //bv_select->bits_ = const_cast<word_t*>(reinterpret_cast<const word_t*>(src));
-        //src += bv_select->bitsSize();
-        //bv_select->select_lut_ = const_cast<position_t*>(reinterpret_cast<const position_t*>(src));
-        //src += bv_select->selectLutSize();
         align(src);
         return bv_select;
     }
 
+    // Bytes the serialize() image at src takes, from its header, or 0 if
+    // the header is invalid or the image does not fit in size bytes.
+    // Nothing past src + size is read.
+    static uint64_t imageSize(const char * src, const uint64_t size)
+    {
+        BitvectorSelect bv_select;
+        if (size < kHeaderSize)
+            return 0;
+        bv_select.readHeader(src);
+        if (!isPowerOfTwo(bv_select.sample_interval_) || !isPowerOfTwo(bv_select.sub_sample_interval_))
+            return 0;
+        uint64_t num_blocks = (static_cast<uint64_t>(bv_select.num_ones_) + bv_select.sample_interval_ - 1) / bv_select.sample_interval_;
+        uint64_t image_size = kHeaderSize + bv_select.bitsSize() + num_blocks * 2 * sizeof(position_t)
+            + static_cast<uint64_t>(bv_select.num_explicit_) * sizeof(position_t)
+            + static_cast<uint64_t>(bv_select.num_sub_samples_) * sizeof(uint16_t);
+        sizeAlign(image_size);
+        return (image_size <= size) ? image_size : 0;
+    }
+
     inline void destroy()
     {
+        if (is_borrowed_)
+            return;
         delete[] bits_;
         delete[] select_lut_;
+        delete[] sub_samples_;
+        delete[] explicit_positions_;
     }
 
+    static const position_t kDefaultSubSampleInterval = 16;
+
 private:
-    // This function currently assumes that the first bit in the
-    // bitvector is one.
+    // a dense block never needs to scan more words than this after its sub-sample
+    static const position_t kMaxScanWords = 8;
+    static const position_t kMaxDenseBlockSpan = 1 << 16; // sub-sample offsets are 16-bit
+    static const position_t kExplicitBlock = 0x80000000; // directory entry flag
+    // serialized num_bits_, the two intervals and the three counts
+    static const position_t kHeaderSize = 6 * sizeof(position_t);
+
+    static bool isPowerOfTwo(const position_t value) { return (value > 0 && (value & (value - 1)) == 0); }
+
+    // Reads the serialized header at src; returns its size
+    inline position_t readHeader(const char * src)
+    {
+        position_t fields[6];
+        memcpy(fields, src, sizeof(fields));
+        num_bits_ = fields[0];
+        sample_interval_ = fields[1];
+        sub_sample_interval_ = fields[2];
+        num_ones_ = fields[3];
+        num_sub_samples_ = fields[4];
+        num_explicit_ = fields[5];
+        return kHeaderSize;
+    }
+
+    inline void initShifts()
+    {
+        assert(isPowerOfTwo(sample_interval_));
+        assert(isPowerOfTwo(sub_sample_interval_));
+        sample_shift_ = __builtin_ctz(sample_interval_);
+        sub_sample_shift_ = __builtin_ctz(sub_sample_interval_);
+    }
+
+    // Decides whether the block of 1's at block_positions can use sub-samples
+    inline bool isDenseBlock(const std::vector<position_t> & block_positions) const
+    {
+        position_t num = static_cast<position_t>(block_positions.size());
+        if (block_positions[num - 1] - block_positions[0] >= kMaxDenseBlockSpan)
+            return false;
+        for (position_t i = 0; i < num; i += sub_sample_interval_)
+        {
+            position_t last = i + sub_sample_interval_ - 1;
+            if (last >= num)
+                last = num - 1;
+            if (block_positions[last] / kWordSize - block_positions[i] / kWordSize >= kMaxScanWords)
+                return false;
+        }
+        return true;
+    }
+
+    inline void addBlock(
+        const std::vector<position_t> & block_positions,
+        std::vector<position_t> & lut,
+        std::vector<uint16_t> & sub_samples,
+        std::vector<position_t> & explicit_positions) const
+    {
+        lut.push_back(block_positions[0]);
+        if (isDenseBlock(block_positions))
+        {
+            lut.push_back(static_cast<position_t>(sub_samples.size()));
+            for (position_t i = sub_sample_interval_; i < sample_interval_; i += sub_sample_interval_)
+            {
+                uint16_t offset = 0;
+                if (i < block_positions.size())
+                    offset = static_cast<uint16_t>(block_positions[i] - block_positions[0]);
+                sub_samples.push_back(offset);
+            }
+        }
+        else
+        {
+            lut.push_back(static_cast<position_t>(explicit_positions.size()) | kExplicitBlock);
+            explicit_positions.insert(explicit_positions.end(), block_positions.begin(), block_positions.end());
+        }
+    }
+
     inline void initSelectLut()
     {
-        position_t num_words = num_bits_ / kWordSize;
-        if (num_bits_ % kWordSize != 0)
-            num_words++;
+        std::vector<position_t> lut;
+        std::vector<uint16_t> sub_samples;
+        std::vector<position_t> explicit_positions;
+        std::vector<position_t> block_positions;
+        block_positions.reserve(sample_interval_);
 
-        std::vector<position_t> select_lut_vector;
-        select_lut_vector.push_back(0); //ASSERT: first bit is 1
-        position_t sampling_ones = sample_interval_;
-        position_t cumu_ones_upto_word = 0;
+        num_ones_ = 0;
+        position_t num_words = numWords();
         for (position_t i = 0; i < num_words; i++)
         {
-            position_t num_ones_in_word = popcount(bits_[i]);
-            while (sampling_ones <= (cumu_ones_upto_word + num_ones_in_word))
+            word_t word = bits_[i];
+            while (word)
             {
-                int diff = sampling_ones - cumu_ones_upto_word;
-                position_t result_pos = i * kWordSize + select64_popcount_search(bits_[i], diff);
-                select_lut_vector.push_back(result_pos);
-                sampling_ones += sample_interval_;
+                int offset = __builtin_clzll(word);
+                block_positions.push_back(i * kWordSize + offset);
+                word &= ~(kMsbMask >> offset);
+                num_ones_++;
+                if (block_positions.size() == sample_interval_)
+                {
+                    addBlock(block_positions, lut, sub_samples, explicit_positions);
+                    block_positions.clear();
+                }
             }
-            cumu_ones_upto_word += popcount(bits_[i]);
         }
+        if (!block_positions.empty())
+            addBlock(block_positions, lut, sub_samples, explicit_positions);
 
-        num_ones_ = cumu_ones_upto_word;
-        position_t num_samples = static_cast<position_t>(select_lut_vector.size());
-        select_lut_ = new position_t[num_samples];
-        for (position_t i = 0; i < num_samples; i++)
-            select_lut_[i] = select_lut_vector[i];
+        num_sub_samples_ = static_cast<position_t>(sub_samples.size());
+        num_explicit_ = static_cast<position_t>(explicit_positions.size());
+        select_lut_ = new position_t[lut.size()];
+        std::copy(lut.begin(), lut.end(), select_lut_);
+        sub_samples_ = new uint16_t[num_sub_samples_];
+        std::copy(sub_samples.begin(), sub_samples.end(), sub_samples_);
+        explicit_positions_ = new position_t[num_explicit_];
+        std::copy(explicit_positions.begin(), explicit_positions.end(), explicit_positions_);
     }
 
 private:
     position_t sample_interval_;
+    position_t sub_sample_interval_;
     position_t num_ones_;
-    position_t * select_lut_; //select look-up table
+    position_t num_sub_samples_;
+    position_t num_explicit_;
+    position_t sample_shift_; // log2(sample_interval_)
+    position_t sub_sample_shift_; // log2(sub_sample_interval_)
+    // per block: position of its first 1, then a sub_samples_ index
+    // or (kExplicitBlock | explicit_positions_ index)
+    position_t * select_lut_;
+    uint16_t * sub_samples_; // offsets from the block's first 1
+    position_t * explicit_positions_;
 };
 
 } // namespace surf
@@ -7,6 +7,7 @@
 
 #include <vector>
 
+#include "compact_codec.hpp"
 #include "config.hpp"
 #include "hash.hpp"
 
@@ -43,15 +44,25 @@ public:
         real_suffix_len_ = real_suffix_len;
     }
 
-    static word_t constructHashSuffix(const std::string & key, const level_t len)
+    // num_bits 0's; suffixes are stored in place with write
+    BitvectorSuffix(const SuffixType type, const level_t hash_suffix_len, const level_t real_suffix_len, const position_t num_bits)
+        : Bitvector(num_bits)
     {
-        word_t suffix = suffixHash(key);
+        assert((hash_suffix_len + real_suffix_len) <= kWordSize);
+        type_ = type;
+        hash_suffix_len_ = hash_suffix_len;
+        real_suffix_len_ = real_suffix_len;
+    }
+
+    static word_t constructHashSuffix(const KeyView & key, const level_t len)
+    {
+        word_t suffix = suffixHash(key.data(), static_cast<int>(key.length()));
         suffix <<= (kWordSize - len - kHashShift);
         suffix >>= (kWordSize - len);
         return suffix;
     }
 
-    static word_t constructRealSuffix(const std::string & key, const level_t level, const level_t len)
+    static word_t constructRealSuffix(const KeyView & key, const level_t level, const level_t len)
     {
         if (key.length() < level || ((key.length() - level) * 8) < len)
             return 0;
@@ -78,7 +89,7 @@ public:
         return suffix;
     }
 
-    static word_t constructMixedSuffix(const std::string & key, const level_t hash_len, const level_t real_level, const level_t real_len)
+    static word_t constructMixedSuffix(const KeyView & key, const level_t hash_len, const level_t real_level, const level_t real_len)
     {
         word_t hash_suffix = constructHashSuffix(key, hash_len);
         word_t real_suffix = constructRealSuffix(key, real_level, real_len);
@@ -89,7 +100,7 @@ public:
     }
 
     static word_t constructSuffix(
-        const SuffixType type, const std::string & key, const level_t hash_len, const level_t real_level, const level_t real_len)
+        const SuffixType type, const KeyView & key, const level_t hash_len, const level_t real_level, const level_t real_len)
     {
         switch (type)
         {
@@ -131,13 +142,35 @@ public:
 
     inline position_t size() const { return (sizeof(BitvectorSuffix) + bitsSize()); }
 
+    // size() of a BitvectorSuffix of num_bits bits
+    static position_t sizeFor(const position_t num_bits)
+    {
+        return (sizeof(BitvectorSuffix) + (num_bits + kWordSize - 1) / kWordSize * (kWordSize / 8));
+    }
+
+    template <bool kPaged = false>
     inline word_t read(const position_t idx) const;
+    // Pins the words holding the first num_resident_suffixes suffixes in
+    // page_cache, whose region bits_ points into; the other words are
+    // paged in by the paged reads that need them
+    inline void setPageCache(PageCache * page_cache, const position_t num_resident_suffixes)
+    {
+        if (type_ == kNone)
+            return;
+        page_cache->pin(bits_, (num_resident_suffixes * getSuffixLen() + kWordSize - 1) / kWordSize * sizeof(word_t));
+        Bitvector::setPageCache(page_cache);
+    }
+    // Stores suffix in the (still empty) idx-th suffix slot
+    inline void write(const position_t idx, const word_t suffix);
+    template <bool kPaged = false>
     inline word_t readReal(const position_t idx) const;
-    inline bool checkEquality(const position_t idx, const std::string & key, const level_t level) const;
+    template <bool kPaged = false>
+    inline bool checkEquality(const position_t idx, const KeyView & key, const level_t level) const;
 
     // Compare stored suffix to querying suffix.
     // kReal suffix type only.
-    inline int compare(const position_t idx, const std::string & key, const level_t level) const;
+    template <bool kPaged = false>
+    inline int compare(const position_t idx, const KeyView & key, const level_t level) const;
 
     inline void serialize(char *& dst) const
     {
@@ -157,42 +190,124 @@ public:
         align(dst);
     }
 
-    static BitvectorSuffix * deSerialize(char *& src)
+    // zero_copy: point into src instead of copying (see SuRF::deSerialize)
+    static BitvectorSuffix * deSerialize(char *& src, const bool zero_copy = false)
     {
         BitvectorSuffix * sv = new BitvectorSuffix();
-        memcpy(&(sv->num_bits_), src, sizeof(sv->num_bits_));
-        src += sizeof(sv->num_bits_);
-        memcpy(&(sv->type_), src, sizeof(sv->type_));
-        src += sizeof(sv->type_);
-        memcpy(&(sv->hash_suffix_len_), src, sizeof(sv->hash_suffix_len_));
-        src += sizeof(sv->hash_suffix_len_);
-        memcpy(&(sv->real_suffix_len_), src, sizeof(sv->real_suffix_len_));
-        src += sizeof(sv->real_suffix_len_);
-        if (sv->type_ != kNone)
+        src += sv->readHeader(src);
+        if (sv->type_ != kNone && zero_copy)
+        {
+            sv->is_borrowed_ = true;
+            sv->bits_ = reinterpret_cast<word_t *>(src);
+            src += sv->bitsSize();
+        }
+        else if (sv->type_ != kNone)
         {
             sv->bits_ = new word_t[sv->numWords()];
             memcpy(sv->bits_, src, sv->bitsSize());
             src += sv->bitsSize();
-
-            //sv->bits_ = const_cast<word_t*>(reinterpret_cast<const word_t*>(src));
-            //src += sv->bitsSize();
         }
         align(src);
         return sv;
     }
 
-    inline void destroy()
+    // Compact encoding (see compact_codec.hpp): the parameters as varints,
+    // then the suffix words raw; hash suffixes do not compress
+    inline void serializeCompact(CompactWriter & writer) const
     {
+        writer.putVarint(num_bits_);
+        writer.putVarint(type_);
+        writer.putVarint(hash_suffix_len_);
+        writer.putVarint(real_suffix_len_);
         if (type_ != kNone)
+            writer.putBytes(bits_, bitsSize());
+    }
+
+    static BitvectorSuffix * deSerializeCompact(CompactReader & reader)
+    {
+        BitvectorSuffix * sv = new BitvectorSuffix();
+        sv->num_bits_ = static_cast<position_t>(reader.getVarint(kMaxPos));
+        sv->type_ = static_cast<SuffixType>(reader.getVarint(kMixed));
+        sv->hash_suffix_len_ = static_cast<level_t>(reader.getVarint(kWordSize));
+        sv->real_suffix_len_ = static_cast<level_t>(reader.getVarint(kWordSize - sv->hash_suffix_len_));
+        if (sv->type_ != kNone)
+        {
+            const char * bits = reader.getBytes(sv->bitsSize());
+            if (bits == nullptr)
+                sv->num_bits_ = 0;
+            sv->bits_ = new word_t[sv->numWords()];
+            if (bits != nullptr)
+                memcpy(sv->bits_, bits, sv->bitsSize());
+        }
+        return sv;
+    }
+
+    // Bytes the serialize() image at src takes, from its header, or 0 if
+    // the header is invalid or the image does not fit in size bytes.
+    // Nothing past src + size is read.
+    static uint64_t imageSize(const char * src, const uint64_t size)
+    {
+        BitvectorSuffix sv;
+        if (size < kHeaderSize)
+            return 0;
+        sv.readHeader(src);
+        if (static_cast<uint64_t>(sv.hash_suffix_len_) + sv.real_suffix_len_ > kWordSize)
+            return 0;
+        uint64_t image_size = kHeaderSize + ((sv.type_ != kNone) ? sv.bitsSize() : 0);
+        sizeAlign(image_size);
+        return (image_size <= size) ? image_size : 0;
+    }
+
+    inline void destroy()
+    {
+        if (type_ != kNone && !is_borrowed_)
             delete[] bits_;
     }
 
 private:
+    // serialized num_bits_, type_ and the two suffix lengths
+    static const position_t kHeaderSize = sizeof(position_t) + sizeof(SuffixType) + 2 * sizeof(level_t);
+
+    // Reads the serialized header at src; returns its size
+    inline position_t readHeader(const char * src)
+    {
+        memcpy(&num_bits_, src, sizeof(num_bits_));
+        src += sizeof(num_bits_);
+        memcpy(&type_, src, sizeof(type_));
+        src += sizeof(type_);
+        memcpy(&hash_suffix_len_, src, sizeof(hash_suffix_len_));
+        src += sizeof(hash_suffix_len_);
+        memcpy(&real_suffix_len_, src, sizeof(real_suffix_len_));
+        return kHeaderSize;
+    }
+
     SuffixType type_;
     level_t hash_suffix_len_; // in bits
     level_t real_suffix_len_; // in bits
 };
 
+inline void BitvectorSuffix::write(const position_t idx, const word_t suffix)
+{
+    level_t suffix_len = getSuffixLen();
+    if (suffix_len == 0)
+        return;
+    position_t bit_pos = idx * suffix_len;
+    assert(bit_pos + suffix_len <= num_bits_);
+    position_t word_id = bit_pos / kWordSize;
+    position_t offset = bit_pos & (kWordSize - 1);
+    position_t word_remaining_len = kWordSize - offset;
+    if (suffix_len <= word_remaining_len)
+    {
+        bits_[word_id] |= (suffix << (word_remaining_len - suffix_len));
+    }
+    else
+    {
+        bits_[word_id] |= (suffix >> (suffix_len - word_remaining_len));
+        bits_[word_id + 1] |= (suffix << (kWordSize - (suffix_len - word_remaining_len)));
+    }
+}
+
+template <bool kPaged>
 inline word_t BitvectorSuffix::read(const position_t idx) const
 {
     if (type_ == kNone)
@@ -205,25 +320,28 @@ inline word_t BitvectorSuffix::read(const position_t idx) const
     position_t bit_pos = idx * suffix_len;
     position_t word_id = bit_pos / kWordSize;
     position_t offset = bit_pos & (kWordSize - 1);
+    touchWords<kPaged>(bits_ + word_id, (offset + suffix_len > kWordSize) ? 2 : 1);
     word_t ret_word = (bits_[word_id] << offset) >> (kWordSize - suffix_len);
     if (offset + suffix_len > kWordSize)
         ret_word += (bits_[word_id + 1] >> (kWordSize - offset - suffix_len));
     return ret_word;
 }
 
+template <bool kPaged>
 inline word_t BitvectorSuffix::readReal(const position_t idx) const
 {
-    return extractRealSuffix(read(idx), real_suffix_len_);
+    return extractRealSuffix(read<kPaged>(idx), real_suffix_len_);
 }
 
-inline bool BitvectorSuffix::checkEquality(const position_t idx, const std::string & key, const level_t level) const
+template <bool kPaged>
+inline bool BitvectorSuffix::checkEquality(const position_t idx, const KeyView & key, const level_t level) const
 {
     if (type_ == kNone)
         return true;
     if (idx * getSuffixLen() >= num_bits_)
         return false;
 
-    word_t stored_suffix = read(idx);
+    word_t stored_suffix = read<kPaged>(idx);
     if (type_ == kReal)
     {
         // if no suffix info for the stored key
@@ -257,19 +375,22 @@ inline bool BitvectorSuffix::checkEquality(const position_t idx, const std::stri
 // 	return 1;
 // }
 
-inline int BitvectorSuffix::compare(const position_t idx, const std::string & key, const level_t level) const
+template <bool kPaged>
+inline int BitvectorSuffix::compare(const position_t idx, const KeyView & key, const level_t level) const
 {
     if ((idx * getSuffixLen() >= num_bits_) || (type_ == kNone) || (type_ == kHash))
         return kCouldBePositive;
 
-    word_t stored_suffix = read(idx);
+    word_t stored_suffix = read<kPaged>(idx);
     word_t querying_suffix = constructRealSuffix(key, level, real_suffix_len_);
     if (type_ == kMixed)
         stored_suffix = extractRealSuffix(stored_suffix, real_suffix_len_);
 
-    if ((stored_suffix == 0) && (querying_suffix == 0))
+    // no suffix info for the stored key (see checkEquality): the key may
+    // be on either side
+    if (stored_suffix == 0)
         return kCouldBePositive;
-    else if ((stored_suffix == 0) || (stored_suffix < querying_suffix))
+    else if (stored_suffix < querying_suffix)
         return -1;
     else if (stored_suffix == querying_suffix)
         return kCouldBePositive;
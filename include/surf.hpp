@@ -1,13 +1,24 @@
 #ifndef SURF_H_
 #define SURF_H_
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <queue>
 #include <string>
 #include <vector>
 
+#include "compact_codec.hpp"
 #include "config.hpp"
 #include "louds_dense.hpp"
 #include "louds_sparse.hpp"
+#include "page_cache.hpp"
 #include "surf_builder.hpp"
+#include "surf_direct_builder.hpp"
+#include "surf_format.hpp"
 
 namespace surf
 {
@@ -18,19 +29,32 @@ public:
     class Iter
     {
     public:
-        Iter() { }
+        Iter()
+            : could_be_fp_(false)
+            , filter_(nullptr)
+        {
+        }
         Iter(const SuRF * filter)
         {
             dense_iter_ = LoudsDense::Iter(filter->louds_dense_);
             sparse_iter_ = LoudsSparse::Iter(filter->louds_sparse_);
             could_be_fp_ = false;
+            filter_ = filter;
         }
 
         inline void clear();
+        // Returns the iterator to its freshly constructed state without
+        // releasing its level buffers
+        inline void reset();
         inline bool isValid() const;
         inline bool getFpFlag() const;
-        inline int compare(const std::string & key) const;
+        // true if the key is stored in full because it is a prefix of
+        // other keys: it then matches itself only, not its extensions
+        inline bool isAtPrefixKey() const;
+        inline int compare(const KeyView & key) const;
         inline std::string getKey() const;
+        // Copies the key into key, reusing its capacity
+        inline void getKey(std::string & key) const;
         inline int getSuffix(word_t * suffix) const;
         inline std::string getKeyWithSuffix(unsigned * bitlen) const;
 
@@ -44,12 +68,48 @@ public:
         bool incrementSparseIter();
         bool decrementDenseIter();
         bool decrementSparseIter();
+        // true if the iter points to a key erased from filter_
+        inline bool isErased() const;
+        // Moves past erased keys, forward or backward
+        inline void skipErased(const bool forward);
 
     private:
         // true implies that dense_iter_ is valid
         LoudsDense::Iter dense_iter_;
         LoudsSparse::Iter sparse_iter_;
         bool could_be_fp_;
+        const SuRF * filter_; // for the tombstones; nullptr for a default-constructed iter
+
+        friend class SuRF;
+    };
+
+    // Caller-owned scratch state for the const range queries: two iterators
+    // and the position lists used by approxCount. Keep one context per
+    // thread and reuse it; any number of threads can then query a shared
+    // filter without locks, and queries stop allocating once the context
+    // has been used. A context binds to the filter it is used with and
+    // rebinds (reallocating) when it is handed a different one.
+    class QueryContext
+    {
+    public:
+        QueryContext()
+            : filter_(nullptr)
+            , louds_dense_(nullptr)
+            , louds_sparse_(nullptr)
+        {
+        }
+
+    private:
+        inline void bind(const SuRF * filter);
+
+    private:
+        const SuRF * filter_;
+        const LoudsDense * louds_dense_;
+        const LoudsSparse * louds_sparse_;
+        SuRF::Iter iter_;
+        SuRF::Iter iter2_;
+        std::vector<position_t> left_pos_list_;
+        std::vector<position_t> right_pos_list_;
 
         friend class SuRF;
     };
@@ -85,7 +145,11 @@ public:
     }
 
     // Constructor that takes a pre-built SuRFBuilder
-    SuRF(const SuRFBuilder & builder) { createFromBuilder(builder); }
+    SuRF(const SuRFBuilder & builder)
+        : builder_(nullptr)
+    {
+        createFromBuilder(builder);
+    }
 
     // Constructor for incremental insertion - creates an empty SuRF ready for insertions
     SuRF(
@@ -114,6 +178,85 @@ public:
         const level_t hash_suffix_len,
         const level_t real_suffix_len);
 
+    // Same filter as create(), from num_keys sorted keys packed in one
+    // buffer (see SuRFBuilder::build(blob, offsets, num_keys))
+    inline void create(
+        const char * blob,
+        const uint32_t * offsets,
+        const size_t num_keys,
+        const bool include_dense,
+        const uint32_t sparse_dense_ratio,
+        const SuffixType suffix_type,
+        const level_t hash_suffix_len,
+        const level_t real_suffix_len);
+
+    // Same filter as create(), written in place by SuRFDirectBuilder:
+    // no intermediate per-level vectors, at the cost of two key scans
+    inline void createDirect(
+        const std::vector<std::string> & keys,
+        const bool include_dense,
+        const uint32_t sparse_dense_ratio,
+        const SuffixType suffix_type,
+        const level_t hash_suffix_len,
+        const level_t real_suffix_len);
+    inline void createDirect(
+        const char * blob,
+        const uint32_t * offsets,
+        const size_t num_keys,
+        const bool include_dense,
+        const uint32_t sparse_dense_ratio,
+        const SuffixType suffix_type,
+        const level_t hash_suffix_len,
+        const level_t real_suffix_len);
+
+    // createDirect() tuned to a memory budget of bits_per_key bits per
+    // key; the suffix lengths are upper bounds (see
+    // SuRFDirectBuilder::setBitsPerKeyBudget). Returns whether the
+    // filter fits the budget.
+    inline bool createWithBudget(
+        const std::vector<std::string> & keys,
+        const bool include_dense,
+        const uint32_t sparse_dense_ratio,
+        const SuffixType suffix_type,
+        const level_t max_hash_suffix_len,
+        const level_t max_real_suffix_len,
+        const double bits_per_key);
+
+    // Same filter as create(), with the trie built by up to num_threads
+    // threads (see SuRFBuilder::buildParallel)
+    inline void createParallel(
+        const std::vector<std::string> & keys,
+        const bool include_dense,
+        const uint32_t sparse_dense_ratio,
+        const SuffixType suffix_type,
+        const level_t hash_suffix_len,
+        const level_t real_suffix_len,
+        const unsigned num_threads);
+
+    // Filter over keys given in any order, duplicates allowed; keys is
+    // sorted and deduplicated in place (see SuRFBuilder::buildUnsorted)
+    inline void createFromUnsorted(
+        std::vector<std::string> & keys,
+        const bool include_dense,
+        const uint32_t sparse_dense_ratio,
+        const SuffixType suffix_type,
+        const level_t hash_suffix_len,
+        const level_t real_suffix_len,
+        const unsigned num_threads);
+
+    // Same filter as create(), with the sorted keys pulled one at a time
+    // from bool next_key(std::string & key) (see SuRFBuilder::buildFromStream).
+    // Returns false, and creates nothing, if the stream is empty or out
+    // of order.
+    template <typename KeySource>
+    inline bool createFromStream(
+        KeySource next_key,
+        const bool include_dense,
+        const uint32_t sparse_dense_ratio,
+        const SuffixType suffix_type,
+        const level_t hash_suffix_len,
+        const level_t real_suffix_len);
+
     inline void createFromBuilder(const SuRFBuilder & builder);
 
     // Initialize SuRF for incremental insertion
@@ -133,28 +276,94 @@ public:
     // This method should be called after all keys have been inserted via insert() method
     // It builds the final trie structures and optimizes for lookups
     inline void finalize();
-    inline bool lookupKey(const std::string & key) const;
+    inline bool lookupKey(const KeyView & key) const;
+    // lookupKey for a filter built only from kKeyLen-byte keys; key points
+    // to kKeyLen bytes. Used by SuRFInt.
+    template <level_t kKeyLen>
+    inline bool lookupFixedLengthKey(const char * key) const;
+    // Batched point queries: results[i] = lookupKey(keys[i]).
+    // Up to kLookupBatchSize lookups are kept in flight and advanced
+    // round-robin, one trie level at a time; the memory needed by the
+    // next step of each lookup is prefetched before switching to the
+    // next one so that the cache misses of different keys overlap.
+    inline void lookupKeys(const std::vector<std::string> & keys, std::vector<bool> & results) const;
+    // Batched lookupFixedLengthKey over num_keys kKeyLen-byte keys stored
+    // back to back at keys: results[i] is the answer for the i-th one.
+    // Used by SuRFInt.
+    template <level_t kKeyLen>
+    inline void lookupFixedLengthKeys(const char * keys, const size_t num_keys, std::vector<bool> & results) const;
     // This function searches in a conservative way: if inclusive is true
     // and the stored key prefix matches key, iter stays at this key prefix.
-    inline SuRF::Iter moveToKeyGreaterThan(const std::string & key, const bool inclusive) const;
-    inline SuRF::Iter moveToKeyLessThan(const std::string & key) const;
+    inline SuRF::Iter moveToKeyGreaterThan(const KeyView & key, const bool inclusive) const;
+    // Same as above, but reuses iter (which must belong to this filter) instead of allocating one
+    inline void moveToKeyGreaterThan(const KeyView & key, const bool inclusive, SuRF::Iter & iter) const;
+    inline SuRF::Iter moveToKeyLessThan(const KeyView & key, const bool inclusive) const;
     inline SuRF::Iter moveToFirst() const;
     inline SuRF::Iter moveToLast() const;
+    inline void moveToLast(SuRF::Iter & iter) const;
+
+    // The range queries without a QueryContext share one context owned by
+    // the filter and must not run concurrently on the same filter.
     inline bool
-    lookupRange(const std::string & left_key, const bool left_inclusive, const std::string & right_key, const bool right_inclusive);
+    lookupRange(const KeyView & left_key, const bool left_inclusive, const KeyView & right_key, const bool right_inclusive);
+    inline bool lookupRange(
+        const KeyView & left_key,
+        const bool left_inclusive,
+        const KeyView & right_key,
+        const bool right_inclusive,
+        QueryContext & context) const;
     // Accurate except at the boundaries --> undercount by at most 2
-    inline uint64_t approxCount(const std::string & left_key, const std::string & right_key);
+    inline uint64_t approxCount(const KeyView & left_key, const KeyView & right_key);
+    inline uint64_t approxCount(const KeyView & left_key, const KeyView & right_key, QueryContext & context) const;
     inline uint64_t approxCount(const SuRF::Iter * iter, const SuRF::Iter * iter2);
+    inline uint64_t approxCount(const SuRF::Iter * iter, const SuRF::Iter * iter2, QueryContext & context) const;
+
+    // Marks the leaf that key matches with a tombstone: the point, range
+    // and count queries and the iterators then skip it. Returns false if
+    // key does not match a leaf or the leaf is already erased.
+    // REQUIRED: key is in the key set. A key that only matches as a false
+    // positive would erase the leaf of another key, which then becomes a
+    // false negative.
+    // Tombstones live in memory only: serialize() writes the filter as
+    // built. Once needsRebuild(), rebuild from the live keys.
+    inline bool erase(const KeyView & key);
+    inline position_t getNumErased() const { return num_erased_; }
+    // Erased leaves / all leaves
+    inline double getErasedRatio() const;
+    // Tombstone ratio at which needsRebuild() turns true (default
+    // kEraseRebuildRatio)
+    inline void setRebuildThreshold(const double ratio) { rebuild_threshold_ = ratio; }
+    inline bool needsRebuild() const { return num_erased_ > 0 && getErasedRatio() >= rebuild_threshold_; }
+
+    // Conservative union of filters, built from the filters alone: every
+    // key that an input reports present is reported present by the
+    // result. Each input is walked in key order. A stored key prefix,
+    // extended by the complete bytes of its real suffix, is a prefix of
+    // the original key; the k-way merge of these prefixes, without the
+    // ones inside a shorter (non prefix-key) one, is streamed into the
+    // builder. Hash suffixes cannot be carried over, so the result keeps
+    // real suffixes only, as long as the longest input real suffix.
+    // Returns nullptr if the inputs hold no keys; the caller owns the
+    // result (destroy() and delete).
+    static inline SuRF * merge(
+        const std::vector<const SuRF *> & filters,
+        const bool include_dense = kIncludeDense,
+        const uint32_t sparse_dense_ratio = kSparseDenseRatio);
 
     inline uint64_t serializedSize() const;
     inline uint64_t getMemoryUsage() const;
     inline level_t getHeight() const;
     inline level_t getSparseStartLevel() const;
+    inline level_t getRealSuffixLen() const;
+    // Memory used while this filter was built (all zero for a
+    // deserialized filter)
+    inline const BuildMemoryStats & getBuildMemoryStats() const { return build_memory_stats_; }
 
     inline char * serialize() const
     {
         uint64_t size = serializedSize();
         char * data = new char[size];
+        memset(data, 0, size); // alignment padding is not written
         char * cur_data = data;
         louds_dense_->serialize(cur_data);
         louds_sparse_->serialize(cur_data);
@@ -162,31 +371,153 @@ public:
         return data;
     }
 
-    static SuRF * deSerialize(char * src)
+    static SuRF * deSerialize(char * src) { return deSerialize(src, false); }
+
+    // With zero_copy, the filter reads the serialized bytes in place: no
+    // section is copied, so loading costs a few small allocations
+    // whatever the filter size. src must then stay valid and unchanged
+    // until the filter is destroyed, and destroy() leaves it alone.
+    // Returns nullptr if src is not 8-byte aligned (serialize() aligns
+    // every section to 8 bytes from an aligned start).
+    static SuRF * deSerialize(char * src, const bool zero_copy)
     {
+        if (zero_copy && (reinterpret_cast<uintptr_t>(src) % 8 != 0))
+            return nullptr;
         SuRF * surf = new SuRF();
-        surf->louds_dense_ = LoudsDense::deSerialize(src);
-        surf->louds_sparse_ = LoudsSparse::deSerialize(src);
-        surf->iter_ = SuRF::Iter(surf);
+        surf->louds_dense_ = LoudsDense::deSerialize(src, zero_copy);
+        surf->louds_sparse_ = LoudsSparse::deSerialize(src, zero_copy);
         return surf;
     }
 
+    // Bytes the serialize() image at src takes, from the headers of its
+    // parts, or 0 if a header is invalid or the image does not fit in
+    // size bytes. Nothing past src + size is read, so this is the check
+    // to run before deSerialize on bytes of unknown length.
+    static inline uint64_t imageSize(const char * src, const uint64_t size);
+
+    // serialize() image behind a self-describing header (see
+    // surf_format.hpp): magic, format version, build parameters, key
+    // count, min/max key and a table of the sections with their CRC32C
+    inline uint64_t formattedSize() const;
+    inline char * serializeFormatted() const;
+    // Checks the header and, with verify_checksums, every section
+    // checksum, then deserializes the sections (zero_copy as in
+    // deSerialize). Returns nullptr if the size bytes at src are not a
+    // valid serializeFormatted() image.
+    static inline SuRF *
+    deSerializeFormatted(char * src, const uint64_t size, const bool zero_copy = false, const bool verify_checksums = true);
+
+    // Compact cold-storage encoding (see compact_codec.hpp): no LUTs or
+    // padding, and the trie items range-coded, for filters that are
+    // stored or shipped far more often than they are loaded. size is set
+    // to the number of bytes returned. Tombstones are not written, as
+    // with serialize(). Returns nullptr if the trie is taller
+    // than kCompactMaxKeyLen key bytes.
+    inline char * serializeCompact(uint64_t & size) const;
+    // Decodes a serializeCompact() image back to the normal in-memory
+    // layout (the filter owns its memory; src can be freed). Returns
+    // nullptr if the size bytes at src are not a valid image or fail
+    // their checksum.
+    static inline SuRF * deSerializeCompact(const char * src, const uint64_t size);
+
+    // Maps the file written from serializeFormatted() or serialize() at
+    // path and reads it in place (zero-copy deSerialize): only the pages
+    // that queries touch are read from disk. The louds-dense section,
+    // which every lookup walks, is prefetched (MADV_WILLNEED) and, with
+    // lock_dense, locked into memory (best effort: the lock is skipped if
+    // RLIMIT_MEMLOCK does not allow it). Readahead is turned off for the
+    // louds-sparse section (MADV_RANDOM), whose deep levels are paged in
+    // on demand. destroy() unmaps the file.
+    // Returns nullptr if the file cannot be mapped or is shorter than the
+    // filter it describes (checked with imageSize before any of it is
+    // loaded). A formatted file is also rejected if its header is invalid
+    // or, with verify_checksums, if a section checksum does not match
+    // (this reads every page once); the contents of a plain serialize()
+    // image are trusted.
+    static inline SuRF * open(const char * path, const bool lock_dense = false, const bool verify_checksums = true);
+    inline bool isMapped() const { return mapped_data_ != nullptr; }
+
+    // Tiered loading of the serializeFormatted() file at path: the
+    // louds-dense levels, the first num_resident_sparse_levels
+    // louds-sparse levels and the rank/select LUTs are read up front and
+    // stay in memory; the labels, bits and suffixes of the deeper levels
+    // are read from the file on demand, in pages of page_size bytes, and
+    // at most cache_pages of them are kept (see PageCache). Resident
+    // memory is then about the eager part plus cache_pages * page_size,
+    // whatever the filter size. getPageCache() reports the faults.
+    // Returns nullptr if the file cannot be read or its header is
+    // invalid. The checksums of the eagerly read sections are verified;
+    // the paged sections are not. A page that cannot be read later on
+    // (an I/O error, or the file was truncated) sets
+    // getPageCache()->failed(), and the filter then fails open: the point
+    // and range lookups return true and approxCount returns the number
+    // of keys in the filter. Reopen the file to get exact answers back.
+    // A tiered filter must not be queried from several threads at once,
+    // and cannot be serialized. destroy() closes the file.
+    static inline SuRF * openTiered(
+        const char * path,
+        const level_t num_resident_sparse_levels,
+        const uint64_t cache_pages = kTieredCachePages,
+        const uint64_t page_size = kTieredPageSize);
+    inline bool isTiered() const { return page_cache_ != nullptr; }
+    inline const PageCache * getPageCache() const { return page_cache_; }
+
     inline void destroy()
     {
         louds_dense_->destroy();
         louds_sparse_->destroy();
+        if (mapped_data_ != nullptr)
+        {
+            munmap(mapped_data_, mapped_size_);
+            mapped_data_ = nullptr;
+            mapped_size_ = 0;
+        }
+        delete page_cache_;
+        page_cache_ = nullptr;
     }
 
     // Check if the SuRF has any keys inserted
     inline bool hasKeys() const;
 
 private:
+    class MergeCursor;
+
+    // Builds the tries from builder_, then deletes it
+    inline void createFromOwnedBuilder();
+    // The interleaved walk of lookupKeys; key_at(i) returns the i-th
+    // key as a KeyView
+    template <typename KeyAt>
+    inline void lookupKeysBatched(KeyAt key_at, const size_t num_keys, std::vector<bool> & results) const;
+    inline void setBuildMemoryStats(const BuildMemoryStats & builder_stats);
+    // Version of moveToKeyGreaterThan that may stop at an erased key
+    inline void seekKeyGreaterThan(const KeyView & key, const bool inclusive, SuRF::Iter & iter) const;
+    // Stored prefixes of the first and the last key (empty if none)
+    inline void getKeyBounds(std::string & min_key, std::string & max_key) const;
+    // True once a page of a tiered filter could not be read: the
+    // answers read from the zeroed pages must not be trusted
+    inline bool pagingFailed() const { return (page_cache_ != nullptr) && page_cache_->failed(); }
+
     LoudsDense * louds_dense_;
     LoudsSparse * louds_sparse_;
     SuRFBuilder * builder_; // Used for batch construction or incremental building
     bool incremental_mode_; // Flag to track if we're in incremental insertion mode
-    SuRF::Iter iter_;
-    SuRF::Iter iter2_;
+    QueryContext context_; // used by the range queries that take no context
+    BuildMemoryStats build_memory_stats_;
+
+    // Erased leaves, one bit per leaf index of each part; allocated by
+    // the first erase
+    std::vector<word_t> dense_tombstones_;
+    std::vector<word_t> sparse_tombstones_;
+    position_t num_erased_ = 0;
+    position_t num_leaves_ = 0; // set by the first erase
+    double rebuild_threshold_ = kEraseRebuildRatio;
+
+    // File mapping the filter reads in place (see open)
+    char * mapped_data_ = nullptr;
+    size_t mapped_size_ = 0;
+    // Serves the deep louds-sparse levels (see openTiered)
+    PageCache * page_cache_ = nullptr;
+    uint64_t num_tiered_keys_ = 0; // approxCount of a failed tiered filter
 };
 
 inline void SuRF::create(
@@ -199,12 +530,123 @@ inline void SuRF::create(
 {
     builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len);
     builder_->build(keys);
-    louds_dense_ = new LoudsDense(builder_);
-    louds_sparse_ = new LoudsSparse(builder_);
-    iter_ = SuRF::Iter(this);
-    delete builder_;
-    builder_ = nullptr;
+    createFromOwnedBuilder();
+}
+
+inline void SuRF::create(
+    const char * blob,
+    const uint32_t * offsets,
+    const size_t num_keys,
+    const bool include_dense,
+    const uint32_t sparse_dense_ratio,
+    const SuffixType suffix_type,
+    const level_t hash_suffix_len,
+    const level_t real_suffix_len)
+{
+    builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len);
+    builder_->build(blob, offsets, num_keys);
+    createFromOwnedBuilder();
+}
+
+inline void SuRF::createDirect(
+    const std::vector<std::string> & keys,
+    const bool include_dense,
+    const uint32_t sparse_dense_ratio,
+    const SuffixType suffix_type,
+    const level_t hash_suffix_len,
+    const level_t real_suffix_len)
+{
+    SuRFDirectBuilder builder(include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len);
+    builder.build(keys);
+    louds_dense_ = builder.getLoudsDense();
+    louds_sparse_ = builder.getLoudsSparse();
     incremental_mode_ = false;
+    setBuildMemoryStats(builder.getMemoryStats());
+}
+
+inline void SuRF::createDirect(
+    const char * blob,
+    const uint32_t * offsets,
+    const size_t num_keys,
+    const bool include_dense,
+    const uint32_t sparse_dense_ratio,
+    const SuffixType suffix_type,
+    const level_t hash_suffix_len,
+    const level_t real_suffix_len)
+{
+    SuRFDirectBuilder builder(include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len);
+    builder.build(blob, offsets, num_keys);
+    louds_dense_ = builder.getLoudsDense();
+    louds_sparse_ = builder.getLoudsSparse();
+    incremental_mode_ = false;
+    setBuildMemoryStats(builder.getMemoryStats());
+}
+
+inline bool SuRF::createWithBudget(
+    const std::vector<std::string> & keys,
+    const bool include_dense,
+    const uint32_t sparse_dense_ratio,
+    const SuffixType suffix_type,
+    const level_t max_hash_suffix_len,
+    const level_t max_real_suffix_len,
+    const double bits_per_key)
+{
+    SuRFDirectBuilder builder(include_dense, sparse_dense_ratio, suffix_type, max_hash_suffix_len, max_real_suffix_len);
+    builder.setBitsPerKeyBudget(bits_per_key);
+    builder.build(keys);
+    louds_dense_ = builder.getLoudsDense();
+    louds_sparse_ = builder.getLoudsSparse();
+    incremental_mode_ = false;
+    setBuildMemoryStats(builder.getMemoryStats());
+    return builder.isWithinBudget();
+}
+
+inline void SuRF::createParallel(
+    const std::vector<std::string> & keys,
+    const bool include_dense,
+    const uint32_t sparse_dense_ratio,
+    const SuffixType suffix_type,
+    const level_t hash_suffix_len,
+    const level_t real_suffix_len,
+    const unsigned num_threads)
+{
+    builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len);
+    builder_->buildParallel(keys, num_threads);
+    createFromOwnedBuilder();
+}
+
+inline void SuRF::createFromUnsorted(
+    std::vector<std::string> & keys,
+    const bool include_dense,
+    const uint32_t sparse_dense_ratio,
+    const SuffixType suffix_type,
+    const level_t hash_suffix_len,
+    const level_t real_suffix_len,
+    const unsigned num_threads)
+{
+    builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len);
+    builder_->buildUnsorted(keys, num_threads);
+    createFromOwnedBuilder();
+}
+
+template <typename KeySource>
+inline bool SuRF::createFromStream(
+    KeySource next_key,
+    const bool include_dense,
+    const uint32_t sparse_dense_ratio,
+    const SuffixType suffix_type,
+    const level_t hash_suffix_len,
+    const level_t real_suffix_len)
+{
+    builder_ = new SuRFBuilder(include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len);
+    if (!builder_->buildFromStream(next_key))
+    {
+        delete builder_;
+        builder_ = nullptr;
+        return false;
+    }
+    createFromOwnedBuilder();
+    return true;
 }
 
 inline void SuRF::createFromBuilder(const SuRFBuilder & builder)
@@ -212,10 +654,29 @@ inline void SuRF::createFromBuilder(const SuRFBuilder & builder)
     // Create LoudsDense and LoudsSparse from the builder
     louds_dense_ = new LoudsDense(&builder);
     louds_sparse_ = new LoudsSparse(&builder);
-    iter_ = SuRF::Iter(this);
+    incremental_mode_ = false;
+    setBuildMemoryStats(builder.getMemoryStats());
+}
+
+inline void SuRF::createFromOwnedBuilder()
+{
+    louds_dense_ = new LoudsDense(builder_);
+    louds_sparse_ = new LoudsSparse(builder_);
+    setBuildMemoryStats(builder_->getMemoryStats());
+    delete builder_;
+    builder_ = nullptr;
     incremental_mode_ = false;
 }
 
+inline void SuRF::setBuildMemoryStats(const BuildMemoryStats & builder_stats)
+{
+    build_memory_stats_ = builder_stats;
+    build_memory_stats_.final_bytes = getMemoryUsage();
+    // the builder is alive until the tries built from it are complete
+    build_memory_stats_.peak_bytes
+        = std::max(builder_stats.peak_transient_bytes, builder_stats.transientBytes() + build_memory_stats_.final_bytes);
+}
+
 inline void SuRF::initializeForIncrementalInsertion(
     const bool include_dense,
     const uint32_t sparse_dense_ratio,
@@ -248,15 +709,8 @@ inline void SuRF::finalize()
     // Finalize the builder
     builder_->finalize();
 
-    // Create the trie structures
-    louds_dense_ = new LoudsDense(builder_);
-    louds_sparse_ = new LoudsSparse(builder_);
-    iter_ = SuRF::Iter(this);
-
-    // Clean up and exit incremental mode
-    delete builder_;
-    builder_ = nullptr;
-    incremental_mode_ = false;
+    // Create the trie structures, then clean up and exit incremental mode
+    createFromOwnedBuilder();
 }
 
 inline bool SuRF::hasKeys() const
@@ -269,30 +723,222 @@ inline bool SuRF::hasKeys() const
     return louds_dense_ != nullptr && louds_sparse_ != nullptr;
 }
 
-inline bool SuRF::lookupKey(const std::string & key) const
+inline bool SuRF::lookupKey(const KeyView & key) const
 {
     if (incremental_mode_)
     {
-        return false; // Cannot perform lookups while in incremental insertion mode
+        return false; // Cannot perform lookups while in incremental insertion mode (see GrowingSuRF)
     }
 
+    // The walkers report the leaf they end at; it only matters once a
+    // key has been erased
     position_t connect_node_num = 0;
-    if (!louds_dense_->lookupKey(key, connect_node_num))
+    position_t leaf = kMaxPos;
+    if (!louds_dense_->lookupKey(key, connect_node_num, leaf))
+        return false;
+    else if (leaf != kMaxPos)
+        return (num_erased_ == 0) || !SuRFBuilder::readBit(dense_tombstones_, leaf);
+    else if (connect_node_num == 0)
+        return true;
+    if (!louds_sparse_->lookupKey(key, connect_node_num, leaf))
+        return pagingFailed();
+    return (num_erased_ == 0) || !SuRFBuilder::readBit(sparse_tombstones_, leaf) || pagingFailed();
+}
+
+inline bool SuRF::erase(const KeyView & key)
+{
+    if (incremental_mode_)
+        return false;
+
+    position_t connect_node_num = 0;
+    position_t leaf = kMaxPos;
+    if (!louds_dense_->lookupKey(key, connect_node_num, leaf))
+        return false;
+    bool in_dense = (leaf != kMaxPos);
+    if (!in_dense && !louds_sparse_->lookupKey(key, connect_node_num, leaf))
         return false;
-    else if (connect_node_num != 0)
-        return louds_sparse_->lookupKey(key, connect_node_num);
+
+    if (num_leaves_ == 0)
+    {
+        position_t num_dense_leaves = louds_dense_->getNumLeaves();
+        position_t num_sparse_leaves = louds_sparse_->getNumLeaves();
+        dense_tombstones_.assign((num_dense_leaves + kWordSize - 1) / kWordSize, 0);
+        sparse_tombstones_.assign((num_sparse_leaves + kWordSize - 1) / kWordSize, 0);
+        num_leaves_ = num_dense_leaves + num_sparse_leaves;
+    }
+    std::vector<word_t> & tombstones = in_dense ? dense_tombstones_ : sparse_tombstones_;
+    if (SuRFBuilder::readBit(tombstones, leaf))
+        return false;
+    SuRFBuilder::setBit(tombstones, leaf);
+    num_erased_++;
     return true;
 }
 
-inline SuRF::Iter SuRF::moveToKeyGreaterThan(const std::string & key, const bool inclusive) const
+inline double SuRF::getErasedRatio() const
+{
+    if (num_leaves_ == 0)
+        return 0;
+    return static_cast<double>(num_erased_) / num_leaves_;
+}
+
+template <level_t kKeyLen>
+inline bool SuRF::lookupFixedLengthKey(const char * key) const
+{
+    if (incremental_mode_)
+        return false;
+    if (num_erased_ > 0)
+        return lookupKey(KeyView(key, kKeyLen));
+
+    position_t connect_node_num = 0;
+    if (!louds_dense_->lookupFixedLengthKey<kKeyLen>(key, connect_node_num))
+        return false;
+    // a trie without a dense part starts at node 0 of louds-sparse
+    if ((connect_node_num != 0) || (louds_dense_->getHeight() == 0))
+        return louds_sparse_->lookupFixedLengthKey<kKeyLen>(key, connect_node_num) || pagingFailed();
+    return true;
+}
+
+inline void SuRF::lookupKeys(const std::vector<std::string> & keys, std::vector<bool> & results) const
+{
+    results.assign(keys.size(), false);
+    if (incremental_mode_)
+        return; // Cannot perform lookups while in incremental insertion mode
+    if (num_erased_ > 0)
+    {
+        // the batched steps do not track leaf indexes
+        for (size_t i = 0; i < keys.size(); i++)
+            results[i] = lookupKey(keys[i]);
+        return;
+    }
+
+    // same as lookupKey: a search that ends at the bottom of an empty
+    // louds-dense part is reported as found
+    if (louds_dense_->getHeight() == 0)
+    {
+        results.assign(keys.size(), true);
+        return;
+    }
+    lookupKeysBatched([&keys](const size_t i) { return KeyView(keys[i]); }, keys.size(), results);
+}
+
+template <level_t kKeyLen>
+inline void SuRF::lookupFixedLengthKeys(const char * keys, const size_t num_keys, std::vector<bool> & results) const
+{
+    results.assign(num_keys, false);
+    if (incremental_mode_)
+        return;
+    // unlike lookupKey, lookupFixedLengthKey walks louds-sparse from node
+    // 0 when the louds-dense part is empty
+    if ((num_erased_ > 0) || (louds_dense_->getHeight() == 0))
+    {
+        for (size_t i = 0; i < num_keys; i++)
+            results[i] = lookupFixedLengthKey<kKeyLen>(keys + i * kKeyLen);
+        return;
+    }
+    lookupKeysBatched([keys](const size_t i) { return KeyView(keys + i * kKeyLen, kKeyLen); }, num_keys, results);
+}
+
+template <typename KeyAt>
+inline void SuRF::lookupKeysBatched(KeyAt key_at, const size_t num_keys, std::vector<bool> & results) const
+{
+    struct InFlightLookup
+    {
+        size_t key_id;
+        bool in_sparse;
+        level_t level;
+        position_t node_num;
+        position_t pos; // louds-sparse only
+    };
+    InFlightLookup batch[kLookupBatchSize];
+    unsigned num_in_flight = 0;
+    size_t next_key_id = 0;
+
+    while (num_in_flight < kLookupBatchSize && next_key_id < num_keys)
+    {
+        InFlightLookup & lookup = batch[num_in_flight++];
+        lookup.key_id = next_key_id++;
+        lookup.in_sparse = false;
+        lookup.level = 0;
+        lookup.node_num = 0;
+        louds_dense_->prefetchLookupStep(key_at(lookup.key_id), lookup.level, lookup.node_num);
+    }
+
+    unsigned i = 0;
+    while (num_in_flight > 0)
+    {
+        if (i >= num_in_flight)
+            i = 0;
+        InFlightLookup & lookup = batch[i];
+        const KeyView key = key_at(lookup.key_id);
+
+        LookupStatus status;
+        if (!lookup.in_sparse)
+        {
+            status = louds_dense_->lookupKeyStep(key, lookup.level, lookup.node_num);
+            if (status == kLookupToSparse)
+            {
+                lookup.in_sparse = true;
+                lookup.level = louds_sparse_->getStartLevel();
+                lookup.pos = kMaxPos;
+                status = kLookupInProgress;
+            }
+        }
+        else
+        {
+            status = louds_sparse_->lookupKeyStep(key, lookup.level, lookup.node_num, lookup.pos);
+        }
+
+        if (status == kLookupInProgress)
+        {
+            if (lookup.in_sparse)
+                louds_sparse_->prefetchLookupStep(lookup.node_num, lookup.pos);
+            else
+                louds_dense_->prefetchLookupStep(key, lookup.level, lookup.node_num);
+            i++;
+            continue;
+        }
+
+        results[lookup.key_id] = (status == kLookupFound) || (lookup.in_sparse && pagingFailed());
+        if (next_key_id < num_keys)
+        {
+            // refill the slot with the next key
+            lookup.key_id = next_key_id++;
+            lookup.in_sparse = false;
+            lookup.level = 0;
+            lookup.node_num = 0;
+            louds_dense_->prefetchLookupStep(key_at(lookup.key_id), lookup.level, lookup.node_num);
+            i++;
+        }
+        else
+        {
+            // retire the slot
+            batch[i] = batch[--num_in_flight];
+        }
+    }
+}
+
+inline SuRF::Iter SuRF::moveToKeyGreaterThan(const KeyView & key, const bool inclusive) const
 {
     SuRF::Iter iter(this);
+    moveToKeyGreaterThan(key, inclusive, iter);
+    return iter;
+}
+
+inline void SuRF::moveToKeyGreaterThan(const KeyView & key, const bool inclusive, SuRF::Iter & iter) const
+{
+    seekKeyGreaterThan(key, inclusive, iter);
+    iter.skipErased(true);
+}
+
+inline void SuRF::seekKeyGreaterThan(const KeyView & key, const bool inclusive, SuRF::Iter & iter) const
+{
+    iter.reset();
     iter.could_be_fp_ = louds_dense_->moveToKeyGreaterThan(key, inclusive, iter.dense_iter_);
 
     if (!iter.dense_iter_.isValid())
-        return iter;
+        return;
     if (iter.dense_iter_.isComplete())
-        return iter;
+        return;
 
     if (!iter.dense_iter_.isSearchComplete())
     {
@@ -300,21 +946,21 @@ inline SuRF::Iter SuRF::moveToKeyGreaterThan(const std::string & key, const bool
         iter.could_be_fp_ = louds_sparse_->moveToKeyGreaterThan(key, inclusive, iter.sparse_iter_);
         if (!iter.sparse_iter_.isValid())
             iter.incrementDenseIter();
-        return iter;
+        return;
     }
     else if (!iter.dense_iter_.isMoveLeftComplete())
     {
         iter.passToSparse();
         iter.sparse_iter_.moveToLeftMostKey();
-        return iter;
+        return;
     }
 
     assert(false); // shouldn't reach here
-    return iter;
 }
 
-inline SuRF::Iter SuRF::moveToKeyLessThan(const std::string & key) const
+inline SuRF::Iter SuRF::moveToKeyLessThan(const KeyView & key, const bool inclusive) const
 {
+    (void)inclusive;
     SuRF::Iter iter = moveToKeyGreaterThan(key, false);
     if (!iter.isValid())
     {
@@ -337,67 +983,69 @@ inline SuRF::Iter SuRF::moveToFirst() const
     {
         iter.dense_iter_.setToFirstLabelInRoot();
         iter.dense_iter_.moveToLeftMostKey();
-        if (iter.dense_iter_.isMoveLeftComplete())
-            return iter;
-        iter.passToSparse();
-        iter.sparse_iter_.moveToLeftMostKey();
+        if (!iter.dense_iter_.isMoveLeftComplete())
+        {
+            iter.passToSparse();
+            iter.sparse_iter_.moveToLeftMostKey();
+        }
     }
     else
     {
         iter.sparse_iter_.setToFirstLabelInRoot();
         iter.sparse_iter_.moveToLeftMostKey();
     }
+    iter.skipErased(true);
     return iter;
 }
 
 inline SuRF::Iter SuRF::moveToLast() const
 {
     SuRF::Iter iter(this);
+    moveToLast(iter);
+    return iter;
+}
+
+inline void SuRF::moveToLast(SuRF::Iter & iter) const
+{
+    iter.reset();
     if (louds_dense_->getHeight() > 0)
     {
         iter.dense_iter_.setToLastLabelInRoot();
         iter.dense_iter_.moveToRightMostKey();
-        if (iter.dense_iter_.isMoveRightComplete())
-            return iter;
-        iter.passToSparse();
-        iter.sparse_iter_.moveToRightMostKey();
+        if (!iter.dense_iter_.isMoveRightComplete())
+        {
+            iter.passToSparse();
+            iter.sparse_iter_.moveToRightMostKey();
+        }
     }
     else
     {
         iter.sparse_iter_.setToLastLabelInRoot();
         iter.sparse_iter_.moveToRightMostKey();
     }
-    return iter;
+    iter.skipErased(false);
 }
 
 inline bool
-SuRF::lookupRange(const std::string & left_key, const bool left_inclusive, const std::string & right_key, const bool right_inclusive)
+SuRF::lookupRange(const KeyView & left_key, const bool left_inclusive, const KeyView & right_key, const bool right_inclusive)
 {
-    iter_.clear();
-    louds_dense_->moveToKeyGreaterThan(left_key, left_inclusive, iter_.dense_iter_);
-    if (!iter_.dense_iter_.isValid())
-        return false;
-    if (!iter_.dense_iter_.isComplete())
-    {
-        if (!iter_.dense_iter_.isSearchComplete())
-        {
-            iter_.passToSparse();
-            louds_sparse_->moveToKeyGreaterThan(left_key, left_inclusive, iter_.sparse_iter_);
-            if (!iter_.sparse_iter_.isValid())
-            {
-                iter_.incrementDenseIter();
-            }
-        }
-        else if (!iter_.dense_iter_.isMoveLeftComplete())
-        {
-            iter_.passToSparse();
-            iter_.sparse_iter_.moveToLeftMostKey();
-        }
-    }
-    if (!iter_.isValid())
-        return false;
-    int compare = iter_.compare(right_key);
-    if (compare == kCouldBePositive)
+    return lookupRange(left_key, left_inclusive, right_key, right_inclusive, context_);
+}
+
+inline bool SuRF::lookupRange(
+    const KeyView & left_key,
+    const bool left_inclusive,
+    const KeyView & right_key,
+    const bool right_inclusive,
+    QueryContext & context) const
+{
+    context.bind(this);
+    SuRF::Iter & iter = context.iter_;
+    moveToKeyGreaterThan(left_key, left_inclusive, iter);
+    if (!iter.isValid())
+        return pagingFailed();
+    int compare = iter.compare(right_key);
+    if ((compare == kCouldBePositive) || pagingFailed())
         return true;
     if (right_inclusive)
         return (compare <= 0);
@@ -407,26 +1055,336 @@ SuRF::lookupRange(const std::string & left_key, const bool left_inclusive, const
 
 inline uint64_t SuRF::approxCount(const SuRF::Iter * iter, const SuRF::Iter * iter2)
 {
+    return approxCount(iter, iter2, context_);
+}
+
+inline uint64_t SuRF::approxCount(const SuRF::Iter * iter, const SuRF::Iter * iter2, QueryContext & context) const
+{
+    if (pagingFailed())
+        return num_tiered_keys_;
     if (!iter->isValid() || !iter2->isValid())
         return 0;
+    context.bind(this);
     position_t out_node_num_left = 0, out_node_num_right = 0;
-    uint64_t count = louds_dense_->approxCount(&(iter->dense_iter_), &(iter2->dense_iter_), out_node_num_left, out_node_num_right);
-    count += louds_sparse_->approxCount(&(iter->sparse_iter_), &(iter2->sparse_iter_), out_node_num_left, out_node_num_right);
+    uint64_t count = louds_dense_->approxCount(
+        &(iter->dense_iter_),
+        &(iter2->dense_iter_),
+        out_node_num_left,
+        out_node_num_right,
+        context.left_pos_list_,
+        context.right_pos_list_,
+        (num_erased_ > 0) ? &dense_tombstones_ : nullptr);
+    count += louds_sparse_->approxCount(
+        &(iter->sparse_iter_),
+        &(iter2->sparse_iter_),
+        out_node_num_left,
+        out_node_num_right,
+        context.left_pos_list_,
+        context.right_pos_list_,
+        (num_erased_ > 0) ? &sparse_tombstones_ : nullptr);
+    if (pagingFailed())
+        return num_tiered_keys_;
     return count;
 }
 
-inline uint64_t SuRF::approxCount(const std::string & left_key, const std::string & right_key)
+inline uint64_t SuRF::approxCount(const KeyView & left_key, const KeyView & right_key)
+{
+    return approxCount(left_key, right_key, context_);
+}
+
+inline uint64_t SuRF::approxCount(const KeyView & left_key, const KeyView & right_key, QueryContext & context) const
+{
+    context.bind(this);
+    moveToKeyGreaterThan(left_key, true, context.iter_);
+    if (!context.iter_.isValid())
+        return pagingFailed() ? num_tiered_keys_ : 0;
+    moveToKeyGreaterThan(right_key, true, context.iter2_);
+    if (!context.iter2_.isValid())
+        moveToLast(context.iter2_);
+
+    return approxCount(&context.iter_, &context.iter2_, context);
+}
+
+inline void SuRF::getKeyBounds(std::string & min_key, std::string & max_key) const
+{
+    SuRF::Iter iter = moveToFirst();
+    min_key = iter.isValid() ? iter.getKey() : std::string();
+    iter = moveToLast();
+    max_key = iter.isValid() ? iter.getKey() : std::string();
+}
+
+inline uint64_t SuRF::formattedSize() const
 {
-    iter_.clear();
-    iter2_.clear();
-    iter_ = moveToKeyGreaterThan(left_key, true);
-    if (!iter_.isValid())
+    std::string min_key;
+    std::string max_key;
+    getKeyBounds(min_key, max_key);
+    return formatPayloadOffset(min_key.size(), max_key.size()) + serializedSize();
+}
+
+inline char * SuRF::serializeFormatted() const
+{
+    std::string min_key;
+    std::string max_key;
+    getKeyBounds(min_key, max_key);
+    uint64_t payload_offset = formatPayloadOffset(min_key.size(), max_key.size());
+    uint64_t size = payload_offset + serializedSize();
+    char * data = new char[size];
+    memset(data, 0, size); // alignment padding is not written
+    char * cur_data = data + payload_offset;
+    louds_dense_->serialize(cur_data);
+    louds_sparse_->serialize(cur_data);
+    assert(cur_data - data == static_cast<int64_t>(size));
+
+    FormatHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kFormatMagic, sizeof(kFormatMagic));
+    header.version = kFormatVersion;
+    header.file_size = size;
+    header.num_keys = louds_dense_->getNumLeaves() + louds_sparse_->getNumLeaves();
+    header.suffix_type = louds_sparse_->getSuffixType();
+    header.hash_suffix_len = louds_sparse_->getHashSuffixLen();
+    header.real_suffix_len = louds_sparse_->getRealSuffixLen();
+    header.height = louds_sparse_->getHeight();
+    header.sparse_start_level = louds_sparse_->getStartLevel();
+    header.num_sections = kNumFormatSections;
+    header.min_key_len = static_cast<uint32_t>(min_key.size());
+    header.max_key_len = static_cast<uint32_t>(max_key.size());
+
+    std::vector<uint64_t> part_sizes;
+    louds_dense_->getSerializedPartSizes(part_sizes);
+    louds_sparse_->getSerializedPartSizes(part_sizes);
+    assert(part_sizes.size() == kNumFormatSections);
+    uint64_t offset = payload_offset;
+    for (uint32_t i = 0; i < kNumFormatSections; i++)
+    {
+        header.sections[i].offset = offset;
+        header.sections[i].length = part_sizes[i];
+        header.sections[i].crc = crc32c(data + offset, part_sizes[i]);
+        offset += part_sizes[i];
+    }
+    assert(offset == size);
+
+    memcpy(data + sizeof(FormatHeader), min_key.data(), min_key.size());
+    memcpy(data + sizeof(FormatHeader) + min_key.size(), max_key.data(), max_key.size());
+    header.header_crc = computeFormatHeaderCrc(data, header);
+    memcpy(data, &header, sizeof(header));
+    return data;
+}
+
+inline SuRF * SuRF::deSerializeFormatted(char * src, const uint64_t size, const bool zero_copy, const bool verify_checksums)
+{
+    FormatHeader header;
+    if (readFormatHeader(src, size, header) != kFormatOk)
+        return nullptr;
+    if (verify_checksums)
+    {
+        for (uint32_t i = 0; i < kNumFormatSections; i++)
+        {
+            if (!verifyFormatSection(src, header, i))
+                return nullptr;
+        }
+    }
+    uint64_t payload_offset = header.sections[0].offset;
+    if (imageSize(src + payload_offset, size - payload_offset) == 0)
+        return nullptr;
+    return deSerialize(src + payload_offset, zero_copy);
+}
+
+inline char * SuRF::serializeCompact(uint64_t & size) const
+{
+    size = 0;
+    if (louds_sparse_->getHeight() > kCompactMaxKeyLen + 1)
+        return nullptr;
+    CompactWriter writer;
+    std::vector<char> & buffer = writer.buffer();
+    buffer.resize(sizeof(CompactHeader));
+    louds_dense_->serializeCompact(writer);
+    louds_sparse_->serializeCompact(writer);
+
+    CompactHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kCompactMagic, sizeof(kCompactMagic));
+    header.version = kCompactVersion;
+    header.body_size = buffer.size() - sizeof(CompactHeader);
+    header.body_crc = crc32c(buffer.data() + sizeof(CompactHeader), header.body_size);
+    memcpy(buffer.data(), &header, sizeof(header));
+
+    size = buffer.size();
+    char * data = new char[size];
+    memcpy(data, buffer.data(), size);
+    return data;
+}
+
+inline SuRF * SuRF::deSerializeCompact(const char * src, const uint64_t size)
+{
+    CompactHeader header;
+    if (size < sizeof(CompactHeader))
+        return nullptr;
+    memcpy(&header, src, sizeof(header));
+    if (memcmp(header.magic, kCompactMagic, sizeof(kCompactMagic)) != 0)
+        return nullptr;
+    if (header.version == 0 || header.version > kCompactVersion)
+        return nullptr;
+    if (header.body_size > size - sizeof(CompactHeader))
+        return nullptr;
+    const char * body = src + sizeof(CompactHeader);
+    if (crc32c(body, header.body_size) != header.body_crc)
+        return nullptr;
+
+    CompactReader reader(body, header.body_size);
+    SuRF * surf = new SuRF();
+    surf->louds_dense_ = LoudsDense::deSerializeCompact(reader);
+    surf->louds_sparse_ = LoudsSparse::deSerializeCompact(reader);
+    if (reader.failed() || !reader.atEnd())
+    {
+        surf->destroy();
+        delete surf;
+        return nullptr;
+    }
+    return surf;
+}
+
+inline uint64_t SuRF::imageSize(const char * src, const uint64_t size)
+{
+    uint64_t dense_size = LoudsDense::imageSize(src, size);
+    if (dense_size == 0)
         return 0;
-    iter2_ = moveToKeyGreaterThan(right_key, true);
-    if (!iter2_.isValid())
-        iter2_ = moveToLast();
+    uint64_t sparse_size = LoudsSparse::imageSize(src + dense_size, size - dense_size);
+    return (sparse_size == 0) ? 0 : (dense_size + sparse_size);
+}
 
-    return approxCount(&iter_, &iter2_);
+inline SuRF * SuRF::open(const char * path, const bool lock_dense, const bool verify_checksums)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+    size_t size = static_cast<size_t>(file_stat.st_size);
+    void * mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file open
+    if (mapping == MAP_FAILED)
+        return nullptr;
+
+    char * data = static_cast<char *>(mapping);
+    size_t payload_offset = 0;
+    if (size >= sizeof(kFormatMagic) && memcmp(data, kFormatMagic, sizeof(kFormatMagic)) == 0)
+    {
+        FormatHeader header;
+        bool is_valid = (readFormatHeader(data, size, header) == kFormatOk);
+        for (uint32_t i = 0; is_valid && verify_checksums && i < kNumFormatSections; i++)
+            is_valid = verifyFormatSection(data, header, i);
+        if (!is_valid)
+        {
+            munmap(data, size);
+            return nullptr;
+        }
+        payload_offset = header.sections[0].offset;
+    }
+    if (imageSize(data + payload_offset, size - payload_offset) == 0)
+    {
+        munmap(data, size);
+        return nullptr;
+    }
+    SuRF * surf = deSerialize(data + payload_offset, true);
+    surf->mapped_data_ = data;
+    surf->mapped_size_ = size;
+
+    // madvise works on whole pages: the dense range is rounded out, the
+    // sparse range in, so that the page the two sections share is
+    // prefetched
+    uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t begin = reinterpret_cast<uintptr_t>(data);
+    uintptr_t dense_end = begin + payload_offset + surf->louds_dense_->serializedSize();
+    uintptr_t sparse_begin = (dense_end + page_size - 1) & ~(page_size - 1);
+    uintptr_t end = (begin + size + page_size - 1) & ~(page_size - 1);
+    size_t dense_len = sparse_begin - begin;
+    madvise(data, dense_len, MADV_WILLNEED);
+    if (lock_dense)
+        mlock(data, dense_len);
+    if (end > sparse_begin)
+        madvise(reinterpret_cast<void *>(sparse_begin), end - sparse_begin, MADV_RANDOM);
+    return surf;
+}
+
+inline SuRF *
+SuRF::openTiered(const char * path, const level_t num_resident_sparse_levels, const uint64_t cache_pages, const uint64_t page_size)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat file_stat;
+    FormatHeader header;
+    std::vector<char> head(sizeof(FormatHeader));
+    if (fstat(fd, &file_stat) != 0 || pread(fd, head.data(), head.size(), 0) != static_cast<ssize_t>(head.size()))
+    {
+        ::close(fd);
+        return nullptr;
+    }
+    uint64_t file_size = static_cast<uint64_t>(file_stat.st_size);
+    memcpy(&header, head.data(), sizeof(header));
+    // the key lengths are unchecked until the header crc is: they must
+    // not size the buffer before the file is known to hold the keys
+    if (memcmp(header.magic, kFormatMagic, sizeof(kFormatMagic)) != 0 || header.version == 0
+        || header.version > kFormatVersion || formatPayloadOffset(header.min_key_len, header.max_key_len) > file_size)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+    head.resize(formatPayloadOffset(header.min_key_len, header.max_key_len));
+    if (pread(fd, head.data(), head.size(), 0) != static_cast<ssize_t>(head.size())
+        || readFormatHeader(head.data(), file_size, header) != kFormatOk)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+
+    uint64_t payload_offset = header.sections[0].offset;
+    uint64_t payload_size = header.file_size - payload_offset;
+    PageCache * cache = PageCache::create(fd, payload_offset, payload_size, page_size, cache_pages);
+    if (cache == nullptr)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+    // the louds-dense sections and the louds-sparse header for good, and
+    // the start of the other louds-sparse sections, whose headers
+    // deSerialize reads
+    char * region = cache->getRegion();
+    const FormatSectionEntry & sparse_header = header.sections[kSectionSparseHeader];
+    cache->pin(region, sparse_header.offset + sparse_header.length - payload_offset);
+    for (uint32_t i = kSectionSparseHeader + 1; i < kNumFormatSections; i++)
+        cache->pin(region + (header.sections[i].offset - payload_offset), 64);
+    if (cache->failed())
+    {
+        delete cache;
+        return nullptr;
+    }
+    for (uint32_t i = 0; i <= kSectionSparseHeader; i++)
+    {
+        const FormatSectionEntry & section = header.sections[i];
+        if (crc32c(region + (section.offset - payload_offset), section.length) != section.crc)
+        {
+            delete cache;
+            return nullptr;
+        }
+    }
+
+    SuRF * surf = deSerialize(region, true);
+    surf->page_cache_ = cache;
+    if (surf->serializedSize() != payload_size)
+    {
+        surf->destroy();
+        delete surf;
+        return nullptr;
+    }
+    surf->louds_sparse_->setPageCache(cache, num_resident_sparse_levels);
+    surf->num_tiered_keys_ = header.num_keys;
+    return surf;
 }
 
 inline uint64_t SuRF::serializedSize() const
@@ -437,7 +1395,9 @@ inline uint64_t SuRF::serializedSize() const
 inline uint64_t SuRF::getMemoryUsage() const
 {
     // Approximate base object size + component memory usage
-    return (64 + louds_dense_->getMemoryUsage() + louds_sparse_->getMemoryUsage());
+    return (
+        64 + louds_dense_->getMemoryUsage() + louds_sparse_->getMemoryUsage()
+        + (dense_tombstones_.size() + sparse_tombstones_.size()) * sizeof(word_t));
 }
 
 inline level_t SuRF::getHeight() const
@@ -450,6 +1410,128 @@ inline level_t SuRF::getSparseStartLevel() const
     return louds_sparse_->getStartLevel();
 }
 
+inline level_t SuRF::getRealSuffixLen() const
+{
+    return louds_sparse_->getRealSuffixLen();
+}
+
+//============================================================================
+
+// One input of merge(): walks a filter in key order and exposes, for each
+// stored key, the longest byte string the original key is known to start
+// with
+class SuRF::MergeCursor
+{
+public:
+    explicit MergeCursor(const SuRF * filter)
+        : iter_(filter->moveToFirst())
+        , is_prefix_key_(false)
+    {
+        load();
+    }
+
+    inline bool isValid() const { return iter_.isValid(); }
+    inline const std::string & getKey() const { return key_; }
+    // see Iter::isAtPrefixKey
+    inline bool isPrefixKey() const { return is_prefix_key_; }
+
+    inline void next()
+    {
+        iter_++;
+        load();
+    }
+
+private:
+    inline void load()
+    {
+        if (!iter_.isValid())
+            return;
+        iter_.getKey(key_);
+        is_prefix_key_ = iter_.isAtPrefixKey();
+        // 0 means no real suffix was stored; bits of a partial byte
+        // cannot be kept in a key
+        word_t suffix = 0;
+        int suffix_len = iter_.getSuffix(&suffix);
+        if (suffix == 0)
+            return;
+        for (int bits = suffix_len; bits >= 8; bits -= 8)
+            key_.push_back(static_cast<char>(suffix >> (bits - 8)));
+    }
+
+    SuRF::Iter iter_;
+    std::string key_;
+    bool is_prefix_key_;
+};
+
+inline SuRF * SuRF::merge(const std::vector<const SuRF *> & filters, const bool include_dense, const uint32_t sparse_dense_ratio)
+{
+    std::vector<MergeCursor> cursors;
+    cursors.reserve(filters.size());
+    level_t real_suffix_len = 0;
+    for (size_t i = 0; i < filters.size(); i++)
+    {
+        cursors.push_back(MergeCursor(filters[i]));
+        real_suffix_len = std::max(real_suffix_len, filters[i]->getRealSuffixLen());
+    }
+
+    // min-heap of the valid cursors by current key
+    auto greater = [&cursors](const size_t a, const size_t b) { return cursors[a].getKey() > cursors[b].getKey(); };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+    for (size_t i = 0; i < cursors.size(); i++)
+        if (cursors[i].isValid())
+            heap.push(i);
+    if (heap.empty())
+        return nullptr;
+
+    // A key that is not a prefix key stands for all its extensions, so
+    // the keys that extend it are dropped: in the result they could turn
+    // it into a prefix key that matches itself only.
+    std::string cover;
+    bool has_cover = false;
+    std::string last_key;
+    bool has_last_key = false;
+    auto next_key = [&](std::string & key) {
+        while (!heap.empty())
+        {
+            size_t i = heap.top();
+            heap.pop();
+            MergeCursor & cursor = cursors[i];
+            const std::string & cursor_key = cursor.getKey();
+            bool emit = false;
+            if (!has_cover || cursor_key.compare(0, cover.length(), cover) != 0)
+            {
+                if (!cursor.isPrefixKey())
+                {
+                    cover = cursor_key;
+                    has_cover = true;
+                }
+                if (!has_last_key || cursor_key != last_key)
+                {
+                    key = cursor_key;
+                    last_key = cursor_key;
+                    has_last_key = true;
+                    emit = true;
+                }
+            }
+            cursor.next();
+            if (cursor.isValid())
+                heap.push(i);
+            if (emit)
+                return true;
+        }
+        return false;
+    };
+
+    SuRF * merged = new SuRF();
+    if (!merged->createFromStream(
+            next_key, include_dense, sparse_dense_ratio, (real_suffix_len > 0) ? kReal : kNone, 0, real_suffix_len))
+    {
+        delete merged;
+        return nullptr;
+    }
+    return merged;
+}
+
 //============================================================================
 
 inline void SuRF::Iter::clear()
@@ -458,17 +1540,48 @@ inline void SuRF::Iter::clear()
     sparse_iter_.clear();
 }
 
+inline void SuRF::Iter::reset()
+{
+    dense_iter_.reset();
+    sparse_iter_.reset();
+    could_be_fp_ = false;
+}
+
+//============================================================================
+
+inline void SuRF::QueryContext::bind(const SuRF * filter)
+{
+    if (filter_ == filter && louds_dense_ == filter->louds_dense_ && louds_sparse_ == filter->louds_sparse_)
+        return;
+    filter_ = filter;
+    louds_dense_ = filter->louds_dense_;
+    louds_sparse_ = filter->louds_sparse_;
+    iter_ = SuRF::Iter(filter);
+    iter2_ = SuRF::Iter(filter);
+    left_pos_list_.clear();
+    right_pos_list_.clear();
+    left_pos_list_.reserve(filter->getHeight() + 1);
+    right_pos_list_.reserve(filter->getHeight() + 1);
+}
+
 inline bool SuRF::Iter::getFpFlag() const
 {
     return could_be_fp_;
 }
 
+inline bool SuRF::Iter::isAtPrefixKey() const
+{
+    if (dense_iter_.isComplete())
+        return dense_iter_.isAtPrefixKey();
+    return sparse_iter_.isAtTerminator();
+}
+
 inline bool SuRF::Iter::isValid() const
 {
     return dense_iter_.isValid() && (dense_iter_.isComplete() || sparse_iter_.isValid());
 }
 
-inline int SuRF::Iter::compare(const std::string & key) const
+inline int SuRF::Iter::compare(const KeyView & key) const
 {
     assert(isValid());
     int dense_compare = dense_iter_.compare(key);
@@ -479,11 +1592,19 @@ inline int SuRF::Iter::compare(const std::string & key) const
 
 inline std::string SuRF::Iter::getKey() const
 {
+    std::string key;
+    getKey(key);
+    return key;
+}
+
+inline void SuRF::Iter::getKey(std::string & key) const
+{
+    key.clear();
     if (!isValid())
-        return std::string();
-    if (dense_iter_.isComplete())
-        return dense_iter_.getKey();
-    return dense_iter_.getKey() + sparse_iter_.getKey();
+        return;
+    dense_iter_.appendKey(key);
+    if (!dense_iter_.isComplete())
+        sparse_iter_.appendKey(key);
 }
 
 inline int SuRF::Iter::getSuffix(word_t * suffix) const
@@ -538,9 +1659,12 @@ inline bool SuRF::Iter::operator++(int)
 {
     if (!isValid())
         return false;
-    if (incrementSparseIter())
-        return true;
-    return incrementDenseIter();
+    do
+    {
+        if (!incrementSparseIter() && !incrementDenseIter())
+            return false;
+    } while (isErased());
+    return true;
 }
 
 inline bool SuRF::Iter::decrementDenseIter()
@@ -571,9 +1695,34 @@ inline bool SuRF::Iter::operator--(int)
 {
     if (!isValid())
         return false;
-    if (decrementSparseIter())
-        return true;
-    return decrementDenseIter();
+    do
+    {
+        if (!decrementSparseIter() && !decrementDenseIter())
+            return false;
+    } while (isErased());
+    return true;
+}
+
+inline bool SuRF::Iter::isErased() const
+{
+    if (filter_ == nullptr || filter_->num_erased_ == 0 || !isValid())
+        return false;
+    if (dense_iter_.isComplete())
+        return SuRFBuilder::readBit(filter_->dense_tombstones_, dense_iter_.getLeafIndex());
+    return SuRFBuilder::readBit(filter_->sparse_tombstones_, sparse_iter_.getLeafIndex());
+}
+
+inline void SuRF::Iter::skipErased(const bool forward)
+{
+    if (!isErased())
+        return;
+    // the next live key is a different key, so no longer a possible
+    // false positive
+    could_be_fp_ = false;
+    if (forward)
+        (*this)++;
+    else
+        (*this)--;
 }
 
 } // namespace surf
@@ -3,16 +3,53 @@
 
 #include <cassert>
 
+#include <algorithm>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "config.hpp"
 #include "hash.hpp"
+#include "key_sort.hpp"
 #include "suffix.hpp"
 
 namespace surf
 {
 
+// Memory held while building a filter, in bytes of allocated vector
+// capacity (allocator overhead not included).
+struct BuildMemoryStats
+{
+    BuildMemoryStats()
+        : sparse_bytes(0)
+        , suffix_bytes(0)
+        , dense_bytes(0)
+        , other_bytes(0)
+        , peak_transient_bytes(0)
+        , final_bytes(0)
+        , peak_bytes(0)
+    {
+    }
+
+    // Transient (builder) memory by build stage
+    uint64_t sparse_bytes; // key scan: LOUDS-Sparse labels, child and louds bits
+    uint64_t suffix_bytes; // key scan: suffix words
+    uint64_t dense_bytes; // buildDense: LOUDS-Dense bitmaps
+    uint64_t other_bytes; // per-level bookkeeping and the buffered key
+    // The builder vectors of each trie level (sparse, suffix and dense)
+    std::vector<uint64_t> level_bytes;
+    // Largest transient total at any point of the build; includes the
+    // partition builders of buildParallel while they are merged
+    uint64_t peak_transient_bytes;
+
+    // Filled in by SuRF: the finished filter (SuRF::getMemoryUsage), and
+    // the most transient plus final memory held at the same time
+    uint64_t final_bytes;
+    uint64_t peak_bytes;
+
+    inline uint64_t transientBytes() const { return sparse_bytes + suffix_bytes + dense_bytes + other_bytes; }
+};
+
 class SuRFBuilder
 {
 public:
@@ -20,6 +57,8 @@ public:
         : sparse_start_level_(0)
         , suffix_type_(kNone)
         , has_keys_(false)
+        , has_pending_key_(false)
+        , peak_memory_bytes_(0)
     {
     }
     explicit SuRFBuilder(
@@ -31,6 +70,8 @@ public:
         , hash_suffix_len_(hash_suffix_len)
         , real_suffix_len_(real_suffix_len)
         , has_keys_(false)
+        , has_pending_key_(false)
+        , peak_memory_bytes_(0)
     {
     }
 
@@ -54,6 +95,8 @@ public:
         , is_last_item_terminator_(other.is_last_item_terminator_)
         , last_inserted_key_(other.last_inserted_key_)
         , has_keys_(other.has_keys_)
+        , has_pending_key_(other.has_pending_key_)
+        , peak_memory_bytes_(other.peak_memory_bytes_)
     {
     }
 
@@ -65,20 +108,70 @@ public:
     // REQUIRED: provided key list must be sorted.
     inline void build(const std::vector<std::string> & keys);
 
+    // Same result as build(keys), with the LOUDS-Sparse vectors built by
+    // up to num_threads threads. All keys share their first split level
+    // bytes (split level = length of the common prefix of the key set),
+    // so the key list is cut where the byte at the split level changes.
+    // Each partition is built on its own thread and the per-level vectors
+    // are then concatenated: below the split level every partition holds
+    // the same single-node chain, at the split level the partitions'
+    // labels form one node, and deeper nodes keep their key order.
+    // REQUIRED: provided key list must be sorted.
+    inline void buildParallel(const std::vector<std::string> & keys, const unsigned num_threads);
+
+    // Builds from keys in any order, duplicates allowed: keys is sorted
+    // and deduplicated in place (see sortUniqueKeys), then built with
+    // buildParallel, both on up to num_threads threads. The two phases
+    // run one after the other, not pipelined: the build starts only once
+    // the whole list is sorted, and the sort is most of the time (about
+    // 80% for 2M random 64-bit keys, 70% for random text keys).
+    inline void buildUnsorted(std::vector<std::string> & keys, const unsigned num_threads);
+
+    // Builds from num_keys sorted keys packed back to back in one buffer:
+    // key i is blob[offsets[i], offsets[i + 1]), so offsets has
+    // num_keys + 1 entries. The keys are read in place, never copied.
+    inline void build(const char * blob, const uint32_t * offsets, const size_t num_keys);
+
+    // Streaming builds: same result as build(keys) without materializing
+    // the key list. The builder holds one key of lookahead (a key's bytes
+    // are placed only once its successor is known), so its memory is the
+    // trie plus two keys.
+    // REQUIRED: keys must arrive sorted.
+    // Returns false if the stream holds no key, or stops there and
+    // returns false at the first key that is smaller than the one before
+    // it; the builder is then unfinished and must not be used.
+    //
+    // From an input iterator range over std::string (or anything
+    // assignable to one)
+    template <typename InputIterator>
+    inline bool build(InputIterator first, InputIterator last);
+    // From a callback: bool next_key(std::string & key) stores the next
+    // key and returns false once the stream is exhausted
+    template <typename KeySource>
+    inline bool buildFromStream(KeySource next_key);
+
     // Insert a single key into the existing trie structure.
     // This method allows incremental building of the SuRF.
+    // The key is buffered until the next insert (or finalize), so that
+    // the trie comes out identical to build().
     // REQUIRED: key must be inserted in sorted order relative to previously inserted keys.
     // Returns true if insertion was successful, false if key violates sort order.
     inline bool insert(const std::string & key);
 
     // Finalize the builder after incremental insertions.
     // This method should be called after all keys have been inserted via insert() method.
-    // It performs the dense level optimization if enabled.
+    // It places the buffered last key and performs the dense level
+    // optimization if enabled.
     inline void finalize();
 
     // Check if the builder has any keys inserted
     inline bool hasKeys() const { return has_keys_; }
 
+    // Memory currently held by the builder vectors, per stage and per
+    // level, and the peak so far. The vectors only grow, so after a
+    // build the current total is also the peak except for buildParallel.
+    inline BuildMemoryStats getMemoryStats() const;
+
     static bool readBit(const std::vector<word_t> & bits, const position_t pos)
     {
         assert(pos < (bits.size() * kWordSize));
@@ -97,6 +190,15 @@ public:
 
     inline level_t getTreeHeight() const { return static_cast<level_t>(labels_.size()); }
 
+    // The cutoff determineCutoffLevel picks for a trie with these per-level
+    // node, item (label) and suffix counts
+    static level_t computeCutoffLevel(
+        const std::vector<position_t> & node_counts,
+        const std::vector<position_t> & item_counts,
+        const std::vector<position_t> & suffix_counts,
+        const level_t suffix_len,
+        const uint32_t sparse_dense_ratio);
+
     // const accessors
     const std::vector<std::vector<word_t>> & getBitmapLabels() const { return bitmap_labels_; }
     const std::vector<std::vector<word_t>> & getBitmapChildIndicatorBits() const { return bitmap_child_indicator_bits_; }
@@ -114,11 +216,30 @@ public:
     inline level_t getRealSuffixLen() const { return real_suffix_len_; }
 
 private:
-    static bool isSameKey(const std::string & a, const std::string & b) { return a.compare(b) == 0; }
+    static bool isSameKey(const KeyView & a, const KeyView & b)
+    {
+        return (a.length() == b.length()) && (memcmp(a.data(), b.data(), a.length()) == 0);
+    }
+
+    // Places key in the trie; next_key is its successor in the key list
+    // (empty for the last key)
+    inline void insertKey(const KeyView & key, const KeyView & next_key);
 
     // Fill in the LOUDS-Sparse vectors through a single scan
     // of the sorted key list.
     inline void buildSparse(const std::vector<std::string> & keys);
+    // Builds keys[begin, end); keys[end], if any, is the successor of the last key
+    inline void buildSparse(const std::vector<std::string> & keys, const position_t begin, const position_t end);
+
+    // Cuts keys into at most num_parts ranges at split-level boundaries;
+    // bounds gets the start of every range plus keys.size()
+    static void partitionKeys(
+        const std::vector<std::string> & keys, const unsigned num_parts, level_t & split_level, std::vector<position_t> & bounds);
+    // Concatenates the LOUDS-Sparse vectors of the partition builders
+    inline void mergeSparse(const std::vector<SuRFBuilder> & parts, const level_t split_level);
+    // ORs src[0, num_bits) into dst starting at bit dst_offset
+    static void copyBits(std::vector<word_t> & dst, const uint64_t dst_offset, const std::vector<word_t> & src, const uint64_t num_bits);
+    static level_t commonPrefixLen(const std::string & a, const std::string & b);
 
     // Walks down the current partially-filled trie by comparing key to
     // its previous key in the list until their prefixes do not match.
@@ -126,17 +247,17 @@ private:
     // label vector.
     // For each matching prefix byte(label), it sets the corresponding
     // child indicator bit to 1 for that label.
-    inline level_t skipCommonPrefix(const std::string & key);
+    inline level_t skipCommonPrefix(const KeyView & key);
 
     // Starting at the start_level of the trie, the function inserts
     // key bytes to the trie vectors until the first byte/label where
     // key and next_key do not match.
     // This function is called after skipCommonPrefix. Therefore, it
     // guarantees that the stored prefix of key is unique in the trie.
-    inline level_t insertKeyBytesToTrieUntilUnique(const std::string & key, const std::string & next_key, const level_t start_level);
+    inline level_t insertKeyBytesToTrieUntilUnique(const KeyView & key, const KeyView & next_key, const level_t start_level);
 
     // Fills in the suffix byte for key
-    inline void insertSuffix(const std::string & key, const level_t level);
+    inline void insertSuffix(const KeyView & key, const level_t level);
 
     inline bool isCharCommonPrefix(const label_t c, const level_t level) const;
     inline bool isLevelEmpty(const level_t level) const;
@@ -149,8 +270,17 @@ private:
     // Dense size < Sparse size / sparse_dense_ratio_
     inline void determineCutoffLevel();
 
-    inline uint64_t computeDenseMem(const level_t downto_level) const;
-    inline uint64_t computeSparseMem(const level_t start_level) const;
+    // Memory estimate of one level encoded as LOUDS-Dense / LOUDS-Sparse
+    static uint64_t denseLevelMem(
+        const std::vector<position_t> & node_counts,
+        const std::vector<position_t> & suffix_counts,
+        const level_t suffix_len,
+        const level_t level);
+    static uint64_t sparseLevelMem(
+        const std::vector<position_t> & item_counts,
+        const std::vector<position_t> & suffix_counts,
+        const level_t suffix_len,
+        const level_t level);
 
     // Fill in the LOUDS-Dense vectors based on the built
     // Sparse vectors.
@@ -165,6 +295,12 @@ private:
     inline bool isStartOfNode(const level_t level, const position_t pos) const;
     inline bool isTerminator(const level_t level, const position_t pos) const;
 
+    template <typename T>
+    static uint64_t vectorBytes(const std::vector<T> & v)
+    {
+        return v.capacity() * sizeof(T);
+    }
+
 private:
     // trie level < sparse_start_level_: LOUDS-Dense
     // trie level >= sparse_start_level_: LOUDS-Sparse
@@ -192,9 +328,15 @@ private:
     std::vector<position_t> node_counts_;
     std::vector<bool> is_last_item_terminator_;
 
-    // For incremental insertion, track the last inserted key
+    // For incremental insertion, track the last inserted key; it stays
+    // pending (not yet in the trie) until its successor arrives
     std::string last_inserted_key_;
     bool has_keys_;
+    bool has_pending_key_;
+
+    // Transient peak recorded at points where more than this builder's
+    // own vectors were alive (see getMemoryStats)
+    uint64_t peak_memory_bytes_;
 };
 
 inline void SuRFBuilder::build(const std::vector<std::string> & keys)
@@ -208,23 +350,237 @@ inline void SuRFBuilder::build(const std::vector<std::string> & keys)
     }
 }
 
+inline void SuRFBuilder::buildParallel(const std::vector<std::string> & keys, const unsigned num_threads)
+{
+    assert(keys.size() > 0);
+    level_t split_level = 0;
+    std::vector<position_t> bounds;
+    partitionKeys(keys, num_threads, split_level, bounds);
+    position_t num_parts = static_cast<position_t>(bounds.size() - 1);
+    if (num_parts <= 1)
+    {
+        build(keys);
+        return;
+    }
+
+    std::vector<SuRFBuilder> parts(
+        num_parts, SuRFBuilder(include_dense_, sparse_dense_ratio_, suffix_type_, hash_suffix_len_, real_suffix_len_));
+    std::vector<std::thread> threads;
+    for (position_t p = 0; p < num_parts; p++)
+    {
+        SuRFBuilder * part = &parts[p];
+        position_t begin = bounds[p];
+        position_t end = bounds[p + 1];
+        threads.push_back(std::thread([part, &keys, begin, end]() { part->buildSparse(keys, begin, end); }));
+    }
+    for (position_t p = 0; p < num_parts; p++)
+        threads[p].join();
+
+    mergeSparse(parts, split_level);
+    uint64_t part_bytes = 0;
+    for (position_t p = 0; p < num_parts; p++)
+        part_bytes += parts[p].getMemoryStats().transientBytes();
+    peak_memory_bytes_ = part_bytes + getMemoryStats().transientBytes();
+    if (include_dense_)
+    {
+        determineCutoffLevel();
+        buildDense();
+    }
+}
+
+inline void SuRFBuilder::buildUnsorted(std::vector<std::string> & keys, const unsigned num_threads)
+{
+    sortUniqueKeys(keys, num_threads);
+    buildParallel(keys, num_threads);
+}
+
 inline void SuRFBuilder::buildSparse(const std::vector<std::string> & keys)
 {
-    for (position_t i = 0; i < keys.size(); i++)
+    buildSparse(keys, 0, static_cast<position_t>(keys.size()));
+}
+
+inline void SuRFBuilder::buildSparse(const std::vector<std::string> & keys, const position_t begin, const position_t end)
+{
+    for (position_t i = begin; i < end; i++)
     {
-        level_t level = skipCommonPrefix(keys[i]);
         position_t curpos = i;
-        while ((i + 1 < keys.size()) && isSameKey(keys[curpos], keys[i + 1]))
+        while ((i + 1 < end) && isSameKey(keys[curpos], keys[i + 1]))
             i++;
         if (i < keys.size() - 1)
-            level = insertKeyBytesToTrieUntilUnique(keys[curpos], keys[i + 1], level);
+            insertKey(keys[curpos], keys[i + 1]);
+        else // for last key, there is no successor key in the list
+            insertKey(keys[curpos], KeyView());
+    }
+}
+
+inline void SuRFBuilder::build(const char * blob, const uint32_t * offsets, const size_t num_keys)
+{
+    assert(num_keys > 0);
+    for (size_t i = 0; i < num_keys; i++)
+    {
+        KeyView key(blob + offsets[i], offsets[i + 1] - offsets[i]);
+        while ((i + 1 < num_keys) && isSameKey(key, KeyView(blob + offsets[i + 1], offsets[i + 2] - offsets[i + 1])))
+            i++;
+        if (i + 1 < num_keys)
+            insertKey(key, KeyView(blob + offsets[i + 1], offsets[i + 2] - offsets[i + 1]));
         else // for last key, there is no successor key in the list
-            level = insertKeyBytesToTrieUntilUnique(keys[curpos], std::string(), level);
-        insertSuffix(keys[curpos], level);
+            insertKey(key, KeyView());
+    }
+    if (include_dense_)
+    {
+        determineCutoffLevel();
+        buildDense();
     }
 }
 
-inline level_t SuRFBuilder::skipCommonPrefix(const std::string & key)
+inline void SuRFBuilder::insertKey(const KeyView & key, const KeyView & next_key)
+{
+    level_t level = skipCommonPrefix(key);
+    level = insertKeyBytesToTrieUntilUnique(key, next_key, level);
+    insertSuffix(key, level);
+}
+
+template <typename InputIterator>
+inline bool SuRFBuilder::build(InputIterator first, InputIterator last)
+{
+    return buildFromStream([&first, &last](std::string & key) {
+        if (first == last)
+            return false;
+        key = *first;
+        ++first;
+        return true;
+    });
+}
+
+template <typename KeySource>
+inline bool SuRFBuilder::buildFromStream(KeySource next_key)
+{
+    std::string key;
+    while (next_key(key))
+    {
+        if (!insert(key))
+            return false;
+    }
+    if (!has_keys_)
+        return false;
+    finalize();
+    return true;
+}
+
+inline level_t SuRFBuilder::commonPrefixLen(const std::string & a, const std::string & b)
+{
+    level_t len = 0;
+    while ((len < a.length()) && (len < b.length()) && (a[len] == b[len]))
+        len++;
+    return len;
+}
+
+inline void SuRFBuilder::partitionKeys(
+    const std::vector<std::string> & keys, const unsigned num_parts, level_t & split_level, std::vector<position_t> & bounds)
+{
+    position_t num_keys = static_cast<position_t>(keys.size());
+    split_level = commonPrefixLen(keys[0], keys[num_keys - 1]);
+    bounds.clear();
+    bounds.push_back(0);
+    // a boundary is a key whose predecessor differs from it at split_level
+    // (equal keys have a longer common prefix unless both end there)
+    for (unsigned p = 1; p < num_parts; p++)
+    {
+        position_t i = static_cast<position_t>(static_cast<uint64_t>(num_keys) * p / num_parts);
+        if (i <= bounds.back())
+            i = bounds.back() + 1;
+        while ((i < num_keys) && ((commonPrefixLen(keys[i - 1], keys[i]) != split_level) || isSameKey(keys[i - 1], keys[i])))
+            i++;
+        if (i >= num_keys)
+            break;
+        bounds.push_back(i);
+    }
+    bounds.push_back(num_keys);
+}
+
+inline void SuRFBuilder::copyBits(std::vector<word_t> & dst, const uint64_t dst_offset, const std::vector<word_t> & src, const uint64_t num_bits)
+{
+    uint64_t num_words = (num_bits + kWordSize - 1) / kWordSize;
+    uint64_t shift = dst_offset % kWordSize;
+    for (uint64_t i = 0; i < num_words; i++)
+    {
+        word_t word = src[i];
+        // bits past num_bits are zero in the builder's vectors
+        if ((i == num_words - 1) && (num_bits % kWordSize != 0))
+            word &= ~(kOneMask >> (num_bits % kWordSize));
+        uint64_t word_id = dst_offset / kWordSize + i;
+        dst[word_id] |= (word >> shift);
+        if ((shift > 0) && (word_id + 1 < dst.size()))
+            dst[word_id + 1] |= (word << (kWordSize - shift));
+    }
+}
+
+inline void SuRFBuilder::mergeSparse(const std::vector<SuRFBuilder> & parts, const level_t split_level)
+{
+    assert(getTreeHeight() == 0);
+    level_t height = 0;
+    for (position_t p = 0; p < parts.size(); p++)
+        if (parts[p].getTreeHeight() > height)
+            height = parts[p].getTreeHeight();
+
+    level_t suffix_len = getSuffixLen();
+    for (level_t level = 0; level < height; level++)
+    {
+        addLevel();
+        // every partition holds the same chain above the split level
+        position_t first_part = 0;
+        position_t end_part = static_cast<position_t>(parts.size());
+        if (level < split_level)
+            end_part = 1;
+
+        uint64_t num_items = 0;
+        uint64_t num_suffixes = 0;
+        for (position_t p = first_part; p < end_part; p++)
+        {
+            if (level >= parts[p].getTreeHeight())
+                continue;
+            num_items += parts[p].getNumItems(level);
+            num_suffixes += parts[p].suffix_counts_[level];
+        }
+        labels_[level].reserve(num_items);
+        child_indicator_bits_[level].assign(num_items / kWordSize + 1, 0);
+        louds_bits_[level].assign(num_items / kWordSize + 1, 0);
+        uint64_t num_suffix_bits = num_suffixes * suffix_len;
+        uint64_t num_suffix_words = (num_suffix_bits + kWordSize - 1) / kWordSize;
+        if ((num_suffixes > 0) && (num_suffix_words == 0))
+            num_suffix_words = 1; // storeSuffix allocates a word even for empty suffixes
+        suffixes_[level].assign(num_suffix_words, 0);
+
+        uint64_t item_offset = 0;
+        uint64_t suffix_offset = 0;
+        for (position_t p = first_part; p < end_part; p++)
+        {
+            const SuRFBuilder & part = parts[p];
+            if (level >= part.getTreeHeight())
+                continue;
+            position_t part_items = part.getNumItems(level);
+            labels_[level].insert(labels_[level].end(), part.labels_[level].begin(), part.labels_[level].end());
+            copyBits(child_indicator_bits_[level], item_offset, part.child_indicator_bits_[level], part_items);
+            copyBits(louds_bits_[level], item_offset, part.louds_bits_[level], part_items);
+            node_counts_[level] += part.node_counts_[level];
+            // the partitions' split-level labels all belong to one node
+            if ((level == split_level) && (p > 0) && (part_items > 0))
+            {
+                louds_bits_[level][item_offset / kWordSize] &= ~(kMsbMask >> (item_offset % kWordSize));
+                node_counts_[level]--;
+            }
+            if (part_items > 0)
+                is_last_item_terminator_[level] = part.is_last_item_terminator_[level];
+            item_offset += part_items;
+
+            copyBits(suffixes_[level], suffix_offset, part.suffixes_[level], static_cast<uint64_t>(part.suffix_counts_[level]) * suffix_len);
+            suffix_counts_[level] += part.suffix_counts_[level];
+            suffix_offset += static_cast<uint64_t>(part.suffix_counts_[level]) * suffix_len;
+        }
+    }
+}
+
+inline level_t SuRFBuilder::skipCommonPrefix(const KeyView & key)
 {
     level_t level = 0;
     while (level < key.length() && isCharCommonPrefix(static_cast<label_t>(key[level]), level))
@@ -236,7 +592,7 @@ inline level_t SuRFBuilder::skipCommonPrefix(const std::string & key)
 }
 
 inline level_t
-SuRFBuilder::insertKeyBytesToTrieUntilUnique(const std::string & key, const std::string & next_key, const level_t start_level)
+SuRFBuilder::insertKeyBytesToTrieUntilUnique(const KeyView & key, const KeyView & next_key, const level_t start_level)
 {
     assert(start_level < key.length());
 
@@ -251,7 +607,7 @@ SuRFBuilder::insertKeyBytesToTrieUntilUnique(const std::string & key, const std:
     // shoud be in an the node as the previous key.
     insertKeyByte(key[level], level, is_start_of_node, is_term);
     level++;
-    if (level > next_key.length() || !isSameKey(key.substr(0, level), next_key.substr(0, level)))
+    if (level > next_key.length() || (memcmp(key.data(), next_key.data(), level) != 0))
         return level;
 
     // All the following bytes inserted must be the start of a
@@ -278,7 +634,7 @@ SuRFBuilder::insertKeyBytesToTrieUntilUnique(const std::string & key, const std:
     return level;
 }
 
-inline void SuRFBuilder::insertSuffix(const std::string & key, const level_t level)
+inline void SuRFBuilder::insertSuffix(const KeyView & key, const level_t level)
 {
     if (level >= getTreeHeight())
         addLevel();
@@ -361,42 +717,57 @@ inline void SuRFBuilder::storeSuffix(const level_t level, const word_t suffix)
 
 inline void SuRFBuilder::determineCutoffLevel()
 {
+    std::vector<position_t> item_counts;
+    for (level_t level = 0; level < getTreeHeight(); level++)
+        item_counts.push_back(getNumItems(level));
+    sparse_start_level_ = computeCutoffLevel(node_counts_, item_counts, suffix_counts_, getSuffixLen(), sparse_dense_ratio_);
+}
+
+inline level_t SuRFBuilder::computeCutoffLevel(
+    const std::vector<position_t> & node_counts,
+    const std::vector<position_t> & item_counts,
+    const std::vector<position_t> & suffix_counts,
+    const level_t suffix_len,
+    const uint32_t sparse_dense_ratio)
+{
+    level_t height = static_cast<level_t>(item_counts.size());
+    // dense_mem covers levels [0, cutoff_level), sparse_mem the rest;
+    // each step down moves one level from one sum to the other
+    uint64_t dense_mem = 0;
+    uint64_t sparse_mem = 0;
+    for (level_t level = 0; level < height; level++)
+        sparse_mem += sparseLevelMem(item_counts, suffix_counts, suffix_len, level);
     level_t cutoff_level = 0;
-    uint64_t dense_mem = computeDenseMem(cutoff_level);
-    uint64_t sparse_mem = computeSparseMem(cutoff_level);
-    while ((cutoff_level < getTreeHeight()) && (dense_mem * sparse_dense_ratio_ < sparse_mem))
+    while ((cutoff_level < height) && (dense_mem * sparse_dense_ratio < sparse_mem))
     {
+        dense_mem += denseLevelMem(node_counts, suffix_counts, suffix_len, cutoff_level);
+        sparse_mem -= sparseLevelMem(item_counts, suffix_counts, suffix_len, cutoff_level);
         cutoff_level++;
-        dense_mem = computeDenseMem(cutoff_level);
-        sparse_mem = computeSparseMem(cutoff_level);
     }
-    sparse_start_level_ = cutoff_level--;
+    return cutoff_level;
 }
 
-inline uint64_t SuRFBuilder::computeDenseMem(const level_t downto_level) const
+inline uint64_t SuRFBuilder::denseLevelMem(
+    const std::vector<position_t> & node_counts,
+    const std::vector<position_t> & suffix_counts,
+    const level_t suffix_len,
+    const level_t level)
 {
-    assert(downto_level <= getTreeHeight());
-    uint64_t mem = 0;
-    for (level_t level = 0; level < downto_level; level++)
-    {
-        mem += (2 * kFanout * node_counts_[level]);
-        if (level > 0)
-            mem += (node_counts_[level - 1] / 8 + 1);
-        mem += (suffix_counts_[level] * getSuffixLen() / 8);
-    }
+    uint64_t mem = (2 * kFanout * node_counts[level]);
+    if (level > 0)
+        mem += (node_counts[level - 1] / 8 + 1);
+    mem += (suffix_counts[level] * suffix_len / 8);
     return mem;
 }
 
-inline uint64_t SuRFBuilder::computeSparseMem(const level_t start_level) const
+inline uint64_t SuRFBuilder::sparseLevelMem(
+    const std::vector<position_t> & item_counts,
+    const std::vector<position_t> & suffix_counts,
+    const level_t suffix_len,
+    const level_t level)
 {
-    uint64_t mem = 0;
-    for (level_t level = start_level; level < getTreeHeight(); level++)
-    {
-        position_t num_items = static_cast<position_t>(labels_[level].size());
-        mem += (num_items + 2 * num_items / 8 + 1);
-        mem += (suffix_counts_[level] * getSuffixLen() / 8);
-    }
-    return mem;
+    position_t num_items = item_counts[level];
+    return (num_items + 2 * num_items / 8 + 1 + suffix_counts[level] * suffix_len / 8);
 }
 
 inline void SuRFBuilder::buildDense()
@@ -485,6 +856,31 @@ inline bool SuRFBuilder::isTerminator(const level_t level, const position_t pos)
     return ((label == kTerminator) && !readBit(child_indicator_bits_[level], pos));
 }
 
+inline BuildMemoryStats SuRFBuilder::getMemoryStats() const
+{
+    BuildMemoryStats stats;
+    for (level_t level = 0; level < getTreeHeight(); level++)
+    {
+        uint64_t sparse_bytes
+            = vectorBytes(labels_[level]) + vectorBytes(child_indicator_bits_[level]) + vectorBytes(louds_bits_[level]);
+        uint64_t suffix_bytes = vectorBytes(suffixes_[level]);
+        uint64_t dense_bytes = 0;
+        if (level < bitmap_labels_.size())
+            dense_bytes = vectorBytes(bitmap_labels_[level]) + vectorBytes(bitmap_child_indicator_bits_[level])
+                + vectorBytes(prefixkey_indicator_bits_[level]);
+        stats.sparse_bytes += sparse_bytes;
+        stats.suffix_bytes += suffix_bytes;
+        stats.dense_bytes += dense_bytes;
+        stats.level_bytes.push_back(sparse_bytes + suffix_bytes + dense_bytes);
+    }
+    stats.other_bytes = vectorBytes(labels_) + vectorBytes(child_indicator_bits_) + vectorBytes(louds_bits_)
+        + vectorBytes(bitmap_labels_) + vectorBytes(bitmap_child_indicator_bits_) + vectorBytes(prefixkey_indicator_bits_)
+        + vectorBytes(suffixes_) + vectorBytes(suffix_counts_) + vectorBytes(node_counts_) + is_last_item_terminator_.capacity() / 8
+        + last_inserted_key_.capacity();
+    stats.peak_transient_bytes = std::max(peak_memory_bytes_, stats.transientBytes());
+    return stats;
+}
+
 inline bool SuRFBuilder::insert(const std::string & key)
 {
     // Check if key maintains sorted order
@@ -499,23 +895,27 @@ inline bool SuRFBuilder::insert(const std::string & key)
         return true; // Key already exists, treat as successful
     }
 
-    // Perform the insertion using the same logic as buildSparse
-    level_t level = skipCommonPrefix(key);
-
-    // For incremental insertion, we need to handle the case where this key
-    // might be the last key differently since we don't know the next key
-    level = insertKeyBytesToTrieUntilUnique(key, std::string(), level);
-    insertSuffix(key, level);
+    // key is the successor of the pending key, which can now be placed
+    // exactly as buildSparse would place it
+    if (has_pending_key_)
+        insertKey(last_inserted_key_, key);
 
     // Update tracking variables
-    last_inserted_key_ = key;
+    last_inserted_key_.assign(key);
     has_keys_ = true;
+    has_pending_key_ = true;
 
     return true;
 }
 
 inline void SuRFBuilder::finalize()
 {
+    // the last key has no successor
+    if (has_pending_key_)
+    {
+        insertKey(last_inserted_key_, KeyView());
+        has_pending_key_ = false;
+    }
     if (include_dense_ && has_keys_)
     {
         determineCutoffLevel();
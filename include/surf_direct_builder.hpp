@@ -0,0 +1,583 @@
+#ifndef SURFDIRECTBUILDER_H_
+#define SURFDIRECTBUILDER_H_
+
+#include <cassert>
+
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "label_vector.hpp"
+#include "louds_dense.hpp"
+#include "louds_sparse.hpp"
+#include "rank.hpp"
+#include "select.hpp"
+#include "suffix.hpp"
+#include "surf_builder.hpp"
+
+namespace surf
+{
+
+// Builds the same LoudsDense and LoudsSparse as SuRFBuilder, but writes
+// every label, bit and suffix straight into its final position instead
+// of into per-level vectors that are then copied and shifted into place.
+// The sorted keys are scanned twice. The first pass runs the
+// SuRFBuilder insertion logic keeping only per-level counts, which fix
+// the dense/sparse cutoff and where each level starts in the final
+// arrays; the second pass runs it again and writes. Build memory is the
+// finished filter plus O(trie height) bookkeeping.
+class SuRFDirectBuilder
+{
+public:
+    explicit SuRFDirectBuilder(
+        bool include_dense, uint32_t sparse_dense_ratio, SuffixType suffix_type, level_t hash_suffix_len, level_t real_suffix_len)
+        : include_dense_(include_dense)
+        , sparse_dense_ratio_(sparse_dense_ratio)
+        , sparse_start_level_(0)
+        , suffix_type_(suffix_type)
+        , hash_suffix_len_(hash_suffix_len)
+        , real_suffix_len_(real_suffix_len)
+        , bits_per_key_(0)
+        , is_within_budget_(true)
+        , estimated_memory_usage_(0)
+        , is_writing_(false)
+        , louds_dense_(nullptr)
+        , louds_sparse_(nullptr)
+    {
+    }
+
+    ~SuRFDirectBuilder() { }
+
+    // Builds to a memory budget of bits_per_key bits per (unique) key.
+    // The suffix lengths given to the constructor become upper bounds:
+    // the build keeps the longest suffixes for which some cutoff level
+    // no deeper than the sparse_dense_ratio rule fits the budget, with
+    // the deepest such cutoff. Sizes come from the exact size of every
+    // structure, rank and select indexes included. If the filter does
+    // not fit even without suffixes, the smallest one is built and
+    // isWithinBudget() returns false.
+    inline void setBitsPerKeyBudget(const double bits_per_key) { bits_per_key_ = bits_per_key; }
+
+    // REQUIRED: provided key list must be sorted.
+    inline void build(const std::vector<std::string> & keys);
+    // Key i is blob[offsets[i], offsets[i + 1]) (see SuRFBuilder)
+    inline void build(const char * blob, const uint32_t * offsets, const size_t num_keys);
+
+    // The built tries; the caller takes ownership
+    inline LoudsDense * getLoudsDense() const { return louds_dense_; }
+    inline LoudsSparse * getLoudsSparse() const { return louds_sparse_; }
+    inline level_t getSparseStartLevel() const { return sparse_start_level_; }
+    // The suffix configuration built (differs from the constructor
+    // arguments only under a budget; a suffix cut to 0 bits drops its type)
+    inline SuffixType getSuffixType() const { return suffix_type_; }
+    inline level_t getHashSuffixLen() const { return hash_suffix_len_; }
+    inline level_t getRealSuffixLen() const { return real_suffix_len_; }
+    inline bool isWithinBudget() const { return is_within_budget_; }
+    // LoudsDense plus LoudsSparse getMemoryUsage() as predicted before
+    // the second pass (exact unless the select index needed explicit blocks)
+    inline uint64_t getEstimatedMemoryUsage() const { return estimated_memory_usage_; }
+
+    // Only bookkeeping is transient here: everything else is written into
+    // the final structures
+    inline BuildMemoryStats getMemoryStats() const;
+
+private:
+    // Insertion state of one trie level; the "last item" is the one
+    // SuRFBuilder would find at the back of the level's vectors
+    struct LevelState
+    {
+        LevelState()
+            : num_items(0)
+            , num_nodes(0)
+            , num_suffixes(0)
+            , last_label(0)
+            , is_last_item_terminator(false)
+            , is_last_item_start_of_node(false)
+            , last_item_has_child(false)
+        {
+        }
+
+        position_t num_items;
+        position_t num_nodes;
+        position_t num_suffixes;
+        label_t last_label;
+        bool is_last_item_terminator;
+        bool is_last_item_start_of_node;
+        bool last_item_has_child;
+    };
+
+    inline level_t getSuffixLen() const { return hash_suffix_len_ + real_suffix_len_; }
+    inline level_t getTreeHeight() const { return static_cast<level_t>(levels_.size()); }
+
+    static bool isSameKey(const KeyView & a, const KeyView & b)
+    {
+        return (a.length() == b.length()) && (memcmp(a.data(), b.data(), a.length()) == 0);
+    }
+
+    // Both passes: key_at(i) returns the i-th key as a KeyView
+    template <typename KeyAt>
+    inline void build(KeyAt key_at, const size_t num_keys);
+    template <typename KeyAt>
+    inline void insertKeys(KeyAt key_at, const size_t num_keys);
+
+    // Same walk as the SuRFBuilder functions of the same names
+    inline void insertKey(const KeyView & key, const KeyView & next_key);
+    inline level_t skipCommonPrefix(const KeyView & key);
+    inline level_t insertKeyBytesToTrieUntilUnique(const KeyView & key, const KeyView & next_key, const level_t start_level);
+    inline void insertKeyByte(const label_t label, const level_t level, const bool is_start_of_node, const bool is_term);
+    inline void insertSuffix(const KeyView & key, const level_t level);
+    inline bool isCharCommonPrefix(const label_t c, const level_t level) const;
+
+    // Sets the child indicator bit of the last item of level
+    inline void setChildIndicatorBit(const level_t level);
+    // A dense item is written once it is no longer the last of its
+    // level, because only then its child indicator bit is final
+    inline void writeDenseItem(const level_t level);
+
+    // Predicted getMemoryUsage() of the tries for a cutoff level and
+    // suffix length (0 for kNone), from the prefix sums of the per-level
+    // counts
+    inline uint64_t estimateDenseMemoryUsage(const level_t cutoff_level, const level_t suffix_len) const;
+    inline uint64_t estimateSparseMemoryUsage(const level_t cutoff_level, const level_t suffix_len) const;
+    // The sparse_dense_ratio rule over the predicted sizes
+    inline level_t ratioCutoffLevel(const level_t suffix_len) const;
+    // Picks suffix lengths and cutoff level for bits_per_key_
+    inline void fitToBudget();
+    // suffix_type_ with hash_len and real_len suffix bits, dropping a
+    // part that has no bits
+    inline SuffixType effectiveSuffixType(const level_t hash_len, const level_t real_len) const;
+
+    // Between the passes: sizes the final structures from the counts
+    inline void allocate();
+    // After the second pass: writes the last dense items and builds the
+    // rank and select indexes over the finished bitvectors
+    inline void finish();
+
+private:
+    bool include_dense_;
+    uint32_t sparse_dense_ratio_;
+    level_t sparse_start_level_;
+
+    SuffixType suffix_type_;
+    level_t hash_suffix_len_;
+    level_t real_suffix_len_;
+
+    double bits_per_key_; // 0: no budget
+    bool is_within_budget_;
+    uint64_t estimated_memory_usage_;
+    // prefix sums over levels of the node, item and suffix counts
+    std::vector<position_t> node_sums_;
+    std::vector<position_t> item_sums_;
+    std::vector<position_t> suffix_sums_;
+
+    // false during the counting pass
+    bool is_writing_;
+    std::vector<LevelState> levels_;
+
+    // Where each level starts in the final arrays: first node (dense
+    // levels), first item (sparse levels) and first suffix slot
+    std::vector<position_t> level_starts_;
+    std::vector<position_t> suffix_starts_;
+
+    LoudsDense * louds_dense_;
+    LoudsSparse * louds_sparse_;
+};
+
+inline void SuRFDirectBuilder::build(const std::vector<std::string> & keys)
+{
+    build([&keys](const size_t i) { return KeyView(keys[i]); }, keys.size());
+}
+
+inline void SuRFDirectBuilder::build(const char * blob, const uint32_t * offsets, const size_t num_keys)
+{
+    build([blob, offsets](const size_t i) { return KeyView(blob + offsets[i], offsets[i + 1] - offsets[i]); }, num_keys);
+}
+
+template <typename KeyAt>
+inline void SuRFDirectBuilder::build(KeyAt key_at, const size_t num_keys)
+{
+    assert(num_keys > 0);
+    is_writing_ = false;
+    levels_.clear();
+    insertKeys(key_at, num_keys);
+
+    allocate();
+    is_writing_ = true;
+    insertKeys(key_at, num_keys);
+    finish();
+}
+
+template <typename KeyAt>
+inline void SuRFDirectBuilder::insertKeys(KeyAt key_at, const size_t num_keys)
+{
+    for (size_t i = 0; i < num_keys; i++)
+    {
+        KeyView key = key_at(i);
+        while ((i + 1 < num_keys) && isSameKey(key, key_at(i + 1)))
+            i++;
+        if (i + 1 < num_keys)
+            insertKey(key, key_at(i + 1));
+        else // for last key, there is no successor key in the list
+            insertKey(key, KeyView());
+    }
+}
+
+inline void SuRFDirectBuilder::insertKey(const KeyView & key, const KeyView & next_key)
+{
+    level_t level = skipCommonPrefix(key);
+    level = insertKeyBytesToTrieUntilUnique(key, next_key, level);
+    insertSuffix(key, level);
+}
+
+inline level_t SuRFDirectBuilder::skipCommonPrefix(const KeyView & key)
+{
+    level_t level = 0;
+    while (level < key.length() && isCharCommonPrefix(static_cast<label_t>(key[level]), level))
+    {
+        setChildIndicatorBit(level);
+        level++;
+    }
+    return level;
+}
+
+inline level_t
+SuRFDirectBuilder::insertKeyBytesToTrieUntilUnique(const KeyView & key, const KeyView & next_key, const level_t start_level)
+{
+    assert(start_level < key.length());
+
+    level_t level = start_level;
+    bool is_start_of_node = (level >= getTreeHeight()) || (levels_[level].num_items == 0);
+    insertKeyByte(static_cast<label_t>(key[level]), level, is_start_of_node, false);
+    level++;
+    if (level > next_key.length() || (memcmp(key.data(), next_key.data(), level) != 0))
+        return level;
+
+    while (level < key.length() && level < next_key.length() && key[level] == next_key[level])
+    {
+        insertKeyByte(static_cast<label_t>(key[level]), level, true, false);
+        level++;
+    }
+
+    if (level < key.length())
+        insertKeyByte(static_cast<label_t>(key[level]), level, true, false);
+    else
+        insertKeyByte(kTerminator, level, true, true);
+    level++;
+
+    return level;
+}
+
+inline void SuRFDirectBuilder::insertKeyByte(const label_t label, const level_t level, const bool is_start_of_node, const bool is_term)
+{
+    if (level >= getTreeHeight())
+    {
+        assert(!is_writing_);
+        levels_.push_back(LevelState());
+    }
+
+    // sets parent node's child indicator
+    if (level > 0)
+        setChildIndicatorBit(level - 1);
+
+    LevelState & state = levels_[level];
+    if (is_writing_)
+    {
+        if (level < sparse_start_level_)
+        {
+            if (state.num_items > 0)
+                writeDenseItem(level);
+        }
+        else
+        {
+            position_t pos = level_starts_[level] + state.num_items;
+            louds_sparse_->labels_->write(pos, label);
+            if (is_start_of_node)
+                louds_sparse_->louds_bits_->setBit(pos);
+        }
+    }
+    state.num_items++;
+    if (is_start_of_node)
+        state.num_nodes++;
+    state.last_label = label;
+    state.is_last_item_terminator = is_term;
+    state.is_last_item_start_of_node = is_start_of_node;
+    state.last_item_has_child = false;
+}
+
+inline void SuRFDirectBuilder::insertSuffix(const KeyView & key, const level_t level)
+{
+    if (level >= getTreeHeight())
+    {
+        assert(!is_writing_);
+        levels_.push_back(LevelState());
+    }
+    // like SuRFBuilder::storeSuffix, the suffix belongs to the level of
+    // the key's last label
+    LevelState & state = levels_[level - 1];
+    if (is_writing_ && suffix_type_ != kNone)
+    {
+        word_t suffix = BitvectorSuffix::constructSuffix(suffix_type_, key, hash_suffix_len_, level, real_suffix_len_);
+        position_t idx = suffix_starts_[level - 1] + state.num_suffixes;
+        if (level - 1 < sparse_start_level_)
+            louds_dense_->suffixes_->write(idx, suffix);
+        else
+            louds_sparse_->suffixes_->write(idx, suffix);
+    }
+    state.num_suffixes++;
+}
+
+inline bool SuRFDirectBuilder::isCharCommonPrefix(const label_t c, const level_t level) const
+{
+    return (level < getTreeHeight()) && (levels_[level].num_items > 0) && (!levels_[level].is_last_item_terminator)
+        && (c == levels_[level].last_label);
+}
+
+inline void SuRFDirectBuilder::setChildIndicatorBit(const level_t level)
+{
+    LevelState & state = levels_[level];
+    assert(state.num_items > 0);
+    state.last_item_has_child = true;
+    if (is_writing_ && level >= sparse_start_level_)
+        louds_sparse_->child_indicator_bits_->setBit(level_starts_[level] + state.num_items - 1);
+}
+
+inline void SuRFDirectBuilder::writeDenseItem(const level_t level)
+{
+    const LevelState & state = levels_[level];
+    position_t node_num = level_starts_[level] + state.num_nodes - 1;
+    // same test as SuRFBuilder::buildDense: a terminator that starts its
+    // node marks the node as a prefix key
+    if (state.is_last_item_start_of_node && state.last_label == kTerminator && !state.last_item_has_child)
+    {
+        louds_dense_->prefixkey_indicator_bits_->setBit(node_num);
+        return;
+    }
+    position_t pos = node_num * kFanout + state.last_label;
+    louds_dense_->label_bitmaps_->setBit(pos);
+    if (state.last_item_has_child)
+        louds_dense_->child_indicator_bitmaps_->setBit(pos);
+}
+
+inline uint64_t SuRFDirectBuilder::estimateDenseMemoryUsage(const level_t cutoff_level, const level_t suffix_len) const
+{
+    position_t num_nodes = node_sums_[cutoff_level];
+    position_t num_suffix_bits = suffix_sums_[cutoff_level] * suffix_len;
+    return (sizeof(LoudsDense)
+            + 2 * BitvectorRank::sizeFor(num_nodes * kFanout, LoudsDense::kRankBasicBlockSize, LoudsDense::kBitmapRankLayout)
+            + BitvectorRank::sizeFor(num_nodes, LoudsDense::kRankBasicBlockSize, kRankLut) + BitvectorSuffix::sizeFor(num_suffix_bits));
+}
+
+inline uint64_t SuRFDirectBuilder::estimateSparseMemoryUsage(const level_t cutoff_level, const level_t suffix_len) const
+{
+    level_t height = getTreeHeight();
+    position_t num_items = item_sums_[height] - item_sums_[cutoff_level];
+    position_t num_nodes = node_sums_[height] - node_sums_[cutoff_level];
+    position_t num_suffix_bits = (suffix_sums_[height] - suffix_sums_[cutoff_level]) * suffix_len;
+    // LoudsSparse::getMemoryUsage counts sizeof(this)
+    return (sizeof(LoudsSparse *) + LabelVector::sizeFor(num_items)
+            + BitvectorRank::sizeFor(num_items, LoudsSparse::kRankBasicBlockSize, LoudsSparse::kChildRankLayout)
+            + BitvectorSelect::sizeFor(num_items, num_nodes, LoudsSparse::kSelectSampleInterval, LoudsSparse::kSelectSubSampleInterval)
+            + BitvectorSuffix::sizeFor(num_suffix_bits));
+}
+
+inline level_t SuRFDirectBuilder::ratioCutoffLevel(const level_t suffix_len) const
+{
+    if (!include_dense_)
+        return 0;
+    level_t cutoff_level = 0;
+    while ((cutoff_level < getTreeHeight())
+           && (estimateDenseMemoryUsage(cutoff_level, suffix_len) * sparse_dense_ratio_
+               < estimateSparseMemoryUsage(cutoff_level, suffix_len)))
+        cutoff_level++;
+    return cutoff_level;
+}
+
+inline SuffixType SuRFDirectBuilder::effectiveSuffixType(const level_t hash_len, const level_t real_len) const
+{
+    if (suffix_type_ == kMixed && hash_len == 0)
+        return (real_len == 0) ? kNone : kReal;
+    if (suffix_type_ == kMixed && real_len == 0)
+        return kHash;
+    if (hash_len + real_len == 0)
+        return kNone;
+    return suffix_type_;
+}
+
+inline void SuRFDirectBuilder::fitToBudget()
+{
+    double budget_bits = bits_per_key_ * suffix_sums_[getTreeHeight()];
+    level_t hash_len = (suffix_type_ == kHash || suffix_type_ == kMixed) ? hash_suffix_len_ : 0;
+    level_t real_len = (suffix_type_ == kReal || suffix_type_ == kMixed) ? real_suffix_len_ : 0;
+    while (true)
+    {
+        SuffixType type = effectiveSuffixType(hash_len, real_len);
+        level_t suffix_len = (type == kNone) ? 0 : hash_len + real_len;
+        // deepest cutoff within the ratio rule that fits
+        for (level_t cutoff_level = ratioCutoffLevel(suffix_len) + 1; cutoff_level-- > 0;)
+        {
+            uint64_t mem = estimateDenseMemoryUsage(cutoff_level, suffix_len) + estimateSparseMemoryUsage(cutoff_level, suffix_len);
+            if (mem * 8.0 <= budget_bits)
+            {
+                sparse_start_level_ = cutoff_level;
+                suffix_type_ = type;
+                hash_suffix_len_ = (type == kHash || type == kMixed) ? hash_len : 0;
+                real_suffix_len_ = (type == kReal || type == kMixed) ? real_len : 0;
+                is_within_budget_ = true;
+                return;
+            }
+        }
+        if (suffix_len == 0)
+            break;
+        // shorten the longer part first
+        if (real_len >= hash_len)
+            real_len--;
+        else
+            hash_len--;
+    }
+
+    // over budget: the smallest filter, without suffixes
+    suffix_type_ = kNone;
+    hash_suffix_len_ = 0;
+    real_suffix_len_ = 0;
+    level_t max_cutoff_level = include_dense_ ? getTreeHeight() : 0;
+    uint64_t min_mem = 0;
+    for (level_t cutoff_level = 0; cutoff_level <= max_cutoff_level; cutoff_level++)
+    {
+        uint64_t mem = estimateDenseMemoryUsage(cutoff_level, 0) + estimateSparseMemoryUsage(cutoff_level, 0);
+        if (cutoff_level == 0 || mem < min_mem)
+        {
+            min_mem = mem;
+            sparse_start_level_ = cutoff_level;
+        }
+    }
+    is_within_budget_ = false;
+}
+
+inline void SuRFDirectBuilder::allocate()
+{
+    level_t height = getTreeHeight();
+    std::vector<position_t> node_counts;
+    std::vector<position_t> item_counts;
+    std::vector<position_t> suffix_counts;
+    for (level_t level = 0; level < height; level++)
+    {
+        node_counts.push_back(levels_[level].num_nodes);
+        item_counts.push_back(levels_[level].num_items);
+        suffix_counts.push_back(levels_[level].num_suffixes);
+    }
+    node_sums_.assign(height + 1, 0);
+    item_sums_.assign(height + 1, 0);
+    suffix_sums_.assign(height + 1, 0);
+    for (level_t level = 0; level < height; level++)
+    {
+        node_sums_[level + 1] = node_sums_[level] + node_counts[level];
+        item_sums_[level + 1] = item_sums_[level] + item_counts[level];
+        suffix_sums_[level + 1] = suffix_sums_[level] + suffix_counts[level];
+    }
+    sparse_start_level_ = 0;
+    if (bits_per_key_ > 0)
+        fitToBudget();
+    else if (include_dense_)
+        sparse_start_level_
+            = SuRFBuilder::computeCutoffLevel(node_counts, item_counts, suffix_counts, getSuffixLen(), sparse_dense_ratio_);
+    level_t suffix_len = (suffix_type_ == kNone) ? 0 : getSuffixLen();
+    estimated_memory_usage_
+        = estimateDenseMemoryUsage(sparse_start_level_, suffix_len) + estimateSparseMemoryUsage(sparse_start_level_, suffix_len);
+
+    level_starts_.assign(height, 0);
+    suffix_starts_.assign(height, 0);
+    position_t num_dense_nodes = 0;
+    position_t num_dense_suffixes = 0;
+    for (level_t level = 0; level < sparse_start_level_; level++)
+    {
+        level_starts_[level] = num_dense_nodes;
+        suffix_starts_[level] = num_dense_suffixes;
+        num_dense_nodes += node_counts[level];
+        num_dense_suffixes += suffix_counts[level];
+    }
+    position_t num_sparse_items = 0;
+    position_t num_sparse_suffixes = 0;
+    for (level_t level = sparse_start_level_; level < height; level++)
+    {
+        level_starts_[level] = num_sparse_items;
+        suffix_starts_[level] = num_sparse_suffixes;
+        num_sparse_items += item_counts[level];
+        num_sparse_suffixes += suffix_counts[level];
+    }
+
+    // LoudsDense, laid out as by LoudsDense(const SuRFBuilder *)
+    louds_dense_ = new LoudsDense();
+    louds_dense_->height_ = sparse_start_level_;
+    louds_dense_->level_cuts_ = new position_t[sparse_start_level_];
+    for (level_t level = 0; level < sparse_start_level_; level++)
+        louds_dense_->level_cuts_[level] = (level_starts_[level] + node_counts[level]) * kFanout - 1;
+    louds_dense_->label_bitmaps_
+        = new BitvectorRank(LoudsDense::kRankBasicBlockSize, num_dense_nodes * kFanout, LoudsDense::kBitmapRankLayout);
+    louds_dense_->child_indicator_bitmaps_
+        = new BitvectorRank(LoudsDense::kRankBasicBlockSize, num_dense_nodes * kFanout, LoudsDense::kBitmapRankLayout);
+    louds_dense_->prefixkey_indicator_bits_ = new BitvectorRank(LoudsDense::kRankBasicBlockSize, num_dense_nodes, kRankLut);
+    if (suffix_type_ == kNone)
+        louds_dense_->suffixes_ = new BitvectorSuffix();
+    else
+        louds_dense_->suffixes_
+            = new BitvectorSuffix(suffix_type_, hash_suffix_len_, real_suffix_len_, num_dense_suffixes * getSuffixLen());
+
+    // LoudsSparse, laid out as by LoudsSparse(const SuRFBuilder *)
+    louds_sparse_ = new LoudsSparse();
+    louds_sparse_->height_ = height;
+    louds_sparse_->start_level_ = sparse_start_level_;
+    louds_sparse_->node_count_dense_ = num_dense_nodes;
+    if (sparse_start_level_ == 0)
+        louds_sparse_->child_count_dense_ = 0;
+    else if (sparse_start_level_ < height)
+        louds_sparse_->child_count_dense_ = num_dense_nodes + node_counts[sparse_start_level_] - 1;
+    else
+        louds_sparse_->child_count_dense_ = num_dense_nodes - 1;
+    louds_sparse_->level_cuts_ = new position_t[height];
+    for (level_t level = 0; level < height; level++)
+        louds_sparse_->level_cuts_[level] = (level < sparse_start_level_) ? 0 : (level_starts_[level] + item_counts[level] - 1);
+    louds_sparse_->labels_ = new LabelVector(num_sparse_items);
+    louds_sparse_->child_indicator_bits_
+        = new BitvectorRank(LoudsSparse::kRankBasicBlockSize, num_sparse_items, LoudsSparse::kChildRankLayout);
+    louds_sparse_->louds_bits_
+        = new BitvectorSelect(LoudsSparse::kSelectSampleInterval, num_sparse_items, LoudsSparse::kSelectSubSampleInterval);
+    if (suffix_type_ == kNone)
+        louds_sparse_->suffixes_ = new BitvectorSuffix();
+    else
+        louds_sparse_->suffixes_
+            = new BitvectorSuffix(suffix_type_, hash_suffix_len_, real_suffix_len_, num_sparse_suffixes * getSuffixLen());
+
+    // the second pass starts from an empty trie of the same height
+    levels_.assign(height, LevelState());
+}
+
+inline BuildMemoryStats SuRFDirectBuilder::getMemoryStats() const
+{
+    BuildMemoryStats stats;
+    stats.other_bytes = levels_.capacity() * sizeof(LevelState)
+        + (level_starts_.capacity() + suffix_starts_.capacity() + node_sums_.capacity() + item_sums_.capacity()
+           + suffix_sums_.capacity())
+            * sizeof(position_t);
+    stats.level_bytes.assign(getTreeHeight(), 0);
+    // plus the three count vectors of allocate()
+    stats.peak_transient_bytes = stats.other_bytes + 3 * getTreeHeight() * sizeof(position_t);
+    return stats;
+}
+
+inline void SuRFDirectBuilder::finish()
+{
+    for (level_t level = 0; level < sparse_start_level_; level++)
+    {
+        if (levels_[level].num_items > 0)
+            writeDenseItem(level);
+    }
+    louds_dense_->label_bitmaps_->initRankIndex();
+    louds_dense_->child_indicator_bitmaps_->initRankIndex();
+    louds_dense_->prefixkey_indicator_bits_->initRankIndex();
+    louds_sparse_->child_indicator_bits_->initRankIndex();
+    louds_sparse_->louds_bits_->initSelectIndex();
+}
+
+} // namespace surf
+
+#endif // SURFDIRECTBUILDER_H_
@@ -0,0 +1,179 @@
+#ifndef SURFFORMAT_H_
+#define SURFFORMAT_H_
+
+#include <string.h>
+
+#include <string>
+
+#include "config.hpp"
+#include "crc32c.hpp"
+
+namespace surf
+{
+
+// Self-describing on-disk format of a filter (SuRF::serializeFormatted).
+//
+//   FormatHeader | min key | max key | padding to 8 bytes | sections
+//
+// The sections are the parts serialize() writes, in the same order and
+// with the same layout, so the bytes from the first section on are a
+// plain serialize() image and load with SuRF::deSerialize (zero-copy
+// included). Each section has an entry in the header with its offset
+// from the start of the file, its length and its CRC32C: a reader can
+// check or page in one section without touching the others. The header
+// and the keys after it have their own CRC32C.
+//
+// All fields are in host byte order, like the serialize() image.
+
+static const char kFormatMagic[8] = {'S', 'u', 'R', 'F', 'f', 'm', 't', '\0'};
+// Bump on any change to the header or to the section layout
+static const uint32_t kFormatVersion = 1;
+
+enum FormatSection
+{
+    kSectionDenseHeader = 0, // height, level cuts
+    kSectionDenseLabels, // label bitmaps + rank LUT
+    kSectionDenseChildren, // child indicator bitmaps + rank LUT
+    kSectionDensePrefixKeys, // prefix key bits + rank LUT
+    kSectionDenseSuffixes,
+    kSectionSparseHeader, // height, start level, dense counts, level cuts
+    kSectionSparseLabels,
+    kSectionSparseChildren, // child indicator bits + rank LUT
+    kSectionSparseLouds, // louds bits + select samples
+    kSectionSparseSuffixes,
+    kNumFormatSections
+};
+
+enum FormatStatus
+{
+    kFormatOk = 0,
+    kFormatTruncated, // fewer bytes than the header or the file size it records
+    kFormatBadMagic,
+    kFormatBadVersion, // written by a newer version
+    kFormatBadHeader, // header checksum mismatch or inconsistent section table
+    kFormatBadChecksum // section checksum mismatch
+};
+
+struct FormatSectionEntry
+{
+    uint64_t offset; // from the start of the file
+    uint64_t length;
+    uint32_t crc; // CRC32C of the section bytes
+    uint32_t reserved;
+};
+
+struct FormatHeader
+{
+    char magic[8];
+    uint32_t version;
+    // CRC32C of the header and the min/max keys, computed with this
+    // field set to 0
+    uint32_t header_crc;
+    uint64_t file_size;
+    uint64_t num_keys;
+
+    // build parameters
+    uint32_t suffix_type; // SuffixType
+    uint32_t hash_suffix_len;
+    uint32_t real_suffix_len;
+    uint32_t height;
+    uint32_t sparse_start_level; // number of louds-dense levels
+
+    uint32_t num_sections;
+    // Stored prefixes of the smallest and the largest live key (the
+    // filter's first and last keys, without suffixes), right after the
+    // header. Every key the filter can report present is >= min key and
+    // <= max key or starts with max key.
+    uint32_t min_key_len;
+    uint32_t max_key_len;
+
+    FormatSectionEntry sections[kNumFormatSections];
+};
+
+static_assert(sizeof(FormatHeader) % 8 == 0, "FormatHeader must keep the sections 8-byte aligned");
+
+inline uint64_t formatPayloadOffset(const uint32_t min_key_len, const uint32_t max_key_len)
+{
+    uint64_t offset = sizeof(FormatHeader) + min_key_len + max_key_len;
+    sizeAlign(offset);
+    return offset;
+}
+
+inline uint32_t computeFormatHeaderCrc(const char * src, const FormatHeader & header)
+{
+    FormatHeader copy = header;
+    copy.header_crc = 0;
+    uint32_t crc = crc32c(&copy, sizeof(copy));
+    return crc32cExtend(crc, src + sizeof(FormatHeader), header.min_key_len + header.max_key_len);
+}
+
+// Copies the header out of the size bytes at src and checks the magic,
+// the version, the header checksum and that the section table is
+// consistent: the sections lie back to back, 8-byte aligned, from the
+// end of the keys to file_size. The section contents are not read.
+inline FormatStatus readFormatHeader(const char * src, const uint64_t size, FormatHeader & header)
+{
+    if (size < sizeof(FormatHeader))
+        return kFormatTruncated;
+    memcpy(&header, src, sizeof(FormatHeader));
+    if (memcmp(header.magic, kFormatMagic, sizeof(kFormatMagic)) != 0)
+        return kFormatBadMagic;
+    if (header.version == 0 || header.version > kFormatVersion)
+        return kFormatBadVersion;
+    if (header.num_sections != kNumFormatSections)
+        return kFormatBadHeader;
+    uint64_t offset = formatPayloadOffset(header.min_key_len, header.max_key_len);
+    if (offset > size || offset > header.file_size)
+        return (offset > size) ? kFormatTruncated : kFormatBadHeader;
+    if (computeFormatHeaderCrc(src, header) != header.header_crc)
+        return kFormatBadHeader;
+    for (uint32_t i = 0; i < kNumFormatSections; i++)
+    {
+        const FormatSectionEntry & section = header.sections[i];
+        if (section.offset != offset || section.length % 8 != 0 || section.length > header.file_size - offset)
+            return kFormatBadHeader;
+        offset += section.length;
+    }
+    if (offset != header.file_size)
+        return kFormatBadHeader;
+    if (header.file_size > size)
+        return kFormatTruncated;
+    return kFormatOk;
+}
+
+// REQUIRED: readFormatHeader(src, ...) returned kFormatOk for header
+inline bool verifyFormatSection(const char * src, const FormatHeader & header, const uint32_t section)
+{
+    const FormatSectionEntry & entry = header.sections[section];
+    return crc32c(src + entry.offset, entry.length) == entry.crc;
+}
+
+// readFormatHeader, then every section checksum
+inline FormatStatus verifyFormat(const char * src, const uint64_t size)
+{
+    FormatHeader header;
+    FormatStatus status = readFormatHeader(src, size, header);
+    if (status != kFormatOk)
+        return status;
+    for (uint32_t i = 0; i < kNumFormatSections; i++)
+    {
+        if (!verifyFormatSection(src, header, i))
+            return kFormatBadChecksum;
+    }
+    return kFormatOk;
+}
+
+// REQUIRED: readFormatHeader(src, ...) returned kFormatOk for header
+inline std::string getFormatMinKey(const char * src, const FormatHeader & header)
+{
+    return std::string(src + sizeof(FormatHeader), header.min_key_len);
+}
+
+inline std::string getFormatMaxKey(const char * src, const FormatHeader & header)
+{
+    return std::string(src + sizeof(FormatHeader) + header.min_key_len, header.max_key_len);
+}
+
+} // namespace surf
+
+#endif // SURFFORMAT_H_
@@ -0,0 +1,163 @@
+#ifndef SURFINT_H_
+#define SURFINT_H_
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "config.hpp"
+#include "key_sort.hpp"
+#include "surf.hpp"
+
+namespace surf
+{
+
+// SuRF over fixed-width unsigned integer keys (e.g. SuRFInt<uint64_t>).
+// Keys are stored as kKeyLen-byte big-endian strings so that the trie
+// order is the integer order. Probes are encoded into a stack buffer
+// and never go through std::string; point queries use the fixed-length
+// trie walk, which knows the key length at compile time and has no
+// prefix-key or terminator checks.
+template <typename IntT>
+class SuRFInt
+{
+    static_assert(std::is_integral<IntT>::value && std::is_unsigned<IntT>::value, "SuRFInt keys must be unsigned integers");
+
+public:
+    static const level_t kKeyLen = sizeof(IntT);
+
+    SuRFInt() { }
+
+    //------------------------------------------------------------------
+    // Input keys must be SORTED
+    //------------------------------------------------------------------
+    SuRFInt(
+        const std::vector<IntT> & keys,
+        const bool include_dense = kIncludeDense,
+        const uint32_t sparse_dense_ratio = kSparseDenseRatio,
+        const SuffixType suffix_type = kNone,
+        const level_t hash_suffix_len = 0,
+        const level_t real_suffix_len = 0)
+    {
+        create(keys, include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len);
+    }
+
+    inline void create(
+        const std::vector<IntT> & keys,
+        const bool include_dense,
+        const uint32_t sparse_dense_ratio,
+        const SuffixType suffix_type,
+        const level_t hash_suffix_len,
+        const level_t real_suffix_len)
+    {
+        std::vector<std::string> key_strings;
+        key_strings.reserve(keys.size());
+        char buf[kKeyLen];
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            encodeKey(keys[i], buf);
+            key_strings.push_back(std::string(buf, kKeyLen));
+        }
+        filter_.create(key_strings, include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len);
+    }
+
+    // Same as create() for keys in any order, duplicates allowed; keys is
+    // sorted and deduplicated in place on up to num_threads threads (see
+    // sortUniqueKeys)
+    inline void createFromUnsorted(
+        std::vector<IntT> & keys,
+        const bool include_dense,
+        const uint32_t sparse_dense_ratio,
+        const SuffixType suffix_type,
+        const level_t hash_suffix_len,
+        const level_t real_suffix_len,
+        const unsigned num_threads)
+    {
+        sortUniqueKeys(keys, num_threads);
+        create(keys, include_dense, sparse_dense_ratio, suffix_type, hash_suffix_len, real_suffix_len);
+    }
+
+    // Big-endian encoding of key into buf[0, kKeyLen)
+    static inline void encodeKey(const IntT key, char * buf)
+    {
+        for (level_t i = 0; i < kKeyLen; i++)
+            buf[i] = static_cast<char>(key >> (8 * (kKeyLen - 1 - i)));
+    }
+
+    inline bool lookup(const IntT key) const
+    {
+        char buf[kKeyLen];
+        encodeKey(key, buf);
+        return filter_.template lookupFixedLengthKey<kKeyLen>(buf);
+    }
+
+    // Batched point queries: results[i] = lookup(keys[i]). The keys are
+    // encoded back to back into one buffer, then go through
+    // SuRF::lookupFixedLengthKeys.
+    inline void lookupKeys(const std::vector<IntT> & keys, std::vector<bool> & results) const
+    {
+        std::vector<char> buf(keys.size() * kKeyLen);
+        for (size_t i = 0; i < keys.size(); i++)
+            encodeKey(keys[i], buf.data() + i * kKeyLen);
+        filter_.template lookupFixedLengthKeys<kKeyLen>(buf.data(), keys.size(), results);
+    }
+
+    // The range queries without a QueryContext share one context owned by
+    // the filter and must not run concurrently on the same filter.
+    inline bool lookupRange(const IntT left_key, const bool left_inclusive, const IntT right_key, const bool right_inclusive)
+    {
+        char left_buf[kKeyLen];
+        char right_buf[kKeyLen];
+        encodeKey(left_key, left_buf);
+        encodeKey(right_key, right_buf);
+        return filter_.lookupRange(KeyView(left_buf, kKeyLen), left_inclusive, KeyView(right_buf, kKeyLen), right_inclusive);
+    }
+
+    inline bool lookupRange(
+        const IntT left_key,
+        const bool left_inclusive,
+        const IntT right_key,
+        const bool right_inclusive,
+        SuRF::QueryContext & context) const
+    {
+        char left_buf[kKeyLen];
+        char right_buf[kKeyLen];
+        encodeKey(left_key, left_buf);
+        encodeKey(right_key, right_buf);
+        return filter_.lookupRange(
+            KeyView(left_buf, kKeyLen), left_inclusive, KeyView(right_buf, kKeyLen), right_inclusive, context);
+    }
+
+    // Accurate except at the boundaries --> undercount by at most 2
+    inline uint64_t approxCount(const IntT left_key, const IntT right_key)
+    {
+        char left_buf[kKeyLen];
+        char right_buf[kKeyLen];
+        encodeKey(left_key, left_buf);
+        encodeKey(right_key, right_buf);
+        return filter_.approxCount(KeyView(left_buf, kKeyLen), KeyView(right_buf, kKeyLen));
+    }
+
+    inline uint64_t approxCount(const IntT left_key, const IntT right_key, SuRF::QueryContext & context) const
+    {
+        char left_buf[kKeyLen];
+        char right_buf[kKeyLen];
+        encodeKey(left_key, left_buf);
+        encodeKey(right_key, right_buf);
+        return filter_.approxCount(KeyView(left_buf, kKeyLen), KeyView(right_buf, kKeyLen), context);
+    }
+
+    // The underlying string-keyed filter (keys as encodeKey produces them)
+    inline const SuRF & getSuRF() const { return filter_; }
+
+    inline uint64_t getMemoryUsage() const { return filter_.getMemoryUsage(); }
+
+    inline void destroy() { filter_.destroy(); }
+
+private:
+    SuRF filter_;
+};
+
+} // namespace surf
+
+#endif // SURFINT_H_
@@ -5,8 +5,43 @@
 #include <cstdio>
 #include <cstdint>
 
+#include "cpu_features.hpp"
+
+#ifdef SURF_X86
+#include <immintrin.h>
+#endif
+
 namespace surf {
 
+// The default build does not target popcnt/bmi2, so the hardware kernels
+// below are picked at run time from the cpu feature flags. When the
+// compiler already targets an extension (e.g. -march=native), the flag
+// is a compile-time constant and the fallback disappears.
+#if defined(__POPCNT__)
+static const bool kUseHwPopcount = true;
+#elif defined(SURF_X86)
+static const bool kUseHwPopcount = getCpuFeatures().popcnt;
+#else
+static const bool kUseHwPopcount = false;
+#endif
+
+#if defined(__BMI2__)
+static const bool kUsePdep = true;
+#elif defined(SURF_X86)
+static const bool kUsePdep = getCpuFeatures().fast_pdep;
+#else
+static const bool kUsePdep = false;
+#endif
+
+#if defined(SURF_X86)
+static const bool kUseAvx512Popcount = getCpuFeatures().avx512vpopcntdq;
+#else
+static const bool kUseAvx512Popcount = false;
+#endif
+
+// popcountLinear switches to 512-bit vector popcounts above this length
+static const uint64_t kAvx512PopcountMinBits = 256;
+
 #define L8 0x0101010101010101UL // Every lowest 8th bit set: 00000001...
 #define G2 0xAAAAAAAAAAAAAAAAUL // Every highest 2nd bit: 101010...
 #define G4 0x3333333333333333UL // 00110011 ... used to group the sum of 4 bits.
@@ -37,16 +72,65 @@ inline int suxpopcount(uint64_t x) {
     return static_cast<int>(x);
 }
 
-// Default to using the GCC builtin popcount.  On architectures
-// with -march popcnt, this compiles to a single popcnt instruction.
+// GCC builtin popcount. Without -mpopcnt this is the libgcc
+// software routine.
+inline int popcount_sw(uint64_t x) {
+    return __builtin_popcountll(x);
+}
+
+// POPCNT instruction, emitted directly so that no -mpopcnt is needed.
+// Only valid when getCpuFeatures().popcnt.
+inline int popcount_hw(uint64_t x) {
+#ifdef SURF_X86
+    uint64_t count;
+    __asm__("popcnt %1, %0" : "=r"(count) : "r"(x));
+    return static_cast<int>(count);
+#else
+    return __builtin_popcountll(x);
+#endif
+}
+
+// Single popcnt instruction when the cpu has it, the builtin otherwise.
 static inline int popcount(unsigned long x) {
+#if defined(__POPCNT__) || !defined(SURF_X86)
     return __builtin_popcountl(x);
+#else
+    if (kUseHwPopcount)
+        return popcount_hw(x);
+    return __builtin_popcountl(x);
+#endif
 }
 
 #define popcountsize 64UL
 #define popcountmask (popcountsize - 1)
 
-inline uint64_t popcountLinear(uint64_t *bits, uint64_t x, uint64_t nbits) {
+#ifdef SURF_X86
+// popcountLinear with 8 words per AVX-512 VPOPCNTDQ instruction.
+// Only valid when getCpuFeatures().avx512vpopcntdq.
+__attribute__((target("popcnt,avx512f,avx512vpopcntdq")))
+inline uint64_t popcountLinear_avx512(const uint64_t *bits, uint64_t x, uint64_t nbits) {
+    if (nbits == 0) { return 0; }
+    uint64_t lastword = (nbits - 1) / popcountsize;
+    __m512i counts = _mm512_setzero_si512();
+    uint64_t i = 0;
+    for (; i + 8 <= lastword; i += 8)
+        counts = _mm512_add_epi64(counts, _mm512_popcnt_epi64(_mm512_loadu_si512(bits + x + i)));
+    if (i < lastword) {
+        __mmask8 mask = static_cast<__mmask8>((1U << (lastword - i)) - 1);
+        counts = _mm512_add_epi64(counts, _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(mask, bits + x + i)));
+    }
+    // (_mm512_reduce_add_epi64 trips -Wmaybe-uninitialized in GCC 12)
+    uint64_t lanes[8];
+    _mm512_storeu_si512(lanes, counts);
+    uint64_t p = 0;
+    for (int lane = 0; lane < 8; lane++)
+        p += lanes[lane];
+    uint64_t lastshifted = bits[x+lastword] >> (63 - ((nbits - 1) & popcountmask));
+    return p + __builtin_popcountll(lastshifted);
+}
+#endif
+
+inline uint64_t popcountLinear_scalar(const uint64_t *bits, uint64_t x, uint64_t nbits) {
     if (nbits == 0) { return 0; }
     uint64_t lastword = (nbits - 1) / popcountsize;
     uint64_t p = 0;
@@ -65,6 +149,30 @@ inline uint64_t popcountLinear(uint64_t *bits, uint64_t x, uint64_t nbits) {
     return p;
 }
 
+inline uint64_t popcountLinear(uint64_t *bits, uint64_t x, uint64_t nbits) {
+#ifdef SURF_X86
+    if (kUseAvx512Popcount && nbits >= kAvx512PopcountMinBits)
+        return popcountLinear_avx512(bits, x, nbits);
+#endif
+    return popcountLinear_scalar(bits, x, nbits);
+}
+
+// Number of set bits in [begin, end) of a bitmap of nbits bits (MSB
+// first within each word); end is clamped to nbits.
+inline uint64_t popcountRange(const uint64_t *bits, uint64_t nbits, uint64_t begin, uint64_t end) {
+    if (end > nbits) { end = nbits; }
+    if (begin >= end) { return 0; }
+    uint64_t firstword = begin / popcountsize;
+    uint64_t lastword = (end - 1) / popcountsize;
+    uint64_t firstmask = ~0UL >> (begin & popcountmask);
+    uint64_t lastmask = ~0UL << (63 - ((end - 1) & popcountmask));
+    if (firstword == lastword) { return popcount(bits[firstword] & firstmask & lastmask); }
+    uint64_t p = popcount(bits[firstword] & firstmask);
+    for (uint64_t i = firstword + 1; i < lastword; i++)
+        p += popcount(bits[i]);
+    return p + popcount(bits[lastword] & lastmask);
+}
+
 // Return the index of the kth bit set in x 
 inline int select64_naive(uint64_t x, int k) {
     int count = -1;
@@ -123,8 +231,31 @@ inline int select64_broadword(uint64_t x, int k) {
     return place + ( LEQ_STEP_8( bit_sums, byte_rank_step_8 ) * ONES_STEP_8 >> 56 );   
 }
 
+// Same bit order as select64_popcount_search (k is one-based and counted
+// from the most significant bit), computed branch-free with the broadword
+// algorithm above by selecting the matching one from the low end.
+inline int select64_broadword_msb(uint64_t x, int k) {
+    return 63 - select64_broadword(x, popcount(x) - k);
+}
+
+// BMI2 select: pdep deposits a single 1 onto the wanted set bit of x,
+// which is then located with a trailing zero count.
+// Only valid when getCpuFeatures().bmi2.
+inline int select64_pdep_msb(uint64_t x, int k) {
+#ifdef SURF_X86
+    uint64_t bit = 1ULL << (popcount(x) - k);
+    uint64_t deposited;
+    __asm__("pdep %2, %1, %0" : "=r"(deposited) : "r"(bit), "r"(x));
+    return 63 - __builtin_ctzll(deposited);
+#else
+    return select64_broadword_msb(x, k);
+#endif
+}
+
 inline uint64_t select64(uint64_t x, int k) {
-    return static_cast<uint64_t>(select64_popcount_search(x, k));
+    if (kUsePdep)
+        return static_cast<uint64_t>(select64_pdep_msb(x, k));
+    return static_cast<uint64_t>(select64_broadword_msb(x, k));
 }
 
 // x is the starting offset of the 512 bits;
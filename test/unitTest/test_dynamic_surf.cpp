@@ -0,0 +1,123 @@
+#include "gtest/gtest.h"
+
+#include <assert.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "dynamic_surf.hpp"
+
+namespace surf {
+
+namespace dynamicsurftest {
+
+static const uint64_t kNumKeys = 100000;
+static const uint64_t kKeyRange = kNumKeys * 64;
+static const size_t kBufferKeys = 1000;
+
+class DynamicSuRFUnitTest : public ::testing::Test {
+public:
+    virtual void SetUp () {
+	std::mt19937_64 gen(2018);
+	for (uint64_t i = 0; i < kNumKeys; i++)
+	    keys_.push_back(uint64ToString(gen() % kKeyRange));
+    }
+    virtual void TearDown () {}
+
+    void testInsertLookup(const bool background_merges);
+
+    std::vector<std::string> keys_; // unsorted, some duplicates
+};
+
+static uint64_t log2Ceil(uint64_t x) {
+    uint64_t log = 0;
+    while ((1ULL << log) < x)
+	log++;
+    return log;
+}
+
+void DynamicSuRFUnitTest::testInsertLookup(const bool background_merges) {
+    DynamicSuRF filter(kIncludeDense, kSparseDenseRatio, kReal, 0, 8, kBufferKeys, kDynamicRunGrowth, background_merges);
+    for (uint64_t i = 0; i < keys_.size(); i++) {
+	filter.insert(keys_[i]);
+	if (i % 3 == 0) {
+	    // no false negatives, also while merges are in flight
+	    ASSERT_TRUE(filter.lookupKey(keys_[i]));
+	    ASSERT_TRUE(filter.lookupKey(keys_[i / 2]));
+	    ASSERT_TRUE(filter.lookupRange(keys_[i / 3], true, keys_[i / 3], true));
+	}
+    }
+    filter.waitForMerges();
+    ASSERT_TRUE(filter.getBufferSize() < kBufferKeys);
+    ASSERT_TRUE(filter.getNumRuns() <= log2Ceil(kNumKeys / kBufferKeys) + 1);
+    ASSERT_TRUE(filter.getNumKeys() >= filter.getBufferSize());
+
+    std::vector<std::string> sorted_keys = keys_;
+    std::sort(sorted_keys.begin(), sorted_keys.end());
+    // no false negatives once the merges are done
+    for (uint64_t i = 0; i < keys_.size(); i++) {
+	ASSERT_TRUE(filter.lookupKey(keys_[i]));
+	ASSERT_TRUE(filter.lookupRange(keys_[i], true, keys_[i], true));
+    }
+
+    // A random probe that reaches a leaf of a run matches its 8-bit real
+    // suffix with probability about 2^-8, so the union of the runs has a
+    // false positive rate of about num_runs * 2^-8
+    std::mt19937_64 gen(7);
+    uint64_t num_fp = 0;
+    uint64_t num_probes = 0;
+    for (uint64_t i = 0; i < kNumKeys; i++) {
+	std::string probe = uint64ToString(gen() % kKeyRange);
+	if (std::binary_search(sorted_keys.begin(), sorted_keys.end(), probe))
+	    continue;
+	num_probes++;
+	if (filter.lookupKey(probe))
+	    num_fp++;
+    }
+    ASSERT_TRUE(num_probes > kNumKeys * 9 / 10);
+    ASSERT_TRUE(num_fp * 256 <= num_probes * filter.getNumRuns() * 2);
+
+    uint64_t count = filter.approxCount(sorted_keys.front(), sorted_keys.back());
+    // merged runs count keys that share a stored prefix once
+    ASSERT_TRUE(count <= filter.getNumKeys());
+    ASSERT_TRUE(count >= filter.getNumKeys() * 95 / 100);
+}
+
+TEST_F (DynamicSuRFUnitTest, insertLookupTest) {
+    testInsertLookup(false);
+}
+
+TEST_F (DynamicSuRFUnitTest, backgroundMergeTest) {
+    testInsertLookup(true);
+}
+
+TEST_F (DynamicSuRFUnitTest, bufferTest) {
+    DynamicSuRF filter(kIncludeDense, kSparseDenseRatio, kNone, 0, 0);
+    ASSERT_FALSE(filter.lookupKey(keys_[0]));
+    ASSERT_FALSE(filter.lookupRange(keys_[0], true, keys_[0], true));
+    for (uint64_t i = 0; i < 100; i++)
+	filter.insert(keys_[i]);
+    filter.insert(keys_[0]);
+    ASSERT_EQ(0u, filter.getNumRuns());
+    // buffered keys are exact
+    for (uint64_t i = 0; i < 100; i++) {
+	ASSERT_TRUE(filter.lookupKey(keys_[i]));
+	ASSERT_FALSE(filter.lookupKey(keys_[i] + "x"));
+    }
+    filter.flush();
+    ASSERT_EQ(1u, filter.getNumRuns());
+    ASSERT_EQ(0u, filter.getBufferSize());
+    for (uint64_t i = 0; i < 100; i++)
+	ASSERT_TRUE(filter.lookupKey(keys_[i]));
+}
+
+} // namespace dynamicsurftest
+
+} // namespace surf
+
+int main (int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,200 @@
+#include "gtest/gtest.h"
+
+#include <assert.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "growing_surf.hpp"
+#include "surf.hpp"
+
+namespace surf {
+
+namespace growingsurftest {
+
+static const uint64_t kNumKeys = 50000;
+static const uint64_t kNumProbes = 20000;
+static const size_t kMinTailKeys = 500;
+static const int kNumSuffixType = 4;
+static const SuffixType kSuffixTypeList[kNumSuffixType] = {kNone, kHash, kReal, kMixed};
+
+class GrowingSuRFUnitTest : public ::testing::Test {
+public:
+    virtual void SetUp () {
+	std::mt19937_64 gen(2018);
+	std::vector<uint64_t> ints;
+	for (uint64_t i = 0; i < kNumKeys; i++)
+	    ints.push_back(gen() % (kNumKeys * 16));
+	std::sort(ints.begin(), ints.end());
+	ints.erase(std::unique(ints.begin(), ints.end()), ints.end());
+	for (uint64_t i = 0; i < ints.size(); i++)
+	    keys_.push_back(uint64ToString(ints[i]));
+    }
+    virtual void TearDown () {}
+
+    std::vector<std::string> keys_;
+};
+
+static level_t hashLen(SuffixType suffix_type) {
+    return (suffix_type == kHash || suffix_type == kMixed) ? 4 : 0;
+}
+
+static level_t realLen(SuffixType suffix_type) {
+    return (suffix_type == kReal || suffix_type == kMixed) ? 8 : 0;
+}
+
+// While keys arrive, every inserted key is found, the frozen part answers
+// like a SuRF built from the frozen keys and the tail answers exactly
+TEST_F (GrowingSuRFUnitTest, lookupWhileInsertingTest) {
+    for (int t = 0; t < kNumSuffixType; t++) {
+	SuffixType suffix_type = kSuffixTypeList[t];
+	GrowingSuRF filter(kIncludeDense, kSparseDenseRatio, suffix_type, hashLen(suffix_type), realLen(suffix_type),
+			   kMinTailKeys, kGrowingTailRatio);
+	ASSERT_FALSE(filter.lookupKey(keys_[0]));
+
+	uint64_t num_checks = 0;
+	for (uint64_t i = 0; i < keys_.size(); i++) {
+	    ASSERT_TRUE(filter.insert(keys_[i]));
+	    ASSERT_EQ(i + 1, filter.getNumKeys());
+	    ASSERT_LT(filter.getTailSize(), std::max(kMinTailKeys, (size_t)(filter.getNumFrozenKeys() / kGrowingTailRatio)));
+	    ASSERT_TRUE(filter.lookupKey(keys_[i]));
+	    if (i % 7 == 0) {
+		ASSERT_TRUE(filter.lookupKey(keys_[i / 2]));
+	    }
+
+	    if ((i + 1) % 12345 != 0 || filter.getFrozenSuRF() == nullptr || filter.getTailSize() == 0)
+		continue;
+	    num_checks++;
+	    uint64_t num_frozen = filter.getNumFrozenKeys();
+	    std::vector<std::string> frozen_keys(keys_.begin(), keys_.begin() + num_frozen);
+	    SuRF reference(frozen_keys, kIncludeDense, kSparseDenseRatio, suffix_type, hashLen(suffix_type), realLen(suffix_type));
+	    std::mt19937_64 gen(7);
+	    for (uint64_t j = 0; j < kNumProbes; j++) {
+		std::string probe = uint64ToString(gen() % (kNumKeys * 16));
+		if (probe < keys_[num_frozen])
+		    ASSERT_EQ(reference.lookupKey(probe), filter.lookupKey(probe));
+		else
+		    ASSERT_EQ(std::binary_search(keys_.begin() + num_frozen, keys_.begin() + i + 1, probe),
+			      filter.lookupKey(probe));
+	    }
+	    reference.destroy();
+	}
+	ASSERT_TRUE(num_checks > 0);
+    }
+}
+
+TEST_F (GrowingSuRFUnitTest, iteratorTest) {
+    GrowingSuRF filter(kIncludeDense, kSparseDenseRatio, kReal, 0, 8, kMinTailKeys, kGrowingTailRatio);
+    GrowingSuRF::Iter iter = filter.moveToFirst();
+    ASSERT_FALSE(iter.isValid());
+
+    uint64_t num_inserted = keys_.size() * 3 / 4;
+    for (uint64_t i = 0; i < num_inserted; i++)
+	filter.insert(keys_[i]);
+    ASSERT_TRUE(filter.getFrozenSuRF() != nullptr);
+    ASSERT_TRUE(filter.getTailSize() > 0);
+
+    iter = filter.moveToFirst();
+    for (uint64_t i = 0; i < num_inserted; i++) {
+	ASSERT_TRUE(iter.isValid());
+	std::string key = iter.getKey();
+	ASSERT_EQ(0, keys_[i].compare(0, key.length(), key));
+	if (i + 1 < num_inserted)
+	    ASSERT_TRUE(iter++);
+	else
+	    ASSERT_FALSE(iter++);
+    }
+
+    iter = filter.moveToLast();
+    for (uint64_t i = num_inserted; i > 0; i--) {
+	ASSERT_TRUE(iter.isValid());
+	std::string key = iter.getKey();
+	ASSERT_EQ(0, keys_[i - 1].compare(0, key.length(), key));
+	if (i > 1)
+	    ASSERT_TRUE(iter--);
+	else
+	    ASSERT_FALSE(iter--);
+    }
+
+    for (uint64_t i = 0; i < num_inserted; i += 3) {
+	iter = filter.moveToKeyGreaterThan(keys_[i], true);
+	ASSERT_TRUE(iter.isValid());
+	int compare = iter.compare(keys_[i]);
+	ASSERT_TRUE(compare == 0 || compare == kCouldBePositive);
+	// past the inserted keys
+	if (i >= filter.getNumFrozenKeys()) {
+	    ASSERT_FALSE(iter.getFpFlag());
+	}
+    }
+    iter = filter.moveToKeyGreaterThan(keys_[num_inserted - 1], false);
+    ASSERT_FALSE(iter.isValid());
+}
+
+TEST_F (GrowingSuRFUnitTest, rangeAndCountTest) {
+    GrowingSuRF filter(kIncludeDense, kSparseDenseRatio, kReal, 0, 8, kMinTailKeys, kGrowingTailRatio);
+    GrowingSuRF::QueryContext context;
+    for (uint64_t i = 0; i < keys_.size(); i++) {
+	filter.insert(keys_[i]);
+	ASSERT_TRUE(filter.lookupRange(keys_[i], true, keys_[i], true, context));
+	// nothing past the last key, which is exact while it is in the tail
+	if (filter.getTailSize() > 0) {
+	    ASSERT_FALSE(filter.lookupRange(keys_[i], false, uint64ToString(kNumKeys * 16), true, context));
+	}
+	if (i % 1000 == 0) {
+	    ASSERT_TRUE(filter.lookupRange(keys_[i / 2], true, keys_[i / 2], true));
+	    uint64_t count = filter.approxCount(keys_[0], keys_[i], context);
+	    ASSERT_TRUE(count <= i);
+	    ASSERT_TRUE(count + 4 >= i);
+	}
+    }
+}
+
+// tail_ratio 0 re-encodes like tail_ratio 1 instead of dividing by zero
+TEST_F (GrowingSuRFUnitTest, zeroTailRatioTest) {
+    GrowingSuRF filter(kIncludeDense, kSparseDenseRatio, kReal, 0, 8, kMinTailKeys, 0);
+    for (uint64_t i = 0; i < keys_.size(); i++)
+	ASSERT_TRUE(filter.insert(keys_[i]));
+    ASSERT_TRUE(filter.getNumFrozenKeys() > 0);
+    ASSERT_TRUE(filter.getTailSize() <= filter.getNumFrozenKeys());
+    for (uint64_t i = 0; i < keys_.size(); i += 13)
+	ASSERT_TRUE(filter.lookupKey(keys_[i]));
+}
+
+// Once finalized, the filter is the one built from all keys at once
+TEST_F (GrowingSuRFUnitTest, finalizeTest) {
+    for (int t = 0; t < kNumSuffixType; t++) {
+	SuffixType suffix_type = kSuffixTypeList[t];
+	GrowingSuRF filter(kIncludeDense, kSparseDenseRatio, suffix_type, hashLen(suffix_type), realLen(suffix_type));
+	for (uint64_t i = 0; i < keys_.size(); i++) {
+	    ASSERT_TRUE(filter.insert(keys_[i]));
+	    ASSERT_TRUE(filter.insert(keys_[i])); // duplicates are ignored
+	}
+	ASSERT_EQ(keys_.size(), filter.getNumKeys());
+	ASSERT_FALSE(filter.insert(keys_[0]));
+	filter.finalize();
+	ASSERT_TRUE(filter.isFinalized());
+	ASSERT_EQ(0u, filter.getTailSize());
+	ASSERT_FALSE(filter.insert(keys_.back() + "x"));
+
+	SuRF expected(keys_, kIncludeDense, kSparseDenseRatio, suffix_type, hashLen(suffix_type), realLen(suffix_type));
+	const SuRF* frozen = filter.getFrozenSuRF();
+	ASSERT_EQ(expected.serializedSize(), frozen->serializedSize());
+	char* expected_data = expected.serialize();
+	char* frozen_data = frozen->serialize();
+	ASSERT_EQ(0, memcmp(expected_data, frozen_data, expected.serializedSize()));
+	delete[] expected_data;
+	delete[] frozen_data;
+	expected.destroy();
+    }
+}
+
+} // namespace growingsurftest
+
+} // namespace surf
+
+int main (int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
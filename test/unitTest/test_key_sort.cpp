@@ -0,0 +1,111 @@
+#include "gtest/gtest.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "key_sort.hpp"
+
+namespace surf {
+
+namespace keysorttest {
+
+static const uint64_t kNumKeys = 200000;
+static const int kNumThreadCounts = 4;
+static const unsigned kThreadCountList[kNumThreadCounts] = {1, 2, 4, 7};
+
+class KeySortUnitTest : public ::testing::Test {
+public:
+    virtual void SetUp () {
+	std::mt19937_64 gen(2018);
+	// short keys over a small alphabet: many duplicates, many keys
+	// that are prefixes of others, and a long shared prefix
+	for (uint64_t i = 0; i < kNumKeys; i++) {
+	    std::string key;
+	    if (i % 4 == 0)
+		key = "http://www.example.com/";
+	    unsigned len = gen() % 6;
+	    for (unsigned j = 0; j < len; j++)
+		key += (char)("ab\xff\x00"[gen() % 4]);
+	    string_keys_.push_back(key);
+	    int_keys_.push_back((i % 3 == 0) ? (gen() % 1000) : (gen() % (kNumKeys * 4)));
+	}
+    }
+    virtual void TearDown () {}
+
+    std::vector<std::string> string_keys_;
+    std::vector<uint64_t> int_keys_;
+};
+
+template <typename KeyT>
+static void expectSortedUnique(const std::vector<KeyT>& input, const std::vector<KeyT>& output) {
+    std::vector<KeyT> expected = input;
+    std::sort(expected.begin(), expected.end());
+    expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+    ASSERT_EQ(expected.size(), output.size());
+    for (size_t i = 0; i < expected.size(); i++)
+	ASSERT_EQ(expected[i], output[i]);
+}
+
+TEST_F (KeySortUnitTest, stringTest) {
+    for (int t = 0; t < kNumThreadCounts; t++) {
+	std::vector<std::string> keys = string_keys_;
+	sortUniqueKeys(keys, kThreadCountList[t]);
+	expectSortedUnique(string_keys_, keys);
+    }
+}
+
+TEST_F (KeySortUnitTest, intTest) {
+    for (int t = 0; t < kNumThreadCounts; t++) {
+	std::vector<uint64_t> keys = int_keys_;
+	sortUniqueKeys(keys, kThreadCountList[t]);
+	expectSortedUnique(int_keys_, keys);
+
+	// all keys share their first 5 bytes
+	std::vector<uint64_t> small_keys;
+	for (uint64_t i = 0; i < int_keys_.size(); i++)
+	    small_keys.push_back(int_keys_[i] % 100000);
+	keys = small_keys;
+	sortUniqueKeys(keys, kThreadCountList[t]);
+	expectSortedUnique(small_keys, keys);
+    }
+}
+
+TEST_F (KeySortUnitTest, edgeCaseTest) {
+    for (int t = 0; t < kNumThreadCounts; t++) {
+	std::vector<std::string> keys;
+	sortUniqueKeys(keys, kThreadCountList[t]);
+	ASSERT_TRUE(keys.empty());
+
+	keys.assign(kNumKeys, "same");
+	sortUniqueKeys(keys, kThreadCountList[t]);
+	ASSERT_EQ(1u, keys.size());
+	ASSERT_EQ(std::string("same"), keys[0]);
+
+	keys.assign(kNumKeys, std::string());
+	keys.push_back(std::string(1, '\0'));
+	sortUniqueKeys(keys, kThreadCountList[t]);
+	ASSERT_EQ(2u, keys.size());
+	ASSERT_TRUE(keys[0].empty());
+
+	std::vector<uint8_t> bytes;
+	for (uint64_t i = 0; i < kNumKeys; i++)
+	    bytes.push_back((uint8_t)(kNumKeys - i));
+	std::vector<uint8_t> input = bytes;
+	sortUniqueKeys(bytes, kThreadCountList[t]);
+	expectSortedUnique(input, bytes);
+    }
+}
+
+} // namespace keysorttest
+
+} // namespace surf
+
+int main (int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "config.hpp"
+#include "label_search.hpp"
 #include "label_vector.hpp"
 #include "surf_builder.hpp"
 
@@ -248,6 +249,69 @@ TEST_F (LabelVectorUnitTest, searchGreaterThanTest) {
     }
 }
 
+// Every kernel supported by the cpu must agree with linear search on each
+// node of the words trie, probing every label and its two neighbours.
+TEST_F (LabelVectorUnitTest, searchKernelTest) {
+    setupWordsTest();
+    const LabelSearchIsa isas[] = {kLabelSearchScalar, kLabelSearchSse2, kLabelSearchAvx2, kLabelSearchAvx512bw};
+    for (LabelSearchIsa isa : isas) {
+	if (!labelSearchIsaSupported(isa))
+	    continue;
+	LabelSearchKernels kernels = labelSearchKernels(isa);
+	ASSERT_EQ(isa, kernels.isa);
+	position_t start_pos = 0;
+	position_t search_len = 0;
+	for (level_t level = 0; level < builder_->getTreeHeight(); level++) {
+	    for (position_t pos = 0; pos < builder_->getLabels()[level].size(); pos++) {
+		bool louds_bit = SuRFBuilder::readBit(builder_->getLoudsBits()[level], pos);
+		if (louds_bit && search_len > 0) {
+		    // kernels see nodes with the terminator label skipped (see LabelVector::search)
+		    position_t node_start = start_pos;
+		    position_t node_len = search_len;
+		    if (node_len > 1 && labels_->read(node_start) == kTerminator) {
+			node_start++;
+			node_len--;
+		    }
+		    // kernels may read up to kLabelSearchPadding bytes past the node
+		    std::vector<label_t> node(node_len + kLabelSearchPadding, 0);
+		    for (position_t i = 0; i < node_len; i++)
+			node[i] = labels_->read(node_start + i);
+		    for (position_t i = 0; i < node_len; i++) {
+			for (int delta = -1; delta <= 1; delta++) {
+			    label_t target = static_cast<label_t>(node[i] + delta);
+
+			    position_t expected_pos = node_start;
+			    bool expected = labels_->linearSearch(target, expected_pos, node_len);
+			    position_t idx = kMaxPos;
+			    bool found = kernels.search(node.data(), target, node_len, idx);
+			    ASSERT_EQ(expected, found);
+			    if (found) {
+				ASSERT_EQ(expected_pos, node_start + idx);
+			    } else {
+				ASSERT_EQ(kMaxPos, idx);
+			    }
+
+			    expected_pos = node_start;
+			    expected = labels_->linearSearchGreaterThan(target, expected_pos, node_len);
+			    idx = kMaxPos;
+			    found = kernels.search_greater_than(node.data(), target, node_len, idx);
+			    ASSERT_EQ(expected, found);
+			    if (found) {
+				ASSERT_EQ(expected_pos, node_start + idx);
+			    } else {
+				ASSERT_EQ(kMaxPos, idx);
+			    }
+			}
+		    }
+		    start_pos += search_len;
+		    search_len = 0;
+		}
+		search_len++;
+	    }
+	}
+    }
+}
+
 void loadWordList() {
     std::ifstream infile(kFilePath);
     std::string key;
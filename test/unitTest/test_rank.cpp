@@ -3,6 +3,7 @@
 #include <assert.h>
 
 #include <fstream>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -144,6 +145,112 @@ TEST_F (RankUnitTest, serializeTest) {
     testRank();
 }
 
+// The interleaved layout must agree with the look-up table layout
+// bit by bit, including after a serialize/deSerialize round trip.
+TEST_F (RankUnitTest, interleavedLayoutTest) {
+    setupWordsTest();
+    BitvectorRank* bv_interleaved = new BitvectorRank(kRankBasicBlockSize, builder_->getChildIndicatorBits(),
+						      num_items_per_level_, 0, 0, kRankInterleaved);
+    ASSERT_EQ(kRankInterleaved, bv_interleaved->layout());
+    ASSERT_EQ(0u, bv_interleaved->rankLutSize());
+
+    uint64_t size = bv_interleaved->serializedSize();
+    data_ = new char[size];
+    char* data = data_;
+    bv_interleaved->serialize(data);
+    ASSERT_EQ(size, (uint64_t)(data - data_));
+    data = data_;
+    BitvectorRank* bv_loaded = BitvectorRank::deSerialize(data);
+    ASSERT_EQ(kRankInterleaved, bv_loaded->layout());
+    ASSERT_EQ(bv_interleaved->bitsSize(), bv_loaded->bitsSize());
+
+    BitvectorRank* bvs[] = {bv_interleaved, bv_loaded};
+    for (BitvectorRank* bv : bvs) {
+	ASSERT_EQ(bv_->numBits(), bv->numBits());
+	for (position_t pos = 0; pos < num_items_; pos++) {
+	    ASSERT_EQ(bv_->readBit(pos), bv->readBit(pos));
+	    ASSERT_EQ(bv_->rank(pos), bv->rank(pos));
+	    ASSERT_EQ(bv_->distanceToNextSetBit(pos), bv->distanceToNextSetBit(pos));
+	    ASSERT_EQ(bv_->distanceToPrevSetBit(pos), bv->distanceToPrevSetBit(pos));
+	}
+	ASSERT_EQ(bv_->rank(num_items_), bv->rank(num_items_));
+    }
+
+    bv_interleaved->destroy();
+    delete bv_interleaved;
+    bv_loaded->destroy();
+    delete bv_loaded;
+    bv_->destroy();
+    delete bv_;
+    bv2_->destroy();
+    delete bv2_;
+}
+
+// A kRankLut image keeps the layout images had before the interleaved
+// layout: num_bits, basic_block_size, the bits and the rank LUT
+TEST_F (RankUnitTest, lutImageFormatTest) {
+    setupWordsTest();
+    uint64_t size = bv_->serializedSize();
+    uint64_t expected_size = 2 * sizeof(position_t) + bv_->bitsSize() + bv_->rankLutSize();
+    sizeAlign(expected_size);
+    ASSERT_EQ(expected_size, size);
+    data_ = new char[size];
+    char* data = data_;
+    bv_->serialize(data);
+    position_t header[2];
+    memcpy(header, data_, sizeof(header));
+    ASSERT_EQ(bv_->numBits(), header[0]);
+    ASSERT_EQ((position_t)kRankBasicBlockSize, header[1]);
+
+    data = data_;
+    BitvectorRank* bv_loaded = BitvectorRank::deSerialize(data);
+    ASSERT_EQ(kRankLut, bv_loaded->layout());
+    ASSERT_EQ(size, (uint64_t)(data - data_));
+    for (position_t pos = 0; pos < num_items_; pos++)
+	ASSERT_EQ(bv_->rank(pos), bv_loaded->rank(pos));
+
+    bv_loaded->destroy();
+    delete bv_loaded;
+    bv_->destroy();
+    delete bv_;
+    bv2_->destroy();
+    delete bv2_;
+}
+
+// Every popcount kernel the cpu supports must match the builtin
+TEST_F (RankUnitTest, popcountKernelTest) {
+    std::mt19937_64 gen(2018);
+    std::vector<uint64_t> bits(1024);
+    for (uint64_t& word : bits)
+	word = gen();
+    bits[3] = 0;
+    bits[4] = kOneMask;
+
+    for (uint64_t word : bits) {
+	ASSERT_EQ(__builtin_popcountll(word), popcount_sw(word));
+	ASSERT_EQ(__builtin_popcountll(word), popcount(word));
+	if (getCpuFeatures().popcnt) {
+	    ASSERT_EQ(__builtin_popcountll(word), popcount_hw(word));
+	}
+    }
+
+    const uint64_t lengths[] = {1, 63, 64, 65, 500, 511, 512, 513, 1000, 4096, 10000};
+    for (uint64_t x = 0; x < 20; x++) {
+	for (uint64_t nbits : lengths) {
+	    uint64_t expected = 0;
+	    for (uint64_t i = 0; i < nbits; i++)
+		expected += (bits[x + i / 64] >> (63 - i % 64)) & 1;
+	    ASSERT_EQ(expected, popcountLinear_scalar(bits.data(), x, nbits));
+	    ASSERT_EQ(expected, popcountLinear(bits.data(), x, nbits));
+#ifdef SURF_X86
+	    if (getCpuFeatures().avx512vpopcntdq) {
+		ASSERT_EQ(expected, popcountLinear_avx512(bits.data(), x, nbits));
+	    }
+#endif
+	}
+    }
+}
+
 void loadWordList() {
     std::ifstream infile(kFilePath);
     std::string key;
@@ -3,6 +3,7 @@
 #include <assert.h>
 
 #include <fstream>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -110,6 +111,63 @@ TEST_F (SelectUnitTest, serializeTest) {
     testSelect();
 }
 
+// Every select64 kernel the cpu supports must match select64_popcount_search
+TEST_F (SelectUnitTest, select64Test) {
+    std::vector<uint64_t> test_words = {0x8000000000000001ULL, 0xFFFFFFFFFFFFFFFFULL, 0x0123456789ABCDEFULL,
+					0x1ULL, 0x8000000000000000ULL};
+    std::mt19937_64 gen(2018);
+    for (int i = 0; i < 10000; i++) {
+	uint64_t word = gen();
+	// vary the density
+	if (i % 3 == 1) word &= gen();
+	if (i % 3 == 2) word &= gen() & gen();
+	if (word != 0)
+	    test_words.push_back(word);
+    }
+    for (uint64_t word : test_words) {
+	for (int k = 1; k <= popcount(word); k++) {
+	    int expected = select64_popcount_search(word, k);
+	    ASSERT_EQ(expected, select64_broadword_msb(word, k));
+	    if (getCpuFeatures().bmi2) {
+		ASSERT_EQ(expected, select64_pdep_msb(word, k));
+	    }
+	    ASSERT_EQ((uint64_t)expected, select64(word, k));
+	}
+    }
+}
+
+// Long runs of 0's force explicitly stored blocks; every sampling
+// configuration must give the same answers.
+TEST_F (SelectUnitTest, skewedSelectTest) {
+    std::vector<std::vector<word_t> > bits_per_level(1);
+    std::vector<position_t> num_bits_per_level(1, 0);
+    std::vector<position_t> expected_positions;
+    position_t pos = 0;
+    for (position_t i = 0; i < 5000; i++) {
+	// alternate dense stretches with sparse ones
+	position_t gap = ((i / 500) % 2 == 0) ? (i % 3) : (i % 7) * 211;
+	pos += gap;
+	expected_positions.push_back(pos);
+	pos++;
+    }
+    num_bits_per_level[0] = pos;
+    bits_per_level[0].resize(pos / kWordSize + 1, 0);
+    for (position_t p : expected_positions)
+	bits_per_level[0][p / kWordSize] |= (kMsbMask >> (p % kWordSize));
+
+    const position_t intervals[][2] = {{64, 16}, {256, 32}, {512, 64}, {16, 16}};
+    for (unsigned i = 0; i < 4; i++) {
+	BitvectorSelect* bv = new BitvectorSelect(intervals[i][0], bits_per_level, num_bits_per_level,
+						  0, 0, intervals[i][1]);
+	ASSERT_EQ((position_t)expected_positions.size(), bv->numOnes());
+	for (position_t rank = 1; rank <= expected_positions.size(); rank++)
+	    ASSERT_EQ(expected_positions[rank - 1], bv->select(rank));
+	ASSERT_EQ(bv->numBits(), bv->select(bv->numOnes() + 1));
+	bv->destroy();
+	delete bv;
+    }
+}
+
 void loadWordList() {
     std::ifstream infile(kFilePath);
     std::string key;
@@ -1,14 +1,35 @@
 #include "gtest/gtest.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
 
+#include <atomic>
 #include <fstream>
+#include <new>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "config.hpp"
 #include "surf.hpp"
 
+// Counts heap allocations so that tests can check allocation-free paths
+static std::atomic<uint64_t> num_heap_allocs(0);
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    num_heap_allocs++;
+    void* ptr = malloc(size ? size : 1);
+    if (ptr == nullptr)
+	throw std::bad_alloc();
+    return ptr;
+}
+
+__attribute__((noinline)) void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
 namespace surf {
 
 namespace surftest {
@@ -182,6 +203,338 @@ TEST_F (SuRFUnitTest, serializeTest) {
     }
 }
 
+// A zero-copy load answers like the filter it was serialized from and
+// leaves the buffer to the caller
+TEST_F (SuRFUnitTest, zeroCopyDeSerializeTest) {
+    for (int t = 0; t < kNumSuffixType; t++) {
+	newSuRFWords(kSuffixTypeList[t], 8);
+	char* data = surf_->serialize();
+	std::vector<char> saved(data, data + surf_->serializedSize());
+	ASSERT_TRUE(SuRF::deSerialize(data + 1, true) == nullptr);
+	for (int round = 0; round < 2; round++) {
+	    SuRF* view = SuRF::deSerialize(data, true);
+	    ASSERT_EQ(surf_->serializedSize(), view->serializedSize());
+	    for (unsigned i = 0; i < words.size(); i++) {
+		std::string key = words[i];
+		ASSERT_TRUE(view->lookupKey(key));
+		key[key.size() - 1] = 'A';
+		ASSERT_EQ(surf_->lookupKey(key), view->lookupKey(key));
+	    }
+	    SuRF::Iter expected_iter = surf_->moveToFirst();
+	    SuRF::Iter iter = view->moveToFirst();
+	    while (expected_iter.isValid()) {
+		ASSERT_TRUE(iter.isValid());
+		ASSERT_EQ(expected_iter.getKey(), iter.getKey());
+		expected_iter++;
+		iter++;
+	    }
+	    ASSERT_FALSE(iter.isValid());
+	    ASSERT_EQ(surf_->approxCount(words[100], words[words.size() - 100]),
+		      view->approxCount(words[100], words[words.size() - 100]));
+	    view->destroy();
+	    delete view;
+	    ASSERT_EQ(0, memcmp(saved.data(), data, saved.size()));
+	}
+	delete[] data;
+	surf_->destroy();
+	delete surf_;
+    }
+}
+
+TEST_F (SuRFUnitTest, openTest) {
+    static const char* kPath = "surf_open_test.bin";
+    remove(kPath);
+    ASSERT_TRUE(SuRF::open(kPath) == nullptr);
+    for (int t = 0; t < kNumSuffixType; t++) {
+	newSuRFWords(kSuffixTypeList[t], 8);
+	uint64_t size = surf_->serializedSize();
+	char* data = surf_->serialize();
+	std::ofstream out(kPath, std::ios::binary | std::ios::trunc);
+	out.write(data, size);
+	out.close();
+
+	// open sizes the image from its headers before it loads anything
+	ASSERT_EQ(size, SuRF::imageSize(data, size));
+	for (uint64_t cut = 0; cut < size; cut += size / 61 + 1)
+	    ASSERT_EQ(0u, SuRF::imageSize(data, cut));
+	level_t height;
+	memcpy(&height, data, sizeof(height));
+	level_t huge_height = 0x40000000;
+	memcpy(data, &huge_height, sizeof(huge_height));
+	ASSERT_EQ(0u, SuRF::imageSize(data, size));
+	memcpy(data, &height, sizeof(height));
+	delete[] data;
+
+	SuRF* mapped = SuRF::open(kPath, t % 2 == 1);
+	ASSERT_TRUE(mapped != nullptr);
+	ASSERT_TRUE(mapped->isMapped());
+	ASSERT_FALSE(surf_->isMapped());
+	for (unsigned i = 0; i < words.size(); i++) {
+	    std::string key = words[i];
+	    ASSERT_TRUE(mapped->lookupKey(key));
+	    key[0] = 'A';
+	    ASSERT_EQ(surf_->lookupKey(key), mapped->lookupKey(key));
+	}
+	ASSERT_EQ(surf_->approxCount(words[0], words[words.size() / 2]),
+		  mapped->approxCount(words[0], words[words.size() / 2]));
+	mapped->destroy();
+	ASSERT_FALSE(mapped->isMapped());
+	delete mapped;
+
+	// cut short inside the last section
+	ASSERT_EQ(0, truncate(kPath, surf_->serializedSize() - 8));
+	ASSERT_TRUE(SuRF::open(kPath) == nullptr);
+	surf_->destroy();
+	delete surf_;
+    }
+    remove(kPath);
+}
+
+TEST_F (SuRFUnitTest, crc32cTest) {
+    const char* kCheck = "123456789";
+    ASSERT_EQ(0xE3069283u, crc32c(kCheck, 9));
+    ASSERT_EQ(0xE3069283u, ~crc32cUpdateSw(~0u, (const uint8_t*)kCheck, 9));
+    ASSERT_EQ(0u, crc32c(kCheck, 0));
+    std::vector<char> bytes(1000);
+    for (unsigned i = 0; i < bytes.size(); i++)
+	bytes[i] = (char)(i * 31 + 7);
+    // split at every alignment
+    for (unsigned i = 0; i < 16; i++) {
+	uint32_t crc = crc32cExtend(crc32c(bytes.data(), i), bytes.data() + i, bytes.size() - i);
+	ASSERT_EQ(crc32c(bytes.data(), bytes.size()), crc);
+	ASSERT_EQ(~crc32cUpdateSw(~0u, (const uint8_t*)bytes.data(), bytes.size()), crc);
+    }
+}
+
+// The header describes the filter, and a flipped byte anywhere is caught
+TEST_F (SuRFUnitTest, formatTest) {
+    static const char* kPath = "surf_format_test.bin";
+    for (int t = 0; t < kNumSuffixType; t++) {
+	newSuRFWords(kSuffixTypeList[t], 8);
+	uint64_t size = surf_->formattedSize();
+	char* data = surf_->serializeFormatted();
+	FormatHeader header;
+	ASSERT_EQ(kFormatOk, readFormatHeader(data, size, header));
+	ASSERT_EQ(kFormatOk, verifyFormat(data, size));
+	ASSERT_EQ(kFormatVersion, header.version);
+	ASSERT_EQ(size, header.file_size);
+	ASSERT_EQ(words.size(), header.num_keys);
+	ASSERT_EQ((uint32_t)kSuffixTypeList[t], header.suffix_type);
+	ASSERT_EQ(surf_->getHeight(), header.height);
+	ASSERT_EQ(surf_->getSparseStartLevel(), header.sparse_start_level);
+	ASSERT_EQ(surf_->getRealSuffixLen(), header.real_suffix_len);
+	std::string min_key = getFormatMinKey(data, header);
+	std::string max_key = getFormatMaxKey(data, header);
+	ASSERT_FALSE(min_key.empty());
+	ASSERT_EQ(0, words.front().compare(0, min_key.size(), min_key));
+	ASSERT_EQ(0, words.back().compare(0, max_key.size(), max_key));
+	// the sections are the serialize() image
+	char* raw = surf_->serialize();
+	ASSERT_EQ(size - header.sections[0].offset, surf_->serializedSize());
+	ASSERT_EQ(0, memcmp(raw, data + header.sections[0].offset, surf_->serializedSize()));
+	delete[] raw;
+
+	for (int zero_copy = 0; zero_copy < 2; zero_copy++) {
+	    SuRF* loaded = SuRF::deSerializeFormatted(data, size, zero_copy == 1);
+	    ASSERT_TRUE(loaded != nullptr);
+	    for (unsigned i = 0; i < words.size(); i += 7) {
+		std::string key = words[i];
+		ASSERT_TRUE(loaded->lookupKey(key));
+		key[key.size() - 1] = 'A';
+		ASSERT_EQ(surf_->lookupKey(key), loaded->lookupKey(key));
+	    }
+	    loaded->destroy();
+	    delete loaded;
+	}
+
+	for (uint32_t i = 0; i < kNumFormatSections; i++) {
+	    char* byte = data + header.sections[i].offset + header.sections[i].length / 2;
+	    *byte ^= 0x10;
+	    ASSERT_EQ(kFormatOk, readFormatHeader(data, size, header));
+	    ASSERT_FALSE(verifyFormatSection(data, header, i));
+	    ASSERT_EQ(kFormatBadChecksum, verifyFormat(data, size));
+	    ASSERT_TRUE(SuRF::deSerializeFormatted(data, size) == nullptr);
+	    *byte ^= 0x10;
+	}
+	data[sizeof(FormatHeader)] ^= 0x10; // min key
+	ASSERT_EQ(kFormatBadHeader, verifyFormat(data, size));
+	data[sizeof(FormatHeader)] ^= 0x10;
+	data[0] = 'X';
+	ASSERT_EQ(kFormatBadMagic, verifyFormat(data, size));
+	data[0] = 'S';
+	ASSERT_EQ(kFormatTruncated, verifyFormat(data, size - 8));
+	ASSERT_EQ(kFormatTruncated, verifyFormat(data, sizeof(FormatHeader) - 1));
+	ASSERT_TRUE(SuRF::deSerializeFormatted(data, size - 8) == nullptr);
+
+	// open checks the format, then serves from the mapping
+	remove(kPath);
+	std::ofstream out(kPath, std::ios::binary | std::ios::trunc);
+	out.write(data, size);
+	out.close();
+	SuRF* mapped = SuRF::open(kPath);
+	ASSERT_TRUE(mapped != nullptr);
+	for (unsigned i = 0; i < words.size(); i += 7)
+	    ASSERT_TRUE(mapped->lookupKey(words[i]));
+	mapped->destroy();
+	delete mapped;
+	data[header.sections[kSectionSparseLabels].offset + 8] ^= 0x01;
+	out.open(kPath, std::ios::binary | std::ios::trunc);
+	out.write(data, size);
+	out.close();
+	ASSERT_TRUE(SuRF::open(kPath) == nullptr);
+	mapped = SuRF::open(kPath, false, false); // header only
+	ASSERT_TRUE(mapped != nullptr);
+	mapped->destroy();
+	delete mapped;
+
+	delete[] data;
+	surf_->destroy();
+	delete surf_;
+    }
+    remove(kPath);
+}
+
+// Deep levels paged through a tiny cache answer like the filter itself
+TEST_F (SuRFUnitTest, tieredTest) {
+    static const char* kPath = "surf_tiered_test.bin";
+    static const int kNumConfigs = 3;
+    static const level_t kResidentLevels[kNumConfigs] = {0, 2, 1000};
+    static const uint64_t kCachePages[kNumConfigs] = {8, 32, 8};
+    static const unsigned kNumIterSteps = 2000;
+    remove(kPath);
+    ASSERT_TRUE(SuRF::openTiered(kPath, 1) == nullptr);
+    for (int t = 0; t < kNumSuffixType; t++) {
+	newSuRFWords(kSuffixTypeList[t], 8);
+	char* data = surf_->serializeFormatted();
+	std::ofstream out(kPath, std::ios::binary | std::ios::trunc);
+	out.write(data, surf_->formattedSize());
+	out.close();
+	delete[] data;
+
+	for (int c = 0; c < kNumConfigs; c++) {
+	    SuRF* tiered = SuRF::openTiered(kPath, kResidentLevels[c], kCachePages[c]);
+	    ASSERT_TRUE(tiered != nullptr);
+	    ASSERT_TRUE(tiered->isTiered());
+	    const PageCache* cache = tiered->getPageCache();
+	    for (unsigned i = 0; i < words.size(); i += 37) {
+		std::string key = words[i];
+		ASSERT_TRUE(tiered->lookupKey(key));
+		key[key.size() - 1] ^= 0x20;
+		ASSERT_EQ(surf_->lookupKey(key), tiered->lookupKey(key));
+		ASSERT_EQ(surf_->lookupRange(key, true, words[i], false),
+			  tiered->lookupRange(key, true, words[i], false));
+		ASSERT_TRUE(cache->getNumCachedPages() <= cache->getCapacity());
+	    }
+	    SuRF::Iter expected_iter = surf_->moveToKeyGreaterThan(words[words.size() / 3], true);
+	    SuRF::Iter iter = tiered->moveToKeyGreaterThan(words[words.size() / 3], true);
+	    for (unsigned i = 0; i < kNumIterSteps; i++) {
+		ASSERT_TRUE(iter.isValid());
+		ASSERT_EQ(expected_iter.getKey(), iter.getKey());
+		expected_iter++;
+		iter++;
+	    }
+	    iter = tiered->moveToLast();
+	    ASSERT_EQ(surf_->moveToLast().getKey(), iter.getKey());
+	    ASSERT_EQ(surf_->approxCount(words[100], words[words.size() - 100]),
+		      tiered->approxCount(words[100], words[words.size() - 100]));
+
+	    uint64_t capacity_bytes = cache->getCapacity() * cache->getPageSize();
+	    ASSERT_TRUE(cache->getResidentBytes() <= cache->getNumPinnedPages() * cache->getPageSize() + capacity_bytes);
+	    if (kResidentLevels[c] >= surf_->getHeight()) {
+		ASSERT_EQ(0u, cache->getNumFaults());
+	    } else if (kResidentLevels[c] == 0) {
+		ASSERT_TRUE(cache->getNumFaults() > 0);
+		ASSERT_TRUE(cache->getNumEvictions() > 0);
+	    }
+	    ASSERT_FALSE(cache->failed());
+	    tiered->destroy();
+	    delete tiered;
+	}
+	surf_->destroy();
+	delete surf_;
+    }
+
+    // a plain serialize() image has no section table
+    newSuRFWords(kReal, 8);
+    char* data = surf_->serialize();
+    std::ofstream out(kPath, std::ios::binary | std::ios::trunc);
+    out.write(data, surf_->serializedSize());
+    out.close();
+    delete[] data;
+    ASSERT_TRUE(SuRF::openTiered(kPath, 1) == nullptr);
+
+    // garbage, a formatted header claiming huge keys, and a formatted
+    // file cut short are rejected, not allocated for
+    std::string garbage(4096, '\xff');
+    out.open(kPath, std::ios::binary | std::ios::trunc);
+    out.write(garbage.data(), garbage.size());
+    out.close();
+    ASSERT_TRUE(SuRF::openTiered(kPath, 1) == nullptr);
+    ASSERT_TRUE(SuRF::open(kPath) == nullptr);
+
+    data = surf_->serializeFormatted();
+    uint64_t formatted_size = surf_->formattedSize();
+    FormatHeader header;
+    memcpy(&header, data, sizeof(header));
+    header.min_key_len = 0xffffffff;
+    header.max_key_len = 0xffffffff;
+    out.open(kPath, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(data + sizeof(header), formatted_size - sizeof(header));
+    out.close();
+    ASSERT_TRUE(SuRF::openTiered(kPath, 1) == nullptr);
+
+    out.open(kPath, std::ios::binary | std::ios::trunc);
+    out.write(data, formatted_size / 2);
+    out.close();
+    ASSERT_TRUE(SuRF::openTiered(kPath, 1) == nullptr);
+    delete[] data;
+
+    surf_->destroy();
+    delete surf_;
+    remove(kPath);
+}
+
+// The file loses its paged sections under an open tiered filter: the
+// filter fails open instead of returning false negatives
+TEST_F (SuRFUnitTest, tieredFailOpenTest) {
+    static const char* kPath = "surf_tiered_fail_test.bin";
+    for (int t = 0; t < kNumSuffixType; t++) {
+	newSuRFWords(kSuffixTypeList[t], 8);
+	char* data = surf_->serializeFormatted();
+	std::ofstream out(kPath, std::ios::binary | std::ios::trunc);
+	out.write(data, surf_->formattedSize());
+	out.close();
+	delete[] data;
+
+	SuRF* tiered = SuRF::openTiered(kPath, 0, 8);
+	ASSERT_TRUE(tiered != nullptr);
+	ASSERT_EQ(0, truncate(kPath, tiered->getPageCache()->getPageSize() * 2));
+	std::vector<std::string> batch;
+	for (unsigned i = 0; i < words.size(); i += 7) {
+	    ASSERT_TRUE(tiered->lookupKey(words[i]));
+	    ASSERT_TRUE(tiered->lookupRange(words[i], true, words[i], true));
+	    batch.push_back(words[i]);
+	}
+	ASSERT_TRUE(tiered->getPageCache()->failed());
+	ASSERT_EQ(EIO, tiered->getPageCache()->getError());
+
+	std::vector<bool> results;
+	tiered->lookupKeys(batch, results);
+	for (unsigned i = 0; i < results.size(); i++)
+	    ASSERT_TRUE(results[i]);
+	uint64_t count = surf_->approxCount(words[100], words[words.size() - 100]);
+	ASSERT_TRUE(tiered->approxCount(words[100], words[words.size() - 100]) >= count);
+	ASSERT_EQ(words.size(), tiered->approxCount(words[0], words[1]));
+
+	tiered->destroy();
+	delete tiered;
+	surf_->destroy();
+	delete surf_;
+    }
+    remove(kPath);
+}
+
 TEST_F (SuRFUnitTest, lookupIntTest) {
     for (int t = 0; t < kNumSuffixType; t++) {
 	for (int k = 0; k < kNumSuffixLen; k++) {
@@ -199,6 +552,46 @@ TEST_F (SuRFUnitTest, lookupIntTest) {
     }
 }
 
+TEST_F (SuRFUnitTest, lookupKeysWordTest) {
+    std::vector<std::string> keys;
+    for (unsigned i = 0; i < words.size(); i++) {
+	keys.push_back(words[i]);
+	std::string key = words[i];
+	key[key.size() - 1] = 'A';
+	keys.push_back(key);
+    }
+    for (int t = 0; t < kNumSuffixType; t++) {
+	newSuRFWords(kSuffixTypeList[t], 8);
+	std::vector<bool> results;
+	surf_->lookupKeys(keys, results);
+	ASSERT_EQ(keys.size(), results.size());
+	for (unsigned i = 0; i < keys.size(); i++)
+	    ASSERT_EQ(surf_->lookupKey(keys[i]), results[i]);
+	surf_->destroy();
+	delete surf_;
+    }
+}
+
+TEST_F (SuRFUnitTest, lookupKeysIntTest) {
+    std::vector<std::string> keys;
+    for (uint64_t i = 0; i < kIntTestBound; i++)
+	keys.push_back(uint64ToString(i));
+    for (int t = 0; t < kNumSuffixType; t++) {
+	newSuRFInts(kSuffixTypeList[t], 8);
+	std::vector<bool> results;
+	surf_->lookupKeys(keys, results);
+	ASSERT_EQ(keys.size(), results.size());
+	for (uint64_t i = 0; i < kIntTestBound; i++) {
+	    ASSERT_EQ(surf_->lookupKey(keys[i]), results[i]);
+	    if (i % kIntTestSkip == 0) {
+		ASSERT_TRUE(results[i]);
+	    }
+	}
+	surf_->destroy();
+	delete surf_;
+    }
+}
+
 TEST_F (SuRFUnitTest, moveToKeyGreaterThanWordTest) {
     for (int t = 2; t < kNumSuffixType; t++) {
 	for (int k = 0; k < kNumSuffixLen; k++) {
@@ -611,6 +1004,566 @@ TEST_F (SuRFUnitTest, approxCountIntTest) {
     delete surf_;
 }
 
+// Readers sharing one const filter, each with its own QueryContext,
+// must agree with the single-threaded answers.
+TEST_F (SuRFUnitTest, concurrentRangeQueryTest) {
+    newSuRFWords(kReal, 8);
+    const unsigned kNumThreads = 4;
+    const unsigned kStride = 7;
+    std::vector<int> expected_ranges;
+    std::vector<uint64_t> expected_counts;
+    for (unsigned i = 0; i + 1 < words.size(); i += kStride) {
+	expected_ranges.push_back(surf_->lookupRange(words[i], false, words[i+1], false));
+	expected_counts.push_back(surf_->approxCount(words[i / 2], words[i]));
+    }
+
+    const SuRF* filter = surf_;
+    std::vector<int> num_mismatches(kNumThreads, 0);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < kNumThreads; t++) {
+	threads.push_back(std::thread([&, t]() {
+	    SuRF::QueryContext context;
+	    for (unsigned round = 0; round < 2; round++) {
+		unsigned q = 0;
+		for (unsigned i = 0; i + 1 < words.size(); i += kStride, q++) {
+		    if (filter->lookupRange(words[i], false, words[i+1], false, context) != (bool)expected_ranges[q])
+			num_mismatches[t]++;
+		    if (filter->approxCount(words[i / 2], words[i], context) != expected_counts[q])
+			num_mismatches[t]++;
+		}
+	    }
+	}));
+    }
+    for (std::thread& thread : threads)
+	thread.join();
+    for (unsigned t = 0; t < kNumThreads; t++)
+	ASSERT_EQ(0, num_mismatches[t]);
+
+    surf_->destroy();
+    delete surf_;
+}
+
+// Once a QueryContext has been used, range queries through it must not
+// touch the heap, including on tries taller than the iterators' inline
+// level storage.
+TEST_F (SuRFUnitTest, allocationFreeRangeQueryTest) {
+    const unsigned kStride = 13;
+    std::vector<std::string> keys;
+    for (unsigned i = 0; i < words.size(); i += kStride)
+	keys.push_back(words[i]);
+    std::vector<std::string> tall_keys;
+    for (unsigned i = 0; i < keys.size(); i++)
+	tall_keys.push_back(std::string(kIterInlineLevels + 8, 'a') + keys[i]);
+
+    for (int tall = 0; tall < 2; tall++) {
+	const std::vector<std::string>& test_keys = tall ? tall_keys : keys;
+	surf_ = new SuRF(test_keys, kIncludeDense, 16, kReal, 0, 8);
+	std::vector<uint64_t> expected_counts;
+	for (unsigned i = 0; i + 1 < test_keys.size(); i++)
+	    expected_counts.push_back(surf_->approxCount(test_keys[i / 2], test_keys[i]));
+	SuRF::QueryContext context;
+	SuRF::Iter iter(surf_);
+	std::string iter_key;
+	int num_wrong = 0;
+	// the first round warms up the context, the iterator and iter_key
+	for (unsigned round = 0; round < 2; round++) {
+	    uint64_t num_allocs_before = num_heap_allocs;
+	    for (unsigned i = 0; i + 1 < test_keys.size(); i++) {
+		if (!surf_->lookupRange(test_keys[i], true, test_keys[i+1], false, context))
+		    num_wrong++;
+		if (surf_->approxCount(test_keys[i / 2], test_keys[i], context) != expected_counts[i])
+		    num_wrong++;
+		surf_->moveToKeyGreaterThan(test_keys[i], true, iter);
+		if (!iter.isValid() || iter.compare(test_keys[i+1]) >= 0)
+		    num_wrong++;
+		int compare = iter.compare(test_keys[i]);
+		if (compare != 0 && compare != kCouldBePositive)
+		    num_wrong++;
+		iter.getKey(iter_key);
+		if (test_keys[i].compare(0, iter_key.length(), iter_key) != 0)
+		    num_wrong++;
+	    }
+	    if (round > 0) {
+		ASSERT_EQ(num_allocs_before, num_heap_allocs);
+	    }
+	}
+	ASSERT_EQ(0, num_wrong);
+	ASSERT_EQ(iter.getKey(), iter_key);
+	surf_->destroy();
+	delete surf_;
+    }
+}
+
+// Probing with keys that live in a shared byte buffer (KeyView) must give
+// the same answers as probing with std::string copies.
+TEST_F (SuRFUnitTest, keyViewQueryTest) {
+    newSuRFWords(kMixed, 8);
+    std::string buffer;
+    std::vector<size_t> offsets;
+    for (unsigned i = 0; i < words.size(); i++) {
+	offsets.push_back(buffer.size());
+	buffer += words[i];
+    }
+    offsets.push_back(buffer.size());
+    const char* data = buffer.data();
+
+    SuRF::QueryContext context;
+    for (unsigned i = 0; i + 1 < words.size(); i++) {
+	KeyView key(data + offsets[i], offsets[i+1] - offsets[i]);
+	KeyView next_key(data + offsets[i+1], offsets[i+2] - offsets[i+1]);
+	ASSERT_TRUE(surf_->lookupKey(key));
+	std::string truncated = words[i].substr(0, words[i].length() - 1);
+	ASSERT_EQ(surf_->lookupKey(truncated), surf_->lookupKey(KeyView(words[i].data(), truncated.length())));
+	ASSERT_EQ(surf_->lookupRange(words[i], false, words[i+1], false, context),
+		  surf_->lookupRange(key, false, next_key, false, context));
+	ASSERT_EQ(surf_->approxCount(words[i / 2], words[i], context),
+		  surf_->approxCount(KeyView(data + offsets[i / 2], offsets[i / 2 + 1] - offsets[i / 2]), key, context));
+	SuRF::Iter iter = surf_->moveToKeyGreaterThan(key, true);
+	ASSERT_TRUE(iter.isValid());
+	ASSERT_EQ(iter.compare(words[i]), iter.compare(key));
+    }
+#if __cplusplus >= 201703L
+    ASSERT_TRUE(surf_->lookupKey(std::string_view(words[0])));
+#endif
+    surf_->destroy();
+    delete surf_;
+}
+
+// The direct (in place) build must produce the same filter, byte for
+// byte, as the build through the per-level vectors.
+static void expectSameSerialization(SuRF& expected, SuRF& actual) {
+    ASSERT_EQ(expected.serializedSize(), actual.serializedSize());
+    char* expected_data = expected.serialize();
+    char* actual_data = actual.serialize();
+    ASSERT_EQ(0, memcmp(expected_data, actual_data, expected.serializedSize()));
+    delete[] expected_data;
+    delete[] actual_data;
+}
+
+TEST_F (SuRFUnitTest, directBuildTest) {
+    std::vector<std::string> words_dup;
+    for (unsigned i = 0; i < words.size(); i++) {
+	words_dup.push_back(words[i]);
+	if (i % 5 == 0)
+	    words_dup.push_back(words[i]);
+    }
+    const std::vector<std::string>* key_lists[3] = {&words, &words_dup, &ints_};
+    for (int k = 0; k < 3; k++) {
+	const std::vector<std::string>& keys = *key_lists[k];
+	std::string blob;
+	std::vector<uint32_t> offsets;
+	for (unsigned i = 0; i < keys.size(); i++) {
+	    offsets.push_back(static_cast<uint32_t>(blob.size()));
+	    blob += keys[i];
+	}
+	offsets.push_back(static_cast<uint32_t>(blob.size()));
+
+	for (int t = 0; t < kNumSuffixType; t++) {
+	    level_t hash_len = (kSuffixTypeList[t] == kHash || kSuffixTypeList[t] == kMixed) ? 7 : 0;
+	    level_t real_len = (kSuffixTypeList[t] == kReal || kSuffixTypeList[t] == kMixed) ? 13 : 0;
+	    SuRF expected;
+	    expected.create(keys, kIncludeDense, kSparseDenseRatio, kSuffixTypeList[t], hash_len, real_len);
+	    SuRF direct;
+	    direct.createDirect(keys, kIncludeDense, kSparseDenseRatio, kSuffixTypeList[t], hash_len, real_len);
+	    expectSameSerialization(expected, direct);
+	    SuRF direct_blob;
+	    direct_blob.createDirect(blob.data(), offsets.data(), keys.size(),
+				     kIncludeDense, kSparseDenseRatio, kSuffixTypeList[t], hash_len, real_len);
+	    expectSameSerialization(expected, direct_blob);
+	    for (unsigned i = 0; i < keys.size(); i += 97)
+		ASSERT_TRUE(direct.lookupKey(keys[i]));
+	    expected.destroy();
+	    direct.destroy();
+	    direct_blob.destroy();
+	}
+    }
+}
+
+TEST_F (SuRFUnitTest, buildMemoryStatsTest) {
+    SuRF surf;
+    surf.create(words, kIncludeDense, kSparseDenseRatio, kReal, 0, 8);
+    const BuildMemoryStats& stats = surf.getBuildMemoryStats();
+    ASSERT_EQ(surf.getMemoryUsage(), stats.final_bytes);
+    ASSERT_TRUE(stats.transientBytes() > 0);
+    ASSERT_EQ(stats.transientBytes() + stats.final_bytes, stats.peak_bytes);
+
+    // the direct build only keeps per-level bookkeeping besides the filter
+    SuRF direct;
+    direct.createDirect(words, kIncludeDense, kSparseDenseRatio, kReal, 0, 8);
+    const BuildMemoryStats& direct_stats = direct.getBuildMemoryStats();
+    ASSERT_EQ(stats.final_bytes, direct_stats.final_bytes);
+    ASSERT_TRUE(direct_stats.transientBytes() < stats.transientBytes() / 100);
+    ASSERT_TRUE(direct_stats.peak_bytes < stats.peak_bytes);
+    surf.destroy();
+    direct.destroy();
+}
+
+TEST_F (SuRFUnitTest, budgetBuildTest) {
+    // the size model predicts the built tries
+    SuRFDirectBuilder builder(kIncludeDense, kSparseDenseRatio, kMixed, 7, 13);
+    builder.build(words);
+    LoudsDense* louds_dense = builder.getLoudsDense();
+    LoudsSparse* louds_sparse = builder.getLoudsSparse();
+    ASSERT_EQ(louds_dense->getMemoryUsage() + louds_sparse->getMemoryUsage(), builder.getEstimatedMemoryUsage());
+    louds_dense->destroy();
+    louds_sparse->destroy();
+    delete louds_dense;
+    delete louds_sparse;
+
+    const double budgets[4] = {22, 26, 32, 48}; // the trie alone takes ~20 bits per word
+    uint64_t last_mem = 0;
+    for (int b = 0; b < 4; b++) {
+	SuRF surf;
+	ASSERT_TRUE(surf.createWithBudget(words, kIncludeDense, kSparseDenseRatio, kMixed, 16, 16, budgets[b]));
+	uint64_t mem = surf.getMemoryUsage();
+	ASSERT_TRUE(mem * 8 <= budgets[b] * words.size() + 64 * 8);
+	ASSERT_TRUE(mem >= last_mem); // a larger budget keeps longer suffixes
+	last_mem = mem;
+	for (unsigned i = 0; i < words.size(); i += 7)
+	    ASSERT_TRUE(surf.lookupKey(words[i]));
+	surf.destroy();
+    }
+
+    // over budget: still a correct filter, as small as possible
+    SuRF small;
+    ASSERT_FALSE(small.createWithBudget(words, kIncludeDense, kSparseDenseRatio, kReal, 0, 8, 1));
+    for (unsigned i = 0; i < words.size(); i += 7)
+	ASSERT_TRUE(small.lookupKey(words[i]));
+    SuRF no_suffix;
+    no_suffix.createDirect(words, kIncludeDense, kSparseDenseRatio, kNone, 0, 0);
+    ASSERT_TRUE(small.getMemoryUsage() <= no_suffix.getMemoryUsage());
+    small.destroy();
+    no_suffix.destroy();
+}
+
+// The merged filter has no false negatives for any input's keys
+TEST_F (SuRFUnitTest, mergeTest) {
+    const std::vector<std::string>* key_lists[2] = {&words, &ints_};
+    for (int k = 0; k < 2; k++) {
+	const std::vector<std::string>& keys = *key_lists[k];
+	std::vector<std::string> parts[kNumSuffixType];
+	for (unsigned i = 0; i < keys.size(); i++)
+	    parts[(i / 3 + i) % kNumSuffixType].push_back(keys[i]);
+
+	std::vector<SuRF*> filters;
+	std::vector<const SuRF*> inputs;
+	for (int t = 0; t < kNumSuffixType; t++) {
+	    level_t hash_len = (kSuffixTypeList[t] == kHash || kSuffixTypeList[t] == kMixed) ? 4 : 0;
+	    level_t real_len = (kSuffixTypeList[t] == kReal || kSuffixTypeList[t] == kMixed) ? 12 : 0;
+	    filters.push_back(new SuRF(parts[t], kIncludeDense, kSparseDenseRatio, kSuffixTypeList[t], hash_len, real_len));
+	    inputs.push_back(filters.back());
+	}
+	SuRF* merged = SuRF::merge(inputs);
+	ASSERT_TRUE(merged != nullptr);
+	ASSERT_EQ(12u, merged->getRealSuffixLen());
+	SuRF::QueryContext context;
+	for (unsigned i = 0; i < keys.size(); i++) {
+	    ASSERT_TRUE(merged->lookupKey(keys[i]));
+	    ASSERT_TRUE(merged->lookupRange(keys[i], true, keys[i], true, context));
+	}
+
+	// no more false positives than the inputs give together
+	uint64_t merged_fp = 0;
+	uint64_t inputs_fp = 0;
+	for (unsigned i = 0; i + 1 < keys.size(); i++) {
+	    std::string probe = (k == 0) ? keys[i] + "_" : uint64ToString(stringToUint64(keys[i]) + 1);
+	    if (probe == keys[i + 1])
+		continue;
+	    if (merged->lookupKey(probe))
+		merged_fp++;
+	    for (unsigned f = 0; f < filters.size(); f++) {
+		if (filters[f]->lookupKey(probe)) {
+		    inputs_fp++;
+		    break;
+		}
+	    }
+	}
+	ASSERT_TRUE(merged_fp <= inputs_fp);
+
+	for (unsigned f = 0; f < filters.size(); f++) {
+	    filters[f]->destroy();
+	    delete filters[f];
+	}
+	merged->destroy();
+	delete merged;
+    }
+
+    std::vector<const SuRF*> none;
+    ASSERT_TRUE(SuRF::merge(none) == nullptr);
+}
+
+TEST_F (SuRFUnitTest, eraseTest) {
+    const std::vector<std::string>* key_lists[2] = {&words, &ints_};
+    for (int k = 0; k < 2; k++) {
+	const std::vector<std::string>& keys = *key_lists[k];
+	for (int t = 0; t < kNumSuffixType; t++) {
+	    if (k == 0)
+		newSuRFWords(kSuffixTypeList[t], 8);
+	    else
+		newSuRFInts(kSuffixTypeList[t], 8);
+	    uint64_t memory = surf_->getMemoryUsage();
+	    ASSERT_FALSE(surf_->needsRebuild());
+	    std::vector<std::string> live_keys;
+	    for (unsigned i = 0; i < keys.size(); i++) {
+		if (i % 3 == 1) {
+		    ASSERT_TRUE(surf_->erase(keys[i]));
+		    ASSERT_FALSE(surf_->erase(keys[i]));
+		} else {
+		    live_keys.push_back(keys[i]);
+		}
+	    }
+	    ASSERT_EQ(keys.size() - live_keys.size(), surf_->getNumErased());
+	    ASSERT_TRUE(surf_->getMemoryUsage() > memory);
+	    ASSERT_TRUE(surf_->needsRebuild());
+	    surf_->setRebuildThreshold(0.5);
+	    ASSERT_FALSE(surf_->needsRebuild());
+
+	    // every key has its own leaf
+	    std::vector<bool> results;
+	    surf_->lookupKeys(keys, results);
+	    for (unsigned i = 0; i < keys.size(); i++) {
+		ASSERT_EQ(i % 3 != 1, surf_->lookupKey(keys[i]));
+		ASSERT_EQ(i % 3 != 1, results[i]);
+		if (i % 3 != 1) {
+		    ASSERT_TRUE(surf_->lookupRange(keys[i], true, keys[i], true));
+		}
+	    }
+
+	    // the iterators skip exactly the erased keys
+	    SuRF::Iter iter = surf_->moveToFirst();
+	    for (unsigned i = 0; i < live_keys.size(); i++) {
+		ASSERT_TRUE(iter.isValid());
+		std::string iter_key = iter.getKey();
+		ASSERT_EQ(0, live_keys[i].compare(0, iter_key.length(), iter_key));
+		iter++;
+	    }
+	    ASSERT_FALSE(iter.isValid());
+	    iter = surf_->moveToLast();
+	    for (unsigned i = live_keys.size(); i > 0; i--) {
+		ASSERT_TRUE(iter.isValid());
+		std::string iter_key = iter.getKey();
+		ASSERT_EQ(0, live_keys[i - 1].compare(0, iter_key.length(), iter_key));
+		iter--;
+	    }
+	    ASSERT_FALSE(iter.isValid());
+
+	    for (unsigned i = 1; i + 1 < keys.size(); i += 3) {
+		iter = surf_->moveToKeyGreaterThan(keys[i], true);
+		ASSERT_TRUE(iter.isValid());
+		std::string iter_key = iter.getKey();
+		ASSERT_EQ(0, keys[i + 1].compare(0, iter_key.length(), iter_key));
+	    }
+
+	    uint64_t count = surf_->approxCount(keys.front(), keys.back());
+	    ASSERT_TRUE(count <= live_keys.size());
+	    ASSERT_TRUE(count + 2 >= live_keys.size());
+	    surf_->destroy();
+	    delete surf_;
+	}
+    }
+}
+
+// Varints, bit-packed arrays and range-coded bits read back as written
+TEST_F (SuRFUnitTest, compactCodecTest) {
+    CompactWriter writer;
+    const uint64_t varints[] = {0, 1, 127, 128, 300, 1ULL << 35, ~0ULL};
+    for (uint64_t value : varints)
+	writer.putVarint(value);
+    const position_t packed[] = {0, 5, 1000, 7, kMaxPos};
+    writer.putPacked(packed, 5);
+    writer.putPacked(packed, 1); // width 0
+    std::vector<char> stream;
+    RangeEncoder encoder(stream);
+    std::vector<uint16_t> probs(256 + 1, kRangeProbInit);
+    for (unsigned i = 0; i < 10000; i++) {
+	encoder.encodeBit(probs[256], (i % 10 == 0) ? 1 : 0);
+	encoder.encodeByte(probs.data(), (uint8_t)(i * i));
+    }
+    encoder.flush();
+    ASSERT_LT(stream.size(), 10000u + 10000u / 8);
+    putRangeCoded(writer, stream);
+
+    const std::vector<char>& buffer = writer.buffer();
+    CompactReader reader(buffer.data(), buffer.size());
+    for (uint64_t value : varints)
+	ASSERT_EQ(value, reader.getVarint());
+    position_t values[5];
+    reader.getPacked(values, 5);
+    for (unsigned i = 0; i < 5; i++)
+	ASSERT_EQ(packed[i], values[i]);
+    reader.getPacked(values, 1);
+    ASSERT_EQ(0u, values[0]);
+    RangeDecoder decoder = getRangeCoded(reader);
+    std::vector<uint16_t> decode_probs(256 + 1, kRangeProbInit);
+    for (unsigned i = 0; i < 10000; i++) {
+	ASSERT_EQ((i % 10 == 0) ? 1u : 0u, decoder.decodeBit(decode_probs[256]));
+	ASSERT_EQ((uint8_t)(i * i), decoder.decodeByte(decode_probs.data()));
+    }
+    ASSERT_FALSE(decoder.overrun());
+    ASSERT_TRUE(reader.atEnd());
+    ASSERT_FALSE(reader.failed());
+
+    CompactReader truncated(buffer.data(), 3);
+    truncated.getVarint();
+    truncated.getVarint();
+    truncated.getVarint();
+    ASSERT_EQ(0u, truncated.getVarint());
+    ASSERT_TRUE(truncated.failed());
+}
+
+static void testCompactRoundTrip(SuRF* filter, const std::vector<std::string>& keys) {
+    uint64_t size = 0;
+    char* data = filter->serializeCompact(size);
+    ASSERT_LT(size, filter->serializedSize());
+    SuRF* decoded = SuRF::deSerializeCompact(data, size);
+    ASSERT_TRUE(decoded != nullptr);
+    // decoded to the normal layout, LUTs included
+    expectSameSerialization(*filter, *decoded);
+    for (unsigned i = 0; i < keys.size(); i += 7)
+	ASSERT_TRUE(decoded->lookupKey(keys[i]));
+    decoded->destroy();
+    delete decoded;
+
+    // any flipped byte fails the checksum, and a short image is rejected
+    for (uint64_t i = 0; i < size; i += size / 16 + 1) {
+	data[i] ^= 0x04;
+	ASSERT_TRUE(SuRF::deSerializeCompact(data, size) == nullptr);
+	data[i] ^= 0x04;
+    }
+    ASSERT_TRUE(SuRF::deSerializeCompact(data, size - 1) == nullptr);
+    ASSERT_TRUE(SuRF::deSerializeCompact(data, sizeof(CompactHeader) - 1) == nullptr);
+    delete[] data;
+}
+
+// serializeCompact is smaller than serialize() and decodes to the same bytes
+TEST_F (SuRFUnitTest, compactTest) {
+    for (int t = 0; t < kNumSuffixType; t++) {
+	newSuRFWords(kSuffixTypeList[t], 8);
+	testCompactRoundTrip(surf_, words);
+	surf_->destroy();
+	delete surf_;
+    }
+    newSuRFInts(kReal, 8);
+    testCompactRoundTrip(surf_, ints_);
+    surf_->destroy();
+    delete surf_;
+
+    // a filter of a few short keys
+    std::vector<std::string> short_keys = {"a", "ab", "abc", "b", "ba", "c"};
+    surf_ = new SuRF(short_keys, kReal, 0, 8);
+    uint64_t size = 0;
+    char* data = surf_->serializeCompact(size);
+    SuRF* decoded = SuRF::deSerializeCompact(data, size);
+    ASSERT_TRUE(decoded != nullptr);
+    expectSameSerialization(*surf_, *decoded);
+    for (const std::string& key : short_keys)
+	ASSERT_TRUE(decoded->lookupKey(key));
+    decoded->destroy();
+    delete decoded;
+    delete[] data;
+    surf_->destroy();
+    delete surf_;
+}
+
+// Wraps body in a header with a valid checksum, so that only the
+// decoder's own checks can reject it
+static SuRF* deSerializeCompactBody(const std::vector<char>& body) {
+    CompactHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kCompactMagic, sizeof(kCompactMagic));
+    header.version = kCompactVersion;
+    header.body_size = body.size();
+    header.body_crc = crc32c(body.data(), body.size());
+    std::vector<char> image(sizeof(header));
+    memcpy(image.data(), &header, sizeof(header));
+    image.insert(image.end(), body.begin(), body.end());
+    return SuRF::deSerializeCompact(image.data(), image.size());
+}
+
+// An empty louds-dense: no levels, no nodes, no suffixes, empty stream
+static void putEmptyCompactDense(CompactWriter& writer) {
+    writer.putVarint(0);
+    writer.putPacked(nullptr, 0);
+    writer.putVarint(0);
+    BitvectorSuffix suffixes;
+    suffixes.serializeCompact(writer);
+    putRangeCoded(writer, std::vector<char>());
+}
+
+// A louds-sparse header; cuts has height values
+static void putCompactSparseHeader(CompactWriter& writer, std::vector<position_t> cuts, const level_t height,
+				   const position_t num_items) {
+    writer.putVarint(height);
+    writer.putVarint(0);
+    writer.putVarint(0);
+    writer.putVarint(0);
+    writer.putPacked(cuts.data(), cuts.size());
+    writer.putVarint(num_items);
+    BitvectorSuffix suffixes;
+    suffixes.serializeCompact(writer);
+}
+
+// sizes from a corrupt image are bounded before they are allocated
+TEST_F (SuRFUnitTest, compactCorruptTest) {
+    // a height past kCompactMaxKeyLen, and one the rest of the image
+    // cannot hold the cuts of
+    level_t heights[] = {kMaxPos, kCompactMaxKeyLen + 2, kCompactMaxKeyLen};
+    for (level_t height : heights) {
+	CompactWriter writer;
+	writer.putVarint(height);
+	writer.putPacked(nullptr, 0);
+	ASSERT_TRUE(deSerializeCompactBody(writer.buffer()) == nullptr);
+
+	CompactWriter sparse_writer;
+	putEmptyCompactDense(sparse_writer);
+	sparse_writer.putVarint(height);
+	ASSERT_TRUE(deSerializeCompactBody(sparse_writer.buffer()) == nullptr);
+    }
+
+    // more items than the range-coded stream can hold
+    {
+	CompactWriter writer;
+	putEmptyCompactDense(writer);
+	putCompactSparseHeader(writer, {kMaxPos - 2}, 1, kMaxPos - 1);
+	putRangeCoded(writer, std::vector<char>(8, 0));
+	ASSERT_TRUE(deSerializeCompactBody(writer.buffer()) == nullptr);
+    }
+    {
+	CompactWriter writer;
+	writer.putVarint(1);
+	position_t cut = kMaxPos / kFanout * kFanout - 1;
+	writer.putPacked(&cut, 1);
+	writer.putVarint(kMaxPos / kFanout);
+	BitvectorSuffix suffixes;
+	suffixes.serializeCompact(writer);
+	putRangeCoded(writer, std::vector<char>(8, 0));
+	ASSERT_TRUE(deSerializeCompactBody(writer.buffer()) == nullptr);
+    }
+
+    // level cuts that go backwards
+    {
+	CompactWriter writer;
+	putEmptyCompactDense(writer);
+	putCompactSparseHeader(writer, {5, 2, 7}, 3, 8);
+	putRangeCoded(writer, std::vector<char>(8, 0));
+	ASSERT_TRUE(deSerializeCompactBody(writer.buffer()) == nullptr);
+    }
+
+    // the same images with valid sizes do decode
+    std::vector<std::string> keys = {"a", "b"};
+    surf_ = new SuRF(keys, kNone, 0, 0);
+    uint64_t size = 0;
+    char* data = surf_->serializeCompact(size);
+    std::vector<char> body(data + sizeof(CompactHeader), data + size);
+    SuRF* decoded = deSerializeCompactBody(body);
+    ASSERT_TRUE(decoded != nullptr);
+    decoded->destroy();
+    delete decoded;
+    delete[] data;
+    surf_->destroy();
+    delete surf_;
+}
+
 void loadWordList() {
     std::ifstream infile(kFilePath);
     std::string key;
@@ -3,6 +3,8 @@
 #include <assert.h>
 
 #include <fstream>
+#include <list>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -381,6 +383,172 @@ TEST_F (SuRFBuilderUnitTest, buildDenseIntTest) {
     }
 }
 
+static void expectSameBuild(const SuRFBuilder& expected, const SuRFBuilder& actual) {
+    ASSERT_EQ(expected.getTreeHeight(), actual.getTreeHeight());
+    ASSERT_EQ(expected.getSparseStartLevel(), actual.getSparseStartLevel());
+    ASSERT_TRUE(expected.getLabels() == actual.getLabels());
+    ASSERT_TRUE(expected.getChildIndicatorBits() == actual.getChildIndicatorBits());
+    ASSERT_TRUE(expected.getLoudsBits() == actual.getLoudsBits());
+    ASSERT_TRUE(expected.getSuffixes() == actual.getSuffixes());
+    ASSERT_TRUE(expected.getSuffixCounts() == actual.getSuffixCounts());
+    ASSERT_TRUE(expected.getNodeCounts() == actual.getNodeCounts());
+    ASSERT_TRUE(expected.getBitmapLabels() == actual.getBitmapLabels());
+    ASSERT_TRUE(expected.getBitmapChildIndicatorBits() == actual.getBitmapChildIndicatorBits());
+    ASSERT_TRUE(expected.getPrefixkeyIndicatorBits() == actual.getPrefixkeyIndicatorBits());
+}
+
+// The parallel build must reproduce the sequential one exactly, whether
+// the key set splits at the first byte (words) or below a shared prefix
+// (ints, which share their leading zero bytes).
+TEST_F (SuRFBuilderUnitTest, buildParallelTest) {
+    std::vector<std::string> prefixed;
+    prefixed.push_back(std::string("pre"));
+    prefixed.push_back(std::string("pre"));
+    for (int i = 0; i < (int)words.size(); i += 7)
+	prefixed.push_back(std::string("pre") + words[i]);
+
+    const std::vector<std::string>* key_lists[4] = {&words, &words_dup, &ints_, &prefixed};
+    const SuffixType suffix_types[4] = {kNone, kHash, kReal, kMixed};
+    const unsigned num_threads_list[4] = {2, 3, 8, 300};
+    for (int k = 0; k < 4; k++) {
+	for (int t = 0; t < 4; t++) {
+	    for (int n = 0; n < 4; n++) {
+		SuRFBuilder expected(kIncludeDense, kSparseDenseRatio, suffix_types[t], 5, 7);
+		expected.build(*key_lists[k]);
+		SuRFBuilder actual(kIncludeDense, kSparseDenseRatio, suffix_types[t], 5, 7);
+		actual.buildParallel(*key_lists[k], num_threads_list[n]);
+		expectSameBuild(expected, actual);
+	    }
+	}
+    }
+}
+
+// Shuffled keys with duplicates build the same trie as the sorted list
+TEST_F (SuRFBuilderUnitTest, buildUnsortedTest) {
+    const std::vector<std::string>* key_lists[3] = {&words, &words_dup, &ints_};
+    const unsigned num_threads_list[3] = {1, 4, 8};
+    std::mt19937 gen(2018);
+    for (int k = 0; k < 3; k++) {
+	SuRFBuilder expected(kIncludeDense, kSparseDenseRatio, kMixed, 5, 7);
+	expected.build(*key_lists[k]);
+	for (int n = 0; n < 3; n++) {
+	    std::vector<std::string> keys = *key_lists[k];
+	    keys.insert(keys.end(), key_lists[k]->begin(), key_lists[k]->begin() + keys.size() / 3);
+	    std::shuffle(keys.begin(), keys.end(), gen);
+	    SuRFBuilder actual(kIncludeDense, kSparseDenseRatio, kMixed, 5, 7);
+	    actual.buildUnsorted(keys, num_threads_list[n]);
+	    expectSameBuild(expected, actual);
+	}
+    }
+}
+
+// Streaming builds (iterator range, callback, insert + finalize) hold one
+// key of lookahead and must produce exactly the batch build.
+TEST_F (SuRFBuilderUnitTest, buildStreamTest) {
+    const std::vector<std::string>* key_lists[3] = {&words, &words_dup, &ints_};
+    const SuffixType suffix_types[4] = {kNone, kHash, kReal, kMixed};
+    for (int k = 0; k < 3; k++) {
+	const std::vector<std::string>& keys = *key_lists[k];
+	for (int t = 0; t < 4; t++) {
+	    SuRFBuilder expected(kIncludeDense, kSparseDenseRatio, suffix_types[t], 5, 7);
+	    expected.build(keys);
+
+	    std::list<std::string> key_list(keys.begin(), keys.end());
+	    SuRFBuilder from_iterator(kIncludeDense, kSparseDenseRatio, suffix_types[t], 5, 7);
+	    ASSERT_TRUE(from_iterator.build(key_list.begin(), key_list.end()));
+	    expectSameBuild(expected, from_iterator);
+
+	    size_t next = 0;
+	    SuRFBuilder from_stream(kIncludeDense, kSparseDenseRatio, suffix_types[t], 5, 7);
+	    ASSERT_TRUE(from_stream.buildFromStream([&](std::string& key) {
+		    if (next == keys.size())
+			return false;
+		    key = keys[next++];
+		    return true;
+		}));
+	    expectSameBuild(expected, from_stream);
+
+	    SuRFBuilder incremental(kIncludeDense, kSparseDenseRatio, suffix_types[t], 5, 7);
+	    for (size_t i = 0; i < keys.size(); i++)
+		ASSERT_TRUE(incremental.insert(keys[i]));
+	    ASSERT_FALSE(incremental.insert(keys[0]));
+	    incremental.finalize();
+	    expectSameBuild(expected, incremental);
+	}
+    }
+}
+
+// A stream that is empty or out of order is reported, not built.
+TEST_F (SuRFBuilderUnitTest, buildStreamUnsortedTest) {
+    std::vector<std::string> keys(words.begin(), words.begin() + 1000);
+    std::swap(keys[500], keys[501]);
+    SuRFBuilder unsorted(kIncludeDense, kSparseDenseRatio, kReal, 0, 8);
+    ASSERT_FALSE(unsorted.build(keys.begin(), keys.end()));
+
+    size_t num_pulled = 0;
+    SuRFBuilder from_stream(kIncludeDense, kSparseDenseRatio, kReal, 0, 8);
+    ASSERT_FALSE(from_stream.buildFromStream([&](std::string& key) {
+	    if (num_pulled == keys.size())
+		return false;
+	    key = keys[num_pulled++];
+	    return true;
+	}));
+    // the build stops at the first out-of-order key
+    ASSERT_EQ(502u, num_pulled);
+
+    std::vector<std::string> no_keys;
+    SuRFBuilder empty(kIncludeDense, kSparseDenseRatio, kReal, 0, 8);
+    ASSERT_FALSE(empty.build(no_keys.begin(), no_keys.end()));
+}
+
+// Building from one packed key buffer plus offsets must produce exactly
+// the build from the key vector.
+TEST_F (SuRFBuilderUnitTest, buildBlobTest) {
+    const std::vector<std::string>* key_lists[3] = {&words, &words_dup, &ints_};
+    const SuffixType suffix_types[4] = {kNone, kHash, kReal, kMixed};
+    for (int k = 0; k < 3; k++) {
+	const std::vector<std::string>& keys = *key_lists[k];
+	std::string blob;
+	std::vector<uint32_t> offsets;
+	for (size_t i = 0; i < keys.size(); i++) {
+	    offsets.push_back(static_cast<uint32_t>(blob.size()));
+	    blob.append(keys[i]);
+	}
+	offsets.push_back(static_cast<uint32_t>(blob.size()));
+
+	for (int t = 0; t < 4; t++) {
+	    SuRFBuilder expected(kIncludeDense, kSparseDenseRatio, suffix_types[t], 5, 7);
+	    expected.build(keys);
+	    SuRFBuilder actual(kIncludeDense, kSparseDenseRatio, suffix_types[t], 5, 7);
+	    actual.build(blob.data(), offsets.data(), keys.size());
+	    expectSameBuild(expected, actual);
+	}
+    }
+}
+
+TEST_F (SuRFBuilderUnitTest, memoryStatsTest) {
+    SuRFBuilder builder(kIncludeDense, kSparseDenseRatio, kMixed, 5, 7);
+    builder.build(words);
+    BuildMemoryStats stats = builder.getMemoryStats();
+    ASSERT_EQ(builder.getTreeHeight(), stats.level_bytes.size());
+    uint64_t level_sum = 0;
+    for (level_t level = 0; level < stats.level_bytes.size(); level++)
+	level_sum += stats.level_bytes[level];
+    ASSERT_EQ(stats.sparse_bytes + stats.suffix_bytes + stats.dense_bytes, level_sum);
+    ASSERT_TRUE(stats.sparse_bytes > 0);
+    ASSERT_TRUE(stats.suffix_bytes > 0);
+    ASSERT_TRUE(builder.getSparseStartLevel() > 0);
+    ASSERT_TRUE(stats.dense_bytes > 0);
+    ASSERT_EQ(stats.transientBytes(), stats.peak_transient_bytes);
+    ASSERT_EQ(0u, stats.final_bytes);
+
+    // the partition builders are alive while they are merged
+    SuRFBuilder parallel(kIncludeDense, kSparseDenseRatio, kMixed, 5, 7);
+    parallel.buildParallel(words, 4);
+    BuildMemoryStats parallel_stats = parallel.getMemoryStats();
+    ASSERT_TRUE(parallel_stats.peak_transient_bytes > parallel_stats.transientBytes());
+}
+
 void loadWordList() {
     std::ifstream infile(kFilePath);
     std::string key;
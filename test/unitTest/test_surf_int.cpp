@@ -0,0 +1,132 @@
+#include "gtest/gtest.h"
+
+#include <assert.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "surf.hpp"
+#include "surf_int.hpp"
+
+namespace surf {
+
+namespace surfinttest {
+
+static const uint64_t kNumKeys = 100000;
+static const uint64_t kNumProbes = 100000;
+static const int kNumSuffixType = 4;
+static const SuffixType kSuffixTypeList[kNumSuffixType] = {kNone, kHash, kReal, kMixed};
+
+class SuRFIntUnitTest : public ::testing::Test {
+public:
+    virtual void SetUp () {}
+    virtual void TearDown () {}
+};
+
+// Sorted, unique random keys; small ranges so that keys share prefixes
+template <typename IntT>
+static std::vector<IntT> randomKeys(const uint64_t num_keys, const uint64_t seed) {
+    std::mt19937_64 gen(seed);
+    std::vector<IntT> keys;
+    for (uint64_t i = 0; i < num_keys; i++)
+	keys.push_back(static_cast<IntT>(gen() % (num_keys * 16)));
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+template <typename IntT>
+static std::string encode(const IntT key) {
+    char buf[sizeof(IntT)];
+    SuRFInt<IntT>::encodeKey(key, buf);
+    return std::string(buf, sizeof(IntT));
+}
+
+// SuRFInt must give exactly the answers of a SuRF built from the
+// encoded keys, and no false negatives.
+template <typename IntT>
+static void testAgainstSuRF() {
+    std::vector<IntT> keys = randomKeys<IntT>(kNumKeys, 2018);
+    std::vector<std::string> key_strings;
+    for (uint64_t i = 0; i < keys.size(); i++)
+	key_strings.push_back(encode(keys[i]));
+
+    for (int t = 0; t < kNumSuffixType; t++) {
+	SuffixType suffix_type = kSuffixTypeList[t];
+	level_t hash_len = (suffix_type == kHash || suffix_type == kMixed) ? 4 : 0;
+	level_t real_len = (suffix_type == kReal || suffix_type == kMixed) ? 8 : 0;
+	SuRFInt<IntT> filter(keys, kIncludeDense, kSparseDenseRatio, suffix_type, hash_len, real_len);
+	SuRF reference(key_strings, kIncludeDense, kSparseDenseRatio, suffix_type, hash_len, real_len);
+	SuRF::QueryContext context;
+
+	for (uint64_t i = 0; i < keys.size(); i++)
+	    ASSERT_TRUE(filter.lookup(keys[i]));
+
+	std::mt19937_64 gen(7);
+	for (uint64_t i = 0; i < kNumProbes; i++) {
+	    IntT key = static_cast<IntT>(gen() % (kNumKeys * 16));
+	    IntT right_key = key + static_cast<IntT>(gen() % 64);
+	    ASSERT_EQ(reference.lookupKey(encode(key)), filter.lookup(key));
+	    ASSERT_EQ(reference.lookupRange(encode(key), true, encode(right_key), false, context),
+		      filter.lookupRange(key, true, right_key, false, context));
+	    ASSERT_EQ(reference.approxCount(encode(key), encode(right_key), context),
+		      filter.approxCount(key, right_key, context));
+	}
+	// the batched path answers like the per-key one
+	std::vector<IntT> probes;
+	for (uint64_t i = 0; i < kNumProbes; i++)
+	    probes.push_back((i % 2 == 0) ? keys[gen() % keys.size()] : static_cast<IntT>(gen() % (kNumKeys * 16)));
+	std::vector<bool> results;
+	filter.lookupKeys(probes, results);
+	ASSERT_EQ(probes.size(), results.size());
+	for (uint64_t i = 0; i < probes.size(); i++)
+	    ASSERT_EQ(filter.lookup(probes[i]), (bool)results[i]);
+	ASSERT_TRUE(filter.lookupRange(keys[0], true, keys[0], true));
+	ASSERT_EQ(reference.getMemoryUsage(), filter.getMemoryUsage());
+
+	filter.destroy();
+	reference.destroy();
+    }
+}
+
+TEST_F (SuRFIntUnitTest, encodeKeyTest) {
+    ASSERT_EQ(uint64ToString(0x0102030405060708ULL), encode<uint64_t>(0x0102030405060708ULL));
+    ASSERT_EQ(std::string("\x01\x02\x03\x04"), encode<uint32_t>(0x01020304));
+    ASSERT_TRUE(encode<uint32_t>(255) < encode<uint32_t>(256));
+}
+
+TEST_F (SuRFIntUnitTest, uint64Test) {
+    testAgainstSuRF<uint64_t>();
+}
+
+TEST_F (SuRFIntUnitTest, uint32Test) {
+    testAgainstSuRF<uint32_t>();
+}
+
+TEST_F (SuRFIntUnitTest, unsortedTest) {
+    std::vector<uint64_t> keys = randomKeys<uint64_t>(kNumKeys, 2018);
+    std::vector<uint64_t> unsorted = keys;
+    unsorted.insert(unsorted.end(), keys.begin(), keys.begin() + keys.size() / 2);
+    std::shuffle(unsorted.begin(), unsorted.end(), std::mt19937_64(7));
+
+    SuRFInt<uint64_t> expected(keys, kIncludeDense, kSparseDenseRatio, kReal, 0, 8);
+    SuRFInt<uint64_t> filter;
+    filter.createFromUnsorted(unsorted, kIncludeDense, kSparseDenseRatio, kReal, 0, 8, 4);
+    ASSERT_TRUE(unsorted == keys);
+    ASSERT_EQ(expected.getMemoryUsage(), filter.getMemoryUsage());
+    for (uint64_t i = 0; i < kNumProbes; i++)
+	ASSERT_EQ(expected.lookup(i * 3), filter.lookup(i * 3));
+    expected.destroy();
+    filter.destroy();
+}
+
+} // namespace surfinttest
+
+} // namespace surf
+
+int main (int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -50,6 +50,36 @@ TEST_F (SuRFSmallTest, ExampleInPaperTest) {
     ASSERT_TRUE(iter.isValid());
 }
 
+TEST_F (SuRFSmallTest, StreamBuildTest) {
+    const char* keys[] = {"f", "far", "fas", "fast", "fat", "s", "top", "toy", "trie", "trip", "try"};
+    const size_t num_keys = sizeof(keys) / sizeof(keys[0]);
+    size_t next = 0;
+    SuRF surf;
+    ASSERT_TRUE(surf.createFromStream([&](std::string& key) {
+	    if (next == num_keys)
+		return false;
+	    key = keys[next++];
+	    return true;
+	}, kIncludeDense, kSparseDenseRatio, kSuffixType, 0, kSuffixLen));
+    for (size_t i = 0; i < num_keys; i++)
+	ASSERT_TRUE(surf.lookupKey(keys[i]));
+    ASSERT_FALSE(surf.lookupKey(std::string("tr")));
+    ASSERT_TRUE(surf.lookupRange(std::string("fb"), true, std::string("sa"), true));
+    surf.destroy();
+
+    // an out-of-order stream creates nothing
+    const char* unsorted_keys[] = {"f", "fas", "far"};
+    next = 0;
+    SuRF unsorted;
+    ASSERT_FALSE(unsorted.createFromStream([&](std::string& key) {
+	    if (next == 3)
+		return false;
+	    key = unsorted_keys[next++];
+	    return true;
+	}, kIncludeDense, kSparseDenseRatio, kSuffixType, 0, kSuffixLen));
+    ASSERT_FALSE(unsorted.hasKeys());
+}
+
 } // namespace surftest
 
 } // namespace surf